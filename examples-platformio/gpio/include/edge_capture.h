@@ -0,0 +1,44 @@
+/*
+  Timestamped GPIO edge capture and pulse measurement.
+
+  An IRAM interrupt handler stores the time and new level of every
+  edge into a single-producer/single-consumer ring without locks.
+  A task drains the ring periodically (at most EDGE_CAPTURE_RING_LEN
+  edges between two drains) and gets pulse count, frequency and duty
+  cycle of the input. Edges arriving while the ring is full are
+  counted as overflows and the measurement restarts from the next
+  edge. Edges closer than the debounce time to the previous accepted
+  edge are ignored (reed switches).
+
+  The measurement itself is in "edge_measure.h", it has no hardware
+  dependency and can be fed with any stream of timestamps.
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+ */
+
+#ifndef EDGE_CAPTURE
+#define EDGE_CAPTURE
+
+
+/*-----------------------------------------------------------*/
+#include <stdbool.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include <driver/gpio.h>        // GPIO pins
+#include <edge_measure.h>       // Frequency and duty from edges
+
+
+/*-----------------------------------------------------------*/
+#define EDGE_CAPTURE_RING_LEN 256       // Power of two
+
+
+/*-----------------------------------------------------------*/
+/*-----------------------------------------------------------*/
+// Used function(s)
+esp_err_t edge_capture_init(gpio_num_t gpio, gpio_pull_mode_t pull, uint32_t debounce_us);
+void edge_capture_drain(void);
+void edge_capture_poll(edge_capture_result_t *result);
+
+#endif
@@ -0,0 +1,67 @@
+/*
+  Pulse count, frequency and duty cycle from a stream of edges.
+
+  Every edge is given with its time in microseconds (which may wrap
+  around) and the input level after it. Edges closer than the
+  debounce time to the previous accepted edge, or with the same
+  level as it, are rejected as bounces. Frequency and duty cycle are
+  averaged over the rise-to-rise periods completed between two
+  results.
+
+  The module has no ESP-IDF dependency, "tools/edge_bench.c" feeds it
+  synthetic edge streams on the host.
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+ */
+
+#ifndef EDGE_MEASURE
+#define EDGE_MEASURE
+
+
+/*-----------------------------------------------------------*/
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/*-----------------------------------------------------------*/
+// Measurement state over a stream of edges
+typedef struct {
+    uint32_t debounce_us;
+    bool primed;                // At least one edge since (re)start
+    uint8_t level;              // Level after the last accepted edge
+    uint32_t last_us;           // Time of the last accepted edge
+    uint32_t last_rise_us;
+    bool have_rise;
+    // Accumulated since the last edge_measure_result()
+    uint32_t periods;           // Complete rise-to-rise periods
+    uint64_t period_sum_us;
+    uint64_t high_sum_us;       // High time within these periods
+    uint32_t high_us;           // High time of the running period
+    // Totals
+    uint32_t pulses;            // Rising edges
+    uint32_t edges;
+    uint32_t bounces;           // Edges rejected by debounce
+} edge_measure_t;
+
+typedef struct {
+    uint32_t frequency_mhz;     // Millihertz over the last interval, 0 if no period
+    uint16_t duty_permille;     // High time per period, 0..1000
+    uint32_t periods;           // Periods the values are averaged from
+    uint32_t pulses;            // Total rising edges
+    uint32_t edges;             // Total accepted edges
+    uint32_t bounces;
+    uint32_t overflows;         // Edges lost because the ring was full
+    uint16_t ring_peak;         // Highest ring occupancy
+} edge_capture_result_t;
+
+
+/*-----------------------------------------------------------*/
+// Used function(s)
+void edge_measure_init(edge_measure_t *m, uint32_t debounce_us);
+void edge_measure_restart(edge_measure_t *m);
+void edge_measure_update(edge_measure_t *m, uint32_t time_us, uint8_t level);
+void edge_measure_result(edge_measure_t *m, edge_capture_result_t *result);
+
+#endif
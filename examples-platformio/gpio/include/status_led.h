@@ -0,0 +1,54 @@
+/*
+  Status LED patterns played by the RMT peripheral.
+
+  A pattern (heartbeat, blinking, breathing, blink codes) is written
+  once into RMT channel memory and transmitted in loop mode, so the
+  hardware repeats it with no task, timer or interrupt involved.
+  Breathing is a sequence of PWM periods with changing duty cycle.
+  The pattern can be changed from any task or ISR; from an ISR the
+  change is deferred to the FreeRTOS timer service task.
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+ */
+
+#ifndef STATUS_LED
+#define STATUS_LED
+
+
+/*-----------------------------------------------------------*/
+#include <stdint.h>
+#include <esp_err.h>
+#include <driver/gpio.h>        // GPIO pins
+
+
+/*-----------------------------------------------------------*/
+// RMT channel with its memory blocks, channels up to
+// STATUS_LED_RMT_CHANNEL + STATUS_LED_MEM_BLOCKS - 1 cannot be used
+// by anything else
+#define STATUS_LED_RMT_CHANNEL 0
+#define STATUS_LED_MEM_BLOCKS  4
+#define STATUS_LED_MAX_ITEMS   (STATUS_LED_MEM_BLOCKS * 64 - 1)
+
+
+/*-----------------------------------------------------------*/
+typedef enum {
+    STATUS_LED_OFF = 0,
+    STATUS_LED_ON,
+    STATUS_LED_HEARTBEAT,       // Double flash every second
+    STATUS_LED_BLINK_SLOW,      // 1 Hz
+    STATUS_LED_BLINK_FAST,      // 5 Hz
+    STATUS_LED_BREATHING,       // Smooth fade in and out, 2 s
+    STATUS_LED_CODE,            // "code" short blinks, then a pause
+    STATUS_LED_ERROR,           // Fast burst, then "code" long blinks
+} status_led_pattern_t;
+
+
+/*-----------------------------------------------------------*/
+// Used function(s)
+esp_err_t status_led_init(gpio_num_t gpio, bool active_low);
+esp_err_t status_led_set(status_led_pattern_t pattern, uint8_t code);
+status_led_pattern_t status_led_get(void);
+
+#endif
@@ -0,0 +1,135 @@
+/*
+  Timestamped GPIO edge capture and pulse measurement.
+
+  Xtensa dual-core 32-bit LX6 (ESP32-CAM, FireBeetle ESP32), 240 MHz
+  PlatformIO, ESP-IDF framework
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+
+  NOTES:
+    * One edge costs a few microseconds of interrupt time, inputs up
+      to tens of kHz can be measured; faster signals overflow the
+      ring and only the overflow counter grows
+ */
+
+
+/*-----------------------------------------------------------*/
+#include <esp_attr.h>           // IRAM_ATTR
+#include <esp_timer.h>          // esp_timer_get_time() function
+#include <esp_intr_alloc.h>     // ESP_INTR_FLAG_IRAM
+#include <soc/soc.h>            // REG_READ()
+#include <soc/gpio_reg.h>       // GPIO_IN_REG, GPIO_IN1_REG
+#include <edge_capture.h>
+
+
+/*-----------------------------------------------------------*/
+#define EDGE_CAPTURE_GAP 0x80   // Edges were lost before this one
+
+
+/*-----------------------------------------------------------*/
+static gpio_num_t s_gpio;
+static edge_measure_t s_measure;
+
+// Ring written by the ISR only at "s_head", read by the task only
+// at "s_tail"; both indexes run freely and wrap around
+static uint32_t s_ring_time[EDGE_CAPTURE_RING_LEN];
+static uint8_t s_ring_level[EDGE_CAPTURE_RING_LEN];
+static volatile uint32_t s_head = 0;
+static volatile uint32_t s_tail = 0;
+
+// Written by the ISR only
+static volatile uint32_t s_overflows = 0;
+static volatile uint16_t s_peak = 0;
+static bool s_gap = false;
+
+
+/*-----------------------------------------------------------*/
+static void IRAM_ATTR edge_isr(void *arg)
+{
+    uint32_t now = (uint32_t)esp_timer_get_time();
+    uint32_t head = s_head;
+    uint32_t used = head - __atomic_load_n(&s_tail, __ATOMIC_ACQUIRE);
+    uint8_t level;
+
+    // Direct register read, gpio_get_level() is not in IRAM
+    if (s_gpio < 32) {
+        level = (REG_READ(GPIO_IN_REG) >> s_gpio) & 1;
+    }
+    else {
+        level = (REG_READ(GPIO_IN1_REG) >> (s_gpio - 32)) & 1;
+    }
+
+    if (used >= EDGE_CAPTURE_RING_LEN) {
+        s_overflows++;
+        s_gap = true;
+        return;
+    }
+
+    s_ring_time[head % EDGE_CAPTURE_RING_LEN] = now;
+    s_ring_level[head % EDGE_CAPTURE_RING_LEN] = level | (s_gap ? EDGE_CAPTURE_GAP : 0);
+    s_gap = false;
+
+    // Publish the entry after it is written
+    __atomic_store_n(&s_head, head + 1, __ATOMIC_RELEASE);
+    if (used + 1 > s_peak) {
+        s_peak = used + 1;
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+esp_err_t edge_capture_init(gpio_num_t gpio, gpio_pull_mode_t pull, uint32_t debounce_us)
+{
+    esp_err_t err;
+
+    s_gpio = gpio;
+    edge_measure_init(&s_measure, debounce_us);
+
+    gpio_reset_pin(gpio);
+    gpio_set_direction(gpio, GPIO_MODE_INPUT);
+    gpio_set_pull_mode(gpio, pull);
+    gpio_set_intr_type(gpio, GPIO_INTR_ANYEDGE);
+
+    // The service may be installed already by other code
+    err = gpio_install_isr_service(ESP_INTR_FLAG_IRAM);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+        return err;
+    }
+    return gpio_isr_handler_add(gpio, edge_isr, NULL);
+}
+
+
+/*-----------------------------------------------------------*/
+/* Move captured edges from the ring to the measurement. Call often
+   enough that the ring does not fill up. */
+void edge_capture_drain(void)
+{
+    uint32_t head = __atomic_load_n(&s_head, __ATOMIC_ACQUIRE);
+    uint32_t tail = s_tail;
+    uint8_t level;
+
+    while (tail != head) {
+        level = s_ring_level[tail % EDGE_CAPTURE_RING_LEN];
+        if (level & EDGE_CAPTURE_GAP) {
+            edge_measure_restart(&s_measure);
+        }
+        edge_measure_update(&s_measure, s_ring_time[tail % EDGE_CAPTURE_RING_LEN], level & 1);
+        tail++;
+    }
+    // Free the entries for the ISR
+    __atomic_store_n(&s_tail, tail, __ATOMIC_RELEASE);
+}
+
+
+/*-----------------------------------------------------------*/
+/* Drain the ring and return measurement since the previous call */
+void edge_capture_poll(edge_capture_result_t *result)
+{
+    edge_capture_drain();
+
+    edge_measure_result(&s_measure, result);
+    result->overflows = s_overflows;
+    result->ring_peak = s_peak;
+}
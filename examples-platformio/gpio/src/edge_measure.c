@@ -0,0 +1,100 @@
+/*
+  Pulse count, frequency and duty cycle from a stream of edges.
+
+  Xtensa dual-core 32-bit LX6 (ESP32-CAM, FireBeetle ESP32), 240 MHz
+  PlatformIO, ESP-IDF framework
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+
+  NOTES:
+    * The module has no ESP-IDF dependency, "tools/edge_bench.c"
+      builds it on the host
+ */
+
+
+/*-----------------------------------------------------------*/
+#include <edge_measure.h>
+
+
+/*-----------------------------------------------------------*/
+void edge_measure_init(edge_measure_t *m, uint32_t debounce_us)
+{
+    *m = (edge_measure_t) {
+        .debounce_us = debounce_us,
+    };
+}
+
+
+/*-----------------------------------------------------------*/
+/* Forget the running period, e.g. after lost edges */
+void edge_measure_restart(edge_measure_t *m)
+{
+    m->primed = false;
+    m->have_rise = false;
+    m->high_us = 0;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Process one edge, "level" is the input level after it. Time is
+   in microseconds and may wrap around. */
+void edge_measure_update(edge_measure_t *m, uint32_t time_us, uint8_t level)
+{
+    uint32_t period;
+
+    if (m->primed) {
+        // Same level again: the opposite edge was too short to be seen
+        // or was rejected; too close: contact bounce
+        if (level == m->level || (uint32_t)(time_us - m->last_us) < m->debounce_us) {
+            m->bounces++;
+            return;
+        }
+    }
+    m->edges++;
+
+    if (level) {
+        m->pulses++;
+        if (m->have_rise) {
+            period = time_us - m->last_rise_us;
+            m->periods++;
+            m->period_sum_us += period;
+            m->high_sum_us += m->high_us;
+        }
+        m->high_us = 0;
+        m->last_rise_us = time_us;
+        m->have_rise = true;
+    }
+    else if (m->have_rise) {
+        m->high_us = time_us - m->last_rise_us;
+    }
+
+    m->last_us = time_us;
+    m->level = level;
+    m->primed = true;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Frequency and duty cycle averaged over the periods completed since
+   the previous call; totals are copied as they are */
+void edge_measure_result(edge_measure_t *m, edge_capture_result_t *result)
+{
+    result->periods = m->periods;
+    if (m->periods > 0 && m->period_sum_us > 0) {
+        result->frequency_mhz = (uint64_t)m->periods * 1000000000ULL / m->period_sum_us;
+        result->duty_permille = m->high_sum_us * 1000 / m->period_sum_us;
+    }
+    else {
+        result->frequency_mhz = 0;
+        result->duty_permille = m->level ? 1000 : 0;
+    }
+    result->pulses = m->pulses;
+    result->edges = m->edges;
+    result->bounces = m->bounces;
+
+    m->periods = 0;
+    m->period_sum_us = 0;
+    m->high_sum_us = 0;
+}
@@ -1,5 +1,8 @@
 /*
-   Blink a LED.
+   Blink a LED. Patterns are played by the RMT peripheral, the CPU
+   only selects a new one every 10 seconds. Edges on an input pin are
+   timestamped and its frequency and duty cycle are printed; connect
+   CAPTURE_PIN to the LED pin to measure the pattern itself.
    Xtensa dual-core 32-bit LX6 (ESP32-CAM, FireBeetle ESP32), 240 MHz
    PlatformIO, ESP-IDF framework
 
@@ -12,7 +15,10 @@
 /*-----------------------------------------------------------*/
 #include <freertos/FreeRTOS.h>  // FreeRTOS
 #include <freertos/task.h>      // vTaskDelay, portTICK_PERIOD_MS
+#include <esp_log.h>            // ESP_LOG/E/W/I functions
 #include <driver/gpio.h>        // GPIO pins
+#include <status_led.h>         // LED patterns in hardware
+#include <edge_capture.h>       // Input edge timestamps
 
 
 /*-----------------------------------------------------------*/
@@ -20,6 +26,11 @@
 // ESP32-CAM  : #33 (red, bottom side), #4 (Flash, top side)
 // FireBeetle : #2 (blue)
 #define BUILT_IN_LED 2
+#define BUILT_IN_LED_ACTIVE_LOW false   // true for ESP32-CAM #33
+
+// Measured input, e.g. flow sensor or reed switch
+#define CAPTURE_PIN 25
+#define CAPTURE_DEBOUNCE_US 0           // 0: no debounce, ~1000 for reed switches
 
 
 /*-----------------------------------------------------------*/
@@ -27,19 +38,42 @@
    where the program execution begins */
 void app_main()
 {
-    /* Reset an gpio to default state (enable pullup, disable
-       interrupts, ...) */
-    gpio_reset_pin(BUILT_IN_LED);
-    // Set output
-    gpio_set_direction(BUILT_IN_LED, GPIO_MODE_OUTPUT);
+    static const status_led_pattern_t patterns[] = {
+        STATUS_LED_HEARTBEAT,
+        STATUS_LED_BLINK_SLOW,
+        STATUS_LED_BLINK_FAST,
+        STATUS_LED_BREATHING,
+        STATUS_LED_CODE,
+        STATUS_LED_ERROR,
+    };
+    uint8_t i = 0;
+    edge_capture_result_t capture;
+
+    // RMT channel drives the LED pin
+    ESP_ERROR_CHECK(status_led_init(BUILT_IN_LED, BUILT_IN_LED_ACTIVE_LOW));
+
+    // Input edges are timestamped in interrupt
+    ESP_ERROR_CHECK(edge_capture_init(CAPTURE_PIN, GPIO_PULLDOWN_ONLY, CAPTURE_DEBOUNCE_US));
 
     // Forever loop
     while (1) {
-        gpio_set_level(BUILT_IN_LED, 1);        // Set high level
-        vTaskDelay(100 / portTICK_PERIOD_MS);   // Delay 100 milliseconds
+        // Blink codes show 3 blinks
+        status_led_set(patterns[i], 3);
+        ESP_LOGI("gpio", "LED pattern %d", patterns[i]);
+        i = (i + 1) % (sizeof(patterns) / sizeof(patterns[0]));
+
+        // Delay 10 seconds, edges are collected every 100 ms
+        for (uint8_t t = 0; t < 100; t++) {
+            vTaskDelay(100 / portTICK_PERIOD_MS);
+            edge_capture_drain();
+        }
 
-        gpio_set_level(BUILT_IN_LED, 0);        // Set low level
-        vTaskDelay(1000 / portTICK_PERIOD_MS);  // Delay 1 second
+        // Input measured during the last 10 seconds
+        edge_capture_poll(&capture);
+        ESP_LOGI("capture", "%u.%03u Hz, duty %u.%u %%, %u periods, %u pulses, %u overflows (ring peak %u)",
+                 (unsigned)(capture.frequency_mhz / 1000), (unsigned)(capture.frequency_mhz % 1000),
+                 capture.duty_permille / 10, capture.duty_permille % 10, (unsigned)capture.periods,
+                 (unsigned)capture.pulses, (unsigned)capture.overflows, capture.ring_peak);
     }
 
     // Will never reach this
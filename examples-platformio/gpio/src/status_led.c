@@ -0,0 +1,263 @@
+/*
+  Status LED patterns played by the RMT peripheral.
+
+  Xtensa dual-core 32-bit LX6 (ESP32-CAM, FireBeetle ESP32), 240 MHz
+  PlatformIO, ESP-IDF framework
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+
+  See also:
+    Remote Control Transceiver (RMT)
+      * https://docs.espressif.com/projects/esp-idf/en/v4.4/esp32/api-reference/peripherals/rmt.html
+ */
+
+
+/*-----------------------------------------------------------*/
+#include <freertos/FreeRTOS.h>  // FreeRTOS
+#include <freertos/semphr.h>
+#include <freertos/timers.h>    // xTimerPendFunctionCallFromISR()
+#include <esp_log.h>            // ESP_LOG/E/W/I functions
+#include <driver/rmt.h>         // Remote Control Transceiver
+#include <status_led.h>
+
+
+/*-----------------------------------------------------------*/
+// RMT clock is 80 MHz APB divided by
+#define STATUS_LED_BLINK_DIV 250        // 3.125 us per tick
+#define STATUS_LED_PWM_DIV   80         // 1 us per tick
+
+#define STATUS_LED_MAX_TICKS     32767  // 15-bit item duration
+#define STATUS_LED_PWM_PERIOD_US 8000   // 125 Hz
+#define STATUS_LED_BREATH_STEPS  250    // 2 s with 8 ms period
+
+// Blink timing in milliseconds
+#define STATUS_LED_CODE_ON     200
+#define STATUS_LED_CODE_OFF    300
+#define STATUS_LED_ERROR_ON    600
+#define STATUS_LED_ERROR_OFF   400
+#define STATUS_LED_CODE_PAUSE  1500
+#define STATUS_LED_MAX_CODE    20       // Longer codes would not fit
+
+
+/*-----------------------------------------------------------*/
+// Tag for ESP_LOG/E/W/I functions
+static const char *TAG = "status led";
+
+static bool s_active_low = false;
+static volatile status_led_pattern_t s_pattern = STATUS_LED_OFF;
+static uint8_t s_code = 0;
+static SemaphoreHandle_t s_lock = NULL;
+
+// Pattern being built, every item holds two levels ("halves")
+static rmt_item32_t s_items[STATUS_LED_MAX_ITEMS];
+static uint16_t s_halves;
+static uint32_t s_ticks_per_ms;
+
+
+/*-----------------------------------------------------------*/
+/* Append "level" for "ticks" RMT ticks, long levels are split
+   into more items. Return false if the pattern does not fit. */
+static bool add_ticks(uint32_t level, uint32_t ticks)
+{
+    uint32_t chunk;
+
+    level ^= s_active_low;
+    while (ticks > 0) {
+        if (s_halves / 2 >= STATUS_LED_MAX_ITEMS) {
+            return false;
+        }
+        chunk = (ticks > STATUS_LED_MAX_TICKS) ? STATUS_LED_MAX_TICKS : ticks;
+        if (s_halves % 2 == 0) {
+            s_items[s_halves / 2].val = 0;
+            s_items[s_halves / 2].level0 = level;
+            s_items[s_halves / 2].duration0 = chunk;
+        }
+        else {
+            s_items[s_halves / 2].level1 = level;
+            s_items[s_halves / 2].duration1 = chunk;
+        }
+        s_halves++;
+        ticks -= chunk;
+    }
+    return true;
+}
+
+
+/*-----------------------------------------------------------*/
+static bool add_ms(uint32_t level, uint32_t ms)
+{
+    return add_ticks(level, ms * s_ticks_per_ms);
+}
+
+
+/*-----------------------------------------------------------*/
+/* Blink "count" times, each blink followed by "off_ms" pause */
+static void add_blinks(uint8_t count, uint32_t on_ms, uint32_t off_ms)
+{
+    for (uint8_t i = 0; i < count; i++) {
+        add_ms(1, on_ms);
+        add_ms(0, off_ms);
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+/* One PWM period per step, duty follows a triangle squared (rough
+   gamma correction, so the fade looks even) */
+static void add_breathing(void)
+{
+    uint32_t half = STATUS_LED_BREATH_STEPS / 2;
+    uint32_t phase, duty, on;
+
+    for (uint32_t i = 0; i < STATUS_LED_BREATH_STEPS; i++) {
+        phase = (i < half) ? i : STATUS_LED_BREATH_STEPS - 1 - i;
+        duty = (phase * phase * 255) / ((half - 1) * (half - 1));
+        on = STATUS_LED_PWM_PERIOD_US * duty / 255;
+
+        if (on == 0 || on == STATUS_LED_PWM_PERIOD_US) {
+            // Durations must not be zero (end marker)
+            add_ticks(on != 0, STATUS_LED_PWM_PERIOD_US / 2);
+            add_ticks(on != 0, STATUS_LED_PWM_PERIOD_US / 2);
+        }
+        else {
+            add_ticks(1, on);
+            add_ticks(0, STATUS_LED_PWM_PERIOD_US - on);
+        }
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+/* Stop the channel and load the new pattern. Must be called with
+   the lock taken, from task context. */
+static void apply_pattern(status_led_pattern_t pattern, uint8_t code)
+{
+    uint8_t div = (pattern == STATUS_LED_BREATHING) ? STATUS_LED_PWM_DIV : STATUS_LED_BLINK_DIV;
+
+    rmt_tx_stop(STATUS_LED_RMT_CHANNEL);
+
+    if (pattern == STATUS_LED_OFF || pattern == STATUS_LED_ON) {
+        rmt_set_idle_level(STATUS_LED_RMT_CHANNEL, true,
+                           ((pattern == STATUS_LED_ON) ^ s_active_low) ? RMT_IDLE_LEVEL_HIGH : RMT_IDLE_LEVEL_LOW);
+        return;
+    }
+
+    s_halves = 0;
+    s_ticks_per_ms = 80000 / div;
+    if (code == 0) {
+        code = 1;
+    }
+    else if (code > STATUS_LED_MAX_CODE) {
+        code = STATUS_LED_MAX_CODE;
+    }
+
+    switch (pattern) {
+        case STATUS_LED_HEARTBEAT:
+            add_ms(1, 80);
+            add_ms(0, 150);
+            add_ms(1, 80);
+            add_ms(0, 690);
+            break;
+        case STATUS_LED_BLINK_SLOW:
+            add_blinks(1, 500, 500);
+            break;
+        case STATUS_LED_BLINK_FAST:
+            add_blinks(1, 100, 100);
+            break;
+        case STATUS_LED_BREATHING:
+            add_breathing();
+            break;
+        case STATUS_LED_CODE:
+            add_blinks(code, STATUS_LED_CODE_ON, STATUS_LED_CODE_OFF);
+            add_ms(0, STATUS_LED_CODE_PAUSE);
+            break;
+        case STATUS_LED_ERROR:
+            add_blinks(3, 50, 50);
+            add_ms(0, 500);
+            add_blinks(code, STATUS_LED_ERROR_ON, STATUS_LED_ERROR_OFF);
+            add_ms(0, STATUS_LED_CODE_PAUSE);
+            break;
+        default:
+            break;
+    }
+
+    rmt_set_idle_level(STATUS_LED_RMT_CHANNEL, true, s_active_low ? RMT_IDLE_LEVEL_HIGH : RMT_IDLE_LEVEL_LOW);
+    rmt_set_clk_div(STATUS_LED_RMT_CHANNEL, div);
+    // Channel memory holds the whole pattern, in loop mode the RMT
+    // restarts it at the end marker without any interrupt
+    rmt_write_items(STATUS_LED_RMT_CHANNEL, s_items, (s_halves + 1) / 2, false);
+}
+
+
+/*-----------------------------------------------------------*/
+/* Runs in the timer service task for requests from an ISR */
+static void deferred_set(void *pvParameter1, uint32_t ulParameter2)
+{
+    status_led_set(ulParameter2 >> 8, ulParameter2 & 0xff);
+}
+
+
+/*-----------------------------------------------------------*/
+esp_err_t status_led_init(gpio_num_t gpio, bool active_low)
+{
+    esp_err_t err;
+
+    rmt_config_t config = RMT_DEFAULT_CONFIG_TX(gpio, STATUS_LED_RMT_CHANNEL);
+    config.clk_div = STATUS_LED_BLINK_DIV;
+    config.mem_block_num = STATUS_LED_MEM_BLOCKS;
+    config.tx_config.loop_en = true;
+    config.tx_config.idle_output_en = true;
+    config.tx_config.idle_level = active_low ? RMT_IDLE_LEVEL_HIGH : RMT_IDLE_LEVEL_LOW;
+
+    s_active_low = active_low;
+    s_lock = xSemaphoreCreateMutex();
+
+    err = rmt_config(&config);
+    if (err == ESP_OK) {
+        err = rmt_driver_install(STATUS_LED_RMT_CHANNEL, 0, 0);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "RMT channel %d: %s", STATUS_LED_RMT_CHANNEL, esp_err_to_name(err));
+    }
+    return err;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Change the pattern, callable from task and ISR. "code" is the
+   number of blinks of STATUS_LED_CODE and STATUS_LED_ERROR. */
+esp_err_t IRAM_ATTR status_led_set(status_led_pattern_t pattern, uint8_t code)
+{
+    BaseType_t high_task_awoken = pdFALSE;
+
+    if (xPortInIsrContext()) {
+        if (xTimerPendFunctionCallFromISR(deferred_set, NULL, ((uint32_t)pattern << 8) | code,
+                                          &high_task_awoken) != pdPASS) {
+            return ESP_ERR_NO_MEM;
+        }
+        portYIELD_FROM_ISR(high_task_awoken);
+        return ESP_OK;
+    }
+
+    if (s_lock == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (pattern != s_pattern || code != s_code) {
+        s_pattern = pattern;
+        s_code = code;
+        apply_pattern(pattern, code);
+    }
+    xSemaphoreGive(s_lock);
+
+    return ESP_OK;
+}
+
+
+/*-----------------------------------------------------------*/
+status_led_pattern_t status_led_get(void)
+{
+    return s_pattern;
+}
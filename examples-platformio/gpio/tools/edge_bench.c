@@ -0,0 +1,263 @@
+/*
+  Host test and benchmark of "src/edge_measure.c".
+
+  Build and run on Linux:
+
+    cc -O2 -Iinclude tools/edge_bench.c src/edge_measure.c -o edge_bench
+    ./edge_bench
+
+  Feeds synthetic edge streams, as the ISR of "src/edge_capture.c"
+  would put them into the ring, and compares the frequency, duty
+  cycle, period and bounce counts with the values the stream was made
+  from: a square wave, the same wave across the 32-bit microsecond
+  wraparound, a reed switch with contact bounce, edges lost in a full
+  ring, repeated levels, constant inputs and a frequency that is not a
+  whole number of hertz. The table also shows the time per edge. The
+  program returns 1 if any value differs.
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+ */
+
+
+/*-----------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <edge_measure.h>
+
+
+/*-----------------------------------------------------------*/
+#define BENCH_MAX_EDGES  4096
+#define BENCH_MIN_TIME_S 0.1
+#define BENCH_RESTART    0xFF       // Level of a marker: restart the measurement
+
+
+/*-----------------------------------------------------------*/
+// Edge stream and the values expected from it
+typedef struct {
+    uint32_t time_us[BENCH_MAX_EDGES];
+    uint8_t level[BENCH_MAX_EDGES];
+    uint32_t len;
+    uint32_t debounce_us;
+    edge_capture_result_t expected;
+} bench_stream_t;
+
+static bench_stream_t s_stream;
+static int s_failed = 0;
+
+
+/*-----------------------------------------------------------*/
+static double now_s(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+/*-----------------------------------------------------------*/
+static void stream_init(bench_stream_t *s, uint32_t debounce_us)
+{
+    s->len = 0;
+    s->debounce_us = debounce_us;
+    s->expected = (edge_capture_result_t) {0};
+}
+
+
+/*-----------------------------------------------------------*/
+static void add_edge(bench_stream_t *s, uint32_t time_us, uint8_t level)
+{
+    if (s->len < BENCH_MAX_EDGES) {
+        s->time_us[s->len] = time_us;
+        s->level[s->len] = level;
+        s->len++;
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+/* "periods" full periods starting with a rising edge at "start_us",
+   ending with the rising edge of the next one; "bounces" extra
+   edges after every real edge, 300 us apart with alternating levels.
+   Returns the time of the last rising edge. */
+static uint32_t add_square(bench_stream_t *s, uint32_t start_us, uint32_t period_us, uint32_t high_us,
+                           uint32_t periods, uint8_t bounces)
+{
+    uint32_t rise;
+
+    for (uint32_t k = 0; k <= periods; k++) {
+        rise = start_us + k * period_us;
+        add_edge(s, rise, 1);
+        for (uint8_t b = 1; b <= bounces; b++) {
+            add_edge(s, rise + b * 300, b % 2 == 0);
+        }
+        if (k == periods) {
+            break;
+        }
+        add_edge(s, rise + high_us, 0);
+        for (uint8_t b = 1; b <= bounces; b++) {
+            add_edge(s, rise + high_us + b * 300, b % 2 == 1);
+        }
+    }
+    s->expected.periods += periods;
+    s->expected.pulses += periods + 1;
+    s->expected.edges += 2 * periods + 1;
+    s->expected.bounces += (2 * periods + 1) * bounces;
+
+    return start_us + periods * period_us;
+}
+
+
+/*-----------------------------------------------------------*/
+static void run(const bench_stream_t *s, edge_measure_t *m)
+{
+    edge_measure_init(m, s->debounce_us);
+    for (uint32_t i = 0; i < s->len; i++) {
+        if (s->level[i] == BENCH_RESTART) {
+            edge_measure_restart(m);
+        }
+        else {
+            edge_measure_update(m, s->time_us[i], s->level[i]);
+        }
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+static void check(const char *name, const bench_stream_t *s)
+{
+    const edge_capture_result_t *e = &s->expected;
+    edge_capture_result_t r;
+    edge_measure_t m;
+    unsigned long rounds = 0;
+    double start, elapsed;
+    int errors = 0;
+
+    run(s, &m);
+    edge_measure_result(&m, &r);
+    errors += r.frequency_mhz != e->frequency_mhz;
+    errors += r.duty_permille != e->duty_permille;
+    errors += r.periods != e->periods;
+    errors += r.pulses != e->pulses;
+    errors += r.edges != e->edges;
+    errors += r.bounces != e->bounces;
+
+    // The next interval starts empty
+    edge_measure_result(&m, &r);
+    errors += r.periods != 0 || r.frequency_mhz != 0;
+
+    start = now_s();
+    do {
+        run(s, &m);
+        rounds++;
+        elapsed = now_s() - start;
+    } while (elapsed < BENCH_MIN_TIME_S);
+
+    // Repeat the first result, the second one only adds to "errors"
+    run(s, &m);
+    edge_measure_result(&m, &r);
+    printf("%-20s %10u %10u %7u %6u %7u %6d %8.1f\n", name, (unsigned)r.frequency_mhz, r.duty_permille,
+           (unsigned)r.periods, (unsigned)r.edges, (unsigned)r.bounces, errors,
+           s->len ? elapsed * 1e9 / ((double)rounds * s->len) : 0.0);
+    if (errors != 0) {
+        printf("%-20s %10u %10u %7u %6u %7u   expected\n", "", (unsigned)e->frequency_mhz, e->duty_permille,
+               (unsigned)e->periods, (unsigned)e->edges, (unsigned)e->bounces);
+        s_failed++;
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+int main(void)
+{
+    bench_stream_t *s = &s_stream;
+    uint32_t t;
+
+    printf("%-20s %10s %10s %7s %6s %7s %6s %8s\n", "stream", "mHz", "permille", "periods", "edges",
+           "bounces", "errors", "ns/edge");
+
+    // 1 kHz, 25 %
+    stream_init(s, 0);
+    add_square(s, 1000, 1000, 250, 1000, 0);
+    s->expected.frequency_mhz = 1000000;
+    s->expected.duty_permille = 250;
+    check("1 kHz 25 %", s);
+
+    // The same, esp_timer_get_time() wraps from 0xffffffff to 0 in the middle
+    stream_init(s, 0);
+    add_square(s, 0xffffffffu - 500000, 1000, 250, 1000, 0);
+    s->expected.frequency_mhz = 1000000;
+    s->expected.duty_permille = 250;
+    check("1 kHz 25 % wrap", s);
+
+    // Reed switch at 10 Hz, 50 %, three bounces after every edge
+    // within the 2 ms debounce time
+    stream_init(s, 2000);
+    add_square(s, 5000, 100000, 50000, 20, 3);
+    s->expected.frequency_mhz = 10000;
+    s->expected.duty_permille = 500;
+    check("10 Hz 50 % bounce", s);
+
+    // Overflowed ring: the ISR marks the gap, the period across it
+    // must not be counted
+    stream_init(s, 0);
+    t = add_square(s, 1000, 1000, 400, 100, 0);
+    add_edge(s, t + 7777, BENCH_RESTART);
+    add_square(s, t + 7777, 1000, 400, 100, 0);
+    s->expected.frequency_mhz = 1000000;
+    s->expected.duty_permille = 400;
+    check("1 kHz 40 % gap", s);
+
+    // A falling edge repeated after 100 us (the rising edge between
+    // them was too short to be seen) is rejected
+    stream_init(s, 0);
+    add_square(s, 1000, 1000, 250, 100, 0);
+    for (uint32_t i = 0, n = s->len; i < n; i++) {
+        if (s->level[i] == 0) {
+            add_edge(s, s->time_us[i] + 100, 0);
+        }
+    }
+    // Restore time order: repeated edges were appended at the end
+    for (uint32_t i = 1; i < s->len; i++) {
+        for (uint32_t j = i; j > 0 && (int32_t)(s->time_us[j] - s->time_us[j - 1]) < 0; j--) {
+            uint32_t time_us = s->time_us[j];
+            uint8_t level = s->level[j];
+
+            s->time_us[j] = s->time_us[j - 1];
+            s->level[j] = s->level[j - 1];
+            s->time_us[j - 1] = time_us;
+            s->level[j - 1] = level;
+        }
+    }
+    s->expected.frequency_mhz = 1000000;
+    s->expected.duty_permille = 250;
+    s->expected.bounces = 100;
+    check("1 kHz repeated level", s);
+
+    // No complete period: duty from the input level
+    stream_init(s, 0);
+    add_square(s, 1000, 1000, 250, 0, 0);
+    s->expected.duty_permille = 1000;
+    check("constant high", s);
+
+    stream_init(s, 0);
+    add_edge(s, 1000, 0);
+    s->expected.edges = 1;
+    check("constant low", s);
+
+    // 3003.003 Hz, 33.3 %
+    stream_init(s, 0);
+    add_square(s, 1000, 333, 111, 1000, 0);
+    s->expected.frequency_mhz = 3003003;
+    s->expected.duty_permille = 333;
+    check("3.003 kHz 33.3 %", s);
+
+    if (s_failed != 0) {
+        printf("\n%d stream(s) FAILED\n", s_failed);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,67 @@
+/*
+  I2C bus layer with adaptive clock speed per device.
+
+  Every device gets its own SCL frequency. At startup it is probed
+  at the fastest supported speed (1 MHz, 400 kHz, 100 kHz) using a
+  device specific test read. At runtime NACKs, timeouts and checksum
+  errors are counted; when they exceed a limit within a window of
+  transactions, the device steps down to the next lower speed. The
+  chosen speeds are kept in NVS, so a site with long cables does not
+  re-learn them at every boot. Erase the "i2c_bus" NVS namespace to
+  probe from the maximum again.
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+ */
+
+#ifndef I2C_BUS
+#define I2C_BUS
+
+
+/*-----------------------------------------------------------*/
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include <driver/i2c.h>         // Inter-Integrated Circuit driver
+
+
+/*-----------------------------------------------------------*/
+#define I2C_BUS_MAX_DEVICES  8
+#define I2C_BUS_DEFAULT_HZ   100000     // Unknown devices and fallback
+#define I2C_BUS_TIMEOUT_MS   100
+#define I2C_BUS_TUNE_ROUNDS  8          // Error-free test reads to accept a speed
+#define I2C_BUS_ERROR_WINDOW 32         // Transactions per monitoring window
+#define I2C_BUS_ERROR_LIMIT  2          // Errors tolerated within one window
+
+
+/*-----------------------------------------------------------*/
+// Per-device counters
+typedef struct {
+    uint8_t addr;
+    uint32_t clk_hz;            // Current SCL frequency
+    uint32_t transactions;
+    uint32_t nacks;             // ESP_FAIL from the driver
+    uint32_t timeouts;          // ESP_ERR_TIMEOUT and other bus errors
+    uint32_t checksum_errors;   // Reported by the sensor driver
+    uint32_t step_downs;
+} i2c_bus_stats_t;
+
+// Device specific test transaction(s), ESP_OK if data was valid
+typedef esp_err_t (*i2c_bus_test_t)(uint8_t addr);
+
+
+/*-----------------------------------------------------------*/
+// Used function(s)
+esp_err_t i2c_bus_init(i2c_port_t port, const i2c_config_t *conf);
+esp_err_t i2c_bus_add_device(uint8_t addr, uint32_t max_hz);
+esp_err_t i2c_bus_tune(uint8_t addr, i2c_bus_test_t test);
+
+esp_err_t i2c_bus_probe(uint8_t addr);
+esp_err_t i2c_bus_write(uint8_t addr, const uint8_t *data, size_t len);
+esp_err_t i2c_bus_read(uint8_t addr, uint8_t reg, uint8_t reg_len, uint8_t *buf, size_t len);
+void i2c_bus_report(uint8_t addr, esp_err_t err);
+
+esp_err_t i2c_bus_get_stats(uint8_t addr, i2c_bus_stats_t *stats);
+
+#endif
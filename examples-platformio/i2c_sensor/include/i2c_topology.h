@@ -0,0 +1,62 @@
+/*
+  Cached I2C bus topology.
+
+  Addresses of the devices found on the bus, together with one
+  identifier byte per device set by its driver, are kept in NVS. At
+  boot only these addresses are verified; the full scan of addresses
+  0x08..0x76 runs only if a cached device does not respond, if there
+  is no cache yet, or on request. A device added to the bus later is
+  therefore found only by a requested scan.
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+ */
+
+#ifndef I2C_TOPOLOGY
+#define I2C_TOPOLOGY
+
+
+/*-----------------------------------------------------------*/
+#include <stdbool.h>
+#include <stdint.h>
+#include <esp_err.h>
+
+
+/*-----------------------------------------------------------*/
+#define I2C_TOPOLOGY_FIRST_ADDR  0x08
+#define I2C_TOPOLOGY_LAST_ADDR   0x76
+#define I2C_TOPOLOGY_MAX_DEVICES 8
+#define I2C_TOPOLOGY_ID_UNKNOWN  0x00
+
+
+/*-----------------------------------------------------------*/
+typedef struct {
+    uint8_t addr;
+    uint8_t id;                 // Set by the driver, I2C_TOPOLOGY_ID_UNKNOWN if none
+} i2c_topology_device_t;
+
+typedef struct {
+    uint8_t count;
+    i2c_topology_device_t devices[I2C_TOPOLOGY_MAX_DEVICES];
+} i2c_topology_t;
+
+// How the topology was obtained at boot
+typedef struct {
+    bool from_cache;            // false if the full scan was needed
+    uint8_t probes;             // Address probes on the bus
+    int64_t duration_us;
+} i2c_topology_info_t;
+
+
+/*-----------------------------------------------------------*/
+// Used function(s)
+esp_err_t i2c_topology_init(bool force_scan);
+bool i2c_topology_present(uint8_t addr);
+uint8_t i2c_topology_get_id(uint8_t addr);
+void i2c_topology_set_id(uint8_t addr, uint8_t id);
+esp_err_t i2c_topology_commit(void);
+void i2c_topology_get(i2c_topology_t *topology);
+void i2c_topology_get_info(i2c_topology_info_t *info);
+
+#endif
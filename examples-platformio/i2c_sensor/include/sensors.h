@@ -0,0 +1,76 @@
+/*
+  Table-driven I2C sensor drivers with one burst read per device.
+
+  Every supported device is one line of the SENSOR_DEVICES table
+  below: bus address, optional measurement command, conversion time
+  and the register block read in one transaction. The table is
+  expanded by the preprocessor into an enum, a sample structure and
+  straight-line read/decode code, so there are no function pointers
+  or per-register transactions when sampling.
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+ */
+
+#ifndef SENSORS
+#define SENSORS
+
+
+/*-----------------------------------------------------------*/
+#include <stdint.h>
+#include <esp_err.h>
+
+
+/*-----------------------------------------------------------*/
+/* Supported devices, one line each:
+     X(NAME, prefix, address, command, command length [B],
+       conversion time [ms], start register, register length [B],
+       burst length [B], max. SCL frequency [kHz])
+   Driver "prefix" provides prefix_init() and prefix_decode() in
+   sensors.c. Remove a line to leave the driver out of the build. */
+#define SENSOR_DEVICES(X) \
+    X(DHT12,  dht12,  0x5c, 0x0000, 0, 0,  0x00, 1, 5, 400) \
+    X(SHT3X,  sht3x,  0x44, 0x2400, 2, 15, 0x00, 0, 6, 1000) \
+    X(BME280, bme280, 0x76, 0x0000, 0, 0,  0xf7, 1, 8, 1000)
+
+
+/*-----------------------------------------------------------*/
+// Device identifiers: SENSOR_DHT12, SENSOR_SHT3X, ...
+typedef enum {
+#define SENSOR_ENUM(name, prefix, addr, cmd, cmd_len, conv_ms, reg, reg_len, len, khz) SENSOR_##name,
+    SENSOR_DEVICES(SENSOR_ENUM)
+#undef SENSOR_ENUM
+    SENSOR_COUNT
+} sensor_id_t;
+
+// Longest burst read of all devices
+typedef union {
+#define SENSOR_BURST(name, prefix, addr, cmd, cmd_len, conv_ms, reg, reg_len, len, khz) uint8_t name[len];
+    SENSOR_DEVICES(SENSOR_BURST)
+#undef SENSOR_BURST
+} sensor_burst_t;
+
+// Decoded values of one device, quantities it does not measure are 0
+typedef struct {
+    int16_t temp_x100;          // Hundredths of degree Celsius
+    uint16_t humid_x100;        // Hundredths of percent
+    uint32_t press_pa;          // Pascals
+} sensor_values_t;
+
+typedef struct {
+    uint32_t valid;             // Bit n set if device n was read and decoded
+    esp_err_t result[SENSOR_COUNT];
+    sensor_values_t values[SENSOR_COUNT];
+} sensors_sample_t;
+
+
+/*-----------------------------------------------------------*/
+// Used function(s)
+esp_err_t sensors_init(void);
+uint32_t sensors_present(void);
+esp_err_t sensors_read_all(sensors_sample_t *sample);
+const char *sensors_name(sensor_id_t id);
+uint8_t sensors_address(sensor_id_t id);
+
+#endif
@@ -0,0 +1,84 @@
+/*
+  Binary telemetry stream over UART.
+
+  Fixed-size records of one type are collected into a frame:
+
+    type (1) | record size (1) | count (1) | sequence (2) | records | CRC-16 (2)
+
+  all little-endian, CRC-16/CCITT-FALSE (polynomial 0x1021, init
+  0xffff) over everything before it. The frame is COBS encoded, so it
+  contains no zero byte, and terminated by 0x00. A receiver resyncs
+  at the next zero after any garbage (boot messages, lost bytes) and
+  detects lost frames by gaps in the sequence number.
+
+  Frames are put into a ring buffer and written to the UART by a
+  separate task, a frame that does not fit is dropped and never
+  blocks the producer. Script "tools/stream_reader.py" decodes the
+  stream on the host.
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+ */
+
+#ifndef SERIAL_STREAM
+#define SERIAL_STREAM
+
+
+/*-----------------------------------------------------------*/
+#include <stdint.h>
+#include <esp_err.h>
+#include <driver/uart.h>        // UART driver
+
+
+/*-----------------------------------------------------------*/
+#define SERIAL_STREAM_UART        UART_NUM_0    // Shared with the console
+#define SERIAL_STREAM_MAX_PAYLOAD 240           // Record bytes per frame
+#define SERIAL_STREAM_RING_SIZE   8192          // Frames waiting for UART
+
+
+/*-----------------------------------------------------------*/
+typedef enum {
+    SERIAL_STREAM_SAMPLE = 1,
+    SERIAL_STREAM_BUS_STATS = 2,
+} serial_stream_type_t;
+
+// One decoded sensor reading, 14 bytes
+typedef struct __attribute__((packed)) {
+    uint32_t time_us;           // Low 32 bits of esp_timer_get_time()
+    uint8_t sensor;             // sensor_id_t
+    uint8_t reserved;
+    int16_t temp_x100;
+    uint16_t humid_x100;
+    uint32_t press_pa;
+} serial_stream_sample_t;
+
+// Counters of one I2C device, 20 bytes
+typedef struct __attribute__((packed)) {
+    uint32_t time_us;
+    uint8_t addr;
+    uint8_t reserved;
+    uint16_t clk_khz;
+    uint32_t transactions;
+    uint16_t nacks;
+    uint16_t timeouts;
+    uint16_t checksum_errors;
+    uint16_t step_downs;
+} serial_stream_bus_t;
+
+typedef struct {
+    uint32_t frames;            // Put into the ring
+    uint32_t records;
+    uint32_t bytes;             // Encoded, including delimiters
+    uint32_t dropped;           // Frames not fitting into the ring
+} serial_stream_stats_t;
+
+
+/*-----------------------------------------------------------*/
+// Used function(s)
+esp_err_t serial_stream_init(uint32_t baud);
+esp_err_t serial_stream_add(serial_stream_type_t type, const void *record, uint8_t size);
+void serial_stream_flush(void);
+void serial_stream_get_stats(serial_stream_stats_t *stats);
+
+#endif
@@ -0,0 +1,358 @@
+/*
+  I2C bus layer with adaptive clock speed per device.
+
+  Xtensa dual-core 32-bit LX6 (ESP32-CAM), 240 MHz
+  PlatformIO, ESP-IDF framework
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+
+  NOTES:
+    * The clock is changed between transactions to different devices.
+      Devices on the bus ignore traffic not addressed to them, but a
+      slow device may still misread a fast address byte; in that case
+      it NACKs, is counted as error and the other device steps down
+ */
+
+
+/*-----------------------------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>  // FreeRTOS
+#include <esp_log.h>            // ESP_LOG/E/W/I functions
+#include <nvs.h>                // Non-volatile storage
+#include <i2c_bus.h>
+
+
+/*-----------------------------------------------------------*/
+#define I2C_BUS_NVS_NAMESPACE "i2c_bus"
+
+
+/*-----------------------------------------------------------*/
+// Tag for ESP_LOG/E/W/I functions
+static const char *TAG = "i2c bus";
+
+// Candidate SCL frequencies, fastest first
+static const uint32_t s_speeds[] = { 1000000, 400000, 100000 };
+
+typedef struct {
+    uint32_t max_hz;
+    uint32_t stored_hz;         // Value in NVS, 0 if none
+    uint16_t window_count;
+    uint16_t window_errors;
+    i2c_bus_stats_t stats;
+} i2c_bus_device_t;
+
+static i2c_port_t s_port = I2C_NUM_0;
+static i2c_config_t s_conf;
+static uint32_t s_clk_hz = 0;
+static bool s_tuning = false;
+static i2c_bus_device_t s_devices[I2C_BUS_MAX_DEVICES];
+static uint8_t s_device_count = 0;
+
+
+/*-----------------------------------------------------------*/
+static i2c_bus_device_t *find_device(uint8_t addr)
+{
+    for (uint8_t i = 0; i < s_device_count; i++) {
+        if (s_devices[i].stats.addr == addr) {
+            return &s_devices[i];
+        }
+    }
+    return NULL;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Next lower candidate speed, 0 if "hz" is already the lowest one */
+static uint32_t next_lower_speed(uint32_t hz)
+{
+    for (size_t i = 0; i < sizeof(s_speeds) / sizeof(s_speeds[0]); i++) {
+        if (s_speeds[i] < hz) {
+            return s_speeds[i];
+        }
+    }
+    return 0;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Reconfigure SCL only if the device needs a different frequency */
+static void select_device(i2c_bus_device_t *dev)
+{
+    uint32_t hz = (dev != NULL) ? dev->stats.clk_hz : I2C_BUS_DEFAULT_HZ;
+
+    if (hz != s_clk_hz) {
+        s_conf.master.clk_speed = hz;
+        i2c_param_config(s_port, &s_conf);
+        s_clk_hz = hz;
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+static void nvs_store_clock(i2c_bus_device_t *dev)
+{
+    nvs_handle_t handle;
+    char key[8];
+
+    if (dev->stored_hz == dev->stats.clk_hz) {
+        return;
+    }
+    if (nvs_open(I2C_BUS_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+        return;
+    }
+    snprintf(key, sizeof(key), "clk_%02x", dev->stats.addr);
+    if (nvs_set_u32(handle, key, dev->stats.clk_hz) == ESP_OK) {
+        nvs_commit(handle);
+        dev->stored_hz = dev->stats.clk_hz;
+    }
+    nvs_close(handle);
+}
+
+
+/*-----------------------------------------------------------*/
+static uint32_t nvs_load_clock(uint8_t addr)
+{
+    nvs_handle_t handle;
+    char key[8];
+    uint32_t hz = 0;
+
+    if (nvs_open(I2C_BUS_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return 0;
+    }
+    snprintf(key, sizeof(key), "clk_%02x", addr);
+    nvs_get_u32(handle, key, &hz);
+    nvs_close(handle);
+
+    return hz;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Count the result and step the device down if the error rate of
+   the current window is too high */
+static void record_result(i2c_bus_device_t *dev, esp_err_t err)
+{
+    uint32_t lower;
+
+    if (dev == NULL || s_tuning) {
+        return;
+    }
+
+    switch (err) {
+        case ESP_OK:
+            break;
+        case ESP_FAIL:
+            dev->stats.nacks++;
+            break;
+        case ESP_ERR_INVALID_CRC:
+        case ESP_ERR_INVALID_RESPONSE:
+            dev->stats.checksum_errors++;
+            break;
+        default:
+            dev->stats.timeouts++;
+            break;
+    }
+
+    dev->window_count++;
+    if (err != ESP_OK) {
+        dev->window_errors++;
+    }
+
+    if (dev->window_errors > I2C_BUS_ERROR_LIMIT) {
+        lower = next_lower_speed(dev->stats.clk_hz);
+        if (lower != 0) {
+            ESP_LOGW(TAG, "0x%02x: %u errors in %u transactions, %u -> %u Hz",
+                     dev->stats.addr, dev->window_errors, dev->window_count,
+                     (unsigned)dev->stats.clk_hz, (unsigned)lower);
+            dev->stats.clk_hz = lower;
+            dev->stats.step_downs++;
+            nvs_store_clock(dev);
+        }
+        dev->window_count = 0;
+        dev->window_errors = 0;
+    }
+    else if (dev->window_count >= I2C_BUS_ERROR_WINDOW) {
+        dev->window_count = 0;
+        dev->window_errors = 0;
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+/* "conf" is the configuration the driver was installed with, only
+   its clock speed is changed later */
+esp_err_t i2c_bus_init(i2c_port_t port, const i2c_config_t *conf)
+{
+    s_port = port;
+    s_conf = *conf;
+    s_clk_hz = conf->master.clk_speed;
+    s_device_count = 0;
+    memset(s_devices, 0, sizeof(s_devices));
+
+    return ESP_OK;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Register device, its speed is the one from NVS or "max_hz" */
+esp_err_t i2c_bus_add_device(uint8_t addr, uint32_t max_hz)
+{
+    i2c_bus_device_t *dev = find_device(addr);
+
+    if (dev == NULL) {
+        if (s_device_count == I2C_BUS_MAX_DEVICES) {
+            return ESP_ERR_NO_MEM;
+        }
+        dev = &s_devices[s_device_count++];
+    }
+    memset(dev, 0, sizeof(i2c_bus_device_t));
+    dev->stats.addr = addr;
+    dev->max_hz = max_hz;
+    dev->stored_hz = nvs_load_clock(addr);
+    dev->stats.clk_hz = (dev->stored_hz != 0 && dev->stored_hz <= max_hz) ? dev->stored_hz : max_hz;
+
+    return ESP_OK;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Find the fastest speed, not above the current one, at which the
+   test passes I2C_BUS_TUNE_ROUNDS times in a row */
+esp_err_t i2c_bus_tune(uint8_t addr, i2c_bus_test_t test)
+{
+    i2c_bus_device_t *dev = find_device(addr);
+    uint32_t start;
+    esp_err_t err = ESP_FAIL;
+
+    if (dev == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    start = dev->stats.clk_hz;
+    s_tuning = true;
+    for (size_t i = 0; i < sizeof(s_speeds) / sizeof(s_speeds[0]); i++) {
+        if (s_speeds[i] > start) {
+            continue;
+        }
+        dev->stats.clk_hz = s_speeds[i];
+        for (uint8_t round = 0; round < I2C_BUS_TUNE_ROUNDS; round++) {
+            err = test(addr);
+            if (err != ESP_OK) {
+                break;
+            }
+        }
+        if (err == ESP_OK) {
+            break;
+        }
+        ESP_LOGI(TAG, "0x%02x: failed at %u Hz (%s)", addr, (unsigned)s_speeds[i], esp_err_to_name(err));
+    }
+    s_tuning = false;
+
+    ESP_LOGI(TAG, "0x%02x: using %u Hz (max %u Hz)", addr, (unsigned)dev->stats.clk_hz, (unsigned)dev->max_hz);
+    nvs_store_clock(dev);
+
+    return err;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Address-only transaction, ESP_OK if the device acknowledged */
+esp_err_t i2c_bus_probe(uint8_t addr)
+{
+    i2c_bus_device_t *dev = find_device(addr);
+    esp_err_t err;
+
+    select_device(dev);
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, (addr<<1) | I2C_MASTER_WRITE, true);
+    i2c_master_stop(cmd);
+    err = i2c_master_cmd_begin(s_port, cmd, I2C_BUS_TIMEOUT_MS / portTICK_PERIOD_MS);
+    i2c_cmd_link_delete(cmd);
+
+    if (dev != NULL) {
+        dev->stats.transactions++;
+    }
+    record_result(dev, err);
+    return err;
+}
+
+
+/*-----------------------------------------------------------*/
+esp_err_t i2c_bus_write(uint8_t addr, const uint8_t *data, size_t len)
+{
+    i2c_bus_device_t *dev = find_device(addr);
+    esp_err_t err;
+
+    select_device(dev);
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, (addr<<1) | I2C_MASTER_WRITE, true);
+    i2c_master_write(cmd, data, len, true);
+    i2c_master_stop(cmd);
+    err = i2c_master_cmd_begin(s_port, cmd, I2C_BUS_TIMEOUT_MS / portTICK_PERIOD_MS);
+    i2c_cmd_link_delete(cmd);
+
+    if (dev != NULL) {
+        dev->stats.transactions++;
+    }
+    record_result(dev, err);
+    return err;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Burst read of "len" bytes starting at register "reg". Devices
+   without register pointer (reg_len = 0) are read directly. */
+esp_err_t i2c_bus_read(uint8_t addr, uint8_t reg, uint8_t reg_len, uint8_t *buf, size_t len)
+{
+    i2c_bus_device_t *dev = find_device(addr);
+    esp_err_t err;
+
+    select_device(dev);
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    if (reg_len > 0) {
+        i2c_master_start(cmd);
+        i2c_master_write_byte(cmd, (addr<<1) | I2C_MASTER_WRITE, true);
+        i2c_master_write_byte(cmd, reg, true);
+    }
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, (addr<<1) | I2C_MASTER_READ, true);
+    i2c_master_read(cmd, buf, len, I2C_MASTER_LAST_NACK);
+    i2c_master_stop(cmd);
+    err = i2c_master_cmd_begin(s_port, cmd, I2C_BUS_TIMEOUT_MS / portTICK_PERIOD_MS);
+    i2c_cmd_link_delete(cmd);
+
+    if (dev != NULL) {
+        dev->stats.transactions++;
+    }
+    record_result(dev, err);
+    return err;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Errors found in received data (checksum, invalid values) count
+   towards the error rate of the device too */
+void i2c_bus_report(uint8_t addr, esp_err_t err)
+{
+    if (err != ESP_OK) {
+        record_result(find_device(addr), err);
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+esp_err_t i2c_bus_get_stats(uint8_t addr, i2c_bus_stats_t *stats)
+{
+    i2c_bus_device_t *dev = find_device(addr);
+
+    if (dev == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    *stats = dev->stats;
+    return ESP_OK;
+}
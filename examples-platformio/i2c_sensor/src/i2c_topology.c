@@ -0,0 +1,211 @@
+/*
+  Cached I2C bus topology.
+
+  Xtensa dual-core 32-bit LX6 (ESP32-CAM), 240 MHz
+  PlatformIO, ESP-IDF framework
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+ */
+
+
+/*-----------------------------------------------------------*/
+#include <string.h>
+#include <inttypes.h>           // PRId64 format macro
+#include <esp_log.h>            // ESP_LOG/E/W/I functions
+#include <esp_timer.h>          // esp_timer_get_time() function
+#include <nvs.h>                // Non-volatile storage
+#include <i2c_bus.h>
+#include <i2c_topology.h>
+
+
+/*-----------------------------------------------------------*/
+#define I2C_TOPOLOGY_NVS_NAMESPACE "i2c_bus"
+#define I2C_TOPOLOGY_NVS_KEY       "topology"
+
+
+/*-----------------------------------------------------------*/
+// Tag for ESP_LOG/E/W/I functions
+static const char *TAG = "i2c topology";
+
+static i2c_topology_t s_topology;
+static i2c_topology_info_t s_info;
+static bool s_dirty = false;            // Differs from the NVS copy
+
+
+/*-----------------------------------------------------------*/
+static i2c_topology_device_t *find_device(uint8_t addr)
+{
+    for (uint8_t i = 0; i < s_topology.count; i++) {
+        if (s_topology.devices[i].addr == addr) {
+            return &s_topology.devices[i];
+        }
+    }
+    return NULL;
+}
+
+
+/*-----------------------------------------------------------*/
+static bool nvs_load_topology(void)
+{
+    nvs_handle_t handle;
+    size_t size = sizeof(i2c_topology_t);
+    esp_err_t err;
+
+    if (nvs_open(I2C_TOPOLOGY_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return false;
+    }
+    err = nvs_get_blob(handle, I2C_TOPOLOGY_NVS_KEY, &s_topology, &size);
+    nvs_close(handle);
+
+    return (err == ESP_OK && size == sizeof(i2c_topology_t) &&
+            s_topology.count > 0 && s_topology.count <= I2C_TOPOLOGY_MAX_DEVICES);
+}
+
+
+/*-----------------------------------------------------------*/
+/* Probe only the cached addresses, true if all of them answered */
+static bool verify_cached(void)
+{
+    for (uint8_t i = 0; i < s_topology.count; i++) {
+        s_info.probes++;
+        if (i2c_bus_probe(s_topology.devices[i].addr) != ESP_OK) {
+            ESP_LOGW(TAG, "cached device 0x%02x does not respond", s_topology.devices[i].addr);
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Probe every address, identifiers of devices still at the same
+   address are kept */
+static void full_scan(void)
+{
+    i2c_topology_t previous = s_topology;
+
+    memset(&s_topology, 0, sizeof(s_topology));
+    for (uint8_t addr = I2C_TOPOLOGY_FIRST_ADDR; addr <= I2C_TOPOLOGY_LAST_ADDR; addr++) {
+        s_info.probes++;
+        if (i2c_bus_probe(addr) != ESP_OK) {
+            continue;
+        }
+        if (s_topology.count == I2C_TOPOLOGY_MAX_DEVICES) {
+            ESP_LOGW(TAG, "more than %d devices, 0x%02x ignored", I2C_TOPOLOGY_MAX_DEVICES, addr);
+            continue;
+        }
+        s_topology.devices[s_topology.count].addr = addr;
+        s_topology.devices[s_topology.count].id = I2C_TOPOLOGY_ID_UNKNOWN;
+        for (uint8_t i = 0; i < previous.count && i < I2C_TOPOLOGY_MAX_DEVICES; i++) {
+            if (previous.devices[i].addr == addr) {
+                s_topology.devices[s_topology.count].id = previous.devices[i].id;
+            }
+        }
+        s_topology.count++;
+    }
+    s_dirty = true;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Take the topology from NVS and verify it, or scan the whole bus
+   if that fails or "force_scan" is set */
+esp_err_t i2c_topology_init(bool force_scan)
+{
+    int64_t start = esp_timer_get_time();
+    bool cached;
+
+    memset(&s_info, 0, sizeof(s_info));
+    s_dirty = false;
+
+    cached = nvs_load_topology();
+    if (!cached) {
+        memset(&s_topology, 0, sizeof(s_topology));
+    }
+
+    s_info.from_cache = cached && !force_scan && verify_cached();
+    if (!s_info.from_cache) {
+        full_scan();
+    }
+    s_info.duration_us = esp_timer_get_time() - start;
+
+    ESP_LOGI(TAG, "%u device(s), %s, %u probe(s) in %" PRId64 " us", s_topology.count,
+             s_info.from_cache ? "cached" : "full scan", s_info.probes, s_info.duration_us);
+    for (uint8_t i = 0; i < s_topology.count; i++) {
+        ESP_LOGI(TAG, "  0x%02x (id 0x%02x)", s_topology.devices[i].addr, s_topology.devices[i].id);
+    }
+
+    return (s_topology.count > 0) ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+
+/*-----------------------------------------------------------*/
+bool i2c_topology_present(uint8_t addr)
+{
+    return find_device(addr) != NULL;
+}
+
+
+/*-----------------------------------------------------------*/
+uint8_t i2c_topology_get_id(uint8_t addr)
+{
+    i2c_topology_device_t *dev = find_device(addr);
+
+    return (dev != NULL) ? dev->id : I2C_TOPOLOGY_ID_UNKNOWN;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Driver bound to the device at "addr" records its identifier */
+void i2c_topology_set_id(uint8_t addr, uint8_t id)
+{
+    i2c_topology_device_t *dev = find_device(addr);
+
+    if (dev != NULL && dev->id != id) {
+        dev->id = id;
+        s_dirty = true;
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+/* Store the topology in NVS if it changed since boot */
+esp_err_t i2c_topology_commit(void)
+{
+    nvs_handle_t handle;
+    esp_err_t err;
+
+    if (!s_dirty) {
+        return ESP_OK;
+    }
+    err = nvs_open(I2C_TOPOLOGY_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = nvs_set_blob(handle, I2C_TOPOLOGY_NVS_KEY, &s_topology, sizeof(i2c_topology_t));
+    if (err == ESP_OK) {
+        err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+
+    if (err == ESP_OK) {
+        s_dirty = false;
+    }
+    return err;
+}
+
+
+/*-----------------------------------------------------------*/
+void i2c_topology_get(i2c_topology_t *topology)
+{
+    *topology = s_topology;
+}
+
+
+/*-----------------------------------------------------------*/
+void i2c_topology_get_info(i2c_topology_info_t *info)
+{
+    *info = s_info;
+}
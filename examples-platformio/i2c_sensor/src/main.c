@@ -1,5 +1,12 @@
 /*
-   Read temperature and humidity from DHT12 sensor, SLA = 0x5c.
+   Read temperature and humidity from DHT12 (SLA = 0x5c), SHT3x
+   (SLA = 0x44) and BME280 (SLA = 0x76) sensors, whichever of them
+   are connected. Device register maps are in "include/sensors.h".
+   With "STREAM_MODE" set, samples are sent as binary frames at high
+   rate instead of text, decode them with "tools/stream_reader.py".
+   With "SAMPLE_ADAPTIVE" set, sensors are read faster while values
+   change and slower while they are stable, "tools/rate_bench.c"
+   compares it with fixed periods.
 
    Xtensa dual-core 32-bit LX6 (ESP32-CAM), 240 MHz
    PlatformIO, ESP-IDF framework
@@ -11,10 +18,19 @@
 
 
 /*-----------------------------------------------------------*/
+#include <stdlib.h>             // abs() function
 #include <freertos/FreeRTOS.h>  // FreeRTOS
 #include <freertos/task.h>
 #include <esp_log.h>            // ESP_LOG/E/W/I functions
+#include <nvs_flash.h>          // Memory
 #include <driver/i2c.h>         // Inter-Integrated Circuit driver
+#include <esp_timer.h>          // esp_timer_get_time() function
+#include <inttypes.h>           // PRId64 format macro
+#include <i2c_bus.h>            // Adaptive clock per device
+#include <i2c_topology.h>       // Devices found at boot
+#include <sensors.h>            // DHT12, SHT3x, BME280 drivers
+#include <serial_stream.h>      // Binary telemetry frames
+#include <sample_rate.h>        // Adaptive sampling period
 
 
 /*-----------------------------------------------------------*/
@@ -35,31 +51,47 @@
 // ESP32-CAM: SDA #13, SCL #15
 #define I2C_MASTER_SDA_IO 21
 #define I2C_MASTER_SCL_IO 22
-#define I2C_MASTER_FREQ_HZ 100000
-#define I2C_ACK 0x0
-#define I2C_NACK 0x1
-#define I2C_DHT_ADDRESS 0x5c  // DHT12 temp & humidity sensor
-#define I2C_DHT_HUMID 0x00    // 0x00 @ Humidity
-#define I2C_DHT_TEMP 0x02     // 0x02 @ Temperature
+#define I2C_MASTER_FREQ_HZ I2C_BUS_DEFAULT_HZ  // Tuned per device later
+#define BUS_STATS_PERIOD 12   // Print bus statistics every 12th sample
+#define I2C_FORCE_SCAN 0      // 1: ignore cached topology, scan whole bus
+
+#define STREAM_MODE 0         // 1: binary records instead of text logs
+#define STREAM_BAUD 2000000
+#define STREAM_PERIOD_MS 10   // Sampling period in stream mode
+
+// 1: sample every 1..15 s, faster while values change, see
+// "src/sample_rate.c" and "tools/rate_bench.c"; 0: every 5 s
+#define SAMPLE_ADAPTIVE 0
+#define SAMPLE_HOLD 5         // Fast samples after the last change
+#define SAMPLE_ACTIVE_MW 130  // Chip awake at 240 MHz, radio off
+
+#if STREAM_MODE
+#define SAMPLE_MIN_PERIOD_MS STREAM_PERIOD_MS
+#define SAMPLE_MAX_PERIOD_MS STREAM_PERIOD_MS
+#elif SAMPLE_ADAPTIVE
+#define SAMPLE_MIN_PERIOD_MS 1000
+#define SAMPLE_MAX_PERIOD_MS 15000
+#else
+#define SAMPLE_MIN_PERIOD_MS 5000
+#define SAMPLE_MAX_PERIOD_MS 5000
+#endif
 
 
 /*-----------------------------------------------------------*/
-// Used function(s)
-void dht_sensor_task();
-void dht_get_temp();
-void dht_get_humid();
-void dht_get_all_values();
+// Change limits in hundredths, temperature and humidity of every
+// sensor: step above 0.1 °C faster than 0.3 °C/min, or deviation
+// above 0.2 °C; step above 0.5 % faster than 2 %/min, or deviation
+// above 1 %
+static const sample_rate_channel_t temp_limits = {10, 30, 20};
+static const sample_rate_channel_t humid_limits = {50, 200, 100};
 
 
 /*-----------------------------------------------------------*/
-// Declaration of "dht12" variable with structure "DHT_values_structure"
-struct DHT_values_structure {
-    uint8_t humidInt;
-    uint8_t humidDec;
-    uint8_t tempInt;
-    uint8_t tempDec;
-    uint8_t checksum;
-} dht12;
+// Used function(s)
+void sensor_task();
+void stream_sample(const sensors_sample_t *sample);
+void stream_bus_stats(const i2c_bus_stats_t *stats);
+void log_sample_rate(const sample_rate_t *sr);
 
 
 /*-----------------------------------------------------------*/
@@ -85,88 +117,179 @@ void app_main(void)
     i2c_driver_install(I2C_NUM_0, I2C_MODE_MASTER, 0, 0, 0);
     ESP_LOGI("i2c", "i2c driver installed");
 
+    // Initialize NVS (Non-volatile storage in Flash memory), it keeps
+    // the tuned I2C clock of every device
+    ESP_ERROR_CHECK(nvs_flash_init());
+
+    // Verify devices known from the last boot, then initialize sensors
+    // and select their clock speeds
+    i2c_bus_init(I2C_NUM_0, &conf);
+    i2c_topology_init(I2C_FORCE_SCAN);
+    if (sensors_init() != ESP_OK) {
+        ESP_LOGE("i2c", "no sensor found");
+        return;
+    }
+
+    i2c_topology_info_t topology;
+    i2c_topology_get_info(&topology);
+    ESP_LOGI("i2c", "sensors ready %" PRId64 " ms after boot (%s, bus topology in %" PRId64 " us)",
+             esp_timer_get_time() / 1000, topology.from_cache ? "cached topology" : "full scan",
+             topology.duration_us);
+
+#if STREAM_MODE
+    // Console UART carries binary frames from now on, text would
+    // break them
+    ESP_ERROR_CHECK(serial_stream_init(STREAM_BAUD));
+    esp_log_level_set("*", ESP_LOG_NONE);
+#endif
+
     // Start I2C sensor task
-    xTaskCreate(dht_sensor_task, "read_sensor_values", 2048, NULL, 5, NULL);
+    xTaskCreate(sensor_task, "read_sensor_values", 3072, NULL, 5, NULL);
 }
 
 
 /*-----------------------------------------------------------*/
-void dht_sensor_task()
+/* One record per decoded device */
+void stream_sample(const sensors_sample_t *sample)
 {
-    ESP_LOGI("task", "DHT sensor task started");
+    serial_stream_sample_t record = {
+        .time_us = (uint32_t)esp_timer_get_time(),
+    };
 
-    // Forever loop
-    while (1) {
-        // dht_get_temp();
-        // vTaskDelay(20 / portTICK_PERIOD_MS);
-        // dht_get_humid();
-        // vTaskDelay(20 / portTICK_PERIOD_MS);
-        dht_get_all_values();
-        ESP_LOGI("i2c", "temperature: %d.%d °C", dht12.tempInt, dht12.tempDec);
-        ESP_LOGI("i2c", "humidity: %d.%d", dht12.humidInt, dht12.humidDec);
-        ESP_LOGI("i2c", "checksum: %d", dht12.checksum);
-
-        // Delay 5 seconds
-        vTaskDelay(5000 / portTICK_PERIOD_MS);
+    for (int id = 0; id < SENSOR_COUNT; id++) {
+        if (sample->valid & (1UL << id)) {
+            record.sensor = id;
+            record.temp_x100 = sample->values[id].temp_x100;
+            record.humid_x100 = sample->values[id].humid_x100;
+            record.press_pa = sample->values[id].press_pa;
+            serial_stream_add(SERIAL_STREAM_SAMPLE, &record, sizeof(record));
+        }
     }
-
-    // Delete this task if it exits from the loop above
-    vTaskDelete(NULL);
 }
 
 
 /*-----------------------------------------------------------*/
-void dht_get_temp()
+void stream_bus_stats(const i2c_bus_stats_t *stats)
 {
-    // Create and execute i2c commands list
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (I2C_DHT_ADDRESS<<1) | I2C_MASTER_WRITE, true);
-    i2c_master_write_byte(cmd, I2C_DHT_TEMP, true);
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (I2C_DHT_ADDRESS<<1) | I2C_MASTER_READ, true);
-    i2c_master_read_byte(cmd, &dht12.tempInt, I2C_ACK);
-    i2c_master_read_byte(cmd, &dht12.tempDec, I2C_NACK);
-    i2c_master_stop(cmd);
-    i2c_master_cmd_begin(I2C_NUM_0, cmd, (1000 / portTICK_RATE_MS));
-    i2c_cmd_link_delete(cmd);
+    serial_stream_bus_t record = {
+        .time_us = (uint32_t)esp_timer_get_time(),
+        .addr = stats->addr,
+        .clk_khz = stats->clk_hz / 1000,
+        .transactions = stats->transactions,
+        .nacks = stats->nacks,
+        .timeouts = stats->timeouts,
+        .checksum_errors = stats->checksum_errors,
+        .step_downs = stats->step_downs,
+    };
+
+    serial_stream_add(SERIAL_STREAM_BUS_STATS, &record, sizeof(record));
 }
 
 
 /*-----------------------------------------------------------*/
-void dht_get_humid()
+/* Sampling costs per hour next to fixed sampling at the fastest rate */
+void log_sample_rate(const sample_rate_t *sr)
 {
-    // Create and execute i2c commands list
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (I2C_DHT_ADDRESS<<1) | I2C_MASTER_WRITE, true);
-    i2c_master_write_byte(cmd, I2C_DHT_HUMID, true);
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (I2C_DHT_ADDRESS<<1) | I2C_MASTER_READ, true);
-    i2c_master_read_byte(cmd, &dht12.humidInt, I2C_ACK);
-    i2c_master_read_byte(cmd, &dht12.humidDec, I2C_NACK);
-    i2c_master_stop(cmd);
-    i2c_master_cmd_begin(I2C_NUM_0, cmd, (1000 / portTICK_RATE_MS));
-    i2c_cmd_link_delete(cmd);
+    sample_rate_cost_t adaptive, fixed;
+
+    sample_rate_report(sr, &adaptive, &fixed);
+    ESP_LOGI("sample", "period %u ms, %u speed-up(s), %u of %u samples fast",
+             (unsigned)sr->period_ms, (unsigned)sr->speed_ups, (unsigned)sr->fast_samples,
+             (unsigned)sr->samples);
+    ESP_LOGI("sample", "per hour: %u samples, bus %u ms, CPU %u ms, %u mJ (fixed %u ms: %u samples, bus %u ms, CPU %u ms, %u mJ)",
+             (unsigned)adaptive.samples, (unsigned)adaptive.bus_ms, (unsigned)adaptive.cpu_ms,
+             (unsigned)adaptive.energy_mj, (unsigned)sr->config.min_period_ms, (unsigned)fixed.samples,
+             (unsigned)fixed.bus_ms, (unsigned)fixed.cpu_ms, (unsigned)fixed.energy_mj);
 }
 
 
 /*-----------------------------------------------------------*/
-void dht_get_all_values()
+void sensor_task()
 {
-    // Create and execute i2c commands list
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (I2C_DHT_ADDRESS<<1) | I2C_MASTER_WRITE, true);
-    i2c_master_write_byte(cmd, I2C_DHT_HUMID, true);
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (I2C_DHT_ADDRESS<<1) | I2C_MASTER_READ, true);
-    i2c_master_read_byte(cmd, &dht12.humidInt, I2C_ACK);
-    i2c_master_read_byte(cmd, &dht12.humidDec, I2C_ACK);
-    i2c_master_read_byte(cmd, &dht12.tempInt, I2C_ACK);
-    i2c_master_read_byte(cmd, &dht12.tempDec, I2C_ACK);
-    i2c_master_read_byte(cmd, &dht12.checksum, I2C_NACK);
-    i2c_master_stop(cmd);
-    i2c_master_cmd_begin(I2C_NUM_0, cmd, (1000 / portTICK_RATE_MS));
-    i2c_cmd_link_delete(cmd);
+    sensors_sample_t sample;
+    i2c_bus_stats_t stats;
+    uint32_t round = 0;
+    sample_rate_channel_t limits[2 * SENSOR_COUNT];
+    int32_t values[2 * SENSOR_COUNT];
+    uint32_t valid;
+    sample_rate_t rate;
+    uint32_t period_ms;
+    int64_t start, read_end;
+
+    ESP_LOGI("task", "sensor task started");
+
+    // Channels 2n and 2n + 1 are temperature and humidity of device n
+    for (int id = 0; id < SENSOR_COUNT; id++) {
+        limits[2 * id] = temp_limits;
+        limits[2 * id + 1] = humid_limits;
+    }
+    sample_rate_config_t rate_config = {
+        .min_period_ms = SAMPLE_MIN_PERIOD_MS,
+        .max_period_ms = SAMPLE_MAX_PERIOD_MS,
+        .hold = SAMPLE_HOLD,
+        .active_mw = SAMPLE_ACTIVE_MW,
+        .channels = 2 * SENSOR_COUNT,
+        .channel = limits,
+    };
+    sample_rate_init(&rate, &rate_config);
+
+    // Forever loop
+    while (1) {
+        start = esp_timer_get_time();
+        sensors_read_all(&sample);
+        read_end = esp_timer_get_time();
+#if STREAM_MODE
+        stream_sample(&sample);
+#endif
+        for (int id = 0; id < SENSOR_COUNT; id++) {
+            if (sample.valid & (1UL << id)) {
+                sensor_values_t *v = &sample.values[id];
+                ESP_LOGI("i2c", "%s: temperature: %d.%02d °C, humidity: %u.%02u %%, pressure: %u Pa",
+                         sensors_name(id), v->temp_x100 / 100, abs(v->temp_x100 % 100),
+                         v->humid_x100 / 100, v->humid_x100 % 100, (unsigned)v->press_pa);
+            }
+            else if (sample.result[id] != ESP_ERR_NOT_FOUND) {
+                ESP_LOGW("i2c", "%s: %s", sensors_name(id), esp_err_to_name(sample.result[id]));
+            }
+        }
+
+        // Bus clock and error counters of present devices
+        if (++round % BUS_STATS_PERIOD == 0) {
+            for (int id = 0; id < SENSOR_COUNT; id++) {
+                if ((sensors_present() & (1UL << id)) &&
+                    i2c_bus_get_stats(sensors_address(id), &stats) == ESP_OK) {
+#if STREAM_MODE
+                    stream_bus_stats(&stats);
+#endif
+                    ESP_LOGI("i2c", "%s: %u Hz, %u transactions, %u NACK, %u timeout, %u checksum, %u step-down(s)",
+                             sensors_name(id), (unsigned)stats.clk_hz, (unsigned)stats.transactions,
+                             (unsigned)stats.nacks, (unsigned)stats.timeouts,
+                             (unsigned)stats.checksum_errors, (unsigned)stats.step_downs);
+                }
+            }
+#if STREAM_MODE
+            serial_stream_flush();
+#else
+            log_sample_rate(&rate);
+#endif
+        }
+
+        // Next period from the changes of all valid values
+        valid = 0;
+        for (int id = 0; id < SENSOR_COUNT; id++) {
+            if (sample.valid & (1UL << id)) {
+                values[2 * id] = sample.values[id].temp_x100;
+                values[2 * id + 1] = sample.values[id].humid_x100;
+                valid |= 3UL << (2 * id);
+            }
+        }
+        period_ms = sample_rate_update(&rate, values, valid, read_end / 1000);
+        sample_rate_account(&rate, read_end - start, esp_timer_get_time() - read_end);
+
+        // Delay 1 to 15 seconds (or the stream period)
+        vTaskDelay(period_ms / portTICK_PERIOD_MS);
+    }
+
+    // Delete this task if it exits from the loop above
+    vTaskDelete(NULL);
 }
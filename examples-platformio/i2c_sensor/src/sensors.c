@@ -0,0 +1,391 @@
+/*
+  Table-driven I2C sensor drivers with one burst read per device.
+
+  Xtensa dual-core 32-bit LX6 (ESP32-CAM), 240 MHz
+  PlatformIO, ESP-IDF framework
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+
+  See also:
+    DHT12 datasheet
+      * https://datasheetspdf.com/pdf-file/1148040/Aosong/DHT12/1
+    SHT3x-DIS datasheet
+      * https://sensirion.com/products/catalog/SHT30-DIS-B/
+    BME280 datasheet
+      * https://www.bosch-sensortec.com/products/environmental-sensors/humidity-sensors-bme280/
+ */
+
+
+/*-----------------------------------------------------------*/
+#include <freertos/FreeRTOS.h>  // FreeRTOS
+#include <freertos/task.h>
+#include <esp_log.h>            // ESP_LOG/E/W/I functions
+#include <i2c_bus.h>            // Adaptive clock per device
+#include <i2c_topology.h>       // Devices found at boot
+#include <sensors.h>
+
+
+/*-----------------------------------------------------------*/
+#define SENSOR_BIT(id) (1UL << (id))
+
+#define BME280_REG_CALIB_00 0x88    // 0x88..0xa1 @ T1..P9, H1
+#define BME280_REG_CHIP_ID  0xd0
+#define BME280_REG_CALIB_26 0xe1    // 0xe1..0xe7 @ H2..H6
+#define BME280_REG_CTRL_HUM 0xf2
+#define BME280_REG_CTRL_MEAS 0xf4
+#define BME280_REG_CONFIG   0xf5
+#define BME280_CHIP_ID      0x60
+
+
+/*-----------------------------------------------------------*/
+// Tag for ESP_LOG/E/W/I functions
+static const char *TAG = "sensors";
+
+static uint32_t s_present = 0;
+
+// BME280 trimming parameters, read once at startup
+static struct {
+    uint16_t t1;
+    int16_t t2, t3;
+    uint16_t p1;
+    int16_t p2, p3, p4, p5, p6, p7, p8, p9;
+    uint8_t h1, h3;
+    int16_t h2, h4, h5;
+    int8_t h6;
+} s_bme280;
+
+
+/*-----------------------------------------------------------*/
+static esp_err_t bus_write_reg(uint8_t addr, uint8_t reg, uint8_t value)
+{
+    uint8_t data[2] = { reg, value };
+
+    return i2c_bus_write(addr, data, sizeof(data));
+}
+
+
+/*-----------------------------------------------------------*/
+/* DHT12: humidity and temperature as integer and decimal bytes,
+   bit 7 of the temperature decimal is the sign */
+static esp_err_t dht12_init(uint8_t addr)
+{
+    return ESP_OK;
+}
+
+static inline esp_err_t dht12_decode(const uint8_t *buf, sensor_values_t *values)
+{
+    int16_t temp;
+
+    if ((uint8_t)(buf[0] + buf[1] + buf[2] + buf[3]) != buf[4]) {
+        return ESP_ERR_INVALID_CRC;
+    }
+    temp = (buf[2] * 10 + (buf[3] & 0x7f)) * 10;
+    values->temp_x100 = (buf[3] & 0x80) ? -temp : temp;
+    values->humid_x100 = (buf[0] * 10 + buf[1]) * 10;
+    values->press_pa = 0;
+
+    return ESP_OK;
+}
+
+
+/*-----------------------------------------------------------*/
+/* SHT3x: single shot measurement, two 16-bit words each followed
+   by CRC-8 (polynomial 0x31, init 0xff) */
+static esp_err_t sht3x_init(uint8_t addr)
+{
+    return ESP_OK;
+}
+
+static uint8_t sht3x_crc(const uint8_t *data)
+{
+    uint8_t crc = 0xff;
+
+    for (uint8_t i = 0; i < 2; i++) {
+        crc ^= data[i];
+        for (uint8_t b = 0; b < 8; b++) {
+            crc = (crc & 0x80) ? (crc << 1) ^ 0x31 : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+static inline esp_err_t sht3x_decode(const uint8_t *buf, sensor_values_t *values)
+{
+    uint32_t raw_temp = (buf[0] << 8) | buf[1];
+    uint32_t raw_humid = (buf[3] << 8) | buf[4];
+
+    if (sht3x_crc(&buf[0]) != buf[2] || sht3x_crc(&buf[3]) != buf[5]) {
+        return ESP_ERR_INVALID_CRC;
+    }
+    // T = -45 + 175 * raw / (2^16 - 1), RH = 100 * raw / (2^16 - 1)
+    values->temp_x100 = (int32_t)(raw_temp * 17500 / 65535) - 4500;
+    values->humid_x100 = raw_humid * 10000 / 65535;
+    values->press_pa = 0;
+
+    return ESP_OK;
+}
+
+
+/*-----------------------------------------------------------*/
+/* BME280: normal mode with 1x oversampling, compensation formulas
+   in integer arithmetic from the datasheet, chapter 4.2.3 */
+static esp_err_t bme280_init(uint8_t addr)
+{
+    uint8_t buf[26];
+    esp_err_t err;
+
+    err = i2c_bus_read(addr, BME280_REG_CHIP_ID, 1, buf, 1);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (buf[0] != BME280_CHIP_ID) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    err = i2c_bus_read(addr, BME280_REG_CALIB_00, 1, buf, 26);
+    if (err != ESP_OK) {
+        return err;
+    }
+    s_bme280.t1 = buf[0] | (buf[1] << 8);
+    s_bme280.t2 = buf[2] | (buf[3] << 8);
+    s_bme280.t3 = buf[4] | (buf[5] << 8);
+    s_bme280.p1 = buf[6] | (buf[7] << 8);
+    s_bme280.p2 = buf[8] | (buf[9] << 8);
+    s_bme280.p3 = buf[10] | (buf[11] << 8);
+    s_bme280.p4 = buf[12] | (buf[13] << 8);
+    s_bme280.p5 = buf[14] | (buf[15] << 8);
+    s_bme280.p6 = buf[16] | (buf[17] << 8);
+    s_bme280.p7 = buf[18] | (buf[19] << 8);
+    s_bme280.p8 = buf[20] | (buf[21] << 8);
+    s_bme280.p9 = buf[22] | (buf[23] << 8);
+    s_bme280.h1 = buf[25];
+
+    err = i2c_bus_read(addr, BME280_REG_CALIB_26, 1, buf, 7);
+    if (err != ESP_OK) {
+        return err;
+    }
+    s_bme280.h2 = buf[0] | (buf[1] << 8);
+    s_bme280.h3 = buf[2];
+    s_bme280.h4 = ((int8_t)buf[3] << 4) | (buf[4] & 0x0f);
+    s_bme280.h5 = ((int8_t)buf[5] << 4) | (buf[4] >> 4);
+    s_bme280.h6 = buf[6];
+
+    // Humidity x1, standby 1000 ms, then temperature x1, pressure x1,
+    // normal mode (ctrl_hum is applied by the write to ctrl_meas)
+    bus_write_reg(addr, BME280_REG_CTRL_HUM, 0x01);
+    bus_write_reg(addr, BME280_REG_CONFIG, 0xa0);
+    return bus_write_reg(addr, BME280_REG_CTRL_MEAS, 0x27);
+}
+
+static inline esp_err_t bme280_decode(const uint8_t *buf, sensor_values_t *values)
+{
+    int32_t adc_p = (buf[0] << 12) | (buf[1] << 4) | (buf[2] >> 4);
+    int32_t adc_t = (buf[3] << 12) | (buf[4] << 4) | (buf[5] >> 4);
+    int32_t adc_h = (buf[6] << 8) | buf[7];
+    int32_t var1, var2, t_fine, h;
+    int64_t p1, p2, p;
+
+    // Measurement skipped or not finished yet
+    if (adc_t == 0x80000) {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+
+    // Temperature in 0.01 degree Celsius
+    var1 = ((((adc_t >> 3) - ((int32_t)s_bme280.t1 << 1))) * s_bme280.t2) >> 11;
+    var2 = (((((adc_t >> 4) - s_bme280.t1) * ((adc_t >> 4) - s_bme280.t1)) >> 12) * s_bme280.t3) >> 14;
+    t_fine = var1 + var2;
+    values->temp_x100 = (t_fine * 5 + 128) >> 8;
+
+    // Pressure in Q24.8 Pa
+    p1 = (int64_t)t_fine - 128000;
+    p2 = p1 * p1 * s_bme280.p6;
+    p2 = p2 + ((p1 * s_bme280.p5) << 17);
+    p2 = p2 + ((int64_t)s_bme280.p4 << 35);
+    p1 = ((p1 * p1 * s_bme280.p3) >> 8) + ((p1 * s_bme280.p2) << 12);
+    p1 = ((((int64_t)1 << 47) + p1) * s_bme280.p1) >> 33;
+    if (p1 == 0) {
+        values->press_pa = 0;
+    }
+    else {
+        p = 1048576 - adc_p;
+        p = (((p << 31) - p2) * 3125) / p1;
+        p1 = ((int64_t)s_bme280.p9 * (p >> 13) * (p >> 13)) >> 25;
+        p2 = ((int64_t)s_bme280.p8 * p) >> 19;
+        p = ((p + p1 + p2) >> 8) + ((int64_t)s_bme280.p7 << 4);
+        values->press_pa = (uint32_t)(p >> 8);
+    }
+
+    // Humidity in Q22.10 %
+    h = t_fine - 76800;
+    h = (((((adc_h << 14) - ((int32_t)s_bme280.h4 << 20) - (s_bme280.h5 * h)) + 16384) >> 15) *
+         (((((((h * s_bme280.h6) >> 10) * (((h * s_bme280.h3) >> 11) + 32768)) >> 10) + 2097152) *
+           s_bme280.h2 + 8192) >> 14));
+    h = h - (((((h >> 15) * (h >> 15)) >> 7) * s_bme280.h1) >> 4);
+    h = (h < 0) ? 0 : h;
+    h = (h > 419430400) ? 419430400 : h;
+    values->humid_x100 = ((h >> 12) * 100) >> 10;
+
+    return ESP_OK;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Clock tuning test: one complete sample of the device at "addr" */
+static esp_err_t sensor_test(uint8_t addr)
+{
+    sensors_sample_t sample;
+    uint32_t present = s_present;
+    sensor_id_t id = SENSOR_COUNT;
+
+#define SENSOR_ID(name, prefix, address, cmd, cmd_len, conv_ms, reg, reg_len, len, khz) \
+    if ((address) == addr) { \
+        id = SENSOR_##name; \
+    }
+
+    SENSOR_DEVICES(SENSOR_ID)
+#undef SENSOR_ID
+
+    if (id == SENSOR_COUNT) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    s_present = SENSOR_BIT(id);
+    sensors_read_all(&sample);
+    s_present = present;
+
+    return sample.result[id];
+}
+
+
+/*-----------------------------------------------------------*/
+/* Initialize every device of the table present in the bus topology
+   and select the fastest reliable clock for each of them. Driver of
+   device n is recorded as identifier n + 1 in the topology; an
+   address already bound to another driver is skipped. */
+esp_err_t sensors_init(void)
+{
+    uint8_t id;
+    esp_err_t err;
+
+    s_present = 0;
+
+#define SENSOR_PROBE(name, prefix, addr, cmd, cmd_len, conv_ms, reg, reg_len, len, khz) \
+    id = i2c_topology_get_id(addr); \
+    if (!i2c_topology_present(addr) || \
+        (id != I2C_TOPOLOGY_ID_UNKNOWN && id != SENSOR_##name + 1)) { \
+        err = ESP_ERR_NOT_FOUND; \
+    } \
+    else { \
+        i2c_bus_add_device(addr, I2C_BUS_DEFAULT_HZ); \
+        err = prefix##_init(addr); \
+    } \
+    if (err == ESP_OK) { \
+        i2c_bus_add_device(addr, (khz) * 1000); \
+        i2c_bus_tune(addr, sensor_test); \
+        i2c_topology_set_id(addr, SENSOR_##name + 1); \
+        s_present |= SENSOR_BIT(SENSOR_##name); \
+        ESP_LOGI(TAG, "%s found at 0x%02x", #name, addr); \
+    } \
+    else { \
+        ESP_LOGI(TAG, "%s not present at 0x%02x (%s)", #name, addr, esp_err_to_name(err)); \
+    }
+
+    SENSOR_DEVICES(SENSOR_PROBE)
+#undef SENSOR_PROBE
+
+    i2c_topology_commit();
+
+    return (s_present != 0) ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Bitmap of devices found by sensors_init(), bit n is device n */
+uint32_t sensors_present(void)
+{
+    return s_present;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Sample all present devices. Measurement commands are sent to all
+   devices first, so their conversions run in parallel, then each
+   device is read by one burst transaction. */
+esp_err_t sensors_read_all(sensors_sample_t *sample)
+{
+    sensor_burst_t burst;
+    int32_t conv_ms = 0;
+    esp_err_t err;
+
+    sample->valid = 0;
+    for (int i = 0; i < SENSOR_COUNT; i++) {
+        sample->result[i] = ESP_ERR_NOT_FOUND;
+    }
+
+    // Start conversions
+#define SENSOR_START(name, prefix, addr, cmd, cmd_len, ms, reg, reg_len, len, khz) \
+    if ((cmd_len) > 0 && (s_present & SENSOR_BIT(SENSOR_##name))) { \
+        static const uint8_t command[2] = { (cmd) >> 8, (cmd) & 0xff }; \
+        sample->result[SENSOR_##name] = i2c_bus_write(addr, command + 2 - (cmd_len), cmd_len); \
+        if ((ms) > conv_ms) { \
+            conv_ms = (ms); \
+        } \
+    }
+
+    SENSOR_DEVICES(SENSOR_START)
+#undef SENSOR_START
+
+    // Wait for the slowest one, at least "conv_ms" whatever the tick phase is
+    if (conv_ms > 0) {
+        vTaskDelay((conv_ms + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS + 1);
+    }
+
+    // Burst read and decode
+#define SENSOR_READ(name, prefix, addr, cmd, cmd_len, ms, reg, reg_len, len, khz) \
+    if (s_present & SENSOR_BIT(SENSOR_##name)) { \
+        err = ((cmd_len) > 0) ? sample->result[SENSOR_##name] : ESP_OK; \
+        if (err == ESP_OK) { \
+            err = i2c_bus_read(addr, reg, reg_len, burst.name, len); \
+            if (err == ESP_OK) { \
+                err = prefix##_decode(burst.name, &sample->values[SENSOR_##name]); \
+                i2c_bus_report(addr, err); \
+            } \
+        } \
+        if (err == ESP_OK) { \
+            sample->valid |= SENSOR_BIT(SENSOR_##name); \
+        } \
+        sample->result[SENSOR_##name] = err; \
+    }
+
+    SENSOR_DEVICES(SENSOR_READ)
+#undef SENSOR_READ
+
+    return (sample->valid != 0) ? ESP_OK : ESP_FAIL;
+}
+
+
+/*-----------------------------------------------------------*/
+const char *sensors_name(sensor_id_t id)
+{
+    static const char *names[] = {
+#define SENSOR_NAME(name, prefix, addr, cmd, cmd_len, conv_ms, reg, reg_len, len, khz) #name,
+        SENSOR_DEVICES(SENSOR_NAME)
+#undef SENSOR_NAME
+    };
+
+    return (id < SENSOR_COUNT) ? names[id] : "unknown";
+}
+
+
+/*-----------------------------------------------------------*/
+uint8_t sensors_address(sensor_id_t id)
+{
+    static const uint8_t addresses[] = {
+#define SENSOR_ADDRESS(name, prefix, addr, cmd, cmd_len, conv_ms, reg, reg_len, len, khz) addr,
+        SENSOR_DEVICES(SENSOR_ADDRESS)
+#undef SENSOR_ADDRESS
+    };
+
+    return (id < SENSOR_COUNT) ? addresses[id] : 0;
+}
@@ -0,0 +1,217 @@
+/*
+  Binary telemetry stream over UART.
+
+  Xtensa dual-core 32-bit LX6 (ESP32-CAM), 240 MHz
+  PlatformIO, ESP-IDF framework
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+
+  NOTES:
+    * Only one task may add records
+    * At 2 Mbaud, about 13 000 sample records per second fit the line
+
+  See also:
+    Consistent Overhead Byte Stuffing (COBS)
+      * https://en.wikipedia.org/wiki/Consistent_Overhead_Byte_Stuffing
+ */
+
+
+/*-----------------------------------------------------------*/
+#include <string.h>
+#include <freertos/FreeRTOS.h>  // FreeRTOS
+#include <freertos/task.h>
+#include <freertos/ringbuf.h>   // Ring buffer
+#include <esp_log.h>            // ESP_LOG/E/W/I functions
+#include <esp_rom_uart.h>       // esp_rom_uart_tx_wait_idle() function
+#include <serial_stream.h>
+
+
+/*-----------------------------------------------------------*/
+#define SERIAL_STREAM_HEADER 5
+#define SERIAL_STREAM_FRAME  (SERIAL_STREAM_HEADER + SERIAL_STREAM_MAX_PAYLOAD + 2)
+// COBS adds one byte per 254 bytes plus one, then the delimiter
+#define SERIAL_STREAM_ENCODED (SERIAL_STREAM_FRAME + SERIAL_STREAM_FRAME / 254 + 2)
+
+
+/*-----------------------------------------------------------*/
+// Tag for ESP_LOG/E/W/I functions
+static const char *TAG = "serial stream";
+
+static RingbufHandle_t s_ring = NULL;
+static uint8_t s_frame[SERIAL_STREAM_FRAME];
+static uint8_t s_encoded[SERIAL_STREAM_ENCODED];
+static uint16_t s_used = 0;             // Record bytes in frame
+static uint16_t s_seq = 0;
+static serial_stream_stats_t s_stats;
+
+
+/*-----------------------------------------------------------*/
+/* CRC-16/CCITT-FALSE, polynomial 0x1021, init 0xffff */
+static uint16_t crc16(const uint8_t *data, size_t len)
+{
+    uint16_t crc = 0xffff;
+
+    while (len-- > 0) {
+        crc ^= (uint16_t)(*data++) << 8;
+        for (uint8_t b = 0; b < 8; b++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+
+/*-----------------------------------------------------------*/
+/* COBS encode "len" bytes and append the zero delimiter, return
+   the encoded length */
+static size_t cobs_encode(const uint8_t *src, size_t len, uint8_t *dst)
+{
+    size_t code_pos = 0;
+    size_t out = 1;
+    uint8_t code = 1;
+
+    for (size_t i = 0; i < len; i++) {
+        if (src[i] == 0) {
+            dst[code_pos] = code;
+            code_pos = out++;
+            code = 1;
+        }
+        else {
+            dst[out++] = src[i];
+            if (++code == 0xff) {
+                dst[code_pos] = code;
+                code_pos = out++;
+                code = 1;
+            }
+        }
+    }
+    dst[code_pos] = code;
+    dst[out++] = 0;
+
+    return out;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Move encoded frames from the ring to the UART */
+static void serial_stream_task(void *pvParameter)
+{
+    uint8_t *data;
+    size_t size;
+
+    while (1) {
+        data = xRingbufferReceiveUpTo(s_ring, &size, portMAX_DELAY, SERIAL_STREAM_RING_SIZE);
+        if (data != NULL) {
+            uart_write_bytes(SERIAL_STREAM_UART, data, size);
+            vRingbufferReturnItem(s_ring, data);
+        }
+    }
+
+    // Delete this task if it exits from the loop above
+    vTaskDelete(NULL);
+}
+
+
+/*-----------------------------------------------------------*/
+/* Switch the console UART to "baud" and start the writer task.
+   Text logs would corrupt frames, so they should be turned off. */
+esp_err_t serial_stream_init(uint32_t baud)
+{
+    uart_config_t config = {
+        .baud_rate = baud,
+        .data_bits = UART_DATA_8_BITS,
+        .parity = UART_PARITY_DISABLE,
+        .stop_bits = UART_STOP_BITS_1,
+        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+        .source_clk = UART_SCLK_APB,
+    };
+    esp_err_t err;
+
+    ESP_LOGI(TAG, "switching to binary stream at %u Bd", (unsigned)baud);
+    // Let the console print the message at the old speed
+    esp_rom_uart_tx_wait_idle(SERIAL_STREAM_UART);
+
+    s_ring = xRingbufferCreate(SERIAL_STREAM_RING_SIZE, RINGBUF_TYPE_BYTEBUF);
+    if (s_ring == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    err = uart_driver_install(SERIAL_STREAM_UART, 256, 2048, 0, NULL, 0);
+    if (err == ESP_OK) {
+        err = uart_param_config(SERIAL_STREAM_UART, &config);
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_used = 0;
+
+    xTaskCreate(serial_stream_task, "serial_stream", 2048, NULL, 6, NULL);
+    return ESP_OK;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Append one record, the frame is sent when it is full or holds
+   records of other type */
+esp_err_t serial_stream_add(serial_stream_type_t type, const void *record, uint8_t size)
+{
+    if (s_ring == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (size == 0 || size > SERIAL_STREAM_MAX_PAYLOAD) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (s_used > 0 && (s_frame[0] != type || s_frame[1] != size ||
+                       s_used + size > SERIAL_STREAM_MAX_PAYLOAD)) {
+        serial_stream_flush();
+    }
+
+    s_frame[0] = type;
+    s_frame[1] = size;
+    memcpy(&s_frame[SERIAL_STREAM_HEADER + s_used], record, size);
+    s_used += size;
+    s_stats.records++;
+
+    return ESP_OK;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Send the frame being built, if any */
+void serial_stream_flush(void)
+{
+    size_t len = SERIAL_STREAM_HEADER + s_used;
+    size_t encoded;
+    uint16_t crc;
+
+    if (s_used == 0) {
+        return;
+    }
+    s_frame[2] = s_used / s_frame[1];
+    s_frame[3] = s_seq & 0xff;
+    s_frame[4] = s_seq >> 8;
+    crc = crc16(s_frame, len);
+    s_frame[len++] = crc & 0xff;
+    s_frame[len++] = crc >> 8;
+
+    encoded = cobs_encode(s_frame, len, s_encoded);
+    // Sequence advances for dropped frames too, the receiver sees a gap
+    s_seq++;
+    s_used = 0;
+
+    if (xRingbufferSend(s_ring, s_encoded, encoded, 0) != pdTRUE) {
+        s_stats.dropped++;
+        return;
+    }
+    s_stats.frames++;
+    s_stats.bytes += encoded;
+}
+
+
+/*-----------------------------------------------------------*/
+void serial_stream_get_stats(serial_stream_stats_t *stats)
+{
+    *stats = s_stats;
+}
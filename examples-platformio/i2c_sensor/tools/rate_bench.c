@@ -0,0 +1,173 @@
+/*
+  Host benchmark of adaptive against fixed-rate sampling.
+
+  Build and run on Linux:
+
+    cc -O2 -Iinclude tools/rate_bench.c src/sample_rate.c -lm -o rate_bench
+    ./rate_bench
+
+  Replays one simulated day of room temperature and humidity through
+  "sample_rate" with the limits of "src/main.c": slow daily drift and
+  sensor noise, a heater cycle every two hours and a few door
+  openings (3 °C drop within a minute, slow recovery). For fixed
+  periods of 1, 5 (the former firmware) and 15 seconds and for the
+  adaptive controller the table shows costs per hour, the average
+  and largest difference between the signal and the last sample (what
+  a reader of the samples misses), how long after a door opening the
+  next sample came, the largest difference in the 10 minutes after
+  that sample and how many times the controller sped up.
+
+  Bus and CPU times of one sample are estimates for a BME280 and a
+  DHT12 at 400 kHz with text logs; the firmware logs the averages of
+  the real ones, put them in BENCH_BUS_US and BENCH_CPU_US.
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+ */
+
+
+/*-----------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <sample_rate.h>
+
+
+/*-----------------------------------------------------------*/
+#define BENCH_SECONDS    (24 * 3600)
+#define BENCH_BUS_US     650        // Sensor read per sample
+#define BENCH_CPU_US     2400       // Decode, checks and log lines
+#define BENCH_ACTIVE_MW  130        // SAMPLE_ACTIVE_MW of "src/main.c"
+#define BENCH_DOORS      5
+
+
+/*-----------------------------------------------------------*/
+// Limits of "src/main.c", temperature and humidity in hundredths
+static const sample_rate_channel_t channels[] = {
+    {10, 30, 20},
+    {50, 200, 100},
+};
+
+static const int32_t door_open_s[BENCH_DOORS] = {7 * 3600 + 13, 8 * 3600 + 1711, 12 * 3600 + 302,
+                                                 17 * 3600 + 2950, 21 * 3600 + 877};
+
+static int32_t s_temp[BENCH_SECONDS];
+static int32_t s_humid[BENCH_SECONDS];
+
+
+/*-----------------------------------------------------------*/
+static uint32_t xorshift(void)
+{
+    static uint32_t state = 2022;
+
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+
+/*-----------------------------------------------------------*/
+/* One value per second, in hundredths */
+static void make_signal(void)
+{
+    for (int32_t t = 0; t < BENCH_SECONDS; t++) {
+        double temp = 22.0 + 1.0 * sin(2 * M_PI * (t - 9 * 3600) / BENCH_SECONDS);
+        double humid = 45.0 - 3.0 * sin(2 * M_PI * (t - 9 * 3600) / BENCH_SECONDS);
+
+        // Heater: 10 minutes of 0.08 °C per minute, then cooling
+        int32_t cycle = t % 7200;
+        if (cycle < 600) {
+            temp += 0.8 * cycle / 600;
+        }
+        else {
+            temp += 0.8 * exp(-(cycle - 600) / 900.0);
+        }
+        // Door: cold air within a minute, recovery in tens of minutes
+        for (int i = 0; i < BENCH_DOORS; i++) {
+            int32_t dt = t - door_open_s[i];
+            if (dt >= 0 && dt < 3 * 3600) {
+                double depth = (dt < 60) ? dt / 60.0 : exp(-(dt - 60) / 600.0);
+                temp -= 3.0 * depth;
+                humid += 10.0 * depth;
+            }
+        }
+        s_temp[t] = lround(temp * 100) + (int32_t)(xorshift() % 7) - 3;
+        s_humid[t] = lround(humid * 100) + (int32_t)(xorshift() % 21) - 10;
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+static void bench(const char *name, uint32_t min_period_ms, uint32_t max_period_ms)
+{
+    sample_rate_config_t config = {
+        .min_period_ms = min_period_ms,
+        .max_period_ms = max_period_ms,
+        .hold = 5,
+        .active_mw = BENCH_ACTIVE_MW,
+        .channels = sizeof(channels) / sizeof(channels[0]),
+        .channel = channels,
+    };
+    sample_rate_t sr;
+    sample_rate_cost_t adaptive, fixed;
+    int32_t values[2];
+    int32_t held = 0;
+    int32_t max_error = 0;
+    int64_t error_sum = 0;
+    int32_t next_s = 0;
+    int64_t delay_sum = 0;
+    int32_t delay_max = 0;
+    int32_t seen_s = -1;
+    int32_t door_error = 0;
+    int door = 0;
+
+    sample_rate_init(&sr, &config);
+    for (int32_t t = 0; t < BENCH_SECONDS; t++) {
+        if (t == next_s) {
+            values[0] = s_temp[t];
+            values[1] = s_humid[t];
+            held = s_temp[t];
+            sample_rate_account(&sr, BENCH_BUS_US, BENCH_CPU_US);
+            next_s += sample_rate_update(&sr, values, 0x3, (int64_t)t * 1000) / 1000;
+            // First sample after a door opening
+            while (door < BENCH_DOORS && door_open_s[door] <= t) {
+                delay_sum += t - door_open_s[door];
+                if (t - door_open_s[door] > delay_max) {
+                    delay_max = t - door_open_s[door];
+                }
+                seen_s = t;
+                door++;
+            }
+        }
+        error_sum += abs(s_temp[t] - held);
+        // Following the transient once it is seen
+        if (seen_s >= 0 && t - seen_s < 600 && abs(s_temp[t] - held) > door_error) {
+            door_error = abs(s_temp[t] - held);
+        }
+        if (abs(s_temp[t] - held) > max_error) {
+            max_error = abs(s_temp[t] - held);
+        }
+    }
+
+    sample_rate_report(&sr, &adaptive, &fixed);
+    printf("%-9s %9u %9u %9u %9u %9.3f %9.2f %7.1f %7d %9.2f %9u\n", name, adaptive.samples, adaptive.bus_ms,
+           adaptive.cpu_ms, adaptive.energy_mj, (double)error_sum / BENCH_SECONDS / 100, max_error / 100.0,
+           (double)delay_sum / BENCH_DOORS, delay_max, door_error / 100.0, sr.speed_ups);
+}
+
+
+/*-----------------------------------------------------------*/
+int main(void)
+{
+    make_signal();
+    printf("%-9s %9s %9s %9s %9s %9s %9s %7s %7s %9s %9s\n", "variant", "samples/h", "bus ms/h", "cpu ms/h",
+           "mJ/h", "avg err C", "max err C", "door s", "max s", "door err", "speed-ups");
+    bench("fixed 1s", 1000, 1000);
+    bench("fixed 5s", 5000, 5000);
+    bench("fixed 15s", 15000, 15000);
+    bench("adaptive", 1000, 15000);
+
+    return 0;
+}
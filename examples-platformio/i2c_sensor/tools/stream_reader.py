@@ -0,0 +1,300 @@
+#!/usr/bin/env python3
+"""
+Decode the binary telemetry stream of i2c_sensor into CSV or Parquet.
+
+Usage:
+    python3 tools/stream_reader.py /dev/ttyUSB0 -b 2000000 -o bench
+    python3 tools/stream_reader.py capture.bin -o bench --parquet
+    python3 tools/stream_reader.py --loopback
+
+Records of every type go to their own file, e.g. "bench_sample.csv"
+and "bench_bus_stats.csv". Frames with a bad CRC and frames missing
+in the sequence are counted and reported on stderr. The "--loopback"
+mode sends generated frames (with deliberate gaps and garbage)
+through a pseudo-terminal pair and checks the decoder against them.
+
+Frame format is described in "include/serial_stream.h". Serial ports
+need pyserial; Parquet output needs pandas with pyarrow.
+
+Copyright (c) 2022 Tomas Fryza
+Dept. of Radio Electronics, Brno University of Technology, Czechia
+This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+"""
+
+import argparse
+import csv
+import os
+import random
+import struct
+import sys
+import threading
+import time
+
+HEADER = struct.Struct("<BBBH")     # type, record size, count, sequence
+
+# type: (name, record format, columns), must match serial_stream.h
+RECORD_TYPES = {
+    1: ("sample", struct.Struct("<IBxhHI"),
+        ["time_us", "sensor", "temp_x100", "humid_x100", "press_pa"]),
+    2: ("bus_stats", struct.Struct("<IBxHIHHHH"),
+        ["time_us", "addr", "clk_khz", "transactions", "nacks", "timeouts",
+         "checksum_errors", "step_downs"]),
+}
+
+
+def crc16(data):
+    """CRC-16/CCITT-FALSE"""
+    crc = 0xffff
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xffff
+    return crc
+
+
+def cobs_encode(data):
+    out = bytearray([0])
+    code_pos, code = 0, 1
+    for byte in data:
+        if byte == 0:
+            out[code_pos] = code
+            code_pos, code = len(out), 1
+            out.append(0)
+        else:
+            out.append(byte)
+            code += 1
+            if code == 0xff:
+                out[code_pos] = code
+                code_pos, code = len(out), 1
+                out.append(0)
+    out[code_pos] = code
+    return bytes(out) + b"\x00"
+
+
+def cobs_decode(data):
+    """Decode one frame without the delimiter, None if malformed"""
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data):
+            return None
+        out += data[i + 1:i + code]
+        i += code
+        if code < 0xff and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def encode_frame(rtype, seq, records):
+    _, fmt, _ = RECORD_TYPES[rtype]
+    body = b"".join(fmt.pack(*r) for r in records)
+    frame = HEADER.pack(rtype, fmt.size, len(records), seq & 0xffff) + body
+    return cobs_encode(frame + struct.pack("<H", crc16(frame)))
+
+
+class Decoder:
+    """Split bytes into frames, check them and pass records to "sink" """
+
+    def __init__(self, sink):
+        self.sink = sink
+        self.buf = bytearray()
+        self.synced = False
+        self.frames = 0
+        self.records = 0
+        self.bad = 0
+        self.dropped = 0
+        self.unknown = 0
+        self.last_seq = None
+
+    def feed(self, data):
+        self.buf += data
+        while True:
+            end = self.buf.find(0)
+            if end < 0:
+                return
+            chunk = bytes(self.buf[:end])
+            del self.buf[:end + 1]
+            # Anything before the first delimiter is a partial frame
+            if not self.synced:
+                self.synced = True
+                continue
+            if chunk:
+                self.frame(chunk)
+
+    def frame(self, chunk):
+        frame = cobs_decode(chunk)
+        if frame is None or len(frame) < HEADER.size + 2 or \
+                crc16(frame[:-2]) != struct.unpack("<H", frame[-2:])[0]:
+            self.bad += 1
+            return
+        rtype, size, count, seq = HEADER.unpack_from(frame)
+        if self.last_seq is not None:
+            self.dropped += (seq - self.last_seq - 1) & 0xffff
+        self.last_seq = seq
+        self.frames += 1
+
+        body = frame[HEADER.size:-2]
+        if rtype not in RECORD_TYPES or RECORD_TYPES[rtype][1].size != size or len(body) != size * count:
+            self.unknown += 1
+            return
+        name, fmt, _ = RECORD_TYPES[rtype]
+        for values in fmt.iter_unpack(body):
+            self.sink(name, values)
+        self.records += count
+
+    def summary(self):
+        return "%d frames, %d records, %d bad, %d dropped, %d unknown" % (
+            self.frames, self.records, self.bad, self.dropped, self.unknown)
+
+
+class TableSink:
+    """Collect records per type, write CSV or Parquet"""
+
+    def __init__(self, prefix, parquet):
+        self.prefix = prefix
+        self.parquet = parquet
+        self.rows = {}
+        self.writers = {}
+        self.files = []
+
+    def __call__(self, name, values):
+        if self.parquet:
+            self.rows.setdefault(name, []).append(values)
+            return
+        if name not in self.writers:
+            f = open("%s_%s.csv" % (self.prefix, name), "w", newline="")
+            self.files.append(f)
+            columns = next(c for n, _, c in RECORD_TYPES.values() if n == name)
+            self.writers[name] = csv.writer(f)
+            self.writers[name].writerow(columns)
+        self.writers[name].writerow(values)
+
+    def close(self):
+        for f in self.files:
+            f.close()
+        if self.parquet:
+            import pandas
+            for name, rows in self.rows.items():
+                columns = next(c for n, _, c in RECORD_TYPES.values() if n == name)
+                pandas.DataFrame(rows, columns=columns).to_parquet("%s_%s.parquet" % (self.prefix, name))
+
+
+def open_input(path, baud):
+    """Return a function reading available bytes, b"" at end of file"""
+    if os.path.isfile(path):
+        f = open(path, "rb")
+        return lambda: f.read(65536)
+    try:
+        import serial
+        port = serial.Serial(path, baud, timeout=0.1)
+        return lambda: port.read(max(1, port.in_waiting)) or None
+    except ImportError:
+        # Pseudo-terminals work without pyserial
+        import tty
+        fd = os.open(path, os.O_RDONLY | os.O_NOCTTY)
+        tty.setraw(fd)
+        return lambda: os.read(fd, 65536) or None
+
+
+def read_stream(path, baud, decoder, duration):
+    read = open_input(path, baud)
+    start = report = time.monotonic()
+    records = 0
+    while duration is None or time.monotonic() - start < duration:
+        data = read()
+        if data == b"":
+            break
+        if data:
+            decoder.feed(data)
+        now = time.monotonic()
+        if now - report >= 1.0:
+            print("%s, %.0f records/s" % (decoder.summary(), (decoder.records - records) / (now - report)),
+                  file=sys.stderr)
+            report, records = now, decoder.records
+
+
+def loopback(frames, drop_permille, seed=1):
+    """Send generated frames through a pty pair, check what comes out"""
+    import pty
+    import tty
+
+    rng = random.Random(seed)
+    master, slave = pty.openpty()
+    tty.setraw(slave)
+    tty.setraw(master)
+    expected = {"records": 0, "dropped": 0}
+    sent_frames = []
+
+    def writer():
+        # Boot messages before the stream
+        os.write(master, b"rst:0x1 (POWERON_RESET),boot:0x13\r\nI (29) boot: ESP-IDF\r\n\x00")
+        seq = 0
+        for _ in range(frames):
+            if rng.randrange(1000) < drop_permille:
+                seq += 1
+                expected["dropped"] += 1
+                continue
+            records = [(rng.getrandbits(32), rng.randrange(3), rng.randrange(-4000, 8000),
+                        rng.randrange(10000), rng.randrange(90000, 110000)) for _ in range(rng.randrange(1, 18))]
+            os.write(master, encode_frame(1, seq, records))
+            expected["records"] += len(records)
+            sent_frames.append(records)
+            seq += 1
+
+    thread = threading.Thread(target=writer)
+    thread.start()
+
+    decoded = []
+    decoder = Decoder(lambda name, values: decoded.append(values))
+    while thread.is_alive() or decoder.records < expected["records"]:
+        try:
+            os.set_blocking(slave, False)
+            data = os.read(slave, 65536)
+        except BlockingIOError:
+            if not thread.is_alive() and decoder.records >= expected["records"]:
+                break
+            time.sleep(0.001)
+            continue
+        decoder.feed(data)
+    thread.join()
+    os.close(master)
+    os.close(slave)
+
+    sent = [r for frame in sent_frames for r in frame]
+    ok = decoded == sent and decoder.dropped == expected["dropped"] and decoder.bad == 0
+    print("loopback: %s; expected %d records, %d dropped: %s" % (
+        decoder.summary(), expected["records"], expected["dropped"], "OK" if ok else "MISMATCH"), file=sys.stderr)
+    return ok
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("input", nargs="?", help="serial port, pty or captured file")
+    parser.add_argument("-b", "--baud", type=int, default=2000000)
+    parser.add_argument("-o", "--output", default="stream", help="output file prefix")
+    parser.add_argument("-t", "--time", type=float, help="stop after seconds")
+    parser.add_argument("--parquet", action="store_true", help="write Parquet instead of CSV")
+    parser.add_argument("--loopback", action="store_true", help="self-check over a pty pair")
+    parser.add_argument("--frames", type=int, default=2000, help="frames sent in loopback")
+    args = parser.parse_args()
+
+    if args.loopback:
+        sys.exit(0 if loopback(args.frames, 20) else 1)
+    if not args.input:
+        parser.error("input is required")
+
+    sink = TableSink(args.output, args.parquet)
+    decoder = Decoder(sink)
+    try:
+        read_stream(args.input, args.baud, decoder, args.time)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        sink.close()
+    print(decoder.summary(), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,586 @@
+#!/usr/bin/env python3
+"""
+Size and performance regression suite of all PlatformIO examples.
+
+Usage:
+    python3 tools/perf_suite.py
+    python3 tools/perf_suite.py --projects wifi_thingspeak,i2c_sensor --boards firebeetle32
+    python3 tools/perf_suite.py --host-only --update-baseline
+    python3 tools/perf_suite.py --log wifi_thingspeak:firebeetle32=monitor.txt
+    python3 tools/perf_suite.py --selftest
+
+Device target: every example is built for every board configuration
+("sdkconfig.esp32cam", "sdkconfig.firebeetle32") with PlatformIO in a
+copy of the project, so the working tree is not touched. A project
+without its own configuration for a board is built with the one it
+ships; the report says which file was used. From the ELF file come
+flash code and read-only data, static DRAM (data and bss), IRAM and
+RTC memory; from the linker map the DRAM and IRAM left free and the
+size of every library per memory region. Boot time is read from
+monitor logs given by "--log" (time stamp of "Starting scheduler").
+
+Host target: every "tools/*.c" benchmark is compiled with the command
+in its comment and run, and every number of its result table becomes
+a metric; every "tools/*.py" with "--selftest" or "--loopback" is run
+as a check. Options of the board configurations that change RAM or
+timing (stack sizes, buffers, CPU and tick frequency, optimization,
+log level, partitions) and a digest of each whole file are recorded
+too, so configuration drift shows up even with no build.
+
+The report is JSON with one flat, sorted metric per line, so two
+reports diff well in git. It is compared with "tools/perf_baseline.json":
+growth of a size or a worse deterministic result (heap calls, ratio,
+failed check) is a regression and the exit code is 1; run times
+(ns/request, MB/s, boot) differ between machines and only warn when
+they are 25 % worse, unless "--strict-timing" is given. The suite
+needs Python 3.7+, a C compiler and zlib for the host part and
+PlatformIO ("pio") for the device part.
+
+Copyright (c) 2022 Tomas Fryza
+Dept. of Radio Electronics, Brno University of Technology, Czechia
+This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+"""
+
+import argparse
+import configparser
+import contextlib
+import glob
+import hashlib
+import io
+import json
+import os
+import re
+import shlex
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+BASELINE = os.path.join(ROOT, "tools", "perf_baseline.json")
+
+# Configuration name (file suffix and env) and PlatformIO board
+BOARDS = {
+    "esp32cam": "esp32cam",
+    "firebeetle32": "firebeetle32",
+}
+
+# ELF sections by memory region of ESP32 with ESP-IDF v4.4
+REGIONS = [
+    ("dram_data", (".dram0.data",)),
+    ("dram_bss", (".dram0.bss", ".noinit")),
+    ("iram", (".iram0",)),
+    ("flash_code", (".flash.text",)),
+    ("flash_rodata", (".flash.rodata", ".flash.appdesc")),
+    ("rtc", (".rtc",)),
+    ("psram", (".ext_ram",)),
+]
+
+# Linker memory segments to the regions they hold
+SEGMENTS = {
+    "dram0_0_seg": ("dram_data", "dram_bss"),
+    "iram0_0_seg": ("iram",),
+}
+
+# Options worth following, the rest is covered by the digest
+CONFIG_OPTIONS = re.compile(r"^CONFIG_\w*(STACK_SIZE|BUFFER_NUM|SPIRAM_SUPPORT|DEFAULT_CPU_FREQ_MHZ|FREERTOS_HZ|"
+                            r"COMPILER_OPTIMIZATION_|LOG_DEFAULT_LEVEL|PARTITION_TABLE_FILENAME|"
+                            r"ESPTOOLPY_FLASHSIZE|IN_IRAM)\w*=")
+
+NUMBER = re.compile(r"^-?\d+(\.\d+)?$")
+# Run times, they depend on the machine
+TIMING = re.compile(r"ns/|MB/s|wall_ms$|boot_ms$")
+# Results where more is better, less is better for all others
+HIGHER_BETTER = re.compile(r"ratio|MB/s|/passed$|_free$")
+TIMING_TOLERANCE = 0.25
+
+
+def log(text):
+    print(text, file=sys.stderr)
+
+
+# ---------------------------------------------------------------- ELF and map
+
+def elf_sections(path):
+    """Sizes of allocated sections as {name: size}"""
+    with open(path, "rb") as f:
+        data = f.read()
+    if data[:4] != b"\x7fELF":
+        raise ValueError("%s is not an ELF file" % path)
+    bits64 = data[4] == 2
+    endian = "<" if data[5] == 1 else ">"
+    if bits64:
+        shoff, = struct.unpack_from(endian + "Q", data, 0x28)
+        shentsize, shnum, shstrndx = struct.unpack_from(endian + "HHH", data, 0x3a)
+        header = struct.Struct(endian + "IIQQQQIIQQ")
+    else:
+        shoff, = struct.unpack_from(endian + "I", data, 0x20)
+        shentsize, shnum, shstrndx = struct.unpack_from(endian + "HHH", data, 0x2e)
+        header = struct.Struct(endian + "IIIIIIIIII")
+
+    headers = [header.unpack_from(data, shoff + i * shentsize) for i in range(shnum)]
+    strtab = headers[shstrndx][4]
+    sections = {}
+    for name, _, flags, _, _, size, *_ in headers:
+        if flags & 0x2:         # SHF_ALLOC
+            end = data.index(b"\0", strtab + name)
+            sections[data[strtab + name:end].decode()] = size
+    return sections
+
+
+def region_of(section):
+    for region, prefixes in REGIONS:
+        if section.startswith(prefixes):
+            return region
+    return None
+
+
+def region_sizes(sections):
+    sizes = {region: 0 for region, _ in REGIONS}
+    for name, size in sections.items():
+        region = region_of(name)
+        if region is not None:
+            sizes[region] += size
+    return sizes
+
+
+def parse_map(text):
+    """Memory segment lengths and library sizes per region of a GNU ld map"""
+    segments = {}
+    libraries = {}
+    in_memory = False
+    output = None
+    pending = None
+    for line in text.splitlines():
+        if line.startswith("Memory Configuration"):
+            in_memory = True
+            continue
+        if in_memory:
+            if line.startswith("Linker script and memory map"):
+                in_memory = False
+            m = re.match(r"^(\w+)\s+0x[0-9a-fA-F]+\s+0x([0-9a-fA-F]+)", line)
+            if m:
+                segments[m.group(1)] = int(m.group(2), 16)
+            continue
+
+        m = re.match(r"^(\.\S+)(\s+0x[0-9a-fA-F]+\s+0x[0-9a-fA-F]+)?\s*$", line)
+        if m:
+            output = region_of(m.group(1))
+            continue
+        # Input section, its address and size may be on the next line
+        m = re.match(r"^ (\.\S+|COMMON)\s*$", line)
+        if m:
+            pending = m.group(1)
+            continue
+        m = re.match(r"^ (\.\S+|COMMON)?\s+0x[0-9a-fA-F]+\s+0x([0-9a-fA-F]+)\s+(\S.*)$", line)
+        if m and output is not None and (m.group(1) or pending):
+            source = m.group(3).strip()
+            library = os.path.basename(source.split("(")[0]) if "(" in source else os.path.basename(source)
+            per_region = libraries.setdefault(output, {})
+            per_region[library] = per_region.get(library, 0) + int(m.group(2), 16)
+        pending = None
+    return segments, libraries
+
+
+def read_config(path):
+    """Followed options and digest of a sdkconfig file"""
+    options = {}
+    digest = hashlib.sha1()
+    with open(path) as f:
+        for line in f:
+            if line.startswith("#") or not line.strip():
+                continue
+            digest.update(line.strip().encode() + b"\n")
+            if CONFIG_OPTIONS.match(line):
+                name, value = line.strip().split("=", 1)
+                options[name] = value
+    return {"options": options, "digest": digest.hexdigest()[:12]}
+
+
+# ---------------------------------------------------------------- Device builds
+
+def board_config(project, board):
+    """Configuration file used for a board, own or borrowed"""
+    own = os.path.join(ROOT, project, "sdkconfig." + board)
+    if os.path.exists(own):
+        return own
+    shipped = sorted(glob.glob(os.path.join(ROOT, project, "sdkconfig.*")))
+    return shipped[0] if shipped else None
+
+
+def write_project_ini(project, board, dst):
+    ini = configparser.ConfigParser(inline_comment_prefixes=("#", ";"), interpolation=None)
+    ini.read(os.path.join(ROOT, project, "platformio.ini"))
+    envs = [s for s in ini.sections() if s.startswith("env:")]
+    env = ini["env:" + board] if "env:" + board in envs else ini[envs[0]]
+    options = dict(env)
+    options["board"] = BOARDS[board]
+    with open(os.path.join(dst, "platformio.ini"), "w") as f:
+        f.write("; Generated by tools/perf_suite.py\n[env:%s]\n" % board)
+        for key, value in options.items():
+            f.write("%s = %s\n" % (key, value))
+
+
+def build_device(project, board, work, pio):
+    """Build in a copy, the build directory is kept for the next run"""
+    src = os.path.join(ROOT, project)
+    dst = os.path.join(work, "%s-%s" % (project, board))
+    os.makedirs(dst, exist_ok=True)
+    for name in os.listdir(src):
+        if name == ".pio" or name.startswith("sdkconfig") or name == "platformio.ini":
+            continue
+        path = os.path.join(dst, name)
+        if os.path.isdir(path):
+            shutil.rmtree(path)
+        if os.path.isdir(os.path.join(src, name)):
+            shutil.copytree(os.path.join(src, name), path)
+        else:
+            shutil.copy2(os.path.join(src, name), path)
+    shutil.copy2(board_config(project, board), os.path.join(dst, "sdkconfig." + board))
+    write_project_ini(project, board, dst)
+
+    start = time.monotonic()
+    result = subprocess.run([pio, "run", "-d", dst, "-e", board], stdout=subprocess.PIPE,
+                            stderr=subprocess.STDOUT, universal_newlines=True)
+    if result.returncode != 0:
+        log(result.stdout[-3000:])
+        raise RuntimeError("build of %s for %s failed" % (project, board))
+    return os.path.join(dst, ".pio", "build", board), time.monotonic() - start
+
+
+def device_metrics(build_dir):
+    metrics = {}
+    sizes = region_sizes(elf_sections(os.path.join(build_dir, "firmware.elf")))
+    for region, size in sizes.items():
+        metrics[region] = size
+    metrics["dram_static"] = sizes["dram_data"] + sizes["dram_bss"]
+    image = os.path.join(build_dir, "firmware.bin")
+    if os.path.exists(image):
+        metrics["image"] = os.path.getsize(image)
+
+    libraries = {}
+    maps = glob.glob(os.path.join(build_dir, "*.map"))
+    if maps:
+        with open(maps[0], errors="replace") as f:
+            segments, libraries = parse_map(f.read())
+        for segment, regions in SEGMENTS.items():
+            if segment in segments:
+                metrics[segment.split("0")[0] + "_free"] = segments[segment] - sum(sizes[r] for r in regions)
+    return metrics, libraries
+
+
+def boot_ms(path):
+    with open(path, errors="replace") as f:
+        for line in f:
+            m = re.search(r"\((\d+)\) cpu_start: Starting scheduler", line)
+            if m:
+                return int(m.group(1))
+    return None
+
+
+# ---------------------------------------------------------------- Host target
+
+def parse_tables(text):
+    """Rows of right-aligned result tables as {"row/column": value}"""
+    metrics = {}
+    header = None
+    for line in text.splitlines():
+        tokens = [(m.group(), m.end()) for m in re.finditer(r"\S+", line)]
+        if not tokens:
+            header = None
+            continue
+        if not any(NUMBER.match(t) for t, _ in tokens):
+            header = line
+            continue
+        if header is None:
+            continue
+        # Numbers at the right, each ends where its column name ends,
+        # the first column names the rows
+        ends = {m.end() for m in re.finditer(r"\S+", header)}
+        columns = []
+        while tokens and NUMBER.match(tokens[-1][0]) and tokens[-1][1] in ends and tokens[-1][1] > min(ends):
+            columns.insert(0, tokens.pop())
+        if not columns or not tokens:
+            continue
+        row = " ".join(t for t, _ in tokens)
+        previous = None
+        for value, end in columns:
+            if previous is None:
+                name = re.split(r"\s{2,}", header[:end].strip())[-1]
+            else:
+                name = header[previous:end].strip()
+            previous = end
+            metrics["%s/%s" % (row, name)] = float(value) if "." in value else int(value)
+    return metrics
+
+
+def build_command(source):
+    """Build line from the comment of a host benchmark"""
+    with open(source) as f:
+        for line in f:
+            if line.strip().startswith("cc "):
+                return shlex.split(line.strip())
+            if line.startswith(" */"):
+                break
+    return None
+
+
+def run_host(project, work, metrics):
+    for source in sorted(glob.glob(os.path.join(ROOT, project, "tools", "*.c"))):
+        name = os.path.splitext(os.path.basename(source))[0]
+        command = build_command(source)
+        if command is None:
+            log("%s: no build line, skipped" % source)
+            continue
+        binary = os.path.join(work, "%s-%s" % (project, name))
+        command[command.index("-o") + 1] = binary
+        subprocess.run(command, cwd=os.path.join(ROOT, project), check=True)
+        start = time.monotonic()
+        result = subprocess.run([binary], cwd=os.path.join(ROOT, project), stdout=subprocess.PIPE,
+                                universal_newlines=True, check=True)
+        metrics["host/%s/%s/wall_ms" % (project, name)] = int((time.monotonic() - start) * 1000)
+        for key, value in parse_tables(result.stdout).items():
+            metrics["host/%s/%s/%s" % (project, name, key)] = value
+        log("host %s/%s: done" % (project, name))
+
+    for script in sorted(glob.glob(os.path.join(ROOT, project, "tools", "*.py"))):
+        with open(script) as f:
+            text = f.read()
+        mode = "--selftest" if '"--selftest"' in text else "--loopback" if '"--loopback"' in text else None
+        if mode is None:
+            continue
+        name = os.path.splitext(os.path.basename(script))[0]
+        start = time.monotonic()
+        result = subprocess.run([sys.executable, script, mode], cwd=os.path.join(ROOT, project),
+                                stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, universal_newlines=True)
+        passed = result.returncode == 0
+        metrics["check/%s/%s/passed" % (project, name)] = int(passed)
+        metrics["check/%s/%s/wall_ms" % (project, name)] = int((time.monotonic() - start) * 1000)
+        log("check %s/%s: %s" % (project, name, "passed" if passed else "FAILED"))
+        if not passed:
+            log(result.stderr[-2000:])
+
+
+# ---------------------------------------------------------------- Comparison
+
+def compare(report, baseline, size_slack, strict_timing):
+    """Print differences, return the number of regressions"""
+    regressions = 0
+    old = baseline.get("metrics", {})
+    new = report.get("metrics", {})
+    for key in sorted(set(old) | set(new)):
+        if key not in new:
+            print("  gone      %s" % key)
+            continue
+        if key not in old:
+            print("  new       %s = %s" % (key, new[key]))
+            continue
+        if new[key] == old[key]:
+            continue
+        worse = (new[key] < old[key]) if HIGHER_BETTER.search(key) else (new[key] > old[key])
+        change = "%+.1f %%" % ((new[key] - old[key]) * 100.0 / old[key]) if old[key] else "from 0"
+        if TIMING.search(key):
+            # Run to run noise is not shown
+            if abs(new[key] - old[key]) <= abs(old[key]) * TIMING_TOLERANCE:
+                continue
+            status = "SLOWER" if worse else "faster"
+            regressions += worse and strict_timing
+        elif key.startswith("device/") and not HIGHER_BETTER.search(key):
+            status = "GREW" if new[key] > old[key] + size_slack else "size"
+            regressions += status == "GREW"
+        else:
+            status = "WORSE" if worse else "better"
+            regressions += worse
+        print("  %-9s %s: %s -> %s (%s)" % (status, key, old[key], new[key], change))
+
+    # Configuration drift
+    for target, config in sorted(report.get("configs", {}).items()):
+        before = baseline.get("configs", {}).get(target)
+        if before is None or before["digest"] == config["digest"]:
+            continue
+        print("  config    %s: %s changed" % (target, config["file"]))
+        for option in sorted(set(before["options"]) | set(config["options"])):
+            a = before["options"].get(option)
+            b = config["options"].get(option)
+            if a != b:
+                print("              %s: %s -> %s" % (option, a, b))
+
+    # Libraries behind changed device sizes
+    for target, regions in sorted(report.get("size_maps", {}).items()):
+        before = baseline.get("size_maps", {}).get(target, {})
+        for region, libraries in sorted(regions.items()):
+            for library, size in sorted(libraries.items()):
+                delta = size - before.get(region, {}).get(library, 0)
+                if before and abs(delta) >= 64:
+                    print("              %s %s %s: %+d bytes" % (target, region, library, delta))
+    return regressions
+
+
+# ---------------------------------------------------------------- Self test
+
+def selftest():
+    ok = True
+
+    # Minimal ELF32 with ESP32 sections
+    names = [b"", b".shstrtab", b".flash.text", b".dram0.data", b".dram0.bss", b".iram0.text", b".debug_info"]
+    sizes = [0, 0, 1000, 200, 300, 400, 5000]
+    flags = [0, 0, 0x6, 0x3, 0x3, 0x6, 0]
+    strtab = b"\0".join(names) + b"\0"
+    offsets = [strtab.index(b"\0" + n + b"\0") + 1 if n else 0 for n in names]
+    shoff = 52 + len(strtab)
+    elf = bytearray(b"\x7fELF\x01\x01\x01" + bytes(9))
+    elf += struct.pack("<HHIIIIIHHHHHH", 2, 94, 1, 0, 0, shoff, 0, 52, 0, 0, 40, len(names), 1)
+    elf += strtab
+    for i in range(len(names)):
+        elf += struct.pack("<IIIIIIIIII", offsets[i], 3 if i == 1 else 1, flags[i], 0,
+                           52 if i == 1 else 0, len(strtab) if i == 1 else sizes[i], 0, 0, 1, 0)
+    path = os.path.join(tempfile.mkdtemp(), "firmware.elf")
+    with open(path, "wb") as f:
+        f.write(elf)
+    sizes = region_sizes(elf_sections(path))
+    ok &= sizes["flash_code"] == 1000 and sizes["dram_data"] == 200 and sizes["dram_bss"] == 300
+    ok &= sizes["iram"] == 400
+    shutil.rmtree(os.path.dirname(path))
+
+    segments, libraries = parse_map("\n".join([
+        "Memory Configuration", "",
+        "Name             Origin             Length             Attributes",
+        "dram0_0_seg      0x3ffb0000         0x0002c200         rw",
+        "", "Linker script and memory map", "",
+        ".dram0.bss      0x3ffb1000      0x150",
+        " .bss.s_stats   0x3ffb1000       0x50 esp-idf/main/libmain.a(status_server.c.obj)",
+        " .bss.s_long_name_of_a_buffer",
+        "                0x3ffb1050      0x100 esp-idf/lwip/liblwip.a(tcp.c.obj)",
+        ".flash.text     0x400d0020      0x40",
+        " *(.literal .text)",
+        " .text.app_main 0x400d0020       0x40 esp-idf/main/libmain.a(main.c.obj)",
+    ]))
+    ok &= segments.get("dram0_0_seg") == 0x2c200
+    ok &= libraries == {"dram_bss": {"libmain.a": 0x50, "liblwip.a": 0x100}, "flash_code": {"libmain.a": 0x40}}
+
+    tables = parse_tables("\n".join([
+        "setup line with 2 numbers 3", "",
+        "variant   heap/req  arena/req   ns/request  heap peak",
+        "before        82.0        0.0        971.8       2913",
+        "zlib -1       36.0        1.0        386.9       1888",
+        "mJ/h avg err C",
+        "  47      0.023",
+    ]))
+    ok &= tables == {"before/heap/req": 82.0, "before/arena/req": 0.0, "before/ns/request": 971.8,
+                     "before/heap peak": 2913, "zlib -1/heap/req": 36.0, "zlib -1/arena/req": 1.0,
+                     "zlib -1/ns/request": 386.9, "zlib -1/heap peak": 1888}
+
+    ok &= all(TIMING.search("host/a/x/r/ns/" + unit) for unit in ("request", "payload", "sample", "float", "edge"))
+    ok &= not TIMING.search("host/a/x/r/heap/req")
+
+    old = {"metrics": {"device/a/b/dram_static": 100, "host/a/x/r/ns/request": 10.0,
+                       "host/a/x/r/ratio": 2.0, "check/a/t/passed": 1}}
+    new = {"metrics": {"device/a/b/dram_static": 90, "host/a/x/r/ns/request": 20.0,
+                       "host/a/x/r/ratio": 2.0, "check/a/t/passed": 1}}
+    with contextlib.redirect_stdout(io.StringIO()):
+        ok &= compare(new, old, 0, False) == 0 and compare(new, old, 0, True) == 1
+        new["metrics"]["device/a/b/dram_static"] = 120
+        new["metrics"]["check/a/t/passed"] = 0
+        ok &= compare(new, old, 0, False) == 2 and compare(new, old, 32, False) == 1
+
+    print("selftest: %s" % ("OK" if ok else "FAIL"), file=sys.stderr)
+    return ok
+
+
+# ---------------------------------------------------------------- Main
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("--projects", help="comma separated, all examples by default")
+    parser.add_argument("--boards", default=",".join(BOARDS), help="comma separated configurations")
+    parser.add_argument("--host-only", action="store_true", help="skip the device builds")
+    parser.add_argument("--no-host", action="store_true", help="skip the host benchmarks and checks")
+    parser.add_argument("--log", action="append", default=[], metavar="PROJECT:BOARD=FILE",
+                        help="serial monitor log of a board for boot time")
+    parser.add_argument("-o", "--output", help="report file, \"perf_report.json\" in the work directory by default")
+    parser.add_argument("--baseline", default=BASELINE, help="report to compare with")
+    parser.add_argument("--update-baseline", action="store_true", help="store the report as baseline")
+    parser.add_argument("--size-slack", type=int, default=0, help="bytes a size may grow")
+    parser.add_argument("--strict-timing", action="store_true", help="slower run times are regressions")
+    parser.add_argument("--work-dir", default=os.path.join(tempfile.gettempdir(), "esp-idf-perf"),
+                        help="project copies and host binaries")
+    parser.add_argument("--selftest", action="store_true", help="check parsers and comparison")
+    args = parser.parse_args()
+
+    if args.selftest:
+        sys.exit(0 if selftest() else 1)
+
+    projects = args.projects.split(",") if args.projects else sorted(
+        p for p in os.listdir(ROOT) if os.path.exists(os.path.join(ROOT, p, "platformio.ini")))
+    boards = args.boards.split(",")
+    for board in boards:
+        if board not in BOARDS:
+            parser.error("unknown board configuration %s" % board)
+    os.makedirs(args.work_dir, exist_ok=True)
+    if args.output is None:
+        args.output = os.path.join(args.work_dir, "perf_report.json")
+    report = {"metrics": {}, "configs": {}, "size_maps": {}}
+    metrics = report["metrics"]
+
+    for project in projects:
+        for board in boards:
+            config = board_config(project, board)
+            if config is None:
+                continue
+            target = "%s/%s" % (project, board)
+            report["configs"][target] = dict(file=os.path.basename(config), **read_config(config))
+
+    if not args.host_only:
+        pio = shutil.which("pio") or shutil.which("platformio")
+        if pio is None:
+            parser.error("PlatformIO not found, install it or use --host-only")
+        for project in projects:
+            for board in boards:
+                if board_config(project, board) is None:
+                    continue
+                build_dir, seconds = build_device(project, board, args.work_dir, pio)
+                values, libraries = device_metrics(build_dir)
+                for key, value in values.items():
+                    metrics["device/%s/%s/%s" % (project, board, key)] = value
+                report["size_maps"]["%s/%s" % (project, board)] = libraries
+                log("device %s/%s: %d B static DRAM, %d B image (%.0f s)" % (
+                    project, board, values["dram_static"], values.get("image", 0), seconds))
+    for item in args.log:
+        target, path = item.split("=", 1)
+        value = boot_ms(path)
+        if value is None:
+            log("%s: no boot time found" % path)
+        else:
+            metrics["device/%s/boot_ms" % target.replace(":", "/")] = value
+
+    if not args.no_host:
+        for project in projects:
+            run_host(project, args.work_dir, metrics)
+
+    with open(args.output, "w") as f:
+        json.dump(report, f, indent=1, sort_keys=True)
+        f.write("\n")
+    log("report written to %s" % args.output)
+
+    regressions = 0
+    if args.update_baseline:
+        shutil.copyfile(args.output, args.baseline)
+        log("baseline updated")
+    elif os.path.exists(args.baseline):
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+        # Only the parts measured in this run
+        kinds = (() if args.host_only else ("device",)) + (() if args.no_host else ("host", "check"))
+        baseline["metrics"] = {k: v for k, v in baseline.get("metrics", {}).items()
+                               if k.split("/")[0] in kinds and k.split("/")[1] in projects and
+                               (k.split("/")[0] != "device" or k.split("/")[2] in boards)}
+        print("Compared with %s:" % os.path.relpath(args.baseline))
+        regressions = compare(report, baseline, args.size_slack, args.strict_timing)
+        print("%d regression(s)" % regressions)
+    sys.exit(1 if regressions else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,59 @@
+/*
+  Request-scoped arena allocator.
+
+  Objects needed only during one request (body staging buffers, built
+  URLs, response text) are cut from a preallocated region by moving
+  one offset, and the whole region is released by arena_reset() in
+  O(1) when the request finishes, so they do not fragment the heap.
+  A request that does not fit gets the rest from the heap; these
+  blocks are chained and freed by the reset as well. High-water mark
+  and heap fallbacks tell how large the region should be.
+
+  An arena is not locked, every task uses its own one.
+
+  Every example builds on its own, so "wifi_get_requests" and
+  "wifi_thingspeak" have a copy of this module each; keep the code of
+  both copies the same.
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+ */
+
+#ifndef ARENA
+#define ARENA
+
+
+/*-----------------------------------------------------------*/
+#include <stddef.h>
+#include <stdint.h>
+
+
+/*-----------------------------------------------------------*/
+#define ARENA_ALIGN 8           // Alignment of every block
+
+
+/*-----------------------------------------------------------*/
+typedef struct {
+    uint8_t *base;
+    size_t size;
+    size_t used;
+    void *heap_blocks;          // Fallback blocks, freed on reset
+    size_t heap_used;
+    // Statistics
+    size_t high_water;          // Most bytes used by one request, heap included
+    uint32_t allocs;
+    uint32_t heap_allocs;       // Blocks that did not fit into the region
+    uint32_t resets;
+} arena_t;
+
+
+/*-----------------------------------------------------------*/
+// Used function(s)
+void arena_init(arena_t *arena, void *buffer, size_t size);
+void *arena_alloc(arena_t *arena, size_t size);
+void *arena_calloc(arena_t *arena, size_t count, size_t size);
+char *arena_strdup(arena_t *arena, const char *str);
+void arena_reset(arena_t *arena);
+
+#endif
@@ -0,0 +1,86 @@
+/*
+  Conditional GET cache for periodic HTTP polling.
+
+  Stores ETag and Last-Modified validators per URL in RAM (and
+  optionally in NVS), sends If-None-Match/If-Modified-Since headers
+  and returns the cached (parsed) result when the server answers
+  with "304 Not Modified".
+
+  One HTTP client is kept open between fetches (keep-alive), only its
+  URL, method, timeout and validator headers change, and the body is
+  staged in the arena set by http_cache_set_arena() if any, so a
+  fetch does not allocate and free the client and its buffers every
+  time. A config with other credentials, certificates or buffers than
+  the first one is refused.
+
+  The response holds copies of the body and the parsed result, so it
+  stays valid while other tasks fetch. The body lives in the staging
+  buffer: until the arena is reset, or until http_cache_release()
+  with no arena.
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+ */
+
+#ifndef HTTP_CACHE
+#define HTTP_CACHE
+
+
+/*-----------------------------------------------------------*/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include <esp_http_client.h>
+#include <arena.h>              // Request-scoped allocations
+
+
+/*-----------------------------------------------------------*/
+#define HTTP_CACHE_MAX_ENTRIES   4      // Number of cached URLs
+#define HTTP_CACHE_MAX_URL       128    // Longest cacheable URL
+#define HTTP_CACHE_MAX_ETAG      64     // Longest stored ETag
+#define HTTP_CACHE_MAX_DATE      40     // Longest stored Last-Modified
+#define HTTP_CACHE_MAX_BODY      1024   // Longest cacheable response body
+#define HTTP_CACHE_MAX_RESULT    128    // Size of parsed result per entry
+
+
+/*-----------------------------------------------------------*/
+/* Optional parser called once for every new (200 OK) body. The
+   parsed result is kept in the cache and handed to callers on
+   "304 Not Modified" without parsing the body again. */
+typedef esp_err_t (*http_cache_parse_t)(const char *body, size_t body_len,
+                                        void *result, size_t result_size);
+
+// Cache counters
+typedef struct {
+    uint32_t hits;          // 304 responses served from cache
+    uint32_t misses;        // Full (200 OK) downloads
+    uint32_t errors;        // Failed requests
+    uint32_t bytes_saved;   // Body bytes not downloaded thanks to 304
+} http_cache_stats_t;
+
+// Result of one cached fetch, copied out of the cache
+typedef struct {
+    char *body;             // Zero terminated, see http_cache_release()
+    size_t body_len;
+    bool has_result;        // false without parser or if it failed
+    uint8_t result[HTTP_CACHE_MAX_RESULT];
+    bool from_cache;        // true if server answered 304
+    int status;             // HTTP status code
+    bool body_on_heap;      // Staged by malloc(), not in the arena
+} http_cache_response_t;
+
+
+/*-----------------------------------------------------------*/
+// Used function(s)
+void http_cache_init(bool use_nvs);
+void http_cache_set_arena(arena_t *arena);
+esp_err_t http_cache_fetch(const esp_http_client_config_t *config,
+                           http_cache_parse_t parse,
+                           http_cache_response_t *response);
+void http_cache_release(http_cache_response_t *response);
+void http_cache_get_stats(http_cache_stats_t *stats);
+void http_cache_clear(void);
+
+#endif
@@ -0,0 +1,75 @@
+/*
+  Bounded worker pool for concurrent HTTP requests.
+
+  A fixed number of worker tasks, each owning a persistent
+  esp_http_client, serve a shared submission queue. Requests have
+  a priority and an optional deadline, the number of concurrent
+  requests per host is limited and a callback is called when a
+  request completes.
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+ */
+
+#ifndef HTTP_POOL
+#define HTTP_POOL
+
+
+/*-----------------------------------------------------------*/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+
+
+/*-----------------------------------------------------------*/
+#define HTTP_POOL_MAX_WORKERS   4       // Worker tasks (and HTTP clients)
+#define HTTP_POOL_QUEUE_LEN     16      // Pending requests
+#define HTTP_POOL_MAX_HOSTS     8       // Hosts tracked for connection limits
+#define HTTP_POOL_MAX_URL       128
+#define HTTP_POOL_MAX_BODY      1024    // Body bytes kept per worker
+#define HTTP_POOL_STACK_SIZE    4096
+
+// Request priorities, higher value is served first
+#define HTTP_POOL_PRIO_LOW      0
+#define HTTP_POOL_PRIO_NORMAL   1
+#define HTTP_POOL_PRIO_HIGH     2
+
+
+/*-----------------------------------------------------------*/
+// Outcome of one request, passed to the completion callback
+typedef struct {
+    const char *url;
+    esp_err_t err;          // ESP_ERR_TIMEOUT if deadline passed in queue
+    int status;             // HTTP status code
+    const char *body;       // Valid only during the callback
+    size_t body_len;
+    bool truncated;         // Body longer than HTTP_POOL_MAX_BODY
+    int64_t wait_us;        // Time spent in the queue
+    int64_t latency_us;     // Time from submit to completion
+    uint8_t worker;
+} http_pool_result_t;
+
+typedef void (*http_pool_done_cb_t)(const http_pool_result_t *result, void *arg);
+
+// Pool counters
+typedef struct {
+    uint32_t submitted;
+    uint32_t completed;
+    uint32_t failed;
+    uint32_t expired;       // Dropped because of passed deadline
+    uint32_t rejected;      // Queue was full
+    uint8_t queued;         // Currently waiting
+} http_pool_stats_t;
+
+
+/*-----------------------------------------------------------*/
+// Used function(s)
+esp_err_t http_pool_init(uint8_t workers, uint8_t per_host_limit);
+esp_err_t http_pool_submit(const char *url, uint8_t priority, uint32_t deadline_ms,
+                           http_pool_done_cb_t done, void *arg);
+void http_pool_set_workers(uint8_t workers);
+void http_pool_get_stats(http_pool_stats_t *stats);
+
+#endif
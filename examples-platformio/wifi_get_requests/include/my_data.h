@@ -5,4 +5,15 @@
 #define WIFI_PASS "REPLACE_WITH_YOUR_WIFI_PASSWORD"
 #define WIFI_MAXIMUM_RETRY  5
 
+// Compare 1..N concurrent workers on the endpoints of "src/main.c"
+// (1), it sends 48 requests to the server of "HTTP_POOL_BASE_URL"
+#define HTTP_POOL_ENABLE 0
+
+// Download a new firmware from "tools/ota_standin.py" (1) and boot it
+#define OTA_ENABLE 0
+#define OTA_URL "http://192.168.1.10:8070/firmware.bin"
+// SHA-256 printed by the stand-in, NULL skips the check
+#define OTA_SHA256 NULL
+#define OTA_MAX_ATTEMPTS 10
+
 #endif
@@ -0,0 +1,72 @@
+/*
+  Streaming firmware download into the OTA partition.
+
+  The image is read from an HTTP server in small chunks, each chunk is
+  written straight to the inactive app partition (sectors are erased
+  just ahead of the writes) and added to a SHA-256 hash, so the image
+  is never held in RAM. When the connection breaks, the download goes
+  on from the last written byte with a "Range" request; "If-Range"
+  with the ETag of the image makes the server send the whole image if
+  it changed meanwhile. Progress is stored in NVS every 64 kB, so a
+  download interrupted by reset is resumed as well.
+
+  At the end the hash is compared with the expected one and the image
+  is checked and marked for the next boot by esp_ota_set_boot_partition().
+  Script "tools/ota_standin.py" serves an image file for tests and can
+  cut connections or limit the rate.
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+ */
+
+#ifndef OTA_STREAM
+#define OTA_STREAM
+
+
+/*-----------------------------------------------------------*/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+
+
+/*-----------------------------------------------------------*/
+#define OTA_STREAM_CHUNK         1024   // Bytes read and written at once
+#define OTA_STREAM_MAX_URL       128
+#define OTA_STREAM_MAX_ETAG      64
+#define OTA_STREAM_SAVE_BYTES    65536  // Progress stored in NVS, sector multiple
+#define OTA_STREAM_STALL_US      20000  // Longer flash write is a stall
+#define OTA_STREAM_TIMEOUT_MS    10000  // No data on the connection
+#define OTA_STREAM_RETRY_MS      5000   // Between connection attempts
+
+
+/*-----------------------------------------------------------*/
+typedef struct {
+    const char *url;
+    const char *sha256;         // Expected hash as 64 hex digits, NULL to skip
+    uint8_t max_attempts;       // Consecutive attempts with no new data
+} ota_stream_config_t;
+
+typedef struct {
+    uint32_t image_size;
+    uint32_t resumed_from;      // Offset restored from NVS, 0 for a new download
+    uint32_t received;          // Bytes downloaded by this call
+    uint16_t connections;
+    uint16_t resumes;           // Range requests answered with 206
+    uint16_t restarts;          // Image changed, download started from zero
+    int64_t download_us;
+    uint32_t throughput;        // Bytes per second
+    int64_t write_us;           // Total time of flash erase and write
+    int64_t max_write_us;       // Longest single erase and write
+    uint32_t stalls;            // Writes longer than OTA_STREAM_STALL_US
+    uint32_t peak_ram;          // Largest drop of free heap during download
+} ota_stream_stats_t;
+
+
+/*-----------------------------------------------------------*/
+// Used function(s)
+esp_err_t ota_stream_download(const ota_stream_config_t *config, ota_stream_stats_t *stats);
+void ota_stream_forget(void);
+
+#endif
@@ -0,0 +1,130 @@
+/*
+  Request-scoped arena allocator.
+
+  Xtensa dual-core 32-bit LX6 (ESP32-CAM, FireBeetle ESP32), 240 MHz
+  PlatformIO, ESP-IDF framework
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+
+  NOTES:
+    * The module has no ESP-IDF dependency, "tools/kept_client_bench.c"
+      builds it on the host
+    * Every example builds on its own, "wifi_get_requests" and
+      "wifi_thingspeak" have the same copy of this module, a fix
+      goes into both
+ */
+
+
+/*-----------------------------------------------------------*/
+#include <string.h>
+#include <stdlib.h>             // malloc() function
+#include <arena.h>
+
+
+/*-----------------------------------------------------------*/
+// Header of a heap fallback block
+typedef struct arena_block {
+    struct arena_block *next;
+    size_t size;
+    uint64_t data[];            // Keeps ARENA_ALIGN alignment
+} arena_block_t;
+
+
+/*-----------------------------------------------------------*/
+static size_t round_up(size_t size)
+{
+    return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+
+/*-----------------------------------------------------------*/
+void arena_init(arena_t *arena, void *buffer, size_t size)
+{
+    memset(arena, 0, sizeof(arena_t));
+    // Region starts aligned, the unaligned head is not used
+    arena->base = (uint8_t *)round_up((uintptr_t)buffer);
+    arena->size = (size > (size_t)(arena->base - (uint8_t *)buffer)) ?
+                  size - (arena->base - (uint8_t *)buffer) : 0;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Block of "size" bytes valid until the next arena_reset(), NULL
+   only if the heap is exhausted as well */
+void *arena_alloc(arena_t *arena, size_t size)
+{
+    size_t rounded = round_up(size ? size : 1);
+    arena_block_t *block;
+    void *ptr;
+
+    arena->allocs++;
+    if (rounded <= arena->size - arena->used) {
+        ptr = arena->base + arena->used;
+        arena->used += rounded;
+    }
+    else {
+        // Region is full, the block is chained for the reset
+        block = malloc(sizeof(arena_block_t) + rounded);
+        if (block == NULL) {
+            return NULL;
+        }
+        block->next = arena->heap_blocks;
+        block->size = rounded;
+        arena->heap_blocks = block;
+        arena->heap_used += rounded;
+        arena->heap_allocs++;
+        ptr = block->data;
+    }
+    if (arena->used + arena->heap_used > arena->high_water) {
+        arena->high_water = arena->used + arena->heap_used;
+    }
+    return ptr;
+}
+
+
+/*-----------------------------------------------------------*/
+void *arena_calloc(arena_t *arena, size_t count, size_t size)
+{
+    void *ptr;
+
+    if (size != 0 && count > SIZE_MAX / size) {
+        return NULL;
+    }
+    ptr = arena_alloc(arena, count * size);
+    if (ptr != NULL) {
+        memset(ptr, 0, count * size);
+    }
+    return ptr;
+}
+
+
+/*-----------------------------------------------------------*/
+char *arena_strdup(arena_t *arena, const char *str)
+{
+    size_t len = strlen(str) + 1;
+    char *copy = arena_alloc(arena, len);
+
+    if (copy != NULL) {
+        memcpy(copy, str, len);
+    }
+    return copy;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Release all blocks, O(1) unless the region overflowed */
+void arena_reset(arena_t *arena)
+{
+    arena_block_t *block;
+
+    while (arena->heap_blocks != NULL) {
+        block = arena->heap_blocks;
+        arena->heap_blocks = block->next;
+        free(block);
+    }
+    arena->used = 0;
+    arena->heap_used = 0;
+    arena->resets++;
+}
@@ -0,0 +1,429 @@
+/*
+  Conditional GET cache for periodic HTTP polling.
+
+  Xtensa dual-core 32-bit LX6 (ESP32-CAM, FireBeetle ESP32), 240 MHz
+  PlatformIO, ESP-IDF framework
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+
+  See also:
+    HTTP conditional requests
+      * https://developer.mozilla.org/en-US/docs/Web/HTTP/Conditional_requests
+ */
+
+
+/*-----------------------------------------------------------*/
+#include <string.h>
+#include <strings.h>            // strcasecmp() function
+#include <stdio.h>              // snprintf() function
+#include <stdlib.h>             // malloc() function
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <esp_log.h>            // ESP_LOG/E/W/I functions
+#include <nvs.h>                // Non-volatile storage
+#include <http_cache.h>
+
+
+/*-----------------------------------------------------------*/
+#define HTTP_CACHE_NVS_NAMESPACE "http_cache"
+#define HTTP_STATUS_OK 200
+#define HTTP_STATUS_NOT_MODIFIED 304
+
+
+/*-----------------------------------------------------------*/
+// Tag for ESP_LOG/E/W/I functions
+static const char *TAG = "http cache";
+
+// One cached URL; the whole structure is stored as NVS blob
+typedef struct {
+    bool used;
+    bool has_result;
+    char url[HTTP_CACHE_MAX_URL];
+    char etag[HTTP_CACHE_MAX_ETAG];
+    char last_modified[HTTP_CACHE_MAX_DATE];
+    uint16_t body_len;
+    char body[HTTP_CACHE_MAX_BODY + 1];
+    uint8_t result[HTTP_CACHE_MAX_RESULT];
+} http_cache_entry_t;
+
+// Per-request context passed to the event handler
+typedef struct {
+    char *body;
+    size_t body_len;
+    bool overflow;
+    char etag[HTTP_CACHE_MAX_ETAG];
+    char last_modified[HTTP_CACHE_MAX_DATE];
+    http_event_handle_cb user_handler;
+} http_cache_ctx_t;
+
+static http_cache_entry_t s_entries[HTTP_CACHE_MAX_ENTRIES];
+static uint32_t s_last_use[HTTP_CACHE_MAX_ENTRIES];
+static uint32_t s_use_counter = 0;
+static http_cache_stats_t s_stats;
+static SemaphoreHandle_t s_lock = NULL;
+static bool s_use_nvs = false;
+
+// Client kept between fetches, one fetch uses it at a time
+static esp_http_client_handle_t s_client = NULL;
+static esp_http_client_config_t s_client_config;   // Config the client was created with
+static SemaphoreHandle_t s_client_lock = NULL;
+static arena_t *s_arena = NULL;
+
+
+/*-----------------------------------------------------------*/
+/* Copy string with truncation, always zero terminated */
+static void copy_string(char *dst, const char *src, size_t size)
+{
+    strncpy(dst, src, size - 1);
+    dst[size - 1] = '\0';
+}
+
+
+/*-----------------------------------------------------------*/
+static void nvs_store_entry(int index)
+{
+    nvs_handle_t handle;
+    char key[8];
+
+    if (!s_use_nvs) {
+        return;
+    }
+    if (nvs_open(HTTP_CACHE_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+        ESP_LOGW(TAG, "nvs open failed");
+        return;
+    }
+    snprintf(key, sizeof(key), "e%d", index);
+    if (nvs_set_blob(handle, key, &s_entries[index], sizeof(http_cache_entry_t)) == ESP_OK) {
+        nvs_commit(handle);
+    }
+    nvs_close(handle);
+}
+
+
+/*-----------------------------------------------------------*/
+static void nvs_load_entries(void)
+{
+    nvs_handle_t handle;
+    char key[8];
+    size_t size;
+
+    if (nvs_open(HTTP_CACHE_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return;
+    }
+    for (int i = 0; i < HTTP_CACHE_MAX_ENTRIES; i++) {
+        snprintf(key, sizeof(key), "e%d", i);
+        size = sizeof(http_cache_entry_t);
+        if (nvs_get_blob(handle, key, &s_entries[i], &size) != ESP_OK ||
+            size != sizeof(http_cache_entry_t)) {
+            memset(&s_entries[i], 0, sizeof(http_cache_entry_t));
+        }
+        else if (s_entries[i].used) {
+            ESP_LOGI(TAG, "restored %s", s_entries[i].url);
+        }
+    }
+    nvs_close(handle);
+}
+
+
+/*-----------------------------------------------------------*/
+/* Find entry for given URL or recycle the least recently used one.
+   Must be called with the lock taken. */
+static int find_entry(const char *url, bool *found)
+{
+    int victim = 0;
+
+    for (int i = 0; i < HTTP_CACHE_MAX_ENTRIES; i++) {
+        if (s_entries[i].used && strcmp(s_entries[i].url, url) == 0) {
+            *found = true;
+            return i;
+        }
+        if (!s_entries[victim].used) {
+            continue;
+        }
+        if (!s_entries[i].used || s_last_use[i] < s_last_use[victim]) {
+            victim = i;
+        }
+    }
+    *found = false;
+    return victim;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Fields the kept client can not change after esp_http_client_init(),
+   compared by value (pointers: the same certificate or credential
+   string) */
+static bool same_connection_config(const esp_http_client_config_t *a, const esp_http_client_config_t *b)
+{
+    return a->username == b->username &&
+           a->password == b->password &&
+           a->cert_pem == b->cert_pem &&
+           a->cert_len == b->cert_len &&
+           a->common_name == b->common_name &&
+           a->disable_auto_redirect == b->disable_auto_redirect &&
+           a->max_redirection_count == b->max_redirection_count &&
+           a->transport_type == b->transport_type &&
+           a->buffer_size == b->buffer_size &&
+           a->buffer_size_tx == b->buffer_size_tx &&
+           a->is_async == b->is_async &&
+           a->use_global_ca_store == b->use_global_ca_store &&
+           a->skip_cert_common_name_check == b->skip_cert_common_name_check &&
+           a->crt_bundle_attach == b->crt_bundle_attach;
+}
+
+
+/*-----------------------------------------------------------*/
+static esp_err_t cache_event_handler(esp_http_client_event_handle_t evt)
+{
+    http_cache_ctx_t *ctx = (http_cache_ctx_t *)evt->user_data;
+
+    // Events of the kept client outside of a fetch, e.g. closed by the server
+    if (ctx == NULL) {
+        return ESP_OK;
+    }
+    switch (evt->event_id) {
+        case HTTP_EVENT_ON_HEADER:
+            if (strcasecmp(evt->header_key, "ETag") == 0) {
+                copy_string(ctx->etag, evt->header_value, sizeof(ctx->etag));
+            }
+            else if (strcasecmp(evt->header_key, "Last-Modified") == 0) {
+                copy_string(ctx->last_modified, evt->header_value, sizeof(ctx->last_modified));
+            }
+            break;
+        case HTTP_EVENT_ON_DATA:
+            // Collect the body (also chunked one) into staging buffer
+            if (ctx->body_len + evt->data_len > HTTP_CACHE_MAX_BODY) {
+                ctx->overflow = true;
+            }
+            else {
+                memcpy(ctx->body + ctx->body_len, evt->data, evt->data_len);
+                ctx->body_len += evt->data_len;
+            }
+            break;
+        default:
+            break;
+    }
+
+    // Forward all events to the original handler
+    if (ctx->user_handler != NULL) {
+        return ctx->user_handler(evt);
+    }
+    return ESP_OK;
+}
+
+
+/*-----------------------------------------------------------*/
+void http_cache_init(bool use_nvs)
+{
+    if (s_lock == NULL) {
+        s_lock = xSemaphoreCreateMutex();
+        s_client_lock = xSemaphoreCreateMutex();
+    }
+    memset(s_entries, 0, sizeof(s_entries));
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_use_nvs = use_nvs;
+
+    if (s_use_nvs) {
+        nvs_load_entries();
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+/* Stage bodies in "arena" instead of the heap, the caller resets it
+   after every fetch; NULL goes back to malloc() */
+void http_cache_set_arena(arena_t *arena)
+{
+    s_arena = arena;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Fetch "config->url" over the kept client. The event handler,
+   method and timeout are taken from every call; the connection fields
+   (credentials, certificates, transport, buffers, redirects) must be
+   the ones the client was created with, otherwise the fetch returns
+   ESP_ERR_INVALID_ARG. */
+esp_err_t http_cache_fetch(const esp_http_client_config_t *config,
+                           http_cache_parse_t parse,
+                           http_cache_response_t *response)
+{
+    http_cache_ctx_t ctx = {0};
+    http_cache_entry_t *entry;
+    esp_http_client_config_t cfg = *config;
+    bool found;
+    bool changed;
+    int index;
+    esp_err_t err;
+
+    memset(response, 0, sizeof(http_cache_response_t));
+    if (strlen(config->url) >= HTTP_CACHE_MAX_URL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    ctx.body = (s_arena != NULL) ? arena_alloc(s_arena, HTTP_CACHE_MAX_BODY + 1) : malloc(HTTP_CACHE_MAX_BODY + 1);
+    if (ctx.body == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    ctx.user_handler = config->event_handler;
+
+    xSemaphoreTake(s_client_lock, portMAX_DELAY);
+    if (s_client != NULL && !same_connection_config(config, &s_client_config)) {
+        xSemaphoreGive(s_client_lock);
+        ESP_LOGE(TAG, "config of %s differs from the kept client", config->url);
+        if (s_arena == NULL) {
+            free(ctx.body);
+        }
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_client == NULL) {
+        cfg.event_handler = cache_event_handler;
+        cfg.user_data = &ctx;
+        cfg.keep_alive_enable = true;
+        s_client = esp_http_client_init(&cfg);
+        s_client_config = *config;
+    }
+    else {
+        // Before the URL: a new host closes the old connection, its
+        // events must not reach the context of an earlier fetch
+        esp_http_client_set_user_data(s_client, &ctx);
+        esp_http_client_set_url(s_client, config->url);
+        esp_http_client_set_method(s_client, config->method);
+        // Default of esp_http_client_init() for 0
+        esp_http_client_set_timeout_ms(s_client, (config->timeout_ms != 0) ? config->timeout_ms : 5000);
+        esp_http_client_delete_header(s_client, "If-None-Match");
+        esp_http_client_delete_header(s_client, "If-Modified-Since");
+    }
+    esp_http_client_handle_t client = s_client;
+    if (client == NULL) {
+        xSemaphoreGive(s_client_lock);
+        if (s_arena == NULL) {
+            free(ctx.body);
+        }
+        return ESP_FAIL;
+    }
+
+    // Attach validators of a previous response, if any
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    index = find_entry(config->url, &found);
+    entry = &s_entries[index];
+    if (found) {
+        if (entry->etag[0] != '\0') {
+            esp_http_client_set_header(client, "If-None-Match", entry->etag);
+        }
+        if (entry->last_modified[0] != '\0') {
+            esp_http_client_set_header(client, "If-Modified-Since", entry->last_modified);
+        }
+    }
+    xSemaphoreGive(s_lock);
+
+    err = esp_http_client_perform(client);
+    response->status = esp_http_client_get_status_code(client);
+    if (err != ESP_OK) {
+        // Next fetch opens a new connection
+        esp_http_client_close(client);
+    }
+    // "ctx" goes out of scope with this call
+    esp_http_client_set_user_data(client, NULL);
+    xSemaphoreGive(s_client_lock);
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    index = find_entry(config->url, &found);
+    entry = &s_entries[index];
+
+    if (err != ESP_OK) {
+        s_stats.errors++;
+    }
+    else if (response->status == HTTP_STATUS_NOT_MODIFIED && found) {
+        // Server confirmed our copy is still valid
+        s_stats.hits++;
+        s_stats.bytes_saved += entry->body_len;
+        response->from_cache = true;
+    }
+    else if (response->status == HTTP_STATUS_OK && !ctx.overflow) {
+        s_stats.misses++;
+        changed = !found || strcmp(entry->etag, ctx.etag) != 0 ||
+                  strcmp(entry->last_modified, ctx.last_modified) != 0;
+
+        // Replace (or create) the entry with fresh data
+        memset(entry, 0, sizeof(http_cache_entry_t));
+        entry->used = true;
+        copy_string(entry->url, config->url, sizeof(entry->url));
+        copy_string(entry->etag, ctx.etag, sizeof(entry->etag));
+        copy_string(entry->last_modified, ctx.last_modified, sizeof(entry->last_modified));
+        memcpy(entry->body, ctx.body, ctx.body_len);
+        entry->body[ctx.body_len] = '\0';
+        entry->body_len = ctx.body_len;
+        if (parse != NULL) {
+            entry->has_result = (parse(entry->body, entry->body_len,
+                                       entry->result, sizeof(entry->result)) == ESP_OK);
+        }
+
+        // Without validators the response can not be revalidated, with
+        // the same ones the stored copy is still good (flash wear)
+        if (changed && (entry->etag[0] != '\0' || entry->last_modified[0] != '\0')) {
+            nvs_store_entry(index);
+        }
+    }
+    else {
+        // Uncacheable response (other status code or too long body)
+        s_stats.misses++;
+        err = (response->status == HTTP_STATUS_OK) ? ESP_ERR_NO_MEM : ESP_FAIL;
+    }
+
+    if (err == ESP_OK) {
+        // Copies for the caller, the entry can change after the unlock
+        s_last_use[index] = ++s_use_counter;
+        memcpy(ctx.body, entry->body, entry->body_len + 1);
+        response->body = ctx.body;
+        response->body_len = entry->body_len;
+        response->body_on_heap = (s_arena == NULL);
+        response->has_result = entry->has_result;
+        memcpy(response->result, entry->result, sizeof(response->result));
+    }
+    xSemaphoreGive(s_lock);
+
+    if (err != ESP_OK && s_arena == NULL) {
+        free(ctx.body);
+    }
+    return err;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Free the body of a response staged without arena */
+void http_cache_release(http_cache_response_t *response)
+{
+    if (response->body_on_heap) {
+        free(response->body);
+    }
+    response->body = NULL;
+    response->body_on_heap = false;
+}
+
+
+/*-----------------------------------------------------------*/
+void http_cache_get_stats(http_cache_stats_t *stats)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *stats = s_stats;
+    xSemaphoreGive(s_lock);
+}
+
+
+/*-----------------------------------------------------------*/
+void http_cache_clear(void)
+{
+    nvs_handle_t handle;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    memset(s_entries, 0, sizeof(s_entries));
+    if (s_use_nvs && nvs_open(HTTP_CACHE_NVS_NAMESPACE, NVS_READWRITE, &handle) == ESP_OK) {
+        nvs_erase_all(handle);
+        nvs_commit(handle);
+        nvs_close(handle);
+    }
+    xSemaphoreGive(s_lock);
+}
@@ -0,0 +1,398 @@
+/*
+  Bounded worker pool for concurrent HTTP requests.
+
+  Xtensa dual-core 32-bit LX6 (ESP32-CAM, FireBeetle ESP32), 240 MHz
+  PlatformIO, ESP-IDF framework
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+ */
+
+
+/*-----------------------------------------------------------*/
+#include <string.h>
+#include <stdio.h>              // snprintf() function
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <esp_log.h>            // ESP_LOG/E/W/I functions
+#include <esp_timer.h>          // esp_timer_get_time() function
+#include <esp_http_client.h>
+#include <http_pool.h>
+
+
+/*-----------------------------------------------------------*/
+#define HTTP_POOL_MAX_HOST_NAME 64
+
+
+/*-----------------------------------------------------------*/
+// Tag for ESP_LOG/E/W/I functions
+static const char *TAG = "http pool";
+
+// One submitted request
+typedef struct {
+    bool used;
+    uint8_t priority;
+    uint8_t host;           // Index to host table
+    char url[HTTP_POOL_MAX_URL];
+    int64_t submit_us;
+    int64_t deadline_us;    // 0 = no deadline
+    http_pool_done_cb_t done;
+    void *arg;
+} http_pool_request_t;
+
+// Host table used for per-host connection limits
+typedef struct {
+    char name[HTTP_POOL_MAX_HOST_NAME];
+    uint8_t active;         // Requests being served right now
+    uint8_t queued;         // Requests referencing this entry
+} http_pool_host_t;
+
+// Worker context with persistent client and body buffer
+typedef struct {
+    uint8_t index;
+    TaskHandle_t task;
+    esp_http_client_handle_t client;
+    char body[HTTP_POOL_MAX_BODY + 1];
+    size_t body_len;
+    bool truncated;
+} http_pool_worker_t;
+
+static http_pool_request_t s_queue[HTTP_POOL_QUEUE_LEN];
+static http_pool_host_t s_hosts[HTTP_POOL_MAX_HOSTS];
+static http_pool_worker_t s_workers[HTTP_POOL_MAX_WORKERS];
+static http_pool_stats_t s_stats;
+static uint8_t s_worker_count = 0;
+static uint8_t s_active_workers = 0;
+static uint8_t s_per_host_limit = 1;
+static SemaphoreHandle_t s_lock = NULL;
+static SemaphoreHandle_t s_wakeup = NULL;
+
+
+/*-----------------------------------------------------------*/
+/* Extract "host[:port]" part of the URL */
+static void url_get_host(const char *url, char *host, size_t size)
+{
+    const char *start = strstr(url, "://");
+    size_t len = 0;
+
+    start = (start != NULL) ? start + 3 : url;
+    while (start[len] != '\0' && start[len] != '/' && start[len] != '?' && len < size - 1) {
+        len++;
+    }
+    memcpy(host, start, len);
+    host[len] = '\0';
+}
+
+
+/*-----------------------------------------------------------*/
+/* Find or allocate host entry. Must be called with the lock taken. */
+static int host_get(const char *url)
+{
+    char name[HTTP_POOL_MAX_HOST_NAME];
+    int free_slot = -1;
+
+    url_get_host(url, name, sizeof(name));
+    for (int i = 0; i < HTTP_POOL_MAX_HOSTS; i++) {
+        if ((s_hosts[i].active > 0 || s_hosts[i].queued > 0) &&
+            strcmp(s_hosts[i].name, name) == 0) {
+            return i;
+        }
+        if (free_slot < 0 && s_hosts[i].active == 0 && s_hosts[i].queued == 0) {
+            free_slot = i;
+        }
+    }
+    if (free_slot >= 0) {
+        strcpy(s_hosts[free_slot].name, name);
+    }
+    return free_slot;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Select the next request: highest priority first, then earliest
+   deadline, then oldest. Requests to hosts at their connection limit
+   are skipped. At most one expired request is removed and returned
+   in "expired" per call. Must be called with the lock taken. */
+static int queue_pick(int64_t now, http_pool_request_t *expired, bool *has_expired)
+{
+    int best = -1;
+
+    for (int i = 0; i < HTTP_POOL_QUEUE_LEN; i++) {
+        http_pool_request_t *req = &s_queue[i];
+
+        if (!req->used) {
+            continue;
+        }
+        if (req->deadline_us != 0 && now > req->deadline_us) {
+            if (!*has_expired) {
+                *expired = *req;
+                *has_expired = true;
+                s_hosts[req->host].queued--;
+                req->used = false;
+                s_stats.queued--;
+                s_stats.expired++;
+            }
+            continue;
+        }
+        if (s_hosts[req->host].active >= s_per_host_limit) {
+            continue;
+        }
+        if (best < 0) {
+            best = i;
+            continue;
+        }
+
+        http_pool_request_t *cur = &s_queue[best];
+        if (req->priority != cur->priority) {
+            if (req->priority > cur->priority) {
+                best = i;
+            }
+        }
+        else if (req->deadline_us != cur->deadline_us) {
+            if (cur->deadline_us == 0 || (req->deadline_us != 0 && req->deadline_us < cur->deadline_us)) {
+                best = i;
+            }
+        }
+        else if (req->submit_us < cur->submit_us) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+
+/*-----------------------------------------------------------*/
+static esp_err_t pool_event_handler(esp_http_client_event_handle_t evt)
+{
+    http_pool_worker_t *worker = (http_pool_worker_t *)evt->user_data;
+
+    if (evt->event_id == HTTP_EVENT_ON_DATA) {
+        size_t space = HTTP_POOL_MAX_BODY - worker->body_len;
+        size_t len = (size_t)evt->data_len;
+
+        if (len > space) {
+            len = space;
+            worker->truncated = true;
+        }
+        memcpy(worker->body + worker->body_len, evt->data, len);
+        worker->body_len += len;
+    }
+    return ESP_OK;
+}
+
+
+/*-----------------------------------------------------------*/
+static void pool_complete(const http_pool_request_t *req, http_pool_result_t *result)
+{
+    result->url = req->url;
+    result->latency_us = esp_timer_get_time() - req->submit_us;
+    if (req->done != NULL) {
+        req->done(result, req->arg);
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+static void pool_worker_task(void *pvParameters)
+{
+    http_pool_worker_t *worker = (http_pool_worker_t *)pvParameters;
+    http_pool_request_t expired;
+    http_pool_request_t req;
+    http_pool_result_t result;
+    bool has_expired = false;
+    int index = -1;
+
+    // Forever loop
+    while (1) {
+        // Block until a new request or a released host slot, but do
+        // not wait while there may be more work in the queue
+        if (index < 0 && !has_expired) {
+            xSemaphoreTake(s_wakeup, portMAX_DELAY);
+        }
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        has_expired = false;
+        index = -1;
+        if (worker->index >= s_active_workers) {
+            // Switched off: hand the token on and sleep until
+            // http_pool_set_workers() switches this worker on
+            xSemaphoreGive(s_lock);
+            xSemaphoreGive(s_wakeup);
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        index = queue_pick(esp_timer_get_time(), &expired, &has_expired);
+        if (index >= 0) {
+            req = s_queue[index];
+            s_queue[index].used = false;
+            s_hosts[req.host].queued--;
+            s_hosts[req.host].active++;
+            s_stats.queued--;
+        }
+        xSemaphoreGive(s_lock);
+
+        if (has_expired) {
+            memset(&result, 0, sizeof(result));
+            result.err = ESP_ERR_TIMEOUT;
+            result.worker = worker->index;
+            pool_complete(&expired, &result);
+        }
+        if (index < 0) {
+            continue;
+        }
+
+        // Reuse the persistent client, keep-alive connection is kept
+        // open as long as the next request goes to the same host
+        memset(&result, 0, sizeof(result));
+        result.worker = worker->index;
+        result.wait_us = esp_timer_get_time() - req.submit_us;
+        worker->body_len = 0;
+        worker->truncated = false;
+        esp_http_client_set_url(worker->client, req.url);
+        result.err = esp_http_client_perform(worker->client);
+        result.status = esp_http_client_get_status_code(worker->client);
+        if (result.err != ESP_OK) {
+            // Next request opens a new connection
+            esp_http_client_close(worker->client);
+        }
+        worker->body[worker->body_len] = '\0';
+        result.body = worker->body;
+        result.body_len = worker->body_len;
+        result.truncated = worker->truncated;
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        s_hosts[req.host].active--;
+        s_stats.completed++;
+        if (result.err != ESP_OK) {
+            s_stats.failed++;
+        }
+        xSemaphoreGive(s_lock);
+
+        // Host slot released, let other workers re-check the queue
+        xSemaphoreGive(s_wakeup);
+
+        pool_complete(&req, &result);
+    }
+
+    // Delete this task if it exits from the loop above
+    vTaskDelete(NULL);
+}
+
+
+/*-----------------------------------------------------------*/
+esp_err_t http_pool_init(uint8_t workers, uint8_t per_host_limit)
+{
+    char name[16];
+
+    if (s_worker_count != 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (workers == 0 || workers > HTTP_POOL_MAX_WORKERS || per_host_limit == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    s_lock = xSemaphoreCreateMutex();
+    s_wakeup = xSemaphoreCreateCounting(HTTP_POOL_QUEUE_LEN + HTTP_POOL_MAX_WORKERS, 0);
+    if (s_lock == NULL || s_wakeup == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_per_host_limit = per_host_limit;
+
+    for (uint8_t i = 0; i < workers; i++) {
+        http_pool_worker_t *worker = &s_workers[i];
+
+        // The URL is replaced before every request
+        esp_http_client_config_t config = {
+            .url = "http://localhost/",
+            .method = HTTP_METHOD_GET,
+            .cert_pem = NULL,
+            .event_handler = pool_event_handler,
+            .user_data = worker,
+            .keep_alive_enable = true,
+        };
+        worker->index = i;
+        worker->client = esp_http_client_init(&config);
+        if (worker->client == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        snprintf(name, sizeof(name), "http_worker_%u", i);
+        xTaskCreate(pool_worker_task, name, HTTP_POOL_STACK_SIZE, worker, 5, &worker->task);
+        s_worker_count++;
+    }
+    s_active_workers = s_worker_count;
+    ESP_LOGI(TAG, "%u workers started, %u connection(s) per host", workers, per_host_limit);
+
+    return ESP_OK;
+}
+
+
+/*-----------------------------------------------------------*/
+esp_err_t http_pool_submit(const char *url, uint8_t priority, uint32_t deadline_ms,
+                           http_pool_done_cb_t done, void *arg)
+{
+    int64_t now = esp_timer_get_time();
+    esp_err_t err = ESP_ERR_NO_MEM;
+    int host;
+
+    if (strlen(url) >= HTTP_POOL_MAX_URL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_stats.submitted++;
+    host = host_get(url);
+    for (int i = 0; host >= 0 && i < HTTP_POOL_QUEUE_LEN; i++) {
+        http_pool_request_t *req = &s_queue[i];
+
+        if (!req->used) {
+            req->used = true;
+            req->priority = priority;
+            req->host = host;
+            strcpy(req->url, url);
+            req->submit_us = now;
+            req->deadline_us = (deadline_ms != 0) ? now + (int64_t)deadline_ms * 1000 : 0;
+            req->done = done;
+            req->arg = arg;
+            s_hosts[host].queued++;
+            s_stats.queued++;
+            err = ESP_OK;
+            break;
+        }
+    }
+    if (err != ESP_OK) {
+        s_stats.rejected++;
+    }
+    xSemaphoreGive(s_lock);
+
+    if (err == ESP_OK) {
+        xSemaphoreGive(s_wakeup);
+    }
+    return err;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Limit number of workers taking new requests, used to compare
+   throughput with 1..N workers without re-creating the tasks */
+void http_pool_set_workers(uint8_t workers)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_active_workers = (workers > s_worker_count) ? s_worker_count : workers;
+    // Wake the ones switched on, a worker that was not asleep keeps
+    // the notification for its next stop
+    for (uint8_t i = 0; i < s_active_workers; i++) {
+        xTaskNotifyGive(s_workers[i].task);
+    }
+    xSemaphoreGive(s_lock);
+}
+
+
+/*-----------------------------------------------------------*/
+void http_pool_get_stats(http_pool_stats_t *stats)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *stats = s_stats;
+    xSemaphoreGive(s_lock);
+}
@@ -11,6 +11,14 @@
   TODO:
     Set SSID and password in "include/my_data.h" file
 
+  NOTES:
+    * With "OTA_ENABLE" set, a new firmware is streamed into the other
+      app partition, interrupted downloads are resumed with HTTP Range
+      requests, see "src/ota_stream.c"
+    * With "HTTP_POOL_ENABLE" set, a pool of worker tasks fetches
+      the benchmark endpoints with 1..N workers and logs total time
+      and mean latency, see "src/http_pool.c"
+
   See also:
     Setup ESP32 as WiFi Station (ESP-IDF)
       * https://embeddedexplorer.com/esp32-wifi-station/
@@ -30,18 +38,63 @@
 /*-----------------------------------------------------------*/
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <freertos/semphr.h>
 #include <esp_log.h>            // ESP_LOG/E/W/I functions
 #include <nvs_flash.h>          // Memory
 #include <esp_wifi.h>           // Wi-Fi driver
 #include <esp_netif.h>
 #include <esp_http_client.h>
+#include <esp_timer.h>          // esp_timer_get_time() function
+#include <esp_system.h>         // esp_restart(), esp_get_free_heap_size() functions
+#include <string.h>             // strstr() function
+#include <inttypes.h>           // PRIu32, PRId64 format macros
 #include <my_data.h>
+#include <http_cache.h>         // Conditional GET cache
+#include <http_pool.h>          // Concurrent HTTP requests
+#include <ota_stream.h>         // Streaming OTA update
+#include <arena.h>              // Request-scoped allocations
+
+
+/*-----------------------------------------------------------*/
+// Base URL of the server used by the worker pool benchmark. Any
+// server providing the three endpoints below can be used, e.g.
+// "tools/pool_standin.py" with a fixed response delay on a PC in
+// the same network ("http://192.168.1.10:8071").
+#define HTTP_POOL_BASE_URL "http://httpbin.org"
+#define HTTP_POOL_BENCHMARK_ROUNDS 4
+// All benchmark endpoints are on one host, a lower limit would cap
+// the 1..N worker comparison at that many requests in flight
+#define HTTP_POOL_PER_HOST_LIMIT HTTP_POOL_MAX_WORKERS
+
+// Region for request-scoped objects of the HTTP client task, the
+// staged body of the conditional GET cache needs most of it
+#define HTTP_CLIENT_ARENA_SIZE 1536
 
 
 /*-----------------------------------------------------------*/
 // Tag for ESP_LOG/E/W/I functions
 static const char *TAG = "wifi station";
 
+// Request-scoped allocations of HttpClientTask()
+static uint8_t s_client_arena_buffer[HTTP_CLIENT_ARENA_SIZE];
+static arena_t s_client_arena;
+
+#if HTTP_POOL_ENABLE
+// Resources fetched by the worker pool benchmark
+static const char *pool_endpoints[] = {
+    HTTP_POOL_BASE_URL "/json",     // Configuration
+    HTTP_POOL_BASE_URL "/uuid",     // Time stand-in
+    HTTP_POOL_BASE_URL "/get",      // Firmware manifest stand-in
+};
+
+// Benchmark counters updated from completion callbacks of all
+// workers, guarded by "s_pool_lock"
+static portMUX_TYPE s_pool_lock = portMUX_INITIALIZER_UNLOCKED;
+static SemaphoreHandle_t s_pool_done;
+static int64_t s_pool_latency_us;
+static uint32_t s_pool_failed;
+#endif
+
 
 /*-----------------------------------------------------------*/
 void event_handler(void *event_handler_arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
@@ -140,22 +193,72 @@ esp_err_t http_event_handler(esp_http_client_event_handle_t evt)
 }
 
 
+/*-----------------------------------------------------------*/
+/* Parse "origin" field from httpbin JSON response. Called only when
+   the body changes, the result is kept in the cache otherwise. */
+esp_err_t http_parse_origin(const char *body, size_t body_len, void *result, size_t result_size)
+{
+    char *origin = (char *)result;
+    const char *start = strstr(body, "\"origin\": \"");
+    size_t len = 0;
+
+    if (start == NULL) {
+        return ESP_FAIL;
+    }
+    start += strlen("\"origin\": \"");
+    while (start[len] != '"' && start[len] != '\0' && len < result_size - 1) {
+        len++;
+    }
+    memcpy(origin, start, len);
+    origin[len] = '\0';
+
+    return ESP_OK;
+}
+
+
 /*-----------------------------------------------------------*/
 void HttpClientTask()
 {
     esp_http_client_config_t config = {
-        .url = "http://httpbin.org/get",
+        .url = "http://httpbin.org/etag/config-v1",     // Answers 304 on matching ETag
+        // .url = "http://httpbin.org/get",             // No validators, always downloaded
         // .url = "http://worldclockapi.com/api/json/utc/now",
         .method = HTTP_METHOD_GET,
         .cert_pem = NULL,
         .event_handler = http_event_handler
     };
+    http_cache_response_t response;
+    http_cache_stats_t stats;
+    uint32_t heap_before;
+
+    arena_init(&s_client_arena, s_client_arena_buffer, sizeof(s_client_arena_buffer));
+    http_cache_set_arena(&s_client_arena);
 
     // Forever loop
     while (1) {
-        esp_http_client_handle_t client = esp_http_client_init(&config);
-        esp_http_client_perform(client);
-        esp_http_client_cleanup(client);
+        // Download the body only if it changed since the last request
+        heap_before = esp_get_free_heap_size();
+        if (http_cache_fetch(&config, http_parse_origin, &response) == ESP_OK) {
+            ESP_LOGI(TAG, "status %d, %s, %u bytes", response.status,
+                     response.from_cache ? "not modified" : "downloaded", (unsigned)response.body_len);
+            if (response.has_result) {
+                ESP_LOGI(TAG, "origin: %s", (const char *)response.result);
+            }
+            http_cache_release(&response);
+        }
+        http_cache_get_stats(&stats);
+        ESP_LOGI(TAG, "cache hits %" PRIu32 ", misses %" PRIu32 ", errors %" PRIu32 ", bytes saved %" PRIu32,
+                 stats.hits, stats.misses, stats.errors, stats.bytes_saved);
+
+        // Everything the request needed is released at once
+        ESP_LOGI(TAG, "arena high water %u of %u bytes, %" PRIu32 " allocations, %" PRIu32 " from heap",
+                 (unsigned)s_client_arena.high_water, (unsigned)s_client_arena.size,
+                 s_client_arena.allocs, s_client_arena.heap_allocs);
+        arena_reset(&s_client_arena);
+        // Measured counterpart of "tools/kept_client_bench.c", the kept
+        // client stays allocated after the first request
+        ESP_LOGI(TAG, "free heap %" PRIu32 " before, %" PRIu32 " after the request",
+                 heap_before, esp_get_free_heap_size());
 
         // Delay 10 seconds
         for (uint8_t i = 10; i > 0; i--) {
@@ -169,6 +272,104 @@ void HttpClientTask()
 }
 
 
+/*-----------------------------------------------------------*/
+#if HTTP_POOL_ENABLE
+/* Called from any worker task, up to HTTP_POOL_MAX_WORKERS at once */
+void pool_request_done(const http_pool_result_t *result, void *arg)
+{
+    portENTER_CRITICAL(&s_pool_lock);
+    if (result->err != ESP_OK || result->status != 200) {
+        s_pool_failed++;
+    }
+    s_pool_latency_us += result->latency_us;
+    portEXIT_CRITICAL(&s_pool_lock);
+    xSemaphoreGive(s_pool_done);
+}
+
+
+/*-----------------------------------------------------------*/
+/* Fetch all endpoints several times with 1..N active workers and
+   compare total time and mean request latency */
+void HttpPoolBenchmarkTask()
+{
+    const uint8_t endpoints = sizeof(pool_endpoints) / sizeof(pool_endpoints[0]);
+    const uint8_t requests = HTTP_POOL_BENCHMARK_ROUNDS * endpoints;
+    int64_t start;
+    int64_t elapsed;
+    int64_t latency_us;
+    uint32_t failed;
+
+    s_pool_done = xSemaphoreCreateCounting(requests, 0);
+
+    // Wait for the Wi-Fi connection
+    vTaskDelay(15000 / portTICK_PERIOD_MS);
+
+    for (uint8_t workers = 1; workers <= HTTP_POOL_MAX_WORKERS; workers++) {
+        http_pool_set_workers(workers);
+        portENTER_CRITICAL(&s_pool_lock);
+        s_pool_latency_us = 0;
+        s_pool_failed = 0;
+        portEXIT_CRITICAL(&s_pool_lock);
+
+        start = esp_timer_get_time();
+        for (uint8_t i = 0; i < requests; i++) {
+            // Configuration first, the rest has to be done within 30 seconds
+            http_pool_submit(pool_endpoints[i % endpoints],
+                             (i % endpoints == 0) ? HTTP_POOL_PRIO_HIGH : HTTP_POOL_PRIO_NORMAL,
+                             30000, pool_request_done, NULL);
+        }
+        for (uint8_t i = 0; i < requests; i++) {
+            xSemaphoreTake(s_pool_done, portMAX_DELAY);
+        }
+        elapsed = esp_timer_get_time() - start;
+        portENTER_CRITICAL(&s_pool_lock);
+        latency_us = s_pool_latency_us;
+        failed = s_pool_failed;
+        portEXIT_CRITICAL(&s_pool_lock);
+
+        ESP_LOGI(TAG, "%u worker(s): %u requests in %" PRId64 " ms, mean latency %" PRId64 " ms, %" PRIu32 " failed",
+                 workers, requests, elapsed / 1000, latency_us / requests / 1000, failed);
+    }
+
+    // Delete this task
+    vTaskDelete(NULL);
+}
+#endif
+
+
+/*-----------------------------------------------------------*/
+/* Stream the new firmware into the other app partition and boot it */
+void OtaTask()
+{
+    ota_stream_config_t config = {
+        .url = OTA_URL,
+        .sha256 = OTA_SHA256,
+        .max_attempts = OTA_MAX_ATTEMPTS,
+    };
+    ota_stream_stats_t stats;
+    esp_err_t err;
+
+    // Wait for the Wi-Fi connection
+    vTaskDelay(15000 / portTICK_PERIOD_MS);
+
+    err = ota_stream_download(&config, &stats);
+    ESP_LOGI(TAG, "ota: %s, %" PRIu32 " bytes (from %" PRIu32 ") in %" PRId64 " ms, %" PRIu32 " B/s, %u connections, %u resumed, %u restarted",
+             esp_err_to_name(err), stats.received, stats.resumed_from, stats.download_us / 1000, stats.throughput,
+             stats.connections, stats.resumes, stats.restarts);
+    ESP_LOGI(TAG, "ota: flash %" PRId64 " ms (max %" PRId64 " ms, %" PRIu32 " stalls), peak RAM %" PRIu32 " bytes",
+             stats.write_us / 1000, stats.max_write_us / 1000, stats.stalls, stats.peak_ram);
+
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "restarting into the new firmware");
+        vTaskDelay(1000 / portTICK_PERIOD_MS);
+        esp_restart();
+    }
+
+    // Delete this task
+    vTaskDelete(NULL);
+}
+
+
 /*-----------------------------------------------------------*/
 /* In ESP-IDF instead of "main", we use "app_main" function
    where the program execution begins */
@@ -178,9 +379,22 @@ void app_main(void)
     // memory which stores key-value pairs)
     nvs_flash_init();
 
+    // Keep ETag/Last-Modified validators also in NVS
+    http_cache_init(true);
+
     // Initialize Wi-Fi connection
     wifi_init_sta();
 
     // Create HTTP client task
     xTaskCreate(HttpClientTask, "ESP HTTP Client", 4096, NULL, 5, NULL);
+
+#if HTTP_POOL_ENABLE
+    // Create HTTP worker pool
+    http_pool_init(HTTP_POOL_MAX_WORKERS, HTTP_POOL_PER_HOST_LIMIT);
+    xTaskCreate(HttpPoolBenchmarkTask, "HTTP pool benchmark", 3072, NULL, 4, NULL);
+#endif
+
+#if OTA_ENABLE
+    xTaskCreate(OtaTask, "OTA download", 6144, NULL, 5, NULL);
+#endif
 }
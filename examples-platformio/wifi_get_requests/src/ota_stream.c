@@ -0,0 +1,415 @@
+/*
+  Streaming firmware download into the OTA partition.
+
+  Xtensa dual-core 32-bit LX6 (ESP32-CAM, FireBeetle ESP32), 240 MHz
+  PlatformIO, ESP-IDF framework
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+
+  NOTES:
+    * The partition is written with esp_partition_write() instead of
+      esp_ota_write(), because esp_ota_begin() erases the partition and
+      a download interrupted by reset could not be resumed
+    * The server must send "Content-Length", chunked images are refused
+
+  See also:
+    Over The Air Updates (OTA)
+      * https://docs.espressif.com/projects/esp-idf/en/v4.4/esp32/api-reference/system/ota.html
+
+    HTTP range requests
+      * https://developer.mozilla.org/en-US/docs/Web/HTTP/Range_requests
+ */
+
+
+/*-----------------------------------------------------------*/
+#include <string.h>
+#include <strings.h>            // strcasecmp() function
+#include <stdio.h>              // snprintf() function
+#include <stdlib.h>             // malloc() function
+#include <inttypes.h>           // PRIu32, PRId64 format macros
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_log.h>            // ESP_LOG/E/W/I functions
+#include <esp_timer.h>          // esp_timer_get_time() function
+#include <esp_system.h>         // esp_get_free_heap_size() function
+#include <esp_http_client.h>
+#include <esp_ota_ops.h>        // Boot partition selection
+#include <esp_partition.h>      // Raw partition access
+#include <esp_spi_flash.h>      // SPI_FLASH_SEC_SIZE
+#include <mbedtls/sha256.h>
+#include <nvs.h>                // Non-volatile storage
+#include <ota_stream.h>
+
+
+/*-----------------------------------------------------------*/
+#define OTA_STREAM_NVS_NAMESPACE "ota_stream"
+#define OTA_STREAM_NVS_KEY "progress"
+#define HTTP_STATUS_OK 200
+#define HTTP_STATUS_PARTIAL_CONTENT 206
+
+
+/*-----------------------------------------------------------*/
+// Tag for ESP_LOG/E/W/I functions
+static const char *TAG = "ota stream";
+
+// Download state; the whole structure is stored as NVS blob
+typedef struct {
+    char url[OTA_STREAM_MAX_URL];
+    char etag[OTA_STREAM_MAX_ETAG];
+    uint32_t address;           // Partition being written
+    uint32_t image_size;        // 0 until the first response
+    uint32_t offset;            // Bytes written to the partition
+} ota_progress_t;
+
+// Response headers captured by the event handler
+typedef struct {
+    char etag[OTA_STREAM_MAX_ETAG];
+    uint32_t range_start;       // "Content-Range: bytes <start>-<end>/<total>"
+    uint32_t range_total;
+} ota_response_t;
+
+static const esp_partition_t *s_partition = NULL;
+static ota_progress_t s_progress;
+static uint32_t s_erased = 0;           // End of the erased area
+static mbedtls_sha256_context s_sha;
+static uint8_t *s_buffer = NULL;
+static ota_stream_stats_t *s_stats = NULL;
+static uint32_t s_min_free = 0;
+
+
+/*-----------------------------------------------------------*/
+static void nvs_save_progress(uint32_t offset)
+{
+    nvs_handle_t handle;
+    ota_progress_t progress = s_progress;
+
+    // Bytes behind the stored offset are rewritten after reset
+    progress.offset = offset - offset % OTA_STREAM_SAVE_BYTES;
+    if (nvs_open(OTA_STREAM_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+        ESP_LOGW(TAG, "nvs open failed");
+        return;
+    }
+    if (nvs_set_blob(handle, OTA_STREAM_NVS_KEY, &progress, sizeof(ota_progress_t)) == ESP_OK) {
+        nvs_commit(handle);
+    }
+    nvs_close(handle);
+}
+
+
+/*-----------------------------------------------------------*/
+static bool nvs_load_progress(ota_progress_t *progress)
+{
+    nvs_handle_t handle;
+    size_t size = sizeof(ota_progress_t);
+    esp_err_t err;
+
+    if (nvs_open(OTA_STREAM_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return false;
+    }
+    err = nvs_get_blob(handle, OTA_STREAM_NVS_KEY, progress, &size);
+    nvs_close(handle);
+
+    return err == ESP_OK && size == sizeof(ota_progress_t);
+}
+
+
+/*-----------------------------------------------------------*/
+/* Drop the stored progress, the next download starts from zero */
+void ota_stream_forget(void)
+{
+    nvs_handle_t handle;
+
+    if (nvs_open(OTA_STREAM_NVS_NAMESPACE, NVS_READWRITE, &handle) == ESP_OK) {
+        nvs_erase_key(handle, OTA_STREAM_NVS_KEY);
+        nvs_commit(handle);
+        nvs_close(handle);
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+static esp_err_t ota_http_event_handler(esp_http_client_event_handle_t evt)
+{
+    ota_response_t *response = (ota_response_t *)evt->user_data;
+    unsigned long start, end, total;
+
+    if (evt->event_id != HTTP_EVENT_ON_HEADER) {
+        return ESP_OK;
+    }
+    if (strcasecmp(evt->header_key, "ETag") == 0) {
+        strlcpy(response->etag, evt->header_value, sizeof(response->etag));
+    }
+    else if (strcasecmp(evt->header_key, "Content-Range") == 0 &&
+             sscanf(evt->header_value, "bytes %lu-%lu/%lu", &start, &end, &total) == 3) {
+        response->range_start = start;
+        response->range_total = total;
+    }
+    return ESP_OK;
+}
+
+
+/*-----------------------------------------------------------*/
+static void sample_heap(void)
+{
+    uint32_t free_size = esp_get_free_heap_size();
+
+    if (free_size < s_min_free) {
+        s_min_free = free_size;
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+/* Start the hash (and the download) from zero */
+static void restart(void)
+{
+    mbedtls_sha256_free(&s_sha);
+    mbedtls_sha256_init(&s_sha);
+    mbedtls_sha256_starts_ret(&s_sha, 0);
+    s_progress.offset = 0;
+    s_erased = 0;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Hash the part of the image already in flash, after reset */
+static esp_err_t rehash(uint32_t size)
+{
+    uint32_t len;
+    esp_err_t err;
+
+    for (uint32_t offset = 0; offset < size; offset += len) {
+        len = (size - offset < OTA_STREAM_CHUNK) ? size - offset : OTA_STREAM_CHUNK;
+        if ((err = esp_partition_read(s_partition, offset, s_buffer, len)) != ESP_OK) {
+            return err;
+        }
+        mbedtls_sha256_update_ret(&s_sha, s_buffer, len);
+    }
+    return ESP_OK;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Erase sectors just ahead of the data and write it */
+static esp_err_t write_chunk(const uint8_t *data, uint32_t len)
+{
+    uint32_t offset = s_progress.offset;
+    int64_t start = esp_timer_get_time();
+    int64_t elapsed;
+    esp_err_t err = ESP_OK;
+
+    if (offset + len > s_partition->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    while (err == ESP_OK && s_erased < offset + len) {
+        err = esp_partition_erase_range(s_partition, s_erased, SPI_FLASH_SEC_SIZE);
+        s_erased += SPI_FLASH_SEC_SIZE;
+    }
+    if (err == ESP_OK) {
+        err = esp_partition_write(s_partition, offset, data, len);
+    }
+    elapsed = esp_timer_get_time() - start;
+    s_stats->write_us += elapsed;
+    if (elapsed > s_stats->max_write_us) {
+        s_stats->max_write_us = elapsed;
+    }
+    if (elapsed > OTA_STREAM_STALL_US) {
+        s_stats->stalls++;
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    mbedtls_sha256_update_ret(&s_sha, data, len);
+    s_progress.offset += len;
+    s_stats->received += len;
+    // Progress crossed a save point
+    if (s_progress.offset / OTA_STREAM_SAVE_BYTES != offset / OTA_STREAM_SAVE_BYTES) {
+        nvs_save_progress(s_progress.offset);
+        ESP_LOGI(TAG, "%" PRIu32 " of %" PRIu32 " bytes", s_progress.offset, s_progress.image_size);
+    }
+    return ESP_OK;
+}
+
+
+/*-----------------------------------------------------------*/
+/* One connection: request the rest of the image and stream it into
+   the partition until the image is complete or the connection breaks */
+static esp_err_t fetch(const char *url)
+{
+    ota_response_t response = { 0 };
+    esp_http_client_config_t config = {
+        .url = url,
+        .method = HTTP_METHOD_GET,
+        .timeout_ms = OTA_STREAM_TIMEOUT_MS,
+        .event_handler = ota_http_event_handler,
+        .user_data = &response,
+    };
+    esp_http_client_handle_t client;
+    char range[24];
+    int64_t length;
+    int status;
+    int len;
+    esp_err_t err;
+
+    client = esp_http_client_init(&config);
+    if (client == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (s_progress.offset > 0) {
+        snprintf(range, sizeof(range), "bytes=%" PRIu32 "-", s_progress.offset);
+        esp_http_client_set_header(client, "Range", range);
+        // Whole image if it is not the same any more
+        if (s_progress.etag[0] != '\0') {
+            esp_http_client_set_header(client, "If-Range", s_progress.etag);
+        }
+    }
+    s_stats->connections++;
+    if ((err = esp_http_client_open(client, 0)) != ESP_OK) {
+        esp_http_client_cleanup(client);
+        return err;
+    }
+    length = esp_http_client_fetch_headers(client);
+    status = esp_http_client_get_status_code(client);
+    sample_heap();
+
+    if (status == HTTP_STATUS_PARTIAL_CONTENT && response.range_start == s_progress.offset &&
+        response.range_total == s_progress.image_size) {
+        s_stats->resumes++;
+    }
+    else if (status == HTTP_STATUS_OK && length > 0) {
+        if (s_progress.offset > 0) {
+            ESP_LOGW(TAG, "image changed, download starts from zero");
+            s_stats->restarts++;
+            restart();
+        }
+        s_progress.image_size = length;
+        strlcpy(s_progress.etag, response.etag, sizeof(s_progress.etag));
+        nvs_save_progress(0);
+    }
+    else {
+        ESP_LOGW(TAG, "status %d, length %" PRId64, status, length);
+        err = ESP_ERR_INVALID_RESPONSE;
+    }
+    if (err == ESP_OK && s_progress.image_size > s_partition->size) {
+        ESP_LOGE(TAG, "image of %" PRIu32 " bytes does not fit into partition", s_progress.image_size);
+        err = ESP_ERR_INVALID_SIZE;
+    }
+
+    // Every chunk goes straight to flash
+    while (err == ESP_OK && s_progress.offset < s_progress.image_size) {
+        len = esp_http_client_read(client, (char *)s_buffer, OTA_STREAM_CHUNK);
+        if (len <= 0) {
+            // Connection closed or timed out
+            err = ESP_FAIL;
+            break;
+        }
+        if ((uint32_t)len > s_progress.image_size - s_progress.offset) {
+            len = s_progress.image_size - s_progress.offset;
+        }
+        err = write_chunk(s_buffer, len);
+        sample_heap();
+    }
+
+    esp_http_client_close(client);
+    esp_http_client_cleanup(client);
+
+    return err;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Download the image into the next OTA partition and select it for
+   the next boot, resume the stored progress of the same URL */
+esp_err_t ota_stream_download(const ota_stream_config_t *config, ota_stream_stats_t *stats)
+{
+    ota_progress_t stored;
+    uint8_t hash[32];
+    char hex[65];
+    uint32_t free_start;
+    uint32_t offset;
+    uint8_t attempts = 0;
+    int64_t start;
+    esp_err_t err = ESP_FAIL;
+
+    memset(stats, 0, sizeof(ota_stream_stats_t));
+    s_stats = stats;
+    s_partition = esp_ota_get_next_update_partition(NULL);
+    if (s_partition == NULL) {
+        ESP_LOGE(TAG, "no OTA partition");
+        return ESP_ERR_NOT_FOUND;
+    }
+    free_start = esp_get_free_heap_size();
+    s_min_free = free_start;
+    s_buffer = malloc(OTA_STREAM_CHUNK);
+    if (s_buffer == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    mbedtls_sha256_init(&s_sha);
+    restart();
+    memset(&s_progress, 0, sizeof(ota_progress_t));
+    strlcpy(s_progress.url, config->url, sizeof(s_progress.url));
+    s_progress.address = s_partition->address;
+
+    // Download interrupted by reset, hash what is already in flash
+    if (nvs_load_progress(&stored) && strcmp(stored.url, s_progress.url) == 0 &&
+        stored.address == s_progress.address && stored.offset <= stored.image_size &&
+        rehash(stored.offset) == ESP_OK) {
+        s_progress = stored;
+        s_erased = stored.offset;
+        stats->resumed_from = stored.offset;
+        ESP_LOGI(TAG, "resuming at %" PRIu32 " of %" PRIu32 " bytes", stored.offset, stored.image_size);
+    }
+    else {
+        restart();
+    }
+    ESP_LOGI(TAG, "writing partition \"%s\" at 0x%" PRIx32, s_partition->label, s_partition->address);
+
+    start = esp_timer_get_time();
+    while (attempts < config->max_attempts) {
+        // Reset came right after the last chunk
+        if (s_progress.image_size > 0 && s_progress.offset >= s_progress.image_size) {
+            err = ESP_OK;
+            break;
+        }
+        offset = s_progress.offset;
+        err = fetch(config->url);
+        if (err == ESP_OK || err == ESP_ERR_INVALID_SIZE || err == ESP_ERR_FLASH_OP_FAIL) {
+            break;
+        }
+        // Give up only when attempts bring nothing
+        attempts = (s_progress.offset > offset) ? 0 : attempts + 1;
+        ESP_LOGW(TAG, "download interrupted at %" PRIu32 " of %" PRIu32 " bytes (%s)",
+                 s_progress.offset, s_progress.image_size, esp_err_to_name(err));
+        vTaskDelay(OTA_STREAM_RETRY_MS / portTICK_PERIOD_MS);
+    }
+    stats->download_us = esp_timer_get_time() - start;
+    stats->throughput = stats->download_us ? (int64_t)stats->received * 1000000 / stats->download_us : 0;
+    stats->image_size = s_progress.image_size;
+    stats->peak_ram = free_start - s_min_free;
+
+    if (err == ESP_OK) {
+        mbedtls_sha256_finish_ret(&s_sha, hash);
+        for (uint8_t i = 0; i < sizeof(hash); i++) {
+            snprintf(&hex[2 * i], 3, "%02x", hash[i]);
+        }
+        ESP_LOGI(TAG, "sha256 %s", hex);
+        if (config->sha256 != NULL && strcasecmp(hex, config->sha256) != 0) {
+            ESP_LOGE(TAG, "sha256 mismatch");
+            err = ESP_ERR_INVALID_CRC;
+        }
+        else {
+            // Checks the image header and its own hash as well
+            err = esp_ota_set_boot_partition(s_partition);
+        }
+        ota_stream_forget();
+    }
+
+    mbedtls_sha256_free(&s_sha);
+    free(s_buffer);
+    s_buffer = NULL;
+
+    return err;
+}
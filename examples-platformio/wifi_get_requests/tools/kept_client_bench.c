@@ -0,0 +1,257 @@
+/*
+  Host model of heap calls per request with a kept HTTP client.
+
+  Build and run on Linux:
+
+    cc -O2 -Iinclude tools/kept_client_bench.c src/arena.c -o kept_client_bench
+    ./kept_client_bench
+
+  Counts the heap calls of one conditional GET through "http_cache"
+  with the HTTP client created for every request and with the client
+  kept between requests, and the part of the kept client the request
+  arena saves on top:
+
+    new client   client created and destroyed per request, body
+                 staged with malloc()
+    kept client  one kept client (only URL and validator headers
+                 change), body staged with malloc()
+    kept arena   kept client, body staged in the request arena, reset
+                 at the end
+    small arena  the same with an arena too small for the body, the
+                 body falls back to the heap
+
+  This is a model, not a measurement: esp_http_client does not build
+  on the host, so the traces of its internal allocations (client,
+  buffers, parser, transports, headers, URL parts, response header
+  strings) are written by hand after ESP-IDF v4.4, sizes rounded from
+  a 32-bit build. Most of the difference is the kept client; the
+  arena never sees those allocations, it only stages the body (and
+  in "wifi_thingspeak" the request strings). Only the arena columns
+  run "src/arena.c" itself. The table shows heap calls and arena
+  allocations per request, the most heap in use at once, the arena
+  high-water mark and heap fallbacks. A changed client (other ESP-IDF
+  version, TLS, redirects) makes the numbers stale; "src/main.c" logs
+  the free heap around every fetch on the target.
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+ */
+
+
+/*-----------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arena.h>
+
+
+/*-----------------------------------------------------------*/
+#define BENCH_REQUESTS   1000
+#define BENCH_SLOTS      64
+#define BENCH_BODY       1025       // HTTP_CACHE_MAX_BODY + 1
+#define BENCH_ARENA_SIZE 1536       // HTTP_CLIENT_ARENA_SIZE of "src/main.c"
+
+
+/*-----------------------------------------------------------*/
+typedef enum {
+    OP_ALLOC,                   // Heap block into slot
+    OP_FREE,                    // Free block of slot
+    OP_ARENA,                   // Request arena block
+    OP_END,
+} op_type_t;
+
+typedef struct {
+    op_type_t type;
+    uint8_t slot;
+    uint16_t size;
+} op_t;
+
+// Client creation, the same in both variants
+static const op_t client_init[] = {
+    {OP_ALLOC, 0, 240},         // esp_http_client struct
+    {OP_ALLOC, 1, 16},          // Request
+    {OP_ALLOC, 2, 24},          // Response
+    {OP_ALLOC, 3, 8},           // Request header list
+    {OP_ALLOC, 4, 8},           // Response header list
+    {OP_ALLOC, 5, 20},          // Request buffer
+    {OP_ALLOC, 6, 20},          // Response buffer
+    {OP_ALLOC, 7, 512},         // Receive data
+    {OP_ALLOC, 8, 512},         // Transmit data
+    {OP_ALLOC, 9, 32},          // Parser
+    {OP_ALLOC, 10, 56},         // Parser settings
+    {OP_ALLOC, 11, 8},          // Transport list
+    {OP_ALLOC, 12, 64},         // TCP transport
+    {OP_ALLOC, 13, 16},         // TCP context
+    {OP_ALLOC, 14, 64},         // SSL transport
+    {OP_ALLOC, 15, 24},         // SSL context
+    {OP_ALLOC, 16, 8},          // Scheme
+    {OP_ALLOC, 17, 12},         // Host
+    {OP_ALLOC, 18, 8},          // Path
+    {OP_ALLOC, 19, 20},         // "User-Agent" header item, key, value
+    {OP_ALLOC, 20, 12},
+    {OP_ALLOC, 21, 24},
+    {OP_ALLOC, 22, 20},         // "Host" header item, key, value
+    {OP_ALLOC, 23, 8},
+    {OP_ALLOC, 24, 12},
+    {OP_END, 0, 0},
+};
+
+// Client destruction
+static const op_t client_cleanup[] = {
+    {OP_FREE, 24, 0}, {OP_FREE, 23, 0}, {OP_FREE, 22, 0}, {OP_FREE, 21, 0}, {OP_FREE, 20, 0},
+    {OP_FREE, 19, 0}, {OP_FREE, 18, 0}, {OP_FREE, 17, 0}, {OP_FREE, 16, 0}, {OP_FREE, 15, 0},
+    {OP_FREE, 14, 0}, {OP_FREE, 13, 0}, {OP_FREE, 12, 0}, {OP_FREE, 11, 0}, {OP_FREE, 10, 0},
+    {OP_FREE, 9, 0}, {OP_FREE, 8, 0}, {OP_FREE, 7, 0}, {OP_FREE, 6, 0}, {OP_FREE, 5, 0},
+    {OP_FREE, 4, 0}, {OP_FREE, 3, 0}, {OP_FREE, 2, 0}, {OP_FREE, 1, 0}, {OP_FREE, 0, 0},
+    {OP_END, 0, 0},
+};
+
+// Validator header, sent request and received response headers
+static const op_t exchange[] = {
+    {OP_ALLOC, 30, 20},         // "If-None-Match" item, key, value
+    {OP_ALLOC, 31, 16},
+    {OP_ALLOC, 32, 40},
+    {OP_ALLOC, 33, 16},         // Response header key and value strings
+    {OP_ALLOC, 34, 32},
+    {OP_FREE, 33, 0}, {OP_FREE, 34, 0},
+    {OP_ALLOC, 33, 16}, {OP_ALLOC, 34, 32}, {OP_FREE, 33, 0}, {OP_FREE, 34, 0},
+    {OP_ALLOC, 33, 16}, {OP_ALLOC, 34, 32}, {OP_FREE, 33, 0}, {OP_FREE, 34, 0},
+    {OP_ALLOC, 33, 16}, {OP_ALLOC, 34, 32}, {OP_FREE, 33, 0}, {OP_FREE, 34, 0},
+    {OP_ALLOC, 33, 16}, {OP_ALLOC, 34, 48}, {OP_FREE, 33, 0}, {OP_FREE, 34, 0},
+    {OP_ALLOC, 33, 16}, {OP_ALLOC, 34, 32}, {OP_FREE, 33, 0}, {OP_FREE, 34, 0},
+    {OP_END, 0, 0},
+};
+
+// One request with its own client
+static const op_t *const new_client[] = {
+    (const op_t[]){{OP_ALLOC, 40, BENCH_BODY}, {OP_END, 0, 0}},
+    client_init,
+    exchange,
+    (const op_t[]){{OP_FREE, 30, 0}, {OP_FREE, 31, 0}, {OP_FREE, 32, 0}, {OP_END, 0, 0}},
+    client_cleanup,
+    (const op_t[]){{OP_FREE, 40, 0}, {OP_END, 0, 0}},
+    NULL,
+};
+
+// Kept client, new URL and validator, body from the heap
+static const op_t *const kept[] = {
+    (const op_t[]){
+        {OP_ALLOC, 40, BENCH_BODY},
+        {OP_FREE, 16, 0}, {OP_FREE, 17, 0}, {OP_FREE, 18, 0},     // esp_http_client_set_url()
+        {OP_ALLOC, 16, 8}, {OP_ALLOC, 17, 12}, {OP_ALLOC, 18, 8},
+        {OP_FREE, 30, 0}, {OP_FREE, 31, 0}, {OP_FREE, 32, 0},     // esp_http_client_delete_header()
+        {OP_END, 0, 0}},
+    exchange,
+    (const op_t[]){{OP_FREE, 40, 0}, {OP_END, 0, 0}},
+    NULL,
+};
+
+// Kept client, body from the arena
+static const op_t *const kept_arena[] = {
+    (const op_t[]){
+        {OP_ARENA, 0, BENCH_BODY},
+        {OP_FREE, 16, 0}, {OP_FREE, 17, 0}, {OP_FREE, 18, 0},     // esp_http_client_set_url()
+        {OP_ALLOC, 16, 8}, {OP_ALLOC, 17, 12}, {OP_ALLOC, 18, 8},
+        {OP_FREE, 30, 0}, {OP_FREE, 31, 0}, {OP_FREE, 32, 0},     // esp_http_client_delete_header()
+        {OP_END, 0, 0}},
+    exchange,
+    NULL,
+};
+
+static void *s_slots[BENCH_SLOTS];
+static uint32_t s_heap_calls;
+static size_t s_sizes[BENCH_SLOTS];
+static size_t s_heap_now;
+static size_t s_heap_peak;
+static arena_t s_arena;
+static uint8_t s_arena_buffer[BENCH_ARENA_SIZE];
+
+
+/*-----------------------------------------------------------*/
+static void run(const op_t *ops)
+{
+    uint8_t *ptr;
+
+    for (; ops->type != OP_END; ops++) {
+        switch (ops->type) {
+            case OP_ALLOC:
+                ptr = malloc(ops->size);
+                ptr[0] = 1;     // Touch like the code filling it
+                s_slots[ops->slot] = ptr;
+                s_sizes[ops->slot] = ops->size;
+                s_heap_now += ops->size;
+                if (s_heap_now > s_heap_peak) {
+                    s_heap_peak = s_heap_now;
+                }
+                s_heap_calls++;
+                break;
+            case OP_FREE:
+                free(s_slots[ops->slot]);
+                s_slots[ops->slot] = NULL;
+                s_heap_now -= s_sizes[ops->slot];
+                s_heap_calls++;
+                break;
+            case OP_ARENA:
+                ptr = arena_alloc(&s_arena, ops->size);
+                ptr[0] = 1;
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+static void bench(const char *name, const op_t *const *request, int keep_client, size_t arena_size)
+{
+    uint32_t calls;
+    uint32_t allocs;
+
+    memset(s_slots, 0, sizeof(s_slots));
+    s_heap_now = 0;
+    s_heap_peak = 0;
+    arena_init(&s_arena, s_arena_buffer, arena_size);
+    if (keep_client) {
+        // Created once, before the first request
+        run(client_init);
+        run((const op_t[]){{OP_ALLOC, 30, 20}, {OP_ALLOC, 31, 16}, {OP_ALLOC, 32, 40}, {OP_END, 0, 0}});
+    }
+    s_heap_calls = 0;
+
+    for (uint32_t i = 0; i < BENCH_REQUESTS; i++) {
+        for (const op_t *const *part = request; *part != NULL; part++) {
+            run(*part);
+        }
+        arena_reset(&s_arena);
+    }
+    // A heap fallback of the arena is one malloc() and one free()
+    calls = s_heap_calls + 2 * s_arena.heap_allocs;
+    allocs = s_arena.allocs;
+
+    printf("%-11s %10.1f %10.1f %10zu %10zu %10u\n", name,
+           (double)calls / BENCH_REQUESTS, (double)allocs / BENCH_REQUESTS,
+           s_heap_peak, s_arena.high_water, s_arena.heap_allocs);
+
+    if (keep_client) {
+        run((const op_t[]){{OP_FREE, 30, 0}, {OP_FREE, 31, 0}, {OP_FREE, 32, 0}, {OP_END, 0, 0}});
+        run(client_cleanup);
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+int main(void)
+{
+    printf("model: esp_http_client allocations replayed from hand-written traces, not measured\n\n");
+    printf("%-11s %10s %10s %10s %10s %10s\n", "model", "heap/req", "arena/req",
+           "heap peak", "arena hw", "fallbacks");
+    bench("new client", new_client, 0, BENCH_ARENA_SIZE);
+    bench("kept client", kept, 1, BENCH_ARENA_SIZE);
+    bench("kept arena", kept_arena, 1, BENCH_ARENA_SIZE);
+    // Region too small, the body falls back to the heap
+    bench("small arena", kept_arena, 1, 512);
+
+    return 0;
+}
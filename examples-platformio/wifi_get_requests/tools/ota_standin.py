@@ -0,0 +1,190 @@
+#!/usr/bin/env python3
+"""
+Local HTTP server serving a firmware image for OTA tests.
+
+Usage:
+    python3 tools/ota_standin.py .pio/build/esp32cam/firmware.bin
+    python3 tools/ota_standin.py firmware.bin --port 8070 --cut-every 150000 --rate 200
+    python3 tools/ota_standin.py --selftest
+
+Serves the image file at "/firmware.bin" with "Content-Length",
+"ETag" and "Accept-Ranges", answers "Range" requests with "206
+Partial Content" and sends the whole image if "If-Range" does not
+match the ETag (the file changed). With "--cut-every" the connection
+is closed after about that many bytes of every response, to check
+that "ota_stream" resumes the download where it stopped; "--rate"
+limits the rate in kB/s. The SHA-256 printed at start is the value of
+OTA_SHA256 in "include/my_data.h".
+
+The "--selftest" mode serves a random image, downloads it with cut
+connections the same way as "src/ota_stream.c" (Range and If-Range
+from the last written byte) and compares the hash.
+
+Copyright (c) 2022 Tomas Fryza
+Dept. of Radio Electronics, Brno University of Technology, Czechia
+This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+"""
+
+import argparse
+import hashlib
+import http.client
+import http.server
+import os
+import random
+import re
+import sys
+import threading
+import time
+
+CHUNK = 1024
+
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def do_GET(self):
+        server = self.server
+        if self.path.split("?")[0] != "/firmware.bin":
+            self.send_error(404)
+            return
+        image = server.image
+        etag = '"%s"' % server.sha256[:16]
+        start = 0
+
+        match = re.fullmatch(r"bytes=(\d+)-", self.headers.get("Range", ""))
+        if_range = self.headers.get("If-Range")
+        if match and (if_range is None or if_range == etag):
+            start = int(match.group(1))
+            if start >= len(image):
+                self.send_response(416)
+                self.send_header("Content-Range", "bytes */%d" % len(image))
+                self.send_header("Content-Length", "0")
+                self.end_headers()
+                return
+            self.send_response(206)
+            self.send_header("Content-Range", "bytes %d-%d/%d" % (start, len(image) - 1, len(image)))
+        else:
+            self.send_response(200)
+        self.send_header("Content-Type", "application/octet-stream")
+        self.send_header("Content-Length", str(len(image) - start))
+        self.send_header("ETag", etag)
+        self.send_header("Accept-Ranges", "bytes")
+        self.end_headers()
+
+        # Cut the connection somewhere around "cut_every" bytes
+        limit = len(image) - start
+        if server.cut_every:
+            limit = min(limit, int(server.cut_every * server.rng.uniform(0.5, 1.5)))
+        sent = 0
+        while sent < limit:
+            n = min(CHUNK, limit - sent)
+            try:
+                self.wfile.write(image[start + sent:start + sent + n])
+            except (BrokenPipeError, ConnectionResetError):
+                return
+            sent += n
+            if server.rate:
+                time.sleep(n / (server.rate * 1000))
+        if start + sent < len(image):
+            self.close_connection = True
+        if server.verbose:
+            print("%s bytes %d-%d of %d%s" % (self.client_address[0], start, start + sent, len(image),
+                  ", cut" if start + sent < len(image) else ""), file=sys.stderr)
+
+    def log_message(self, format, *args):
+        pass
+
+
+class StandIn(http.server.ThreadingHTTPServer):
+    """HTTP server with one image and fault injection"""
+
+    def __init__(self, port, image, cut_every=0, rate=0.0, seed=1, verbose=True):
+        super().__init__(("0.0.0.0", port), Handler)
+        self.image = image
+        self.sha256 = hashlib.sha256(image).hexdigest()
+        self.cut_every = cut_every
+        self.rate = rate
+        self.rng = random.Random(seed)
+        self.verbose = verbose
+        self.port = self.server_address[1]
+
+
+def download(port, timeout=5.0):
+    """Resume loop like ota_stream_download(), returns image and connections"""
+    data = bytearray()
+    etag = None
+    size = None
+    connections = 0
+    while size is None or len(data) < size:
+        connections += 1
+        conn = http.client.HTTPConnection("127.0.0.1", port, timeout=timeout)
+        headers = {}
+        if data:
+            headers["Range"] = "bytes=%d-" % len(data)
+            headers["If-Range"] = etag
+        conn.request("GET", "/firmware.bin", headers=headers)
+        response = conn.getresponse()
+        if response.status == 200:
+            data = bytearray()
+            size = int(response.getheader("Content-Length"))
+            etag = response.getheader("ETag")
+        elif response.status != 206:
+            raise RuntimeError("status %d" % response.status)
+        try:
+            while len(data) < size:
+                chunk = response.read1(CHUNK)
+                if not chunk:
+                    break
+                data += chunk
+        except (http.client.IncompleteRead, ConnectionError):
+            pass
+        conn.close()
+    return bytes(data), connections
+
+
+def selftest():
+    image = random.Random(2).randbytes(300000)
+    server = StandIn(0, image, cut_every=40000, verbose=False)
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+    data, connections = download(server.port)
+
+    # Image changed on the server: If-Range sends it whole again
+    server.image = random.Random(3).randbytes(100000)
+    server.sha256 = hashlib.sha256(server.image).hexdigest()
+    changed, _ = download(server.port)
+    server.shutdown()
+
+    ok = hashlib.sha256(data).hexdigest() == hashlib.sha256(image).hexdigest() and connections > 1 and \
+        changed == server.image
+    print("selftest: %d bytes in %d connections, sha256 %s: %s" % (
+        len(data), connections, hashlib.sha256(data).hexdigest(), "OK" if ok else "MISMATCH"), file=sys.stderr)
+    return ok
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("image", nargs="?", help="firmware image file")
+    parser.add_argument("-p", "--port", type=int, default=8070, help="TCP port")
+    parser.add_argument("--cut-every", type=int, default=0, help="close connections after about N bytes")
+    parser.add_argument("--rate", type=float, default=0.0, help="limit rate in kB/s")
+    parser.add_argument("--selftest", action="store_true", help="check resumed downloads against the server")
+    args = parser.parse_args()
+
+    if args.selftest:
+        sys.exit(0 if selftest() else 1)
+    if args.image is None:
+        parser.error("image file is required")
+
+    with open(args.image, "rb") as f:
+        image = f.read()
+    server = StandIn(args.port, image, args.cut_every, args.rate)
+    print("serving %s (%d bytes, sha256 %s) at http://<host>:%d/firmware.bin" % (
+        os.path.basename(args.image), len(image), server.sha256, server.port), file=sys.stderr)
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
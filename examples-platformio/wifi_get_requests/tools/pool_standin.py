@@ -0,0 +1,201 @@
+#!/usr/bin/env python3
+"""
+Local HTTP server with the endpoints of the worker pool benchmark.
+
+Usage:
+    python3 tools/pool_standin.py
+    python3 tools/pool_standin.py --port 8071 --delay 200 --jitter 50
+    python3 tools/pool_standin.py --selftest
+
+Answers "/json", "/uuid" and "/get" like httpbin.org, on kept
+HTTP/1.1 connections, after a fixed "--delay" (plus random "--jitter")
+in milliseconds. Unlike the public server the delay does not depend
+on the internet connection, so the times of "HttpPoolBenchmarkTask"
+with 1..N workers compare the pool only. Set HTTP_POOL_ENABLE in
+"include/my_data.h" to 1 and HTTP_POOL_BASE_URL in
+"src/main.c" to "http://<host>:<port>". Every second with traffic a
+line shows requests, open connections and the most requests served
+at the same time, which must reach the number of active workers.
+
+The "--selftest" mode runs a small pool with the rules of
+"src/http_pool.c" (workers with kept connections, per-host limit)
+against the server and checks that the time drops with more workers
+and that the peak concurrency follows the workers and the limit.
+
+Copyright (c) 2022 Tomas Fryza
+Dept. of Radio Electronics, Brno University of Technology, Czechia
+This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+"""
+
+import argparse
+import http.client
+import http.server
+import json
+import queue
+import random
+import socket
+import sys
+import threading
+import time
+import uuid
+
+PATHS = ("/json", "/uuid", "/get")
+
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def setup(self):
+        super().setup()
+        # Headers and body are written apart, no Nagle delay between them
+        self.connection.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        with self.server.lock:
+            self.server.connections += 1
+
+    def finish(self):
+        super().finish()
+        with self.server.lock:
+            self.server.connections -= 1
+
+    def do_GET(self):
+        server = self.server
+        path = self.path.split("?")[0]
+        if path not in PATHS:
+            self.send_error(404)
+            return
+        with server.lock:
+            server.active += 1
+            server.peak = max(server.peak, server.active)
+            server.requests += 1
+            delay = server.delay + server.rng.uniform(-server.jitter, server.jitter)
+        time.sleep(max(0.0, delay) / 1000)
+
+        if path == "/json":
+            body = {"slideshow": {"author": "stand-in", "title": "Configuration", "slides": []}}
+        elif path == "/uuid":
+            body = {"uuid": str(uuid.uuid4())}
+        else:
+            body = {"args": {}, "headers": dict(self.headers), "origin": self.client_address[0], "url": self.path}
+        data = json.dumps(body, indent=2).encode() + b"\n"
+        self.send_response(200)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(data)))
+        self.end_headers()
+        self.wfile.write(data)
+        with server.lock:
+            server.active -= 1
+
+    def log_message(self, format, *args):
+        pass
+
+
+class StandIn(http.server.ThreadingHTTPServer):
+    """httpbin.org endpoints with a controlled response time"""
+
+    daemon_threads = True
+
+    def __init__(self, port, delay, jitter=0.0, seed=1):
+        super().__init__(("0.0.0.0", port), Handler)
+        self.delay = delay
+        self.jitter = jitter
+        self.rng = random.Random(seed)
+        self.lock = threading.Lock()
+        self.connections = 0
+        self.active = 0
+        self.peak = 0
+        self.requests = 0
+        self.port = self.server_address[1]
+
+    def reset_peak(self):
+        with self.lock:
+            self.peak = self.active
+
+
+def pool_run(port, workers, per_host_limit, requests):
+    """Fetch the endpoints in turn like HttpPoolBenchmarkTask(), return seconds"""
+    jobs = queue.Queue()
+    for i in range(requests):
+        jobs.put(PATHS[i % len(PATHS)])
+    host_slots = threading.Semaphore(per_host_limit)
+    errors = []
+
+    def worker():
+        conn = http.client.HTTPConnection("127.0.0.1", port, timeout=10)
+        while True:
+            try:
+                path = jobs.get_nowait()
+            except queue.Empty:
+                break
+            with host_slots:
+                conn.request("GET", path)
+                response = conn.getresponse()
+                response.read()
+                if response.status != 200:
+                    errors.append(response.status)
+        conn.close()
+
+    threads = [threading.Thread(target=worker) for _ in range(workers)]
+    start = time.monotonic()
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    if errors:
+        raise RuntimeError("status %s" % errors)
+    return time.monotonic() - start
+
+
+def selftest():
+    server = StandIn(0, delay=50)
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+    ok = True
+    times = []
+    for workers, limit in ((1, 4), (2, 4), (4, 4), (4, 2)):
+        server.reset_peak()
+        elapsed = pool_run(server.port, workers, limit, 12)
+        expected = min(workers, limit)
+        times.append(elapsed)
+        good = server.peak == expected
+        ok = ok and good
+        print("%u worker(s), %u per host: 12 requests in %4.0f ms, peak %u in flight (expected %u)%s" % (
+            workers, limit, elapsed * 1000, server.peak, expected, "" if good else " FAIL"), file=sys.stderr)
+    server.shutdown()
+
+    # 12 requests of 50 ms: about 600, 300, 150 ms; the host limit caps 4 workers at 2
+    ok = ok and times[0] > 1.6 * times[1] and times[1] > 1.6 * times[2] and times[3] > 1.6 * times[2]
+    print("selftest: %s" % ("OK" if ok else "FAIL"), file=sys.stderr)
+    return ok
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("-p", "--port", type=int, default=8071, help="TCP port")
+    parser.add_argument("--delay", type=float, default=200.0, help="response time in ms")
+    parser.add_argument("--jitter", type=float, default=0.0, help="random +- ms added to the delay")
+    parser.add_argument("--selftest", action="store_true", help="check a local pool against the server")
+    args = parser.parse_args()
+
+    if args.selftest:
+        sys.exit(0 if selftest() else 1)
+
+    server = StandIn(args.port, args.delay, args.jitter)
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+    print("serving %s at http://<host>:%d, delay %.0f +- %.0f ms" % (
+        ", ".join(PATHS), server.port, args.delay, args.jitter), file=sys.stderr)
+    last = 0
+    try:
+        while True:
+            time.sleep(1.0)
+            with server.lock:
+                requests, connections, peak = server.requests, server.connections, server.peak
+                server.peak = server.active
+            if requests != last:
+                print("%d requests, %d connections, peak %d in flight" % (requests, connections, peak),
+                      file=sys.stderr)
+                last = requests
+    except KeyboardInterrupt:
+        server.shutdown()
+
+
+if __name__ == "__main__":
+    main()
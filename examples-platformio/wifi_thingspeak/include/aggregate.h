@@ -0,0 +1,63 @@
+/*
+  On-device aggregation and report-by-exception filter.
+
+  Recent DHT12 samples are kept in a fixed-size ring, windowed
+  min/max/mean/last are computed on request. A sample is reported
+  only if temperature or humidity moved past its deadband since
+  the last report, or when the heartbeat interval elapsed.
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+ */
+
+#ifndef AGGREGATE
+#define AGGREGATE
+
+
+/*-----------------------------------------------------------*/
+#include <stdbool.h>
+#include <stdint.h>
+#include <dht12.h>
+
+
+/*-----------------------------------------------------------*/
+#define AGGREGATE_RING_LEN 16
+
+
+/*-----------------------------------------------------------*/
+typedef struct {
+    int16_t temp_deadband;      // Tenths of degree Celsius
+    int16_t humid_deadband;     // Tenths of percent
+    uint32_t heartbeat_ms;      // Report at least this often
+} aggregate_config_t;
+
+// Window statistics of one quantity, in tenths
+typedef struct {
+    int16_t min;
+    int16_t max;
+    int16_t mean;
+    int16_t last;
+} aggregate_stats_t;
+
+typedef struct {
+    uint8_t count;              // Samples in the window
+    aggregate_stats_t temp;
+    aggregate_stats_t humid;
+} aggregate_window_t;
+
+typedef struct {
+    uint32_t samples;
+    uint32_t reported;
+    uint32_t suppressed;
+} aggregate_counters_t;
+
+
+/*-----------------------------------------------------------*/
+// Used function(s)
+void aggregate_init(const aggregate_config_t *config);
+bool aggregate_add(const struct DHT12_values_structure *sample, uint32_t now_ms);
+bool aggregate_get_window(uint8_t window, aggregate_window_t *result);
+void aggregate_get_counters(aggregate_counters_t *counters);
+
+#endif
@@ -0,0 +1,94 @@
+/*
+  Streaming deflate compressor with a small window and fixed memory.
+
+  Input is written in pieces of any size, compressed output is passed
+  to a write function in pieces of at most DEFLATE_STREAM_OUT_SIZE
+  bytes. The whole state lives in one deflate_stream_t (about 2.7 kB
+  with the default 512-byte window), nothing is allocated. Matches are
+  found over hash chains and coded with the fixed Huffman tables of
+  RFC 1951, which is a good fit for short, repetitive JSON or CSV
+  batches. Output is a raw deflate stream, or wrapped as zlib (HTTP
+  "Content-Encoding: deflate") or gzip ("Content-Encoding: gzip").
+
+  The module has no other dependency than <esp_err.h>, so it also
+  builds on the host, see "tools/deflate_bench.c".
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+ */
+
+#ifndef DEFLATE_STREAM
+#define DEFLATE_STREAM
+
+
+/*-----------------------------------------------------------*/
+#include <stddef.h>
+#include <stdint.h>
+#ifdef ESP_PLATFORM
+#include <esp_err.h>
+#else
+typedef int esp_err_t;
+#define ESP_OK               0
+#define ESP_FAIL             -1
+#define ESP_ERR_INVALID_ARG  0x102
+#define ESP_ERR_INVALID_SIZE 0x104
+#endif
+
+
+/*-----------------------------------------------------------*/
+#ifndef DEFLATE_STREAM_WINDOW_BITS
+#define DEFLATE_STREAM_WINDOW_BITS 9        // 512-byte window, 9..14
+#endif
+#ifndef DEFLATE_STREAM_HASH_BITS
+#define DEFLATE_STREAM_HASH_BITS   8
+#endif
+#define DEFLATE_STREAM_MAX_CHAIN   16       // Candidates tried per byte
+#define DEFLATE_STREAM_OUT_SIZE    128      // Output piece
+
+#define DEFLATE_STREAM_WINDOW      (1 << DEFLATE_STREAM_WINDOW_BITS)
+#define DEFLATE_STREAM_HASH_SIZE   (1 << DEFLATE_STREAM_HASH_BITS)
+
+
+/*-----------------------------------------------------------*/
+typedef enum {
+    DEFLATE_STREAM_RAW,         // RFC 1951 only
+    DEFLATE_STREAM_ZLIB,        // RFC 1950, HTTP "deflate"
+    DEFLATE_STREAM_GZIP,        // RFC 1952, HTTP "gzip"
+} deflate_stream_format_t;
+
+// Receives compressed output, anything but ESP_OK stops the stream
+typedef esp_err_t (*deflate_stream_write_t)(void *ctx, const uint8_t *data, size_t len);
+
+// Compressor state, see deflate_stream_init()
+typedef struct {
+    deflate_stream_format_t format;
+    deflate_stream_write_t write;
+    void *ctx;
+    esp_err_t err;              // First error of the write function
+    uint8_t window[2 * DEFLATE_STREAM_WINDOW];  // History and lookahead
+    uint16_t head[DEFLATE_STREAM_HASH_SIZE];    // Last position + 1 of hash
+    uint16_t prev[DEFLATE_STREAM_WINDOW];       // Older position + 1
+    uint16_t pos;               // Next byte to code
+    uint16_t fill;              // Bytes in window
+    uint32_t bits;              // Output bits not yet in "out"
+    uint8_t bit_count;
+    uint8_t out[DEFLATE_STREAM_OUT_SIZE];
+    uint16_t out_len;
+    uint32_t check;             // Adler-32 or CRC-32 of the input
+    uint32_t total_in;
+    uint32_t total_out;
+} deflate_stream_t;
+
+
+/*-----------------------------------------------------------*/
+// Used function(s)
+esp_err_t deflate_stream_init(deflate_stream_t *s, deflate_stream_format_t format,
+                              deflate_stream_write_t write, void *ctx);
+esp_err_t deflate_stream_write(deflate_stream_t *s, const void *data, size_t len);
+esp_err_t deflate_stream_finish(deflate_stream_t *s);
+size_t deflate_stream_compress(deflate_stream_t *s, deflate_stream_format_t format,
+                               const void *data, size_t len, uint8_t *buf, size_t size);
+const char *deflate_stream_encoding(deflate_stream_format_t format);
+
+#endif
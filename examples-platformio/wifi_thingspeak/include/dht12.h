@@ -0,0 +1,46 @@
+#ifndef DHT12
+#define DHT12
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// DHT12 sensor values
+struct DHT12_values_structure {
+    uint8_t humidInt;
+    uint8_t humidDec;
+    uint8_t tempInt;
+    uint8_t tempDec;        // Bit 7 is the sign of temperature
+    uint8_t checksum;
+};
+
+// Temperature in tenths of degree Celsius
+static inline int16_t dht12_temp_x10(const struct DHT12_values_structure *dht)
+{
+    int16_t value = dht->tempInt * 10 + (dht->tempDec & 0x7f);
+    return (dht->tempDec & 0x80) ? -value : value;
+}
+
+// Relative humidity in tenths of percent
+static inline int16_t dht12_humid_x10(const struct DHT12_values_structure *dht)
+{
+    return dht->humidInt * 10 + dht->humidDec;
+}
+
+// Checksum is the low byte of the sum of the four data bytes
+static inline bool dht12_checksum_ok(const struct DHT12_values_structure *dht)
+{
+    return (uint8_t)(dht->humidInt + dht->humidDec + dht->tempInt + dht->tempDec) == dht->checksum;
+}
+
+// Store filtered values back in the sensor format
+static inline void dht12_set_x10(struct DHT12_values_structure *dht, int16_t temp, int16_t humid)
+{
+    uint16_t abs_temp = (temp < 0) ? -temp : temp;
+
+    dht->tempInt = abs_temp / 10;
+    dht->tempDec = (abs_temp % 10) | ((temp < 0) ? 0x80 : 0);
+    dht->humidInt = humid / 10;
+    dht->humidDec = humid % 10;
+}
+
+#endif
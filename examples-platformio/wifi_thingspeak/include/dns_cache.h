@@ -0,0 +1,66 @@
+/*
+  DNS resolver cache with TTLs and background refresh.
+
+  Addresses of the upload hosts are resolved with a minimal DNS
+  A-record query to the station's DNS server, so the record TTL is
+  known. A background task refreshes every entry when 80 % of its TTL
+  has passed, so uploads normally find a fresh address and never wait
+  for a DNS round trip. Hosts are resolved ahead as soon as the
+  station gets an IP address (dns_cache_prefetch()). If the server
+  cannot be reached, an expired entry is still served for up to
+  DNS_CACHE_MAX_STALE_S seconds.
+
+  If the own query fails for other reasons than a non-existing name,
+  lwIP getaddrinfo() is used instead with a fixed TTL.
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+ */
+
+#ifndef DNS_CACHE
+#define DNS_CACHE
+
+
+/*-----------------------------------------------------------*/
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+
+
+/*-----------------------------------------------------------*/
+#define DNS_CACHE_MAX_HOSTS        4
+#define DNS_CACHE_MAX_NAME         64
+#define DNS_CACHE_MIN_TTL_S        30       // Shorter TTLs are raised
+#define DNS_CACHE_MAX_TTL_S        86400
+#define DNS_CACHE_FALLBACK_TTL_S   300      // getaddrinfo() gives no TTL
+#define DNS_CACHE_MAX_STALE_S      3600     // Expired entry still served
+#define DNS_CACHE_REFRESH_PERMILLE 800      // Refresh at 80 % of TTL
+#define DNS_CACHE_RETRY_S          10       // After a failed refresh
+#define DNS_CACHE_TIMEOUT_MS       2000     // One query attempt
+
+
+/*-----------------------------------------------------------*/
+typedef struct {
+    uint32_t hits;              // Fresh entry found
+    uint32_t misses;            // Lookup needed
+    uint32_t stale_hits;        // Lookup failed, expired entry served
+    uint32_t failures;          // Nothing to serve
+    uint32_t refreshes;         // Background lookups
+    uint32_t lookups;           // All network lookups
+    int64_t lookup_sum_us;
+    int64_t lookup_max_us;
+    int64_t last_lookup_us;
+} dns_cache_stats_t;
+
+
+/*-----------------------------------------------------------*/
+// Used function(s)
+esp_err_t dns_cache_init(void);
+esp_err_t dns_cache_add_host(const char *host);
+void dns_cache_prefetch(void);
+esp_err_t dns_cache_resolve(const char *host, uint32_t *addr);
+esp_err_t dns_cache_resolve_str(const char *host, char *ip, size_t size);
+void dns_cache_get_stats(dns_cache_stats_t *stats);
+
+#endif
@@ -0,0 +1,76 @@
+/*
+  Fixed-point filtering kernels for sensor samples.
+
+  Moving average, exponential smoothing, streaming median and
+  Hampel outlier rejection over 16-bit samples (e.g. tenths of
+  degree). No floating point, no dynamic allocation; every filter
+  keeps its state in a caller owned structure.
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+ */
+
+#ifndef FILTERS
+#define FILTERS
+
+
+/*-----------------------------------------------------------*/
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/*-----------------------------------------------------------*/
+#define FILTER_MAX_WINDOW 15    // Longest window (odd for median)
+
+// Q8 fixed-point helpers, 1.0 == 256
+#define FILTER_Q8(x) ((uint16_t)((x) * 256 + 0.5))
+
+
+/*-----------------------------------------------------------*/
+// Ring of the last "size" samples
+typedef struct {
+    int16_t buf[FILTER_MAX_WINDOW];
+    uint8_t size;
+    uint8_t head;               // Next write position
+    uint8_t count;
+} filter_ring_t;
+
+typedef struct {
+    filter_ring_t ring;
+    int32_t sum;
+} filter_mavg_t;
+
+typedef struct {
+    int32_t state;              // Output in Q8
+    uint16_t alpha;             // Smoothing factor in Q8, 1..256
+    bool primed;
+} filter_ema_t;
+
+typedef struct {
+    filter_ring_t ring;
+    int16_t sorted[FILTER_MAX_WINDOW];
+} filter_median_t;
+
+typedef struct {
+    filter_median_t median;
+    uint16_t threshold;         // Number of scaled MADs in Q8, e.g. FILTER_Q8(3)
+    uint32_t outliers;          // Replaced samples
+} filter_hampel_t;
+
+
+/*-----------------------------------------------------------*/
+// Used function(s)
+void filter_mavg_init(filter_mavg_t *f, uint8_t size);
+int16_t filter_mavg_update(filter_mavg_t *f, int16_t x);
+
+void filter_ema_init(filter_ema_t *f, uint16_t alpha);
+int16_t filter_ema_update(filter_ema_t *f, int16_t x);
+
+void filter_median_init(filter_median_t *f, uint8_t size);
+int16_t filter_median_update(filter_median_t *f, int16_t x);
+
+void filter_hampel_init(filter_hampel_t *f, uint8_t size, uint16_t threshold);
+int16_t filter_hampel_update(filter_hampel_t *f, int16_t x);
+
+#endif
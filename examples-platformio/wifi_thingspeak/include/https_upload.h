@@ -0,0 +1,82 @@
+/*
+  Persistent HTTPS connection for uploads with TLS session resumption.
+
+  The connection to one host is kept open (HTTP/1.1 keep-alive). When
+  it has to be re-established, the TLS session ticket of the previous
+  connection is offered to the server, so the expensive asymmetric
+  part of the handshake is skipped. The CA certificate is parsed only
+  once and then shared by all connections.
+
+  A request is sent once. A kept connection idle for longer than
+  HTTPS_UPLOAD_MAX_IDLE_MS, or already closed by the server, is
+  replaced by a new one before writing: a write into a socket the
+  server has closed usually still succeeds and only the response is
+  lost. If writing fails anyway, the request is written again over a
+  new connection; once it is written, a failed response is returned
+  as an error and not repeated, because ThingSpeak would store the
+  sample twice.
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+ */
+
+#ifndef HTTPS_UPLOAD
+#define HTTPS_UPLOAD
+
+
+/*-----------------------------------------------------------*/
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+
+
+/*-----------------------------------------------------------*/
+#define HTTPS_UPLOAD_PORT        443
+#define HTTPS_UPLOAD_TIMEOUT_MS  10000
+#define HTTPS_UPLOAD_MAX_HOST    64
+#define HTTPS_UPLOAD_MAX_REQUEST 512    // Request line and headers
+#define HTTPS_UPLOAD_HEAP_SAMPLE_US 1000 // Free heap sampling during handshakes
+// Longest idle time of a kept connection, below the keep-alive
+// timeout of the server (5 s of Apache, 60 s and more of others)
+#define HTTPS_UPLOAD_MAX_IDLE_MS 4000
+
+
+/*-----------------------------------------------------------*/
+// Connection and handshake counters
+typedef struct {
+    uint32_t requests;
+    uint32_t failed;
+    uint32_t full_handshakes;       // No session ticket was available
+    uint32_t resumed_handshakes;    // Session ticket offered to server
+    uint32_t stale_closes;          // Kept connection idle too long or closed by server
+    int64_t full_handshake_us;      // Sum of full handshake times
+    int64_t resumed_handshake_us;   // Sum of resumed handshake times
+    int64_t last_handshake_us;
+    size_t heap_before_handshake;   // Free heap before last handshake
+    size_t heap_handshake_used;     // Largest heap use during last handshake
+    size_t heap_handshake_max_used; // Largest of all handshakes
+    size_t heap_min_free_ever;      // Lowest free heap since boot
+} https_upload_stats_t;
+
+// Times (esp_timer_get_time()) of one request, steps skipped on an
+// open connection are 0
+typedef struct {
+    int64_t dns_us;                 // Host name resolved
+    int64_t connect_us;             // Handshake finished
+    int64_t sent_us;                // Request written
+} https_upload_timing_t;
+
+
+/*-----------------------------------------------------------*/
+// Used function(s)
+esp_err_t https_upload_init(const char *host, const char *ca_pem);
+esp_err_t https_upload_get(const char *path, char *response, size_t response_size, int *status);
+esp_err_t https_upload_get_timed(const char *path, char *response, size_t response_size, int *status,
+                                 https_upload_timing_t *timing);
+esp_err_t https_upload_post(const char *path, const char *content_type, const char *content_encoding,
+                            const void *body, size_t body_len, char *response, size_t response_size, int *status);
+void https_upload_close(void);
+void https_upload_get_stats(https_upload_stats_t *stats);
+
+#endif
@@ -0,0 +1,69 @@
+/*
+  MQTT telemetry transport with offline outbox and batching.
+
+  One persistent MQTT session is kept open. Samples are put into
+  a fixed-size outbox; while the broker still has not acknowledged
+  previous messages (or the session is down), new samples wait in
+  the outbox and are then coalesced into a single publish. Batches
+  can be published as zlib stream (see "deflate_stream.h"), MQTT
+  3.1.1 has no content coding, so subscribers must expect it.
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+ */
+
+#ifndef MQTT_TRANSPORT
+#define MQTT_TRANSPORT
+
+
+/*-----------------------------------------------------------*/
+#include <stdint.h>
+#include <esp_err.h>
+#include <payload.h>
+
+
+/*-----------------------------------------------------------*/
+#define MQTT_TRANSPORT_OUTBOX_LEN   64      // Samples kept while offline
+#define MQTT_TRANSPORT_MAX_FIELDS   4       // Values per sample
+#define MQTT_TRANSPORT_MAX_TOPIC    64
+#define MQTT_TRANSPORT_MAX_MESSAGE  512     // Longest (batched) publish
+#define MQTT_TRANSPORT_MAX_INFLIGHT 1       // Unacknowledged publishes
+
+
+/*-----------------------------------------------------------*/
+typedef struct {
+    const char *uri;            // e.g. "mqtt://192.168.1.10:1883"
+    const char *client_id;
+    const char *username;
+    const char *password;
+    const char *topic;
+    uint8_t qos;                // 0, 1 or 2
+    uint8_t max_batch;          // Samples per publish, 1 disables batching
+    bool compress;              // Batches as zlib stream
+    const payload_field_t *fields;
+    uint8_t field_count;
+} mqtt_transport_config_t;
+
+// Transport counters
+typedef struct {
+    uint32_t samples;           // Samples accepted to outbox
+    uint32_t dropped;           // Oldest samples overwritten while offline
+    uint32_t published;         // Publish messages sent
+    uint32_t published_samples; // Samples carried by these messages
+    uint32_t acked;             // Acknowledged by broker (QoS > 0)
+    uint32_t bytes;             // Payload bytes sent
+    uint32_t raw_bytes;         // Same before compression
+    int64_t ack_latency_us;     // Sum of publish-to-ack times
+    uint8_t outbox;             // Samples waiting right now
+    bool connected;
+} mqtt_transport_stats_t;
+
+
+/*-----------------------------------------------------------*/
+// Used function(s)
+esp_err_t mqtt_transport_init(const mqtt_transport_config_t *config);
+esp_err_t mqtt_transport_send(const int32_t *values);
+void mqtt_transport_get_stats(mqtt_transport_stats_t *stats);
+
+#endif
@@ -7,4 +7,77 @@
 
 static const char *THINGSPEAK_WRITE_API_KEY = "REPLACE_WITH_YOUR_API_KEY";
 
+// Upload over HTTPS (1) or plain HTTP (0). Set 1 to keep the API key
+// off the air; the first request then needs about 40 kB of heap more
+// for the TLS handshake
+#define THINGSPEAK_USE_HTTPS 0
+// Samples per ThingSpeak bulk update over HTTPS, 1 sends every sample
+// with its own GET request
+#define UPLOAD_BATCH 1
+#define THINGSPEAK_CHANNEL_ID "REPLACE_WITH_YOUR_CHANNEL_ID"
+// Send bulk updates gzip compressed (1), plain JSON is sent again if
+// the server refuses the "Content-Encoding"
+#define UPLOAD_COMPRESS 1
+
+// Move to a better access point of the networks in "src/main.c" (1),
+// scans start only when the link is weaker than the RSSI or more
+// uploads fail, another AP must score the hysteresis better. Set 1
+// after adding the networks to "roam_networks" in "src/main.c"
+#define ROAM_ENABLE 0
+#define ROAM_SCAN_BELOW_RSSI -67
+#define ROAM_SCAN_FAILURE_PERMILLE 200
+#define ROAM_HYSTERESIS_DB 8
+#define ROAM_SCAN_INTERVAL_S 10
+
+// Serve the latest reading at /latest and metrics at /metrics to
+// LAN clients (1), see "tools/status_load.py". Set 1 only on a
+// trusted network, the server has no authentication
+#define STATUS_SERVER_ENABLE 0
+#define STATUS_SERVER_PORT 80
+#define STATUS_SERVER_MAX_CLIENTS 4
+
+// Read the sensor every 15 s while values change, backing off up to
+// every 4 minutes while they are stable (1); or every 60 s (0). 15 s
+// is the shortest update interval of a free ThingSpeak channel. Set 1
+// to follow fast changes with fewer uploads in total
+#define SAMPLE_ADAPTIVE 0
+#define SAMPLE_MIN_PERIOD_MS 15000
+#define SAMPLE_MAX_PERIOD_MS 240000
+
+// SNTP server for sample time stamps, for tests "tools/ntp_standin.py"
+// on the local network, e.g. "192.168.1.10" with port 12300
+#define TIME_NTP_SERVER "pool.ntp.org"
+#define TIME_NTP_PORT 123
+#define TIME_SYNC_INTERVAL_S 3600
+
+// Send samples over one MQTT session (1) instead of HTTP(S) requests (0)
+#define TELEMETRY_USE_MQTT 0
+#define MQTT_BROKER_URI "mqtt://mqtt3.thingspeak.com"
+// #define MQTT_BROKER_URI "mqtt://192.168.1.10:1883"  // Local Mosquitto
+#define MQTT_CLIENT_ID "REPLACE_WITH_YOUR_MQTT_CLIENT_ID"
+#define MQTT_USERNAME "REPLACE_WITH_YOUR_MQTT_USERNAME"
+#define MQTT_PASSWORD "REPLACE_WITH_YOUR_MQTT_PASSWORD"
+#define MQTT_TOPIC "channels/REPLACE_WITH_YOUR_CHANNEL_ID/publish"
+#define MQTT_QOS 1
+// ThingSpeak accepts one sample per message, other brokers may batch
+#define MQTT_MAX_BATCH 1
+// Publish batches as zlib stream (1), subscribers must inflate them
+#define MQTT_COMPRESS 0
+
+// Run with simulated DHT12, Wi-Fi and uploads (1) and log benchmark
+// results, or with the real hardware (0)
+#define SIMULATION 0
+#define SIM_SEED 1
+#define SIM_SAMPLE_PERIOD_MS 100
+#define SIM_DHT12_LATENCY_MS 2
+#define SIM_DHT12_TIMEOUT_PERMILLE 5
+#define SIM_DHT12_CHECKSUM_PERMILLE 5
+// No radio (1), uploads are answered in-process after the latency;
+// or real Wi-Fi (0) with uploads to a local stand-in HTTP server
+#define SIM_FAKE_WIFI 1
+#define SIM_HTTP_HOST "192.168.1.10"
+#define SIM_HTTP_PORT 8080
+#define SIM_HTTP_LATENCY_MS 80
+#define SIM_HTTP_ERROR_PERMILLE 10
+
 #endif
@@ -0,0 +1,67 @@
+/*
+  Offset, drift and error bound of the local clock against SNTP.
+
+  The arithmetic of the "timekeeper" module. SNTP time stamps are
+  converted from and to microseconds since 1970, and one exchange
+  (local send and receive time, server receive and transmit time)
+  gives the offset between both clocks and its round trip. The
+  offsets of two syncs far enough apart give the drift of the local
+  crystal. With it, the offset is predicted for any local time, along
+  with a bound of its error.
+
+  Locking, sockets and NVS are left to "src/timekeeper.c". The
+  module has no ESP-IDF dependency, "tools/clock_bench.c" checks it
+  on the host against simulated clocks.
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+ */
+
+#ifndef NTP_CLOCK
+#define NTP_CLOCK
+
+
+/*-----------------------------------------------------------*/
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/*-----------------------------------------------------------*/
+#define NTP_CLOCK_MIN_DRIFT_SPAN_S  60          // Syncs closer are not used for drift
+#define NTP_CLOCK_MAX_DRIFT_PPB     500000      // Crystal worse than 500 ppm is an error
+#define NTP_CLOCK_DRIFT_ERROR_PPB   50000       // Assumed until drift is measured
+#define NTP_CLOCK_RESIDUAL_PPB      5000        // Left after drift correction
+
+
+/*-----------------------------------------------------------*/
+// One request/response exchange, times in microseconds
+typedef struct {
+    int64_t offset_us;          // UTC minus local time
+    int64_t delay_us;           // Round trip without server time
+    int64_t local_us;           // Midpoint of the exchange
+} ntp_clock_sample_t;
+
+// Mapping from local time to UTC
+typedef struct {
+    bool synced;
+    int64_t base_offset_us;     // Measured at "base_us"
+    int64_t base_us;
+    uint32_t sync_error_us;     // Half round trip of the last sync
+    int32_t drift_ppb;          // Local clock slower (+) or faster (-)
+    bool drift_known;           // Measured or loaded
+    ntp_clock_sample_t prev;    // Earlier sync, for the drift estimate
+    bool prev_valid;
+} ntp_clock_t;
+
+
+/*-----------------------------------------------------------*/
+// Used function(s)
+void ntp_clock_put_time(uint8_t *buf, int64_t unix_us);
+int64_t ntp_clock_get_time(const uint8_t *buf);
+void ntp_clock_sample(int64_t t1, int64_t t2, int64_t t3, int64_t t4, ntp_clock_sample_t *sample);
+int64_t ntp_clock_apply(ntp_clock_t *clock, const ntp_clock_sample_t *sample);
+int64_t ntp_clock_predict(const ntp_clock_t *clock, int64_t time_us);
+uint32_t ntp_clock_error_us(const ntp_clock_t *clock, int64_t time_us, uint32_t update_ms);
+
+#endif
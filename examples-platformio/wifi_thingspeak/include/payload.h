@@ -0,0 +1,58 @@
+/*
+  Heap-free and printf-free encoder for upload payloads.
+
+  A template is prepared once (constant prefix and field names with
+  their lengths), then each sample only writes fixed-point values
+  into a caller supplied buffer. Output never exceeds the buffer,
+  the encoder returns 0 instead.
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+ */
+
+#ifndef PAYLOAD
+#define PAYLOAD
+
+
+/*-----------------------------------------------------------*/
+#include <stddef.h>
+#include <stdint.h>
+
+
+/*-----------------------------------------------------------*/
+#define PAYLOAD_MAX_FIELDS 8
+
+
+/*-----------------------------------------------------------*/
+typedef enum {
+    PAYLOAD_URL_QUERY,      // prefix&field1=23.5&field2=41.0
+    PAYLOAD_JSON,           // {prefix,"field1":23.5,"field2":41.0}
+    PAYLOAD_CBOR,           // Map of text keys and decimal fractions
+} payload_format_t;
+
+// One field: name and number of decimal places of its value
+typedef struct {
+    const char *key;
+    uint8_t decimals;
+} payload_field_t;
+
+// Prepared template, see payload_template_init()
+typedef struct {
+    payload_format_t format;
+    const char *prefix;
+    uint16_t prefix_len;
+    uint8_t field_count;
+    payload_field_t fields[PAYLOAD_MAX_FIELDS];
+    uint8_t key_len[PAYLOAD_MAX_FIELDS];
+} payload_template_t;
+
+
+/*-----------------------------------------------------------*/
+// Used function(s)
+int payload_template_init(payload_template_t *tpl, payload_format_t format, const char *prefix,
+                          const payload_field_t *fields, uint8_t field_count);
+size_t payload_encode(const payload_template_t *tpl, const int32_t *values, uint8_t *buf, size_t size);
+size_t payload_write_fixed(int32_t value, uint8_t decimals, char *buf, size_t size);
+
+#endif
@@ -0,0 +1,82 @@
+/*
+  Roaming between access points while connected.
+
+  The manager keeps a table of access points (BSSIDs) of all candidate
+  networks with smoothed RSSI, upload throughput and failure rate of
+  each. While connected it watches the link RSSI and the failure rate
+  of uploads (roam_report_upload()). Only when the link gets weak or
+  uploads fail, it scans in background, one channel every few seconds
+  with a short dwell time, on the channels where candidates were seen
+  (all channels now and then to find new ones). When another BSSID
+  scores at least "hysteresis_db" better than the current one, the
+  station is moved there.
+
+  Score of a BSSID is its RSSI in dBm, plus 3 dB per doubling of past
+  upload throughput compared to the current AP (at most 6 dB), minus
+  1 dB per 5 % of failed uploads and 10 dB per failed connection.
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+ */
+
+#ifndef ROAM
+#define ROAM
+
+
+/*-----------------------------------------------------------*/
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <esp_err.h>
+
+
+/*-----------------------------------------------------------*/
+#define ROAM_MAX_NETWORKS     4
+#define ROAM_MAX_BSSIDS       12
+#define ROAM_MONITOR_MS       5000      // Link check period
+#define ROAM_SCAN_DWELL_MS    40        // Active scan per channel
+#define ROAM_FULL_SCAN_S      900       // All channels, finds new APs
+#define ROAM_MIN_DWELL_S      60        // No roam sooner after the last one
+#define ROAM_CONNECT_TIMEOUT_S 15       // Roam failed, any AP is taken
+#define ROAM_RECONNECT_S      30        // Retry after the driver gave up
+#define ROAM_ENTRY_TIMEOUT_S  600       // BSSID not seen is forgotten
+
+
+/*-----------------------------------------------------------*/
+typedef struct {
+    const char *ssid;
+    const char *password;
+} roam_network_t;
+
+typedef struct {
+    const roam_network_t *networks;     // Candidate networks
+    uint8_t network_count;
+    int8_t scan_below_rssi;             // Scan when the link is weaker, e.g. -67
+    uint16_t scan_failure_permille;     // ... or more uploads fail
+    uint8_t hysteresis_db;              // Required score improvement
+    uint32_t scan_interval_s;           // Between background channel scans
+} roam_config_t;
+
+typedef struct {
+    bool connected;
+    int8_t rssi;                // Smoothed link RSSI
+    uint8_t channel;
+    uint8_t bssid[6];
+    uint16_t failure_permille;  // Smoothed upload failure rate
+    uint32_t channel_scans;     // Background scans of one channel
+    uint32_t full_scans;
+    uint32_t roams;
+    uint32_t roam_failures;     // Target AP could not be joined
+    uint8_t candidates;         // Known BSSIDs
+} roam_stats_t;
+
+
+/*-----------------------------------------------------------*/
+// Used function(s)
+esp_err_t roam_init(const roam_config_t *config);
+esp_err_t roam_connect_best(void);
+void roam_report_upload(bool ok, size_t bytes, int64_t latency_us);
+void roam_get_stats(roam_stats_t *stats);
+
+#endif
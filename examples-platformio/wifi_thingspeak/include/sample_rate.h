@@ -0,0 +1,99 @@
+/*
+  Adaptive sampling period driven by signal variability.
+
+  Every sample is checked channel by channel (e.g. temperature and
+  humidity of each sensor). A step larger than the channel deadband
+  that is also faster than its slope limit, or an exponentially
+  weighted standard deviation above its limit, is a change: the
+  period drops to "min_period_ms" at once and stays there for "hold"
+  more samples. With no change, the period doubles after every
+  sample up to "max_period_ms". A door opening or HVAC kicking in is
+  thus followed at the fastest rate while a steady room is sampled
+  at the slowest one.
+
+  The caller adds bus and CPU time of every sample; the report gives
+  samples, bus time, CPU time and energy per hour, next to the same
+  costs of fixed-rate sampling at "min_period_ms", which follows
+  every transient as closely with no controller. Energy counts
+  the time awake for the samples only, idle consumption is the same
+  for both.
+
+  The module has no ESP-IDF dependency, "i2c_sensor/tools/rate_bench.c"
+  replays simulated room signals through it on the host.
+
+  Every example builds on its own, so "i2c_sensor" and
+  "wifi_thingspeak" have a copy of this module each; keep the code of
+  both copies the same.
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+ */
+
+#ifndef SAMPLE_RATE
+#define SAMPLE_RATE
+
+
+/*-----------------------------------------------------------*/
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/*-----------------------------------------------------------*/
+#define SAMPLE_RATE_MAX_CHANNELS 6
+
+
+/*-----------------------------------------------------------*/
+// Change limits of one channel, in the units of its values
+typedef struct {
+    int32_t deadband;           // Smaller steps are noise
+    int32_t slope;              // Change per minute
+    int32_t deviation;          // Standard deviation of recent samples
+} sample_rate_channel_t;
+
+typedef struct {
+    uint32_t min_period_ms;     // After a change
+    uint32_t max_period_ms;     // Stable signal
+    uint8_t hold;               // Samples at the fastest rate after a change
+    uint16_t active_mw;         // Power while a sample is read and processed
+    uint8_t channels;
+    const sample_rate_channel_t *channel;
+} sample_rate_config_t;
+
+typedef struct {
+    sample_rate_config_t config;
+    struct {
+        int32_t last;
+        int64_t last_ms;
+        int32_t mean_x16;       // Weighted mean, 1/16 of value units
+        int64_t var_x256;       // Weighted variance of "mean_x16" units
+        bool primed;
+    } state[SAMPLE_RATE_MAX_CHANNELS];
+    uint32_t period_ms;         // Delay before the next sample
+    uint8_t hold;
+    // Statistics
+    uint32_t samples;
+    uint32_t fast_samples;      // Taken at "min_period_ms"
+    uint32_t speed_ups;         // Changes found at a slower rate
+    uint64_t elapsed_ms;        // Sum of the periods
+    uint64_t bus_us;
+    uint64_t cpu_us;
+} sample_rate_t;
+
+// Costs per hour
+typedef struct {
+    uint32_t samples;
+    uint32_t bus_ms;
+    uint32_t cpu_ms;
+    uint32_t energy_mj;
+} sample_rate_cost_t;
+
+
+/*-----------------------------------------------------------*/
+// Used function(s)
+void sample_rate_init(sample_rate_t *sr, const sample_rate_config_t *config);
+uint32_t sample_rate_update(sample_rate_t *sr, const int32_t *values, uint32_t valid, int64_t time_ms);
+void sample_rate_account(sample_rate_t *sr, int64_t bus_us, int64_t cpu_us);
+void sample_rate_report(const sample_rate_t *sr, sample_rate_cost_t *adaptive, sample_rate_cost_t *fixed);
+
+#endif
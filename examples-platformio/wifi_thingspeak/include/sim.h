@@ -0,0 +1,73 @@
+/*
+  Simulated DHT12, Wi-Fi and HTTP uploads with benchmark counters.
+
+  Replaces the hardware dependencies of the example, so the sampling,
+  filtering and upload path runs on a board with nothing connected,
+  in QEMU, or on the host with the stand-ins of "tools/host" (see
+  "tools/sim_bench.c"). The DHT12 answers with a random walk of temperature and
+  humidity after an injected latency, and fails with a timeout or a
+  checksum error at the configured rates. Wi-Fi connection is only
+  an IP_EVENT_STA_GOT_IP event posted to the default event loop.
+  Uploads either go to a local stand-in HTTP server over the real
+  network, or are answered in-process after an injected latency.
+
+  Faults and values come from a seeded pseudo-random generator, so
+  two runs with the same seed see the same sequence of samples.
+  Benchmark counters (samples per second, upload latency, heap) are
+  logged periodically by sim_bench_task().
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+ */
+
+#ifndef SIM
+#define SIM
+
+
+/*-----------------------------------------------------------*/
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <esp_err.h>
+#include <esp_event.h>          // esp_event_handler_t
+#include <dht12.h>              // DHT12 values structure
+
+
+/*-----------------------------------------------------------*/
+typedef struct {
+    uint32_t seed;                  // Pseudo-random generator seed, not 0
+    uint32_t dht_latency_ms;        // Duration of one sensor read
+    uint16_t dht_timeout_permille;  // Reads failing with ESP_ERR_TIMEOUT
+    uint16_t dht_checksum_permille; // Reads returning corrupted data
+    bool fake_wifi;                 // No radio, uploads answered in-process
+    const char *http_host;          // Stand-in server if "fake_wifi" is not set
+    uint16_t http_port;
+    uint32_t http_latency_ms;       // In-process upload duration, +-50 %
+    uint16_t http_error_permille;   // In-process uploads failing
+} sim_config_t;
+
+typedef struct {
+    uint32_t samples;           // Sensor reads, including failed ones
+    uint32_t sensor_errors;
+    uint32_t uploads;
+    uint32_t upload_errors;
+    int64_t latency_sum_us;     // Of all uploads
+    int64_t latency_min_us;
+    int64_t latency_max_us;
+} sim_bench_t;
+
+
+/*-----------------------------------------------------------*/
+// Used function(s)
+void sim_init(const sim_config_t *config);
+esp_err_t sim_dht12_read(struct DHT12_values_structure *dht);
+esp_err_t sim_wifi_start(esp_event_handler_t handler);
+esp_err_t sim_http_get(const char *path, char *response, size_t response_size, int *status);
+
+void sim_bench_sample(bool ok);
+void sim_bench_upload(int64_t latency_us, bool ok);
+void sim_bench_get(sim_bench_t *bench, bool reset);
+void sim_bench_task(void *pvParameter);
+
+#endif
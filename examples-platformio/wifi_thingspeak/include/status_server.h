@@ -0,0 +1,76 @@
+/*
+  HTTP server with the latest reading and runtime metrics for LAN clients.
+
+  GET /latest returns the last DHT12 sample as JSON and GET /metrics
+  the application counters in Prometheus text format. The sampling
+  code only stores new values and bumps a version number; a body is
+  rendered again by the first request after a change, all others get
+  the buffer rendered before. Every body has an ETag, so a poller
+  sending "If-None-Match" gets "304 Not Modified" with no body. The
+  ETag holds a random boot ID, a body of the last boot never matches.
+
+  Connections are kept alive between requests. At most "max_clients"
+  sockets are open, a new client closes the least recently used one.
+  The server task runs below the sampling task priority and handles
+  one request at a time.
+
+  Script "tools/status_load.py" polls the endpoints from many clients
+  and reports latency percentiles.
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+ */
+
+#ifndef STATUS_SERVER
+#define STATUS_SERVER
+
+
+/*-----------------------------------------------------------*/
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <esp_err.h>
+
+
+/*-----------------------------------------------------------*/
+#define STATUS_SERVER_MAX_METRICS   16
+#define STATUS_SERVER_LATEST_SIZE   160     // Rendered /latest body
+#define STATUS_SERVER_METRICS_SIZE  2048    // Rendered /metrics body
+#define STATUS_SERVER_MAX_TIME      32      // Time stamp text of the reading
+#define STATUS_SERVER_ETAG_SIZE     24      // "boot ID-version" in quotes
+#define STATUS_SERVER_PRIORITY      3       // Below the sampling task
+#define STATUS_SERVER_TIMEOUT_S     5       // Slow client is dropped
+
+
+/*-----------------------------------------------------------*/
+typedef struct {
+    const char *name;           // e.g. "dht12_samples_total"
+    const char *help;
+    bool counter;               // Counter (true) or gauge (false)
+} status_metric_t;
+
+typedef struct {
+    uint16_t port;
+    uint8_t max_clients;        // Open sockets, up to 7 with default LwIP
+    const status_metric_t *metrics;
+    uint8_t metric_count;
+} status_server_config_t;
+
+typedef struct {
+    uint32_t requests;
+    uint32_t not_modified;      // Answered 304
+    uint32_t renders;           // Bodies rendered again after a change
+    int64_t handler_us;         // Total time in handlers
+    int64_t max_handler_us;
+} status_server_stats_t;
+
+
+/*-----------------------------------------------------------*/
+// Used function(s)
+esp_err_t status_server_start(const status_server_config_t *config);
+void status_server_set_latest(int32_t temp_x10, int32_t humid_x10, const char *time);
+void status_server_set_metric(uint8_t index, int64_t value);
+void status_server_get_stats(status_server_stats_t *stats);
+
+#endif
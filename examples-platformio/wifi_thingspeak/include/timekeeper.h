@@ -0,0 +1,74 @@
+/*
+  Wall-clock time for sample time stamps, synchronized over SNTP.
+
+  The module keeps a mapping from the monotonic esp_timer_get_time()
+  to UTC. After the station is connected, a background task queries
+  the NTP server a few times, takes the answer with the shortest
+  round trip and measures the offset between both clocks; half the
+  round trip is the error of this measurement. From the offsets of
+  two syncs the drift of the crystal is estimated (and stored in NVS
+  for the next boot), and once a second the task moves the offset on
+  by the drift. Stamping a sample is then a single addition
+  (timekeeper_to_utc_us()).
+
+  The mapping is kept when Wi-Fi drops, only its error grows with the
+  time since the last sync, see timekeeper_error_us(). The offset and
+  drift arithmetic is in "ntp_clock.h". Script "tools/ntp_standin.py"
+  is a local NTP server for tests on Linux.
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+ */
+
+#ifndef TIMEKEEPER
+#define TIMEKEEPER
+
+
+/*-----------------------------------------------------------*/
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <esp_err.h>
+
+
+/*-----------------------------------------------------------*/
+#define TIMEKEEPER_SAMPLES           4          // Queries per sync
+#define TIMEKEEPER_TIMEOUT_MS        1000       // One query
+#define TIMEKEEPER_RETRY_S           30         // After a failed sync
+#define TIMEKEEPER_NVS_NAMESPACE     "timekeeper"
+#define TIMEKEEPER_NVS_KEY           "drift_ppb"
+
+
+/*-----------------------------------------------------------*/
+typedef struct {
+    const char *server;         // Host name or dotted address
+    uint16_t port;              // 123, or the stand-in port
+    uint32_t interval_s;        // Regular sync
+} timekeeper_config_t;
+
+typedef struct {
+    bool synced;
+    bool drift_known;           // Measured or loaded from NVS
+    int64_t offset_us;          // UTC minus esp_timer_get_time() now
+    int32_t drift_ppb;          // Local clock slower (+) or faster (-)
+    int64_t last_sync_us;       // esp_timer_get_time() of the last sync
+    uint32_t sync_error_us;     // Half round trip of the last sync
+    int64_t last_step_us;       // Measured minus predicted offset
+    uint32_t syncs;
+    uint32_t failures;
+} timekeeper_status_t;
+
+
+/*-----------------------------------------------------------*/
+// Used function(s)
+esp_err_t timekeeper_init(const timekeeper_config_t *config);
+void timekeeper_sync_now(void);
+bool timekeeper_is_synced(void);
+int64_t timekeeper_to_utc_us(int64_t time_us);
+int64_t timekeeper_now_utc_us(void);
+uint32_t timekeeper_error_us(int64_t time_us);
+void timekeeper_get_status(timekeeper_status_t *status);
+size_t timekeeper_format_iso8601(int64_t utc_us, char *buf, size_t size);
+
+#endif
@@ -0,0 +1,73 @@
+/*
+  Sample-to-cloud latency tracing.
+
+  Every traced sample gets an identifier at the start of its sensor
+  read and collects a timestamp at each stage of its way to the
+  server: bus read done, queued for upload, payload encoded, server
+  name resolved, connection established, request sent and response
+  received. Stages that did not happen (e.g. no DNS lookup on an open
+  connection) are left out. The time between a stage and the previous
+  recorded one is the "span" of that stage; spans and the total time
+  are collected into histograms with power-of-two millisecond bins.
+
+  Finished samples stay in a small ring until trace_dump() prints
+  them over serial as "TRACE,..." lines. Script "tools/trace2chrome.py"
+  converts such a log into a Chrome trace / Perfetto JSON file.
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+ */
+
+#ifndef TRACE
+#define TRACE
+
+
+/*-----------------------------------------------------------*/
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/*-----------------------------------------------------------*/
+#define TRACE_RING_LEN 32       // Samples kept for dumping
+#define TRACE_HIST_BINS 16      // <1, <2, <4, ... ms, the last one is open
+#define TRACE_NONE 0            // Identifier of an untraced sample
+
+
+/*-----------------------------------------------------------*/
+typedef enum {
+    TRACE_START = 0,            // Sensor read started
+    TRACE_READ,                 // Bus transfer finished
+    TRACE_QUEUED,               // Filtered and handed over to the transport
+    TRACE_ENCODED,              // Upload task encoded the payload
+    TRACE_DNS,                  // Host name resolved
+    TRACE_CONNECT,              // Connection (and TLS handshake) ready
+    TRACE_SENT,                 // Request written
+    TRACE_ACKED,                // Response received
+    TRACE_STAGE_COUNT
+} trace_stage_t;
+
+// Span histogram; index TRACE_START holds the total time
+typedef struct {
+    uint32_t count;
+    uint32_t bins[TRACE_HIST_BINS];
+    uint32_t max_us;
+    uint64_t sum_us;
+} trace_hist_t;
+
+
+/*-----------------------------------------------------------*/
+// Used function(s)
+void trace_init(void);
+uint32_t trace_begin(void);
+void trace_mark(uint32_t id, trace_stage_t stage);
+void trace_mark_at(uint32_t id, trace_stage_t stage, int64_t time_us);
+void trace_finish(uint32_t id, bool ok);
+void trace_abort(uint32_t id);
+
+const char *trace_stage_name(trace_stage_t stage);
+void trace_get_hist(trace_stage_t stage, trace_hist_t *hist);
+uint32_t trace_percentile_us(const trace_hist_t *hist, uint16_t permille);
+void trace_dump(void);
+
+#endif
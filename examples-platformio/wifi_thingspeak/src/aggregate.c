@@ -0,0 +1,146 @@
+/*
+  On-device aggregation and report-by-exception filter.
+
+  Xtensa dual-core 32-bit LX6 (FireBeetle ESP32), 240 MHz
+  PlatformIO, ESP-IDF framework
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+ */
+
+
+/*-----------------------------------------------------------*/
+#include <string.h>
+#include <stdlib.h>             // abs() function
+#include <aggregate.h>
+
+
+/*-----------------------------------------------------------*/
+static aggregate_config_t s_config;
+static struct DHT12_values_structure s_ring[AGGREGATE_RING_LEN];
+static uint8_t s_head = 0;      // Next write position
+static uint8_t s_count = 0;
+static aggregate_counters_t s_counters;
+
+// Values of the last reported sample
+static bool s_reported_once = false;
+static int16_t s_reported_temp;
+static int16_t s_reported_humid;
+static uint32_t s_reported_ms;
+
+
+/*-----------------------------------------------------------*/
+static void stats_begin(aggregate_stats_t *stats, int16_t value)
+{
+    stats->min = value;
+    stats->max = value;
+    stats->last = value;
+}
+
+
+/*-----------------------------------------------------------*/
+static void stats_update(aggregate_stats_t *stats, int16_t value)
+{
+    if (value < stats->min) {
+        stats->min = value;
+    }
+    if (value > stats->max) {
+        stats->max = value;
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+void aggregate_init(const aggregate_config_t *config)
+{
+    s_config = *config;
+    s_head = 0;
+    s_count = 0;
+    s_reported_once = false;
+    memset(&s_counters, 0, sizeof(s_counters));
+}
+
+
+/*-----------------------------------------------------------*/
+/* Store the sample and decide whether it should be reported */
+bool aggregate_add(const struct DHT12_values_structure *sample, uint32_t now_ms)
+{
+    int16_t temp = dht12_temp_x10(sample);
+    int16_t humid = dht12_humid_x10(sample);
+    bool report;
+
+    s_ring[s_head] = *sample;
+    s_head = (s_head + 1) % AGGREGATE_RING_LEN;
+    if (s_count < AGGREGATE_RING_LEN) {
+        s_count++;
+    }
+    s_counters.samples++;
+
+    // Report by exception: value outside deadband or heartbeat
+    report = !s_reported_once ||
+             abs(temp - s_reported_temp) >= s_config.temp_deadband ||
+             abs(humid - s_reported_humid) >= s_config.humid_deadband ||
+             (uint32_t)(now_ms - s_reported_ms) >= s_config.heartbeat_ms;
+
+    if (report) {
+        s_reported_once = true;
+        s_reported_temp = temp;
+        s_reported_humid = humid;
+        s_reported_ms = now_ms;
+        s_counters.reported++;
+    }
+    else {
+        s_counters.suppressed++;
+    }
+
+    return report;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Statistics over the last "window" samples (at most the ring
+   length). Return false if there is no sample yet. */
+bool aggregate_get_window(uint8_t window, aggregate_window_t *result)
+{
+    int32_t temp_sum = 0;
+    int32_t humid_sum = 0;
+    uint8_t index;
+
+    if (s_count == 0) {
+        return false;
+    }
+    if (window == 0 || window > s_count) {
+        window = s_count;
+    }
+
+    // Walk from the newest sample backwards
+    for (uint8_t i = 0; i < window; i++) {
+        index = (s_head + AGGREGATE_RING_LEN - 1 - i) % AGGREGATE_RING_LEN;
+        int16_t temp = dht12_temp_x10(&s_ring[index]);
+        int16_t humid = dht12_humid_x10(&s_ring[index]);
+
+        if (i == 0) {
+            stats_begin(&result->temp, temp);
+            stats_begin(&result->humid, humid);
+        }
+        else {
+            stats_update(&result->temp, temp);
+            stats_update(&result->humid, humid);
+        }
+        temp_sum += temp;
+        humid_sum += humid;
+    }
+    result->count = window;
+    result->temp.mean = temp_sum / window;
+    result->humid.mean = humid_sum / window;
+
+    return true;
+}
+
+
+/*-----------------------------------------------------------*/
+void aggregate_get_counters(aggregate_counters_t *counters)
+{
+    *counters = s_counters;
+}
@@ -0,0 +1,471 @@
+/*
+  Streaming deflate compressor with a small window and fixed memory.
+
+  Xtensa dual-core 32-bit LX6 (FireBeetle ESP32), 240 MHz
+  PlatformIO, ESP-IDF framework
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+
+  NOTES:
+    * Output is one fixed Huffman block, every inflate implementation
+      (zlib, browsers, Python, web servers) accepts it
+    * Matching is greedy, with longer chains or lazy matching the
+      ratio would grow by a few percent at a higher CPU cost
+
+  See also:
+    DEFLATE Compressed Data Format Specification
+      * https://www.rfc-editor.org/rfc/rfc1951
+    ZLIB and GZIP file formats
+      * https://www.rfc-editor.org/rfc/rfc1950
+      * https://www.rfc-editor.org/rfc/rfc1952
+ */
+
+
+/*-----------------------------------------------------------*/
+#include <stdbool.h>
+#include <string.h>
+#include <deflate_stream.h>
+#ifdef ESP_PLATFORM
+#include <esp_rom_crc.h>        // esp_rom_crc32_le() function
+#endif
+
+
+/*-----------------------------------------------------------*/
+#define DEFLATE_MIN_MATCH 3
+#define DEFLATE_MAX_MATCH 258
+#define DEFLATE_END_BLOCK 256
+
+#if DEFLATE_STREAM_WINDOW_BITS < 9 || DEFLATE_STREAM_WINDOW_BITS > 14
+#error "Window must hold the longest match, positions are 16-bit"
+#endif
+
+
+/*-----------------------------------------------------------*/
+// Length codes 257..285: base length and extra bits
+static const uint16_t length_base[] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+};
+static const uint8_t length_extra[] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+};
+
+// Distance codes 0..29: base distance and extra bits
+static const uint16_t dist_base[] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+    8193, 12289, 16385, 24577,
+};
+static const uint8_t dist_extra[] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13,
+};
+
+
+/*-----------------------------------------------------------*/
+/* Pass the collected output to the write function */
+static void flush_out(deflate_stream_t *s)
+{
+    if (s->out_len > 0 && s->err == ESP_OK) {
+        s->err = s->write(s->ctx, s->out, s->out_len);
+    }
+    s->total_out += s->out_len;
+    s->out_len = 0;
+}
+
+
+/*-----------------------------------------------------------*/
+static void put_byte(deflate_stream_t *s, uint8_t byte)
+{
+    s->out[s->out_len++] = byte;
+    if (s->out_len == DEFLATE_STREAM_OUT_SIZE) {
+        flush_out(s);
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+/* Append "count" bits of "value", least significant bit first */
+static void put_bits(deflate_stream_t *s, uint32_t value, uint8_t count)
+{
+    s->bits |= value << s->bit_count;
+    s->bit_count += count;
+    while (s->bit_count >= 8) {
+        put_byte(s, s->bits & 0xff);
+        s->bits >>= 8;
+        s->bit_count -= 8;
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+/* Huffman codes are sent starting with their most significant bit */
+static void put_code(deflate_stream_t *s, uint16_t code, uint8_t count)
+{
+    uint16_t reversed = 0;
+
+    for (uint8_t i = 0; i < count; i++) {
+        reversed = (reversed << 1) | (code & 1);
+        code >>= 1;
+    }
+    put_bits(s, reversed, count);
+}
+
+
+/*-----------------------------------------------------------*/
+/* Literal/length symbol from the fixed Huffman table */
+static void put_symbol(deflate_stream_t *s, uint16_t symbol)
+{
+    if (symbol < 144) {
+        put_code(s, 0x30 + symbol, 8);
+    }
+    else if (symbol < 256) {
+        put_code(s, 0x190 + symbol - 144, 9);
+    }
+    else if (symbol < 280) {
+        put_code(s, symbol - 256, 7);
+    }
+    else {
+        put_code(s, 0xc0 + symbol - 280, 8);
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+static void put_match(deflate_stream_t *s, uint16_t length, uint16_t distance)
+{
+    uint8_t code = 0;
+
+    while (code < 28 && length_base[code + 1] <= length) {
+        code++;
+    }
+    put_symbol(s, 257 + code);
+    put_bits(s, length - length_base[code], length_extra[code]);
+
+    code = 0;
+    while (code < 29 && dist_base[code + 1] <= distance) {
+        code++;
+    }
+    put_code(s, code, 5);
+    put_bits(s, distance - dist_base[code], dist_extra[code]);
+}
+
+
+/*-----------------------------------------------------------*/
+static void put_be32(deflate_stream_t *s, uint32_t value)
+{
+    for (int8_t shift = 24; shift >= 0; shift -= 8) {
+        put_byte(s, value >> shift);
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+static void put_le32(deflate_stream_t *s, uint32_t value)
+{
+    for (uint8_t shift = 0; shift < 32; shift += 8) {
+        put_byte(s, value >> shift);
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+/* Update Adler-32 (zlib) or CRC-32 (gzip) of the input */
+static void update_check(deflate_stream_t *s, const uint8_t *data, size_t len)
+{
+    if (s->format == DEFLATE_STREAM_ZLIB) {
+        uint32_t a = s->check & 0xffff;
+        uint32_t b = s->check >> 16;
+
+        while (len > 0) {
+            // 5552 bytes is the longest run without 32-bit overflow
+            size_t n = (len < 5552) ? len : 5552;
+            len -= n;
+            while (n-- > 0) {
+                a += *data++;
+                b += a;
+            }
+            a %= 65521;
+            b %= 65521;
+        }
+        s->check = (b << 16) | a;
+    }
+    else if (s->format == DEFLATE_STREAM_GZIP) {
+#ifdef ESP_PLATFORM
+        s->check = esp_rom_crc32_le(s->check, data, len);
+#else
+        uint32_t crc = ~s->check;
+
+        while (len-- > 0) {
+            crc ^= *data++;
+            for (uint8_t bit = 0; bit < 8; bit++) {
+                crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+            }
+        }
+        s->check = ~crc;
+#endif
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+static uint16_t hash3(const uint8_t *p)
+{
+    uint32_t v = p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16);
+
+    return (v * 2654435761u) >> (32 - DEFLATE_STREAM_HASH_BITS);
+}
+
+
+/*-----------------------------------------------------------*/
+/* Add position "p" to its hash chain */
+static void insert(deflate_stream_t *s, uint16_t p)
+{
+    uint16_t h;
+
+    if (p + DEFLATE_MIN_MATCH > s->fill) {
+        return;
+    }
+    h = hash3(&s->window[p]);
+    s->prev[p & (DEFLATE_STREAM_WINDOW - 1)] = s->head[h];
+    s->head[h] = p + 1;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Longest earlier match of the bytes at "pos", 0 if none */
+static uint16_t find_match(deflate_stream_t *s, uint16_t *distance)
+{
+    uint16_t max_len = s->fill - s->pos;
+    uint16_t best = 0;
+    uint16_t candidate;
+    const uint8_t *cur = &s->window[s->pos];
+
+    if (max_len > DEFLATE_MAX_MATCH) {
+        max_len = DEFLATE_MAX_MATCH;
+    }
+    if (max_len < DEFLATE_MIN_MATCH) {
+        return 0;
+    }
+
+    candidate = s->head[hash3(cur)];
+    for (uint8_t chain = 0; chain < DEFLATE_STREAM_MAX_CHAIN && candidate != 0; chain++) {
+        uint16_t c = candidate - 1;
+        const uint8_t *old = &s->window[c];
+        uint16_t len = 0;
+
+        // Older entries of the chain may be overwritten already
+        if (s->pos - c >= DEFLATE_STREAM_WINDOW) {
+            break;
+        }
+        if (old[best] == cur[best]) {
+            while (len < max_len && old[len] == cur[len]) {
+                len++;
+            }
+            if (len > best) {
+                best = len;
+                *distance = s->pos - c;
+                if (len == max_len) {
+                    break;
+                }
+            }
+        }
+        candidate = s->prev[c & (DEFLATE_STREAM_WINDOW - 1)];
+    }
+
+    return (best >= DEFLATE_MIN_MATCH) ? best : 0;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Code the window content, keep a full match worth of lookahead
+   unless the stream is finishing */
+static void compress_window(deflate_stream_t *s, bool finish)
+{
+    uint16_t keep = finish ? 0 : DEFLATE_MAX_MATCH;
+    uint16_t distance = 0;
+    uint16_t len;
+
+    while (s->fill - s->pos > keep) {
+        len = find_match(s, &distance);
+        if (len > 0) {
+            put_match(s, len, distance);
+            while (len-- > 0) {
+                insert(s, s->pos++);
+            }
+        }
+        else {
+            put_symbol(s, s->window[s->pos]);
+            insert(s, s->pos++);
+        }
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+/* Drop the older half of the window, positions move down */
+static void slide_window(deflate_stream_t *s)
+{
+    memmove(s->window, s->window + DEFLATE_STREAM_WINDOW, DEFLATE_STREAM_WINDOW);
+    s->pos -= DEFLATE_STREAM_WINDOW;
+    s->fill -= DEFLATE_STREAM_WINDOW;
+
+    for (uint16_t i = 0; i < DEFLATE_STREAM_HASH_SIZE; i++) {
+        s->head[i] = (s->head[i] > DEFLATE_STREAM_WINDOW) ? s->head[i] - DEFLATE_STREAM_WINDOW : 0;
+    }
+    for (uint16_t i = 0; i < DEFLATE_STREAM_WINDOW; i++) {
+        s->prev[i] = (s->prev[i] > DEFLATE_STREAM_WINDOW) ? s->prev[i] - DEFLATE_STREAM_WINDOW : 0;
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+/* Start a new stream, the header is written right away */
+esp_err_t deflate_stream_init(deflate_stream_t *s, deflate_stream_format_t format,
+                              deflate_stream_write_t write, void *ctx)
+{
+    if (write == NULL || format > DEFLATE_STREAM_GZIP) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(s, 0, sizeof(deflate_stream_t));
+    s->format = format;
+    s->write = write;
+    s->ctx = ctx;
+    s->err = ESP_OK;
+
+    if (format == DEFLATE_STREAM_ZLIB) {
+        // Method 8 with the window size, check bits make it divisible by 31
+        uint8_t cmf = ((DEFLATE_STREAM_WINDOW_BITS - 8) << 4) | 8;
+        put_byte(s, cmf);
+        put_byte(s, (31 - (cmf << 8) % 31) % 31);
+        s->check = 1;
+    }
+    else if (format == DEFLATE_STREAM_GZIP) {
+        // No name, no time stamp, unknown OS
+        static const uint8_t header[] = {0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff};
+        for (uint8_t i = 0; i < sizeof(header); i++) {
+            put_byte(s, header[i]);
+        }
+    }
+
+    // The only block, final, fixed Huffman codes
+    put_bits(s, 1, 1);
+    put_bits(s, 1, 2);
+
+    return ESP_OK;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Compress the next "len" bytes. Output is passed to the write
+   function whenever DEFLATE_STREAM_OUT_SIZE bytes are ready. */
+esp_err_t deflate_stream_write(deflate_stream_t *s, const void *data, size_t len)
+{
+    const uint8_t *in = data;
+    size_t n;
+
+    update_check(s, in, len);
+    s->total_in += len;
+
+    while (len > 0 && s->err == ESP_OK) {
+        if (s->fill == sizeof(s->window)) {
+            slide_window(s);
+        }
+        n = sizeof(s->window) - s->fill;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(&s->window[s->fill], in, n);
+        s->fill += n;
+        in += n;
+        len -= n;
+        compress_window(s, false);
+    }
+
+    return s->err;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Code the remaining input, end the block and write the trailer */
+esp_err_t deflate_stream_finish(deflate_stream_t *s)
+{
+    compress_window(s, true);
+    put_symbol(s, DEFLATE_END_BLOCK);
+    // Pad the last byte with zero bits
+    put_bits(s, 0, (8 - s->bit_count) % 8);
+
+    if (s->format == DEFLATE_STREAM_ZLIB) {
+        put_be32(s, s->check);
+    }
+    else if (s->format == DEFLATE_STREAM_GZIP) {
+        put_le32(s, s->check);
+        put_le32(s, s->total_in);
+    }
+    flush_out(s);
+
+    return s->err;
+}
+
+
+/*-----------------------------------------------------------*/
+typedef struct {
+    uint8_t *buf;
+    size_t size;
+    size_t len;
+} deflate_buffer_t;
+
+static esp_err_t buffer_write(void *ctx, const uint8_t *data, size_t len)
+{
+    deflate_buffer_t *out = ctx;
+
+    if (out->len + len > out->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(out->buf + out->len, data, len);
+    out->len += len;
+
+    return ESP_OK;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Compress a whole buffer into "buf". Return length of the output,
+   or 0 if it does not fit. */
+size_t deflate_stream_compress(deflate_stream_t *s, deflate_stream_format_t format,
+                               const void *data, size_t len, uint8_t *buf, size_t size)
+{
+    deflate_buffer_t out = {
+        .buf = buf,
+        .size = size,
+        .len = 0,
+    };
+
+    if (deflate_stream_init(s, format, buffer_write, &out) != ESP_OK ||
+        deflate_stream_write(s, data, len) != ESP_OK ||
+        deflate_stream_finish(s) != ESP_OK) {
+        return 0;
+    }
+
+    return out.len;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Value of HTTP "Content-Encoding" header, NULL for raw deflate
+   which has no registered name */
+const char *deflate_stream_encoding(deflate_stream_format_t format)
+{
+    switch (format) {
+        case DEFLATE_STREAM_ZLIB:
+            return "deflate";
+        case DEFLATE_STREAM_GZIP:
+            return "gzip";
+        default:
+            return NULL;
+    }
+}
@@ -0,0 +1,503 @@
+/*
+  DNS resolver cache with TTLs and background refresh.
+
+  Xtensa dual-core 32-bit LX6 (FireBeetle ESP32), 240 MHz
+  PlatformIO, ESP-IDF framework
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+
+  See also:
+    Domain names - implementation and specification
+      * https://www.rfc-editor.org/rfc/rfc1035
+ */
+
+
+/*-----------------------------------------------------------*/
+#include <string.h>
+#include <stdio.h>              // snprintf() function
+#include <stdbool.h>
+#include <inttypes.h>           // PRIu32 format macro
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <esp_log.h>            // ESP_LOG/E/W/I functions
+#include <esp_timer.h>          // esp_timer_get_time() function
+#include <esp_system.h>         // esp_random() function
+#include <lwip/sockets.h>       // UDP socket
+#include <lwip/netdb.h>         // getaddrinfo() function
+#include <lwip/dns.h>           // dns_getserver() function
+#include <dns_cache.h>
+
+
+/*-----------------------------------------------------------*/
+#define DNS_PORT       53
+#define DNS_PACKET     512      // Maximum UDP message without EDNS
+#define DNS_TYPE_A     1
+#define DNS_CLASS_IN   1
+#define DNS_ATTEMPTS   2
+
+
+/*-----------------------------------------------------------*/
+typedef struct {
+    char host[DNS_CACHE_MAX_NAME];
+    bool used;
+    bool valid;                 // "addr" was resolved at least once
+    uint32_t addr;              // Network byte order
+    uint32_t ttl_s;
+    int64_t expires_us;
+    int64_t refresh_us;         // Next background lookup
+} dns_entry_t;
+
+
+/*-----------------------------------------------------------*/
+// Tag for ESP_LOG/E/W/I functions
+static const char *TAG = "dns cache";
+
+static dns_entry_t s_entries[DNS_CACHE_MAX_HOSTS];
+static dns_cache_stats_t s_stats;
+static SemaphoreHandle_t s_lock = NULL;
+static TaskHandle_t s_task = NULL;
+
+
+/*-----------------------------------------------------------*/
+/* Build A-record query for "host", return its length or 0 */
+static size_t build_query(uint8_t *buf, uint16_t id, const char *host)
+{
+    size_t pos = 12;
+    const char *label = host;
+
+    memset(buf, 0, 12);
+    buf[0] = id >> 8;
+    buf[1] = id & 0xff;
+    buf[2] = 0x01;              // Recursion desired
+    buf[5] = 1;                 // One question
+
+    while (*label != '\0') {
+        const char *dot = strchr(label, '.');
+        size_t len = (dot != NULL) ? (size_t)(dot - label) : strlen(label);
+
+        if (len == 0 || len > 63 || pos + len + 1 + 5 > DNS_PACKET) {
+            return 0;
+        }
+        buf[pos++] = len;
+        memcpy(&buf[pos], label, len);
+        pos += len;
+        label += len;
+        if (*label == '.') {
+            label++;
+        }
+    }
+    buf[pos++] = 0;
+    buf[pos++] = 0;
+    buf[pos++] = DNS_TYPE_A;
+    buf[pos++] = 0;
+    buf[pos++] = DNS_CLASS_IN;
+
+    return pos;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Position after the (possibly compressed) name at "pos", -1 if
+   the message is truncated */
+static int skip_name(const uint8_t *buf, int len, int pos)
+{
+    while (pos < len) {
+        if (buf[pos] == 0) {
+            return pos + 1;
+        }
+        if ((buf[pos] & 0xc0) == 0xc0) {
+            return (pos + 2 <= len) ? pos + 2 : -1;
+        }
+        pos += buf[pos] + 1;
+    }
+    return -1;
+}
+
+
+/*-----------------------------------------------------------*/
+/* First A record of the response, TTL is the lowest one of the
+   records up to it (CNAME chain) */
+static esp_err_t parse_response(const uint8_t *buf, int len, uint16_t id, uint32_t *addr, uint32_t *ttl)
+{
+    uint16_t questions, answers;
+    uint32_t min_ttl = UINT32_MAX;
+    int pos = 12;
+
+    if (len < 12 || ((buf[0] << 8) | buf[1]) != id || !(buf[2] & 0x80)) {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    if ((buf[3] & 0x0f) == 3) {
+        return ESP_ERR_NOT_FOUND;       // NXDOMAIN
+    }
+    if ((buf[3] & 0x0f) != 0) {
+        return ESP_FAIL;
+    }
+    questions = (buf[4] << 8) | buf[5];
+    answers = (buf[6] << 8) | buf[7];
+
+    while (questions-- > 0) {
+        if ((pos = skip_name(buf, len, pos)) < 0 || pos + 4 > len) {
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+        pos += 4;
+    }
+    while (answers-- > 0) {
+        uint16_t type, rclass, rdlen;
+        uint32_t record_ttl;
+
+        if ((pos = skip_name(buf, len, pos)) < 0 || pos + 10 > len) {
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+        type = (buf[pos] << 8) | buf[pos + 1];
+        rclass = (buf[pos + 2] << 8) | buf[pos + 3];
+        record_ttl = ((uint32_t)buf[pos + 4] << 24) | (buf[pos + 5] << 16) | (buf[pos + 6] << 8) | buf[pos + 7];
+        rdlen = (buf[pos + 8] << 8) | buf[pos + 9];
+        pos += 10;
+        if (pos + rdlen > len) {
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+        if (record_ttl < min_ttl) {
+            min_ttl = record_ttl;
+        }
+        if (type == DNS_TYPE_A && rclass == DNS_CLASS_IN && rdlen == 4) {
+            memcpy(addr, &buf[pos], 4);
+            *ttl = min_ttl;
+            return ESP_OK;
+        }
+        pos += rdlen;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Ask the station's primary DNS server */
+static esp_err_t dns_query(const char *host, uint32_t *addr, uint32_t *ttl)
+{
+    uint8_t buf[DNS_PACKET];
+    const ip_addr_t *dns = dns_getserver(0);
+    struct sockaddr_in server = {
+        .sin_family = AF_INET,
+        .sin_port = htons(DNS_PORT),
+    };
+    struct timeval timeout = {
+        .tv_sec = DNS_CACHE_TIMEOUT_MS / 1000,
+        .tv_usec = (DNS_CACHE_TIMEOUT_MS % 1000) * 1000,
+    };
+    uint16_t id = esp_random() & 0xffff;
+    esp_err_t err = ESP_ERR_TIMEOUT;
+    size_t query_len;
+    int sock, len;
+
+    if (ip_addr_isany(dns)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    server.sin_addr.s_addr = ip4_addr_get_u32(ip_2_ip4(dns));
+    if ((query_len = build_query(buf, id, host)) == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) {
+        return ESP_FAIL;
+    }
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    for (uint8_t attempt = 0; attempt < DNS_ATTEMPTS && err == ESP_ERR_TIMEOUT; attempt++) {
+        build_query(buf, id, host);
+        if (sendto(sock, buf, query_len, 0, (struct sockaddr *)&server, sizeof(server)) < 0) {
+            err = ESP_FAIL;
+            break;
+        }
+        // Ignore datagrams that are not the answer to this query
+        do {
+            len = recv(sock, buf, sizeof(buf), 0);
+            err = (len > 0) ? parse_response(buf, len, id, addr, ttl) : ESP_ERR_TIMEOUT;
+        } while (err == ESP_ERR_INVALID_RESPONSE);
+    }
+    close(sock);
+
+    return err;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Resolve over the network and measure it, lwIP resolver is the
+   fallback */
+static esp_err_t lookup(const char *host, uint32_t *addr, uint32_t *ttl)
+{
+    struct addrinfo hints = {
+        .ai_family = AF_INET,
+        .ai_socktype = SOCK_STREAM,
+    };
+    struct addrinfo *res = NULL;
+    int64_t start = esp_timer_get_time();
+    int64_t elapsed;
+    esp_err_t err;
+
+    err = dns_query(host, addr, ttl);
+    if (err != ESP_OK && err != ESP_ERR_NOT_FOUND) {
+        ESP_LOGW(TAG, "query for %s: %s, trying getaddrinfo()", host, esp_err_to_name(err));
+        if (getaddrinfo(host, NULL, &hints, &res) == 0 && res != NULL) {
+            *addr = ((struct sockaddr_in *)res->ai_addr)->sin_addr.s_addr;
+            *ttl = DNS_CACHE_FALLBACK_TTL_S;
+            err = ESP_OK;
+        }
+        freeaddrinfo(res);
+    }
+    elapsed = esp_timer_get_time() - start;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_stats.lookups++;
+    s_stats.lookup_sum_us += elapsed;
+    s_stats.last_lookup_us = elapsed;
+    if (elapsed > s_stats.lookup_max_us) {
+        s_stats.lookup_max_us = elapsed;
+    }
+    xSemaphoreGive(s_lock);
+
+    return err;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Must be called with the lock taken */
+static dns_entry_t *find_entry(const char *host)
+{
+    for (uint8_t i = 0; i < DNS_CACHE_MAX_HOSTS; i++) {
+        if (s_entries[i].used && strcmp(s_entries[i].host, host) == 0) {
+            return &s_entries[i];
+        }
+    }
+    return NULL;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Must be called with the lock taken */
+static void store_entry(dns_entry_t *entry, uint32_t addr, uint32_t ttl_s)
+{
+    int64_t now = esp_timer_get_time();
+
+    if (ttl_s < DNS_CACHE_MIN_TTL_S) {
+        ttl_s = DNS_CACHE_MIN_TTL_S;
+    }
+    else if (ttl_s > DNS_CACHE_MAX_TTL_S) {
+        ttl_s = DNS_CACHE_MAX_TTL_S;
+    }
+    entry->addr = addr;
+    entry->ttl_s = ttl_s;
+    entry->valid = true;
+    entry->expires_us = now + (int64_t)ttl_s * 1000000;
+    entry->refresh_us = now + (int64_t)ttl_s * DNS_CACHE_REFRESH_PERMILLE * 1000;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Refresh entries before they expire */
+static void dns_cache_task(void *pvParameter)
+{
+    char host[DNS_CACHE_MAX_NAME];
+    uint32_t addr, ttl;
+    int64_t now, next;
+
+    while (1) {
+        now = esp_timer_get_time();
+        next = now + 60 * 1000000LL;
+
+        for (uint8_t i = 0; i < DNS_CACHE_MAX_HOSTS; i++) {
+            xSemaphoreTake(s_lock, portMAX_DELAY);
+            bool due = s_entries[i].used && s_entries[i].refresh_us <= now;
+            strcpy(host, s_entries[i].host);
+            xSemaphoreGive(s_lock);
+            if (!due) {
+                continue;
+            }
+
+            esp_err_t err = lookup(host, &addr, &ttl);
+
+            xSemaphoreTake(s_lock, portMAX_DELAY);
+            dns_entry_t *entry = find_entry(host);
+            if (entry != NULL) {
+                s_stats.refreshes++;
+                if (err == ESP_OK) {
+                    store_entry(entry, addr, ttl);
+                    ESP_LOGI(TAG, "%s is %d.%d.%d.%d, TTL %" PRIu32 " s", host,
+                             (int)(addr & 0xff), (int)((addr >> 8) & 0xff),
+                             (int)((addr >> 16) & 0xff), (int)(addr >> 24), entry->ttl_s);
+                }
+                else {
+                    entry->refresh_us = esp_timer_get_time() + DNS_CACHE_RETRY_S * 1000000LL;
+                }
+            }
+            xSemaphoreGive(s_lock);
+        }
+
+        // Sleep until the earliest refresh, or until woken up
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        for (uint8_t i = 0; i < DNS_CACHE_MAX_HOSTS; i++) {
+            if (s_entries[i].used && s_entries[i].refresh_us < next) {
+                next = s_entries[i].refresh_us;
+            }
+        }
+        xSemaphoreGive(s_lock);
+        now = esp_timer_get_time();
+        if (next > now) {
+            ulTaskNotifyTake(pdTRUE, (next - now) / 1000 / portTICK_PERIOD_MS + 1);
+        }
+    }
+
+    // Delete this task if it exits from the loop above
+    vTaskDelete(NULL);
+}
+
+
+/*-----------------------------------------------------------*/
+esp_err_t dns_cache_init(void)
+{
+    if (s_lock != NULL) {
+        return ESP_OK;
+    }
+    s_lock = xSemaphoreCreateMutex();
+    memset(s_entries, 0, sizeof(s_entries));
+    memset(&s_stats, 0, sizeof(s_stats));
+
+    if (xTaskCreate(dns_cache_task, "dns_cache", 3072, NULL, 4, &s_task) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Keep "host" resolved; it is looked up by the next prefetch */
+esp_err_t dns_cache_add_host(const char *host)
+{
+    esp_err_t err = ESP_ERR_NO_MEM;
+
+    if (s_lock == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (strlen(host) >= DNS_CACHE_MAX_NAME) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (find_entry(host) != NULL) {
+        err = ESP_OK;
+    }
+    for (uint8_t i = 0; i < DNS_CACHE_MAX_HOSTS && err != ESP_OK; i++) {
+        if (!s_entries[i].used) {
+            memset(&s_entries[i], 0, sizeof(dns_entry_t));
+            strcpy(s_entries[i].host, host);
+            s_entries[i].used = true;
+            // Nothing to resolve with before the station is connected
+            s_entries[i].refresh_us = INT64_MAX;
+            err = ESP_OK;
+        }
+    }
+    xSemaphoreGive(s_lock);
+
+    return err;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Resolve all hosts now, e.g. after IP_EVENT_STA_GOT_IP. Callable
+   from the event handler, lookups run in the cache task. */
+void dns_cache_prefetch(void)
+{
+    if (s_lock == NULL) {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (uint8_t i = 0; i < DNS_CACHE_MAX_HOSTS; i++) {
+        s_entries[i].refresh_us = 0;
+    }
+    xSemaphoreGive(s_lock);
+    xTaskNotifyGive(s_task);
+}
+
+
+/*-----------------------------------------------------------*/
+/* IPv4 address of "host" in network byte order */
+esp_err_t dns_cache_resolve(const char *host, uint32_t *addr)
+{
+    dns_entry_t *entry;
+    uint32_t ttl;
+    esp_err_t err;
+    struct in_addr numeric;
+
+    // Nothing to resolve
+    if (inet_aton(host, &numeric)) {
+        *addr = numeric.s_addr;
+        return ESP_OK;
+    }
+    if (s_lock == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    entry = find_entry(host);
+    if (entry != NULL && entry->valid && esp_timer_get_time() < entry->expires_us) {
+        *addr = entry->addr;
+        s_stats.hits++;
+        xSemaphoreGive(s_lock);
+        return ESP_OK;
+    }
+    s_stats.misses++;
+    xSemaphoreGive(s_lock);
+
+    err = lookup(host, addr, &ttl);
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    entry = find_entry(host);
+    if (err == ESP_OK) {
+        if (entry != NULL) {
+            store_entry(entry, *addr, ttl);
+        }
+    }
+    else if (entry != NULL && entry->valid &&
+             esp_timer_get_time() < entry->expires_us + DNS_CACHE_MAX_STALE_S * 1000000LL) {
+        // DNS server unreachable, the old address most likely still works
+        *addr = entry->addr;
+        s_stats.stale_hits++;
+        err = ESP_OK;
+    }
+    else {
+        s_stats.failures++;
+    }
+    xSemaphoreGive(s_lock);
+
+    return err;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Same as dns_cache_resolve(), address in dotted form */
+esp_err_t dns_cache_resolve_str(const char *host, char *ip, size_t size)
+{
+    uint32_t addr;
+    esp_err_t err = dns_cache_resolve(host, &addr);
+
+    if (err == ESP_OK) {
+        snprintf(ip, size, "%d.%d.%d.%d", (int)(addr & 0xff), (int)((addr >> 8) & 0xff),
+                 (int)((addr >> 16) & 0xff), (int)(addr >> 24));
+    }
+    return err;
+}
+
+
+/*-----------------------------------------------------------*/
+void dns_cache_get_stats(dns_cache_stats_t *stats)
+{
+    if (s_lock == NULL) {
+        memset(stats, 0, sizeof(dns_cache_stats_t));
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *stats = s_stats;
+    xSemaphoreGive(s_lock);
+}
@@ -0,0 +1,223 @@
+/*
+  Fixed-point filtering kernels for sensor samples.
+
+  Xtensa dual-core 32-bit LX6 (FireBeetle ESP32), 240 MHz
+  PlatformIO, ESP-IDF framework
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+
+  See also:
+    Hampel filter
+      * https://www.mathworks.com/help/signal/ref/hampel.html
+ */
+
+
+/*-----------------------------------------------------------*/
+#include <string.h>
+#include <stdlib.h>             // abs() function
+#include <filters.h>
+
+
+/*-----------------------------------------------------------*/
+// 1.4826 in Q8, scales MAD to standard deviation of normal data
+#define FILTER_MAD_SCALE 380
+
+
+/*-----------------------------------------------------------*/
+static void ring_init(filter_ring_t *r, uint8_t size)
+{
+    memset(r, 0, sizeof(filter_ring_t));
+    r->size = (size == 0 || size > FILTER_MAX_WINDOW) ? FILTER_MAX_WINDOW : size;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Store sample, return true and the oldest sample in "evicted" if
+   the ring was full */
+static bool ring_push(filter_ring_t *r, int16_t x, int16_t *evicted)
+{
+    bool full = (r->count == r->size);
+
+    if (full) {
+        *evicted = r->buf[r->head];
+    }
+    else {
+        r->count++;
+    }
+    r->buf[r->head] = x;
+    r->head = (r->head + 1) % r->size;
+
+    return full;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Integer division rounded to nearest */
+static int32_t div_round(int32_t num, int32_t den)
+{
+    return (num >= 0) ? (num + den / 2) / den : (num - den / 2) / den;
+}
+
+
+/*-----------------------------------------------------------*/
+static void insertion_sort(int16_t *a, uint8_t n)
+{
+    for (uint8_t i = 1; i < n; i++) {
+        int16_t v = a[i];
+        uint8_t j = i;
+
+        while (j > 0 && a[j - 1] > v) {
+            a[j] = a[j - 1];
+            j--;
+        }
+        a[j] = v;
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+/* Median of sorted array, mean of the two middle values for even n */
+static int16_t sorted_median(const int16_t *a, uint8_t n)
+{
+    if (n % 2 == 1) {
+        return a[n / 2];
+    }
+    return div_round((int32_t)a[n / 2 - 1] + a[n / 2], 2);
+}
+
+
+/*-----------------------------------------------------------*/
+void filter_mavg_init(filter_mavg_t *f, uint8_t size)
+{
+    ring_init(&f->ring, size);
+    f->sum = 0;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Moving average, O(1) per sample with running sum */
+int16_t filter_mavg_update(filter_mavg_t *f, int16_t x)
+{
+    int16_t evicted;
+
+    if (ring_push(&f->ring, x, &evicted)) {
+        f->sum -= evicted;
+    }
+    f->sum += x;
+
+    return div_round(f->sum, f->ring.count);
+}
+
+
+/*-----------------------------------------------------------*/
+void filter_ema_init(filter_ema_t *f, uint16_t alpha)
+{
+    f->alpha = (alpha == 0) ? 1 : (alpha > 256 ? 256 : alpha);
+    f->state = 0;
+    f->primed = false;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Exponential smoothing y += alpha * (x - y), state kept in Q8 so
+   small alpha does not lose the fractional part */
+int16_t filter_ema_update(filter_ema_t *f, int16_t x)
+{
+    int32_t x_q8 = (int32_t)x * 256;
+
+    if (!f->primed) {
+        f->state = x_q8;
+        f->primed = true;
+    }
+    else {
+        f->state += div_round((int32_t)f->alpha * (x_q8 - f->state), 256);
+    }
+
+    return div_round(f->state, 256);
+}
+
+
+/*-----------------------------------------------------------*/
+void filter_median_init(filter_median_t *f, uint8_t size)
+{
+    ring_init(&f->ring, size);
+}
+
+
+/*-----------------------------------------------------------*/
+/* Streaming median, the window is kept sorted: O(N) per sample */
+int16_t filter_median_update(filter_median_t *f, int16_t x)
+{
+    uint8_t n = f->ring.count;
+    int16_t evicted;
+    uint8_t i;
+
+    if (ring_push(&f->ring, x, &evicted)) {
+        // Remove the oldest sample from the sorted copy
+        for (i = 0; i < n && f->sorted[i] != evicted; i++) {
+        }
+        memmove(&f->sorted[i], &f->sorted[i + 1], (n - i - 1) * sizeof(int16_t));
+        n--;
+    }
+
+    // Insert the new sample
+    i = n;
+    while (i > 0 && f->sorted[i - 1] > x) {
+        f->sorted[i] = f->sorted[i - 1];
+        i--;
+    }
+    f->sorted[i] = x;
+
+    return sorted_median(f->sorted, f->ring.count);
+}
+
+
+/*-----------------------------------------------------------*/
+void filter_hampel_init(filter_hampel_t *f, uint8_t size, uint16_t threshold)
+{
+    filter_median_init(&f->median, size);
+    f->threshold = threshold;
+    f->outliers = 0;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Hampel identifier: replace the sample by the window median if it
+   is further than threshold * 1.4826 * MAD from it */
+int16_t filter_hampel_update(filter_hampel_t *f, int16_t x)
+{
+    int16_t dev[FILTER_MAX_WINDOW];
+    uint8_t n;
+    int32_t median;
+    int32_t mad;
+    int64_t limit;
+
+    median = filter_median_update(&f->median, x);
+    n = f->median.ring.count;
+    if (n < 3) {
+        return x;
+    }
+
+    // Median absolute deviation
+    for (uint8_t i = 0; i < n; i++) {
+        dev[i] = abs(f->median.sorted[i] - median);
+    }
+    insertion_sort(dev, n);
+    mad = sorted_median(dev, n);
+
+    // Quantized sensors often give MAD = 0, allow at least one step
+    if (mad < 1) {
+        mad = 1;
+    }
+    // Scaled MAD times threshold in Q16, not rounded in between (MAD
+    // of 1 would give 1.0 instead of 1.48 scaled MADs)
+    limit = (int64_t)mad * FILTER_MAD_SCALE * f->threshold;
+
+    if ((int64_t)abs(x - median) * 65536 > limit) {
+        f->outliers++;
+        return median;
+    }
+    return x;
+}
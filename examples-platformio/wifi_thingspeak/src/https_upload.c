@@ -0,0 +1,506 @@
+/*
+  Persistent HTTPS connection for uploads with TLS session resumption.
+
+  Xtensa dual-core 32-bit LX6 (FireBeetle ESP32), 240 MHz
+  PlatformIO, ESP-IDF framework
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+
+  NOTES:
+    * CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS must be enabled in sdkconfig,
+      otherwise every reconnect performs a full handshake
+    * Host address is taken from "dns_cache", which must be initialized
+
+  See also:
+    ESP-TLS
+      * https://docs.espressif.com/projects/esp-idf/en/v4.4/esp32/api-reference/protocols/esp_tls.html
+ */
+
+
+/*-----------------------------------------------------------*/
+#include <string.h>
+#include <strings.h>            // strncasecmp() function
+#include <stdio.h>              // snprintf() function
+#include <stdlib.h>             // strtol() function
+#include <stdbool.h>
+#include <errno.h>              // EAGAIN error code
+#include <inttypes.h>           // PRId64 format macro
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <esp_log.h>            // ESP_LOG/E/W/I functions
+#include <esp_timer.h>          // esp_timer_get_time() function
+#include <esp_heap_caps.h>      // Heap statistics
+#include <esp_tls.h>
+#include <lwip/sockets.h>       // recv() function
+#include <dns_cache.h>          // Cached host address
+#include <esp_crt_bundle.h>     // Certificate bundle
+#include <https_upload.h>
+
+
+/*-----------------------------------------------------------*/
+// Tag for ESP_LOG/E/W/I functions
+static const char *TAG = "https upload";
+
+static char s_host[HTTPS_UPLOAD_MAX_HOST];
+static bool s_use_global_ca = false;
+static esp_tls_t *s_tls = NULL;
+static int64_t s_last_used_us = 0;      // End of the last exchange
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+static esp_tls_client_session_t *s_session = NULL;
+#endif
+static https_upload_stats_t s_stats;
+static SemaphoreHandle_t s_lock = NULL;
+
+// Lowest free heap while a handshake runs
+static esp_timer_handle_t s_heap_timer = NULL;
+static volatile size_t s_heap_low = 0;
+
+// Buffered receiver
+static char s_rx[512];
+static size_t s_rx_pos = 0;
+static size_t s_rx_len = 0;
+
+
+/*-----------------------------------------------------------*/
+/* Address from the DNS cache. esp-tls connects to the dotted address,
+   the host name is kept for SNI and the certificate check. */
+static esp_err_t resolve_host(char *ip, size_t size)
+{
+    if (dns_cache_resolve_str(s_host, ip, size) != ESP_OK) {
+        ESP_LOGW(TAG, "DNS lookup of %s failed", s_host);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Periodic sample of the free heap while esp_tls_conn_new_sync()
+   blocks, the peak of mbedTLS buffers lasts only during the handshake */
+static void heap_sample(void *arg)
+{
+    size_t free_size = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+
+    if (free_size < s_heap_low) {
+        s_heap_low = free_size;
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+/* Open TLS connection, offer the stored session ticket if any */
+static esp_err_t tls_connect(https_upload_timing_t *timing)
+{
+    esp_tls_cfg_t cfg = {
+        .timeout_ms = HTTPS_UPLOAD_TIMEOUT_MS,
+        .common_name = s_host,
+    };
+    char ip[16];
+    bool resumed = false;
+    int64_t start;
+
+    if (resolve_host(ip, sizeof(ip)) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    timing->dns_us = esp_timer_get_time();
+
+    if (s_use_global_ca) {
+        cfg.use_global_ca_store = true;
+    }
+    else {
+        cfg.crt_bundle_attach = esp_crt_bundle_attach;
+    }
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    if (s_session != NULL) {
+        cfg.client_session = s_session;
+        resumed = true;
+    }
+#endif
+
+    s_tls = esp_tls_init();
+    if (s_tls == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    s_stats.heap_before_handshake = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    s_heap_low = s_stats.heap_before_handshake;
+    if (s_heap_timer != NULL) {
+        esp_timer_start_periodic(s_heap_timer, HTTPS_UPLOAD_HEAP_SAMPLE_US);
+    }
+    start = esp_timer_get_time();
+    int ret = esp_tls_conn_new_sync(ip, strlen(ip), HTTPS_UPLOAD_PORT, &cfg, s_tls);
+    if (s_heap_timer != NULL) {
+        esp_timer_stop(s_heap_timer);
+    }
+    heap_sample(NULL);
+    s_stats.heap_handshake_used = s_stats.heap_before_handshake - s_heap_low;
+    if (s_stats.heap_handshake_used > s_stats.heap_handshake_max_used) {
+        s_stats.heap_handshake_max_used = s_stats.heap_handshake_used;
+    }
+    s_stats.heap_min_free_ever = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    if (ret != 1) {
+        ESP_LOGW(TAG, "connection to %s failed", s_host);
+        esp_tls_conn_destroy(s_tls);
+        s_tls = NULL;
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+        // The ticket may have expired on server side, start from scratch
+        if (s_session != NULL) {
+            esp_tls_free_client_session(s_session);
+            s_session = NULL;
+        }
+#endif
+        return ESP_FAIL;
+    }
+    timing->connect_us = esp_timer_get_time();
+    s_stats.last_handshake_us = timing->connect_us - start;
+
+    if (resumed) {
+        s_stats.resumed_handshakes++;
+        s_stats.resumed_handshake_us += s_stats.last_handshake_us;
+    }
+    else {
+        s_stats.full_handshakes++;
+        s_stats.full_handshake_us += s_stats.last_handshake_us;
+    }
+    ESP_LOGI(TAG, "%s handshake in %" PRId64 " ms, heap used %d bytes",
+             resumed ? "resumed" : "full", s_stats.last_handshake_us / 1000,
+             (int)s_stats.heap_handshake_used);
+
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    // Keep the (possibly renewed) session for the next reconnect
+    if (s_session != NULL) {
+        esp_tls_free_client_session(s_session);
+    }
+    s_session = esp_tls_get_client_session(s_tls);
+#endif
+
+    s_rx_pos = 0;
+    s_rx_len = 0;
+    s_last_used_us = timing->connect_us;
+    return ESP_OK;
+}
+
+
+/*-----------------------------------------------------------*/
+static void tls_disconnect(void)
+{
+    if (s_tls != NULL) {
+        esp_tls_conn_destroy(s_tls);
+        s_tls = NULL;
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+/* Kept connection the server may have closed meanwhile: idle for too
+   long, or with a FIN or data (close_notify alert) waiting. Nothing
+   else arrives between two exchanges. */
+static bool connection_stale(void)
+{
+    int sock;
+    char c;
+    int len;
+
+    if (esp_timer_get_time() - s_last_used_us > HTTPS_UPLOAD_MAX_IDLE_MS * 1000LL) {
+        return true;
+    }
+    if (s_rx_pos != s_rx_len || esp_tls_get_conn_sockfd(s_tls, &sock) != ESP_OK) {
+        return true;
+    }
+    len = recv(sock, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+
+    return !(len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+}
+
+
+/*-----------------------------------------------------------*/
+/* Return one received byte, -1 on error or closed connection */
+static int rx_byte(void)
+{
+    if (s_rx_pos == s_rx_len) {
+        int len = esp_tls_conn_read(s_tls, s_rx, sizeof(s_rx));
+        if (len <= 0) {
+            return -1;
+        }
+        s_rx_pos = 0;
+        s_rx_len = len;
+    }
+    return (unsigned char)s_rx[s_rx_pos++];
+}
+
+
+/*-----------------------------------------------------------*/
+/* Read one header line without CR/LF, return its length or -1 */
+static int rx_line(char *line, size_t size)
+{
+    size_t len = 0;
+    int c;
+
+    while ((c = rx_byte()) >= 0) {
+        if (c == '\n') {
+            if (len > 0 && line[len - 1] == '\r') {
+                len--;
+            }
+            line[len] = '\0';
+            return len;
+        }
+        if (len < size - 1) {
+            line[len++] = c;
+        }
+    }
+    return -1;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Read "count" body bytes, store as many as fit into response */
+static esp_err_t rx_body(size_t count, char *response, size_t size, size_t *used)
+{
+    int c;
+
+    while (count-- > 0) {
+        if ((c = rx_byte()) < 0) {
+            return ESP_FAIL;
+        }
+        if (*used < size - 1) {
+            response[(*used)++] = c;
+        }
+    }
+    return ESP_OK;
+}
+
+
+/*-----------------------------------------------------------*/
+static esp_err_t read_response(char *response, size_t size, int *status, bool *keep_alive)
+{
+    char line[128];
+    long content_length = -1;
+    bool chunked = false;
+    size_t used = 0;
+
+    // Status line, e.g. "HTTP/1.1 200 OK"
+    if (rx_line(line, sizeof(line)) < 0 || strncmp(line, "HTTP/1.", 7) != 0) {
+        return ESP_FAIL;
+    }
+    *status = atoi(line + 9);
+    *keep_alive = true;
+
+    // Headers
+    while (1) {
+        int len = rx_line(line, sizeof(line));
+        if (len < 0) {
+            return ESP_FAIL;
+        }
+        if (len == 0) {
+            break;
+        }
+        if (strncasecmp(line, "Content-Length:", 15) == 0) {
+            content_length = strtol(line + 15, NULL, 10);
+            if (content_length < 0) {
+                return ESP_FAIL;
+            }
+        }
+        else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0 && strstr(line, "chunked") != NULL) {
+            chunked = true;
+        }
+        else if (strncasecmp(line, "Connection:", 11) == 0 && strstr(line, "close") != NULL) {
+            *keep_alive = false;
+        }
+    }
+
+    // Body
+    if (chunked) {
+        while (1) {
+            long chunk;
+            if (rx_line(line, sizeof(line)) < 0) {
+                return ESP_FAIL;
+            }
+            chunk = strtol(line, NULL, 16);
+            if (chunk < 0) {
+                return ESP_FAIL;
+            }
+            if (chunk == 0) {
+                rx_line(line, sizeof(line));    // Trailing CRLF
+                break;
+            }
+            if (rx_body(chunk, response, size, &used) != ESP_OK || rx_line(line, sizeof(line)) < 0) {
+                return ESP_FAIL;
+            }
+        }
+    }
+    else if (content_length >= 0) {
+        if (rx_body(content_length, response, size, &used) != ESP_OK) {
+            return ESP_FAIL;
+        }
+    }
+    else {
+        // Body delimited by closing the connection
+        int c;
+        while ((c = rx_byte()) >= 0) {
+            if (used < size - 1) {
+                response[used++] = c;
+            }
+        }
+        *keep_alive = false;
+    }
+    response[used] = '\0';
+
+    return ESP_OK;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Host to connect to and optional CA certificate in PEM format. If
+   no certificate is given, the ESP-IDF certificate bundle is used. */
+esp_err_t https_upload_init(const char *host, const char *ca_pem)
+{
+    if (strlen(host) >= sizeof(s_host)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_lock == NULL) {
+        esp_timer_create_args_t timer_args = {
+            .callback = heap_sample,
+            .name = "tls heap",
+        };
+        s_lock = xSemaphoreCreateMutex();
+        // Without the timer only the heap after the handshake is seen
+        if (esp_timer_create(&timer_args, &s_heap_timer) != ESP_OK) {
+            s_heap_timer = NULL;
+        }
+    }
+    strcpy(s_host, host);
+    memset(&s_stats, 0, sizeof(s_stats));
+
+    // Parse the certificate only once, all connections share it
+    if (ca_pem != NULL) {
+        ESP_ERROR_CHECK(esp_tls_init_global_ca_store());
+        ESP_ERROR_CHECK(esp_tls_set_global_ca_store((const unsigned char *)ca_pem, strlen(ca_pem) + 1));
+        s_use_global_ca = true;
+    }
+
+    return ESP_OK;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Send GET request over the persistent connection, reconnect (and
+   resume the TLS session) once if the server closed it before the
+   request was written */
+esp_err_t https_upload_get(const char *path, char *response, size_t response_size, int *status)
+{
+    https_upload_timing_t timing;
+
+    return https_upload_get_timed(path, response, response_size, status, &timing);
+}
+
+
+/*-----------------------------------------------------------*/
+/* Write request head and body over the persistent connection and
+   read the response. A stale kept connection is replaced (and the TLS
+   session resumed) before writing, and a failed write is tried again
+   over a new connection. After the request was written it is not
+   repeated, ThingSpeak uploads are not idempotent. */
+static esp_err_t send_request(const char *request, size_t len, const void *body, size_t body_len,
+                              char *response, size_t response_size, int *status,
+                              https_upload_timing_t *timing)
+{
+    bool keep_alive = false;
+    bool sent = false;
+    esp_err_t err = ESP_FAIL;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_stats.requests++;
+    if (s_tls != NULL && connection_stale()) {
+        s_stats.stale_closes++;
+        tls_disconnect();
+    }
+    for (uint8_t attempt = 0; attempt < 2 && !sent; attempt++) {
+        if (s_tls == NULL && tls_connect(timing) != ESP_OK) {
+            continue;
+        }
+        if (esp_tls_conn_write(s_tls, request, len) == (ssize_t)len &&
+            (body_len == 0 || esp_tls_conn_write(s_tls, body, body_len) == (ssize_t)body_len)) {
+            sent = true;
+            timing->sent_us = esp_timer_get_time();
+            if (read_response(response, response_size, status, &keep_alive) == ESP_OK) {
+                err = ESP_OK;
+                s_last_used_us = esp_timer_get_time();
+            }
+        }
+        if (err != ESP_OK || !keep_alive) {
+            tls_disconnect();
+        }
+    }
+    if (err != ESP_OK) {
+        s_stats.failed++;
+    }
+    xSemaphoreGive(s_lock);
+
+    return err;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Same as https_upload_get(), with times of the request steps */
+esp_err_t https_upload_get_timed(const char *path, char *response, size_t response_size, int *status,
+                                 https_upload_timing_t *timing)
+{
+    char request[HTTPS_UPLOAD_MAX_REQUEST];
+    int len;
+
+    memset(timing, 0, sizeof(https_upload_timing_t));
+    len = snprintf(request, sizeof(request),
+                   "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: keep-alive\r\n\r\n", path, s_host);
+    if (len >= (int)sizeof(request)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    return send_request(request, len, NULL, 0, response, response_size, status, timing);
+}
+
+
+/*-----------------------------------------------------------*/
+/* Send POST request with "body" over the persistent connection. With
+   "content_encoding" (e.g. "gzip") the body is already compressed;
+   a server not supporting the coding answers 415 Unsupported Media
+   Type and the caller should send the body again uncompressed. */
+esp_err_t https_upload_post(const char *path, const char *content_type, const char *content_encoding,
+                            const void *body, size_t body_len, char *response, size_t response_size, int *status)
+{
+    char request[HTTPS_UPLOAD_MAX_REQUEST];
+    https_upload_timing_t timing;
+    int len;
+
+    memset(&timing, 0, sizeof(https_upload_timing_t));
+    len = snprintf(request, sizeof(request),
+                   "POST %s HTTP/1.1\r\nHost: %s\r\nConnection: keep-alive\r\n"
+                   "Content-Type: %s\r\n%s%s%sContent-Length: %u\r\n\r\n",
+                   path, s_host, content_type,
+                   content_encoding ? "Content-Encoding: " : "", content_encoding ? content_encoding : "",
+                   content_encoding ? "\r\n" : "", (unsigned)body_len);
+    if (len >= (int)sizeof(request)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    return send_request(request, len, body, body_len, response, response_size, status, &timing);
+}
+
+
+/*-----------------------------------------------------------*/
+void https_upload_close(void)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    tls_disconnect();
+    xSemaphoreGive(s_lock);
+}
+
+
+/*-----------------------------------------------------------*/
+void https_upload_get_stats(https_upload_stats_t *stats)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *stats = s_stats;
+    xSemaphoreGive(s_lock);
+}
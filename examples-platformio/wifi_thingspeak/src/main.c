@@ -12,21 +12,59 @@
   NOTES:
     * Set your Wi-Fi SSID and password in "include/my_data.h"
     * Set your ThingSpeak Write API key in "include/my_data.h"
+    * HTTPS uploads keep one TLS connection open and resume the TLS
+      session after reconnects, see "THINGSPEAK_USE_HTTPS"
+    * Samples can be published over MQTT instead, see "TELEMETRY_USE_MQTT"
+    * With "SIMULATION" set, the example runs with no sensor and
+      optionally no access point, and logs samples per second, upload
+      latency and heap usage
+    * Latency of uploaded samples is traced stage by stage, convert the
+      serial log with "tools/trace2chrome.py" to view it in Perfetto
+    * Over HTTPS, samples can be collected and sent as one gzip
+      compressed bulk update, see "UPLOAD_BATCH"
+    * Samples are stamped with UTC time from SNTP, so queued and
+      batched samples keep the time they were read, see "TIME_NTP_SERVER"
+    * With more access points (or networks) around, the station moves
+      to a better one when the link gets weak, see "ROAM_ENABLE"
+    * LAN clients can read the latest sample and metrics over HTTP,
+      see "STATUS_SERVER_ENABLE"
+    * The sensor is read faster while values change and slower while
+      they are stable, see "SAMPLE_ADAPTIVE"
  */
 
 
 /*-----------------------------------------------------------*/
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <freertos/queue.h>
 #include <esp_log.h>            // ESP_LOG/E/W/I functions
 #include <nvs_flash.h>          // Memory
 #include <esp_wifi.h>           // Wi-Fi driver
 #include <esp_netif.h>
 #include <esp_http_client.h>
 #include <my_data.h>
+#include <https_upload.h>       // Persistent HTTPS connection
+#include <payload.h>            // Upload payload encoder
+#include <dht12.h>              // DHT12 values structure
+#include <mqtt_transport.h>     // MQTT session with outbox
+#include <aggregate.h>          // Report-by-exception filter
+#include <filters.h>            // Fixed-point filtering kernels
+#include <sim.h>                // Simulated sensor, Wi-Fi and uploads
+#include <trace.h>              // Sample-to-cloud latency tracing
+#include <dns_cache.h>          // Resolver cache with TTLs
+#include <deflate_stream.h>     // Streaming compressor
+#include <timekeeper.h>         // SNTP time for sample time stamps
+#include <roam.h>               // Best access point while connected
+#include <arena.h>              // Request-scoped allocations
+#include <status_server.h>      // Latest reading and metrics for LAN
+#include <sample_rate.h>        // Adaptive sampling period
+#include <esp_timer.h>          // esp_timer_get_time() function
+#include <esp_system.h>         // esp_get_free_heap_size() function
 #include <driver/gpio.h>        // GPIO pins
 #include <driver/i2c.h>         // Inter-Integrated Circuit driver
-#include <stdio.h>              // sprintf() function
+#include <inttypes.h>           // PRIu32, PRId64 format macros
+#include <string.h>             // strlcpy() function
 
 
 /*-----------------------------------------------------------*/
@@ -39,6 +77,64 @@
 #define I2C_DHT_HUMID 0x00    // 0x00 @ Humidity
 #define I2C_DHT_TEMP 0x02     // 0x02 @ Temperature
 
+#define THINGSPEAK_HOST "api.thingspeak.com"
+
+#if SIMULATION
+#define SENSOR_MIN_PERIOD_MS SIM_SAMPLE_PERIOD_MS
+#define SENSOR_MAX_PERIOD_MS SIM_SAMPLE_PERIOD_MS
+#elif SAMPLE_ADAPTIVE
+#define SENSOR_MIN_PERIOD_MS SAMPLE_MIN_PERIOD_MS
+#define SENSOR_MAX_PERIOD_MS SAMPLE_MAX_PERIOD_MS
+#else
+#define SENSOR_MIN_PERIOD_MS 60000
+#define SENSOR_MAX_PERIOD_MS 60000
+#endif
+
+#if SIMULATION && TELEMETRY_USE_MQTT
+#error "Simulation covers HTTP uploads only"
+#endif
+
+#if UPLOAD_BATCH > 1 && (SIMULATION || TELEMETRY_USE_MQTT || !THINGSPEAK_USE_HTTPS)
+#error "Bulk updates are sent over HTTPS only"
+#endif
+// Longest bulk update entry is ,{"created_at":"2022-05-17T10:00:00Z","field1":-3276.8,"field2":3276.8}
+#define UPLOAD_MAX_BODY (64 + 72 * UPLOAD_BATCH)
+
+// Single sample uploads: waiting samples, request link and response
+// text, and the region they (with the URL of a kept HTTP client) use
+#define UPLOAD_QUEUE_LEN 4
+#define UPLOAD_LINK_SIZE 128
+#define UPLOAD_RESPONSE_SIZE 32
+#define UPLOAD_ARENA_SIZE 512
+
+// Report a sample only if it differs from the last reported one by
+// 0.3 °C or 1.0 %, or at least every 15 minutes
+#define REPORT_TEMP_DEADBAND 3
+#define REPORT_HUMID_DEADBAND 10
+#define REPORT_HEARTBEAT_MS (15 * 60 * 1000)
+#define REPORT_WINDOW 10
+
+// Replace single-sample glitches: a sample further than 3 scaled MADs
+// from the median of the last 5 ones is an outlier
+#define FILTER_WINDOW 5
+#define FILTER_THRESHOLD FILTER_Q8(3)
+
+// Sampling period: fastest for 4 samples after a change, then it
+// doubles per stable sample; 130 mW is the chip awake at 240 MHz
+#define SAMPLE_HOLD 4
+#define SAMPLE_ACTIVE_MW 130
+
+// Print traces of uploaded samples and latency histograms after
+// every 16 reports, see "tools/trace2chrome.py"
+#define TRACE_DUMP_EVERY 16
+
+// Sensor task stack in bytes. Its ESP_LOGx() calls with up to a dozen
+// arguments (64-bit ones among them) run newlib's vfprintf() on this
+// stack; the lowest free stack is logged with every trace dump and a
+// warning is printed below SENSOR_STACK_MIN_FREE
+#define SENSOR_STACK_SIZE 4096
+#define SENSOR_STACK_MIN_FREE 512
+
 // On-board LED(s):
 // FireBeetle : #2 (blue)
 #define BUILT_IN_LED 2
@@ -48,14 +144,119 @@
 // Tag for ESP_LOG/E/W/I functions
 static const char *TAG = "wifi thingspeak";
 
-// DHT12 sensor values
-struct DHT12_values_structure {
-    uint8_t humidInt;
-    uint8_t humidDec;
-    uint8_t tempInt;
-    uint8_t tempDec;
-    uint8_t checksum;
-} dht12;
+// DHT12 sensor values and the time they were read
+struct DHT12_values_structure dht12;
+int64_t dht12_time_us = 0;
+
+// ThingSpeak fields, values in tenths
+static const payload_field_t thingspeak_fields[] = {
+    {"field1", 1},          // Temperature
+    {"field2", 1},          // Humidity
+};
+static payload_template_t thingspeak_template;
+static char thingspeak_prefix[80];
+
+// Outlier rejection of DHT12 values
+static filter_hampel_t temp_filter;
+static filter_hampel_t humid_filter;
+
+// Sampling period from raw DHT12 values, so a real change is seen
+// before the outlier filter accepts it. Limits in tenths: step above
+// 0.1 °C faster than 0.3 °C/min, or deviation above 0.2 °C; step above
+// 0.5 % faster than 2 %/min, or deviation above 1 %
+static const sample_rate_channel_t sample_limits[] = {
+    {1, 3, 2},              // Temperature
+    {5, 20, 10},            // Humidity
+};
+static sample_rate_t sample_rate;
+
+#if STATUS_SERVER_ENABLE
+// Metrics served at /metrics, in the order of "status_metrics"
+enum {
+    METRIC_SAMPLES,
+    METRIC_READ_FAILURES,
+    METRIC_REPORTED,
+    METRIC_SUPPRESSED,
+    METRIC_TEMP_OUTLIERS,
+    METRIC_HUMID_OUTLIERS,
+    METRIC_HEAP_FREE,
+    METRIC_HEAP_MIN_FREE,
+    METRIC_UPTIME,
+    METRIC_SAMPLE_PERIOD,
+};
+static const status_metric_t status_metrics[] = {
+    {"dht12_samples_total", "Samples read from DHT12", true},
+    {"dht12_read_failures_total", "Failed DHT12 reads", true},
+    {"reports_total", "Samples passed to upload", true},
+    {"reports_suppressed_total", "Samples not uploaded, values did not change", true},
+    {"outliers_temperature_total", "Temperature samples replaced by the filter", true},
+    {"outliers_humidity_total", "Humidity samples replaced by the filter", true},
+    {"heap_free_bytes", "Free heap at the last sample", false},
+    {"heap_min_free_bytes", "Lowest free heap since boot", false},
+    {"uptime_seconds", "Time since boot at the last sample", false},
+    {"sample_period_ms", "Delay before the next sample", false},
+};
+static uint32_t read_failures = 0;
+#endif
+
+// Created at the first IP address
+static TaskHandle_t sensor_task = NULL;
+
+// Samples waiting for the upload task, one request each
+typedef struct {
+    uint32_t trace_id;
+    int32_t values[2];
+    int64_t time_us;
+} upload_item_t;
+static QueueHandle_t upload_queue;
+// Request-scoped buffers of the upload task, released after each request
+static uint8_t upload_arena_buffer[UPLOAD_ARENA_SIZE];
+static arena_t upload_arena;
+#if !SIMULATION && !THINGSPEAK_USE_HTTPS
+static esp_http_client_handle_t http_client = NULL;     // Kept between requests
+#endif
+
+#if ROAM_ENABLE
+// Networks to roam between, the first one is joined by default
+static const roam_network_t roam_networks[] = {
+    {WIFI_SSID, WIFI_PASS},
+    // {"REPLACE_WITH_OTHER_SSID", "REPLACE_WITH_OTHER_PASSWORD"},
+};
+#endif
+
+#if UPLOAD_BATCH > 1
+// ThingSpeak bulk update entry, "delta_t" in seconds since the
+// previous entry
+static const payload_field_t bulk_fields[] = {
+    {"delta_t", 0},
+    {"field1", 1},
+    {"field2", 1},
+};
+static payload_template_t bulk_template;
+static payload_template_t bulk_utc_template;   // "created_at" instead of "delta_t"
+// Prefix of "bulk_utc_template", the time is rewritten in place
+#define BULK_CREATED_AT "\"created_at\":\""
+#define BULK_TIME_LEN 20                        // 2022-05-17T10:00:00Z
+static char bulk_created_at[] = BULK_CREATED_AT "2022-05-17T10:00:00Z\"";
+static char bulk_path[80];
+static char bulk_body[UPLOAD_MAX_BODY];
+static size_t bulk_head_len = 0;        // API key, written once
+static size_t bulk_len = 0;
+static uint8_t bulk_count = 0;
+static int64_t bulk_last_ms = 0;
+// Sample that did not fit into the previous batch, opens the next one
+static int32_t bulk_carry[2];
+static int64_t bulk_carry_us;
+static bool bulk_carried = false;
+static SemaphoreHandle_t bulk_idle;     // Taken while the body is sent
+static uint32_t bulk_raw_bytes = 0;
+static uint32_t bulk_sent_bytes = 0;
+#if UPLOAD_COMPRESS
+static deflate_stream_t bulk_deflate;
+static uint8_t bulk_gzip[UPLOAD_MAX_BODY];
+static bool bulk_compress = true;       // Cleared if the server refuses gzip
+#endif
+#endif
 
 
 /*-----------------------------------------------------------*/
@@ -94,8 +295,13 @@ esp_err_t http_event_handler(esp_http_client_event_handle_t evt)
 
 
 /*-----------------------------------------------------------*/
-void dht_get_all_values()
+esp_err_t dht_get_all_values()
 {
+    esp_err_t err;
+
+#if SIMULATION
+    err = sim_dht12_read(&dht12);
+#else
     // Create and execute i2c commands list
     i2c_cmd_handle_t cmd = i2c_cmd_link_create();
     i2c_master_start(cmd);
@@ -109,60 +315,589 @@ void dht_get_all_values()
     i2c_master_read_byte(cmd, &dht12.tempDec, I2C_ACK);
     i2c_master_read_byte(cmd, &dht12.checksum, I2C_NACK);
     i2c_master_stop(cmd);
-    i2c_master_cmd_begin(I2C_NUM_0, cmd, (1000 / portTICK_RATE_MS));
+    err = i2c_master_cmd_begin(I2C_NUM_0, cmd, (1000 / portTICK_RATE_MS));
     i2c_cmd_link_delete(cmd);
+#endif
+
+    if (err == ESP_OK && !dht12_checksum_ok(&dht12)) {
+        err = ESP_ERR_INVALID_CRC;
+    }
+    return err;
 }
 
 
 /*-----------------------------------------------------------*/
-void thingspeak_task()
+void log_dns_stats()
 {
-    char link[100] = "";
+    dns_cache_stats_t dns;
 
-    ESP_LOGI(TAG, "ThingSpeak task started");
+    dns_cache_get_stats(&dns);
+    ESP_LOGI(TAG, "dns: %" PRIu32 " hits, %" PRIu32 " misses, %" PRIu32 " stale, %" PRIu32 " failed, %" PRIu32 " lookups (avg %" PRId64 " ms, max %" PRId64 " ms)",
+             dns.hits, dns.misses, dns.stale_hits, dns.failures, dns.lookups,
+             dns.lookups ? dns.lookup_sum_us / dns.lookups / 1000 : 0, dns.lookup_max_us / 1000);
+}
 
-    sprintf(link, "http://api.thingspeak.com/update?api_key=%s&field1=%d.%d&field2=%d.%d", THINGSPEAK_WRITE_API_KEY, dht12.tempInt, dht12.tempDec, dht12.humidInt, dht12.humidDec);
+
+/*-----------------------------------------------------------*/
+void log_time_status()
+{
+    timekeeper_status_t status;
+
+    timekeeper_get_status(&status);
+    if (status.synced) {
+        ESP_LOGI(TAG, "time: error %" PRIu32 " us, last step %" PRId64 " us, drift %" PRId32 " ppb, %" PRIu32 " syncs, %" PRIu32 " failed",
+                 timekeeper_error_us(esp_timer_get_time()), status.last_step_us, status.drift_ppb, status.syncs, status.failures);
+    }
+    else {
+        ESP_LOGW(TAG, "time: not synced, %" PRIu32 " failed syncs", status.failures);
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+/* Sampling costs per hour next to fixed sampling at the fastest rate */
+void log_sample_rate()
+{
+    sample_rate_cost_t adaptive, fixed;
+
+    sample_rate_report(&sample_rate, &adaptive, &fixed);
+    ESP_LOGI(TAG, "sampling: period %" PRIu32 " ms, %" PRIu32 " speed-ups, %" PRIu32 " of %" PRIu32 " samples fast",
+             sample_rate.period_ms, sample_rate.speed_ups, sample_rate.fast_samples, sample_rate.samples);
+    ESP_LOGI(TAG, "per hour: %" PRIu32 " samples, bus %" PRIu32 " ms, CPU %" PRIu32 " ms, %" PRIu32 " mJ (fixed %" PRIu32 " ms: %" PRIu32 " samples, bus %" PRIu32 " ms, CPU %" PRIu32 " ms, %" PRIu32 " mJ)",
+             adaptive.samples, adaptive.bus_ms, adaptive.cpu_ms, adaptive.energy_mj,
+             sample_rate.config.min_period_ms, fixed.samples, fixed.bus_ms, fixed.cpu_ms, fixed.energy_mj);
+}
+
+
+/*-----------------------------------------------------------*/
+void log_roam_stats()
+{
+#if ROAM_ENABLE
+    roam_stats_t roam;
+
+    roam_get_stats(&roam);
+    ESP_LOGI(TAG, "roam: %02x:%02x:%02x:%02x:%02x:%02x %d dBm channel %u, %u.%u %% failed, %u candidates, %" PRIu32 " channel scans, %" PRIu32 " full scans, %" PRIu32 " roams (%" PRIu32 " failed)",
+             roam.bssid[0], roam.bssid[1], roam.bssid[2], roam.bssid[3], roam.bssid[4], roam.bssid[5],
+             roam.rssi, roam.channel, roam.failure_permille / 10, roam.failure_permille % 10, roam.candidates,
+             roam.channel_scans, roam.full_scans, roam.roams, roam.roam_failures);
+#endif
+}
+
+
+/*-----------------------------------------------------------*/
+/* Send one sample, buffers come from the upload arena */
+void thingspeak_upload(const upload_item_t *item)
+{
+    uint32_t trace_id = item->trace_id;
+    char *link = arena_calloc(&upload_arena, 1, UPLOAD_LINK_SIZE);
+
+    if (link == NULL ||
+        payload_encode(&thingspeak_template, item->values, (uint8_t *)link, UPLOAD_LINK_SIZE) == 0) {
+        ESP_LOGE(TAG, "request does not fit into buffer");
+        trace_abort(trace_id);
+        return;
+    }
+    // Time of the sample, ThingSpeak would use the time of arrival
+    if (timekeeper_is_synced()) {
+        size_t len = strlen(link);
+        char *created_at = arena_alloc(&upload_arena, 24);
+
+        if (created_at == NULL ||
+            timekeeper_format_iso8601(timekeeper_to_utc_us(item->time_us), created_at, 24) == 0 ||
+            strlcat(link, "&created_at=", UPLOAD_LINK_SIZE) >= UPLOAD_LINK_SIZE ||
+            strlcat(link, created_at, UPLOAD_LINK_SIZE) >= UPLOAD_LINK_SIZE) {
+            // Cut time stamp, send the sample with the time of arrival
+            ESP_LOGW(TAG, "time stamp does not fit into request");
+            link[len] = '\0';
+        }
+    }
+    trace_mark(trace_id, TRACE_ENCODED);
 
     // Show request link for debugging purposes
     // ESP_LOGI(TAG, "%s", link);
 
-    esp_http_client_config_t config = {
-        .url = link,
-        .method = HTTP_METHOD_GET,
-        .cert_pem = NULL,
-        .event_handler = http_event_handler
-    };
+#if SIMULATION
+    char *response = arena_alloc(&upload_arena, UPLOAD_RESPONSE_SIZE);
+    int status = 0;
+    int64_t start = esp_timer_get_time();
+    esp_err_t err = sim_http_get(link, response, UPLOAD_RESPONSE_SIZE, &status);
+
+    sim_bench_upload(esp_timer_get_time() - start, err == ESP_OK && status == 200);
+    trace_mark(trace_id, TRACE_ACKED);
+    trace_finish(trace_id, err == ESP_OK && status == 200);
+#elif THINGSPEAK_USE_HTTPS
+    char *response = arena_alloc(&upload_arena, UPLOAD_RESPONSE_SIZE);
+    int status = 0;
+    https_upload_stats_t stats;
+    https_upload_timing_t timing;
+    esp_err_t err;
+
+#if ROAM_ENABLE
+    int64_t start = esp_timer_get_time();
+#endif
+
+    // Reuse the open connection, or resume the TLS session
+    err = https_upload_get_timed(link, response, UPLOAD_RESPONSE_SIZE, &status, &timing);
+#if ROAM_ENABLE
+    roam_report_upload(err == ESP_OK && status == 200, strlen(link), esp_timer_get_time() - start);
+#endif
+    if (err == ESP_OK) {
+        // ThingSpeak return the number of Entries in the channel
+        ESP_LOGI(TAG, "HTTPS status %d, entry %s", status, response);
+    }
+    if (timing.dns_us != 0) {
+        trace_mark_at(trace_id, TRACE_DNS, timing.dns_us);
+    }
+    if (timing.connect_us != 0) {
+        trace_mark_at(trace_id, TRACE_CONNECT, timing.connect_us);
+    }
+    if (timing.sent_us != 0) {
+        trace_mark_at(trace_id, TRACE_SENT, timing.sent_us);
+    }
+    trace_mark(trace_id, TRACE_ACKED);
+    trace_finish(trace_id, err == ESP_OK && status == 200);
+    https_upload_get_stats(&stats);
+    ESP_LOGI(TAG, "handshakes: %" PRIu32 " full (avg %" PRId64 " ms), %" PRIu32 " resumed (avg %" PRId64 " ms), %" PRIu32 " stale closes, handshake heap %d (max %d), min free heap %d",
+             stats.full_handshakes, stats.full_handshakes ? stats.full_handshake_us / stats.full_handshakes / 1000 : 0,
+             stats.resumed_handshakes, stats.resumed_handshakes ? stats.resumed_handshake_us / stats.resumed_handshakes / 1000 : 0,
+             stats.stale_closes,
+             (int)stats.heap_handshake_used, (int)stats.heap_handshake_max_used, (int)stats.heap_min_free_ever);
+    log_dns_stats();
+    log_time_status();
+    log_roam_stats();
+#else
+    char ip[16];
+    const char *host = THINGSPEAK_HOST;
+    char *url;
+    size_t size;
+    int status;
+
+    // Connect to the cached address, no DNS round trip
+    if (dns_cache_resolve_str(THINGSPEAK_HOST, ip, sizeof(ip)) == ESP_OK) {
+        host = ip;
+    }
+    trace_mark(trace_id, TRACE_DNS);
+    if (http_client == NULL) {
+        // One client for all requests, the connection is kept alive
+        esp_http_client_config_t config = {
+            .host = host,
+            .path = link,
+            .method = HTTP_METHOD_GET,
+            .cert_pem = NULL,
+            .keep_alive_enable = true,
+            .event_handler = http_event_handler
+        };
+        http_client = esp_http_client_init(&config);
+    }
+    else {
+        size = strlen("http://") + strlen(host) + strlen(link) + 1;
+        url = arena_alloc(&upload_arena, size);
+        if (url == NULL) {
+            ESP_LOGE(TAG, "no memory for request URL");
+            trace_finish(trace_id, false);
+            return;
+        }
+        strlcpy(url, "http://", size);
+        strlcat(url, host, size);
+        strlcat(url, link, size);
+        esp_http_client_set_url(http_client, url);
+    }
+    esp_http_client_set_header(http_client, "Host", THINGSPEAK_HOST);
+#if ROAM_ENABLE
+    int64_t start = esp_timer_get_time();
+#endif
+    esp_err_t err = esp_http_client_perform(http_client);
+    status = esp_http_client_get_status_code(http_client);
+    trace_mark(trace_id, TRACE_ACKED);
+#if ROAM_ENABLE
+    roam_report_upload(err == ESP_OK && status == 200, strlen(link), esp_timer_get_time() - start);
+#endif
+    trace_finish(trace_id, err == ESP_OK && status == 200);
+    if (err != ESP_OK) {
+        // Next request opens a new connection
+        esp_http_client_close(http_client);
+    }
+    log_dns_stats();
+    log_time_status();
+    log_roam_stats();
+#endif
+}
+
+
+/*-----------------------------------------------------------*/
+/* Upload samples one by one, the task and its client live for the
+   whole run instead of being created for every sample */
+void thingspeak_task(void *pvParameter)
+{
+    upload_item_t item;
+
+    ESP_LOGI(TAG, "ThingSpeak task started");
+    arena_init(&upload_arena, upload_arena_buffer, sizeof(upload_arena_buffer));
+
+    // Forever loop
+    while (1) {
+        xQueueReceive(upload_queue, &item, portMAX_DELAY);
+        thingspeak_upload(&item);
+
+        // Everything the request needed is released at once
+        ESP_LOGI(TAG, "arena high water %u of %u bytes, %" PRIu32 " allocations, %" PRIu32 " from heap",
+                 (unsigned)upload_arena.high_water, (unsigned)upload_arena.size,
+                 upload_arena.allocs, upload_arena.heap_allocs);
+        arena_reset(&upload_arena);
+    }
+
+    // Delete this task if it exits from the loop above
+    vTaskDelete(NULL);
+}
+
+
+/*-----------------------------------------------------------*/
+#if UPLOAD_BATCH > 1
+/* Send the collected bulk update, compressed if the server takes it */
+void bulk_upload_task(void *pvParameter)
+{
+    char response[32];
+    int status = 0;
+    const void *body = bulk_body;
+    size_t len = bulk_len;
+    const char *encoding = NULL;
+    int64_t start;
+    esp_err_t err;
+
+#if UPLOAD_COMPRESS
+    if (bulk_compress) {
+        // Fixed memory, a body that does not shrink is sent as it is
+        size_t n = deflate_stream_compress(&bulk_deflate, DEFLATE_STREAM_GZIP, bulk_body, bulk_len,
+                                           bulk_gzip, sizeof(bulk_gzip));
+        if (n > 0 && n < bulk_len) {
+            body = bulk_gzip;
+            len = n;
+            encoding = deflate_stream_encoding(DEFLATE_STREAM_GZIP);
+        }
+    }
+#endif
 
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    esp_http_client_perform(client);
-    esp_http_client_cleanup(client);
+    start = esp_timer_get_time();
+    err = https_upload_post(bulk_path, "application/json", encoding, body, len,
+                            response, sizeof(response), &status);
+#if UPLOAD_COMPRESS
+    if (err == ESP_OK && status == 415 && encoding != NULL) {
+        ESP_LOGW(TAG, "server does not accept gzip, compression turned off");
+        bulk_compress = false;
+        body = bulk_body;
+        len = bulk_len;
+        err = https_upload_post(bulk_path, "application/json", NULL, body, len,
+                                response, sizeof(response), &status);
+    }
+#endif
+
+#if ROAM_ENABLE
+    roam_report_upload(err == ESP_OK && status == 200, len, esp_timer_get_time() - start);
+#endif
+
+    if (err == ESP_OK) {
+        bulk_raw_bytes += bulk_len;
+        bulk_sent_bytes += len;
+        ESP_LOGI(TAG, "bulk update of %u samples: HTTPS status %d, %u bytes sent (%u raw), total %" PRIu32 " of %" PRIu32 " bytes",
+                 bulk_count, status, (unsigned)len, (unsigned)bulk_len, bulk_sent_bytes, bulk_raw_bytes);
+    }
+    else {
+        ESP_LOGW(TAG, "bulk update of %u samples failed", bulk_count);
+    }
+    log_dns_stats();
+    log_time_status();
+    log_roam_stats();
+
+    bulk_count = 0;
+    xSemaphoreGive(bulk_idle);
 
     // Delete this task
     vTaskDelete(NULL);
 }
 
 
+/*-----------------------------------------------------------*/
+/* Append one entry to the bulk update, return false if it does not
+   fit; "values" are temperature and humidity */
+bool bulk_append(const int32_t *values, int64_t time_us)
+{
+    int64_t now_ms = time_us / 1000;
+    int32_t entry[3] = {
+        (bulk_count > 0) ? (now_ms - bulk_last_ms) / 1000 : 0,
+        values[0],
+        values[1],
+    };
+    char *stamp = bulk_created_at + strlen(BULK_CREATED_AT);
+    size_t pos = (bulk_count > 0) ? bulk_len + 1 : bulk_head_len;
+    size_t n;
+
+    // Keep space for "]}" and zero terminator
+    if (pos + 3 > sizeof(bulk_body)) {
+        return false;
+    }
+    if (timekeeper_is_synced() &&
+        timekeeper_format_iso8601(timekeeper_to_utc_us(time_us), stamp, BULK_TIME_LEN + 1) == BULK_TIME_LEN) {
+        // Absolute time of the sample goes in front of the fields,
+        // the terminator replaced the closing quote
+        stamp[BULK_TIME_LEN] = '"';
+        n = payload_encode(&bulk_utc_template, &entry[1], (uint8_t *)bulk_body + pos, sizeof(bulk_body) - pos - 2);
+    }
+    else {
+        n = payload_encode(&bulk_template, entry, (uint8_t *)bulk_body + pos, sizeof(bulk_body) - pos - 2);
+    }
+    if (n == 0) {
+        return false;
+    }
+    if (bulk_count > 0) {
+        bulk_body[bulk_len] = ',';
+    }
+    bulk_len = pos + n;
+    bulk_count++;
+    bulk_last_ms = now_ms;
+    return true;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Close the collected entries and send them in background */
+void bulk_start_upload()
+{
+    bulk_body[bulk_len++] = ']';
+    bulk_body[bulk_len++] = '}';
+    bulk_body[bulk_len] = '\0';
+    xTaskCreate(bulk_upload_task, "bulk_upload", 8192, NULL, 5, NULL);
+}
+
+
+/*-----------------------------------------------------------*/
+/* Append the current sample to the bulk update, start the upload
+   when UPLOAD_BATCH samples are collected or the body is full */
+void bulk_add(uint32_t trace_id)
+{
+    int32_t values[2] = {
+        dht12_temp_x10(&dht12),
+        dht12_humid_x10(&dht12),
+    };
+
+    // The body is not touched until the previous upload ends
+    if (xSemaphoreTake(bulk_idle, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "bulk update in progress, sample dropped");
+        trace_abort(trace_id);
+        return;
+    }
+
+    if (bulk_carried) {
+        bulk_carried = false;
+        if (!bulk_append(bulk_carry, bulk_carry_us)) {
+            ESP_LOGE(TAG, "bulk update entry does not fit into buffer");
+        }
+    }
+    if (!bulk_append(values, dht12_time_us)) {
+        if (bulk_count == 0) {
+            ESP_LOGE(TAG, "bulk update entry does not fit into buffer");
+            trace_abort(trace_id);
+            xSemaphoreGive(bulk_idle);
+            return;
+        }
+        // Send the full body, this sample opens the next one
+        memcpy(bulk_carry, values, sizeof(bulk_carry));
+        bulk_carry_us = dht12_time_us;
+        bulk_carried = true;
+        trace_finish(trace_id, true);
+        bulk_start_upload();
+        return;
+    }
+    // Upload is asynchronous, the trace ends in the bulk update
+    trace_finish(trace_id, true);
+
+    if (bulk_count < UPLOAD_BATCH) {
+        xSemaphoreGive(bulk_idle);
+        return;
+    }
+    bulk_start_upload();
+}
+#endif
+
+
+/*-----------------------------------------------------------*/
+/* Hand the current sample over to the selected transport */
+void telemetry_send(uint32_t trace_id)
+{
+#if TELEMETRY_USE_MQTT
+    // Put sample to MQTT outbox, it is published in background
+    int32_t values[2] = {
+        dht12_temp_x10(&dht12),
+        dht12_humid_x10(&dht12),
+    };
+    mqtt_transport_stats_t stats;
+
+    mqtt_transport_send(values);
+    // Publishing is asynchronous, the trace ends in the outbox
+    trace_finish(trace_id, true);
+    mqtt_transport_get_stats(&stats);
+    ESP_LOGI(TAG, "mqtt: %" PRIu32 " samples in %" PRIu32 " publishes (%" PRIu32 " bytes, %" PRIu32 " raw), %u queued, avg ack %" PRId64 " ms",
+             stats.published_samples, stats.published, stats.bytes, stats.raw_bytes, stats.outbox,
+             stats.acked ? stats.ack_latency_us / stats.acked / 1000 : 0);
+#elif UPLOAD_BATCH > 1
+    // Collect samples, all of them go in one request
+    bulk_add(trace_id);
+#else
+    // Send data to ThingSpeak
+    upload_item_t item = {
+        .trace_id = trace_id,
+        .values = { dht12_temp_x10(&dht12), dht12_humid_x10(&dht12) },
+        .time_us = dht12_time_us,
+    };
+    if (xQueueSend(upload_queue, &item, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "upload queue full, sample dropped");
+        trace_abort(trace_id);
+    }
+#endif
+}
+
+
+/*-----------------------------------------------------------*/
+#if STATUS_SERVER_ENABLE
+/* Values for LAN clients, bodies are rendered when they ask */
+void status_update(bool read_ok)
+{
+    aggregate_counters_t counters;
+    status_server_stats_t stats;
+    char stamp[STATUS_SERVER_MAX_TIME] = "";
+
+    if (read_ok) {
+        if (timekeeper_is_synced()) {
+            timekeeper_format_iso8601(timekeeper_to_utc_us(dht12_time_us), stamp, sizeof(stamp));
+        }
+        status_server_set_latest(dht12_temp_x10(&dht12), dht12_humid_x10(&dht12), stamp);
+    }
+    else {
+        read_failures++;
+    }
+    aggregate_get_counters(&counters);
+    status_server_set_metric(METRIC_SAMPLES, counters.samples);
+    status_server_set_metric(METRIC_READ_FAILURES, read_failures);
+    status_server_set_metric(METRIC_REPORTED, counters.reported);
+    status_server_set_metric(METRIC_SUPPRESSED, counters.suppressed);
+    status_server_set_metric(METRIC_TEMP_OUTLIERS, temp_filter.outliers);
+    status_server_set_metric(METRIC_HUMID_OUTLIERS, humid_filter.outliers);
+    status_server_set_metric(METRIC_HEAP_FREE, esp_get_free_heap_size());
+    status_server_set_metric(METRIC_HEAP_MIN_FREE, esp_get_minimum_free_heap_size());
+    status_server_set_metric(METRIC_UPTIME, esp_timer_get_time() / 1000000);
+    status_server_set_metric(METRIC_SAMPLE_PERIOD, sample_rate.period_ms);
+
+    status_server_get_stats(&stats);
+    ESP_LOGI(TAG, "status server: %" PRIu32 " requests, %" PRIu32 " not modified, %" PRIu32 " renders, avg %" PRId64 " us, max %" PRId64 " us",
+             stats.requests, stats.not_modified, stats.renders,
+             stats.requests ? stats.handler_us / stats.requests : 0, stats.max_handler_us);
+}
+#endif
+
+
+/*-----------------------------------------------------------*/
+/* Lowest free stack of the sensor task since it started */
+void log_stack_free()
+{
+    UBaseType_t free_bytes = uxTaskGetStackHighWaterMark(NULL);
+
+    if (free_bytes < SENSOR_STACK_MIN_FREE) {
+        ESP_LOGW(TAG, "sensor task: only %u of %u stack bytes never used, raise SENSOR_STACK_SIZE",
+                 (unsigned)free_bytes, (unsigned)SENSOR_STACK_SIZE);
+    }
+    else {
+        ESP_LOGI(TAG, "sensor task: %u of %u stack bytes never used",
+                 (unsigned)free_bytes, (unsigned)SENSOR_STACK_SIZE);
+    }
+}
+
+
 /*-----------------------------------------------------------*/
 void dht_sensor_task()
 {
+    uint32_t reports = 0;
+    uint32_t period_ms;
+
     ESP_LOGI(TAG, "DHT sensor task started");
 
+    // Delay 5 seconds, DNS and time sync run meanwhile
+    vTaskDelay(5000 / portTICK_PERIOD_MS);
+
     // Forever loop
     while (1) {
         // Turn the LED on
         gpio_set_level(BUILT_IN_LED, 1);
 
-        // Read values from I2C sensor
-        dht_get_all_values();
+        // Read values from I2C sensor, skip the sample if it failed
+        uint32_t trace_id = trace_begin();
+        int64_t start = esp_timer_get_time();
+        esp_err_t err = dht_get_all_values();
+        dht12_time_us = esp_timer_get_time();
+        int64_t read_end = dht12_time_us;
+        trace_mark(trace_id, TRACE_READ);
+#if SIMULATION
+        sim_bench_sample(err == ESP_OK);
+#endif
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "DHT12 read failed: %s", esp_err_to_name(err));
+#if STATUS_SERVER_ENABLE
+            status_update(false);
+#endif
+            trace_abort(trace_id);
+            gpio_set_level(BUILT_IN_LED, 0);
+            vTaskDelay(sample_rate.period_ms / portTICK_PERIOD_MS);
+            continue;
+        }
+
+        // Next period from the raw values
+        int32_t values[2] = {
+            dht12_temp_x10(&dht12),
+            dht12_humid_x10(&dht12),
+        };
+        period_ms = sample_rate_update(&sample_rate, values, 0x3, dht12_time_us / 1000);
+
+        // Reject glitches before they reach the report filter
+        dht12_set_x10(&dht12,
+                      filter_hampel_update(&temp_filter, dht12_temp_x10(&dht12)),
+                      filter_hampel_update(&humid_filter, dht12_humid_x10(&dht12)));
 
-        // Send data to ThingSpeak
-        xTaskCreate(thingspeak_task, "send_values_to_thingspeak", 4096, NULL, 5, NULL);
+        // Aggregate and upload only changed values
+        aggregate_window_t window;
+        aggregate_counters_t counters;
+        bool report = aggregate_add(&dht12, esp_timer_get_time() / 1000);
+
+        aggregate_get_window(REPORT_WINDOW, &window);
+        aggregate_get_counters(&counters);
+        ESP_LOGI(TAG, "last %u samples: temp %d..%d (mean %d), humid %d..%d (mean %d) [x0.1]",
+                 window.count, window.temp.min, window.temp.max, window.temp.mean,
+                 window.humid.min, window.humid.max, window.humid.mean);
+        ESP_LOGI(TAG, "%" PRIu32 " samples, %" PRIu32 " reported, %" PRIu32 " suppressed (%" PRIu32 " %%)",
+                 counters.samples, counters.reported, counters.suppressed,
+                 counters.suppressed * 100 / counters.samples);
+        ESP_LOGI(TAG, "outliers replaced: temp %" PRIu32 ", humid %" PRIu32,
+                 temp_filter.outliers, humid_filter.outliers);
+        log_sample_rate();
+#if STATUS_SERVER_ENABLE
+        status_update(true);
+#endif
+
+        if (report) {
+            trace_mark(trace_id, TRACE_QUEUED);
+            telemetry_send(trace_id);
+            if (++reports % TRACE_DUMP_EVERY == 0) {
+                trace_dump();
+                log_stack_free();
+            }
+        }
+        else {
+            trace_abort(trace_id);
+        }
 
         // Turn the LED off
         gpio_set_level(BUILT_IN_LED, 0);
+        sample_rate_account(&sample_rate, read_end - start, esp_timer_get_time() - read_end);
 
-        // Delay 60 seconds
-        vTaskDelay(60000 / portTICK_PERIOD_MS);
+        // Delay 15 s to 4 minutes (60 s fixed, or the simulation period)
+        vTaskDelay(period_ms / portTICK_PERIOD_MS);
     }
 
     // Delete this task if it exits from the loop above
@@ -177,7 +912,12 @@ void event_handler(void *event_handler_arg, esp_event_base_t event_base, int32_t
 
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START)
     {
+#if ROAM_ENABLE
+        // Scan first, join the strongest AP of all networks
+        roam_connect_best();
+#else
         esp_wifi_connect();
+#endif
     }
     else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED)
     {
@@ -195,11 +935,16 @@ void event_handler(void *event_handler_arg, esp_event_base_t event_base, int32_t
         ESP_LOGI(TAG, "got ip:" IPSTR, IP2STR(&event->ip_info.ip));
         s_retry_num = 0;
 
-        // Delay 5 seconds
-        vTaskDelay(5000 / portTICK_PERIOD_MS);
+        // Resolve upload host before the first sample needs it
+        dns_cache_prefetch();
+        // The time mapping survives reconnects, sync it anyway
+        timekeeper_sync_now();
 
-        // Start I2C sensor task
-        xTaskCreate(dht_sensor_task, "read_sensor_values", 2048, NULL, 5, NULL);
+        // Start I2C sensor task at the first connection only, it
+        // keeps running over reconnects and roams
+        if (sensor_task == NULL) {
+            xTaskCreate(dht_sensor_task, "read_sensor_values", SENSOR_STACK_SIZE, NULL, 5, &sensor_task);
+        }
     }
 }
 
@@ -218,6 +963,19 @@ void wifi_init_sta()
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
 
+#if ROAM_ENABLE
+    // Roaming handlers must run before the ones below
+    roam_config_t roam_config = {
+        .networks = roam_networks,
+        .network_count = sizeof(roam_networks) / sizeof(roam_networks[0]),
+        .scan_below_rssi = ROAM_SCAN_BELOW_RSSI,
+        .scan_failure_permille = ROAM_SCAN_FAILURE_PERMILLE,
+        .hysteresis_db = ROAM_HYSTERESIS_DB,
+        .scan_interval_s = ROAM_SCAN_INTERVAL_S,
+    };
+    ESP_ERROR_CHECK(roam_init(&roam_config));
+#endif
+
     // 2 - Wi-Fi Configuration Phase
     esp_event_handler_instance_t instance_any_id;
     esp_event_handler_instance_t instance_got_ip;
@@ -271,12 +1029,135 @@ void app_main(void)
     gpio_set_direction(BUILT_IN_LED, GPIO_MODE_OUTPUT);
     gpio_set_level(BUILT_IN_LED, 0);
 
+#if SIMULATION
+    // Per-sample logs would limit the sample rate
+    esp_log_level_set(TAG, ESP_LOG_WARN);
+    sim_config_t sim_config = {
+        .seed = SIM_SEED,
+        .dht_latency_ms = SIM_DHT12_LATENCY_MS,
+        .dht_timeout_permille = SIM_DHT12_TIMEOUT_PERMILLE,
+        .dht_checksum_permille = SIM_DHT12_CHECKSUM_PERMILLE,
+        .fake_wifi = SIM_FAKE_WIFI,
+        .http_host = SIM_HTTP_HOST,
+        .http_port = SIM_HTTP_PORT,
+        .http_latency_ms = SIM_HTTP_LATENCY_MS,
+        .http_error_permille = SIM_HTTP_ERROR_PERMILLE,
+    };
+    sim_init(&sim_config);
+    xTaskCreate(sim_bench_task, "sim_bench", 3072, NULL, 4, NULL);
+#else
     // I2C
     i2c_setup();
+#endif
 
     // Wi-Fi
     // Initialize NVS (Non-volatile storage in Flash memory)
     ESP_ERROR_CHECK(nvs_flash_init());
+    // Report-by-exception filter
+    aggregate_config_t aggregate_config = {
+        .temp_deadband = REPORT_TEMP_DEADBAND,
+        .humid_deadband = REPORT_HUMID_DEADBAND,
+        .heartbeat_ms = REPORT_HEARTBEAT_MS,
+    };
+    aggregate_init(&aggregate_config);
+    trace_init();
+    filter_hampel_init(&temp_filter, FILTER_WINDOW, FILTER_THRESHOLD);
+    filter_hampel_init(&humid_filter, FILTER_WINDOW, FILTER_THRESHOLD);
+    sample_rate_config_t sample_config = {
+        .min_period_ms = SENSOR_MIN_PERIOD_MS,
+        .max_period_ms = SENSOR_MAX_PERIOD_MS,
+        .hold = SAMPLE_HOLD,
+        .active_mw = SAMPLE_ACTIVE_MW,
+        .channels = sizeof(sample_limits) / sizeof(sample_limits[0]),
+        .channel = sample_limits,
+    };
+    sample_rate_init(&sample_rate, &sample_config);
+
+    // Request template, API key is copied only once. A cut key would
+    // only give "401 Unauthorized" for every upload, stop here instead
+    strlcpy(thingspeak_prefix, "/update?api_key=", sizeof(thingspeak_prefix));
+    if (strlcat(thingspeak_prefix, THINGSPEAK_WRITE_API_KEY, sizeof(thingspeak_prefix)) >= sizeof(thingspeak_prefix)) {
+        ESP_LOGE(TAG, "THINGSPEAK_WRITE_API_KEY does not fit into thingspeak_prefix[%u]",
+                 (unsigned)sizeof(thingspeak_prefix));
+        ESP_ERROR_CHECK(ESP_ERR_INVALID_SIZE);
+    }
+    payload_template_init(&thingspeak_template, PAYLOAD_URL_QUERY, thingspeak_prefix,
+                          thingspeak_fields, sizeof(thingspeak_fields) / sizeof(thingspeak_fields[0]));
+#if !TELEMETRY_USE_MQTT && UPLOAD_BATCH <= 1
+    // Uploads of single samples
+    upload_queue = xQueueCreate(UPLOAD_QUEUE_LEN, sizeof(upload_item_t));
+    xTaskCreate(thingspeak_task, "send_values_to_thingspeak", 8192, NULL, 5, NULL);
+#endif
+#if UPLOAD_BATCH > 1
+    strlcpy(bulk_path, "/channels/", sizeof(bulk_path));
+    strlcat(bulk_path, THINGSPEAK_CHANNEL_ID, sizeof(bulk_path));
+    if (strlcat(bulk_path, "/bulk_update.json", sizeof(bulk_path)) >= sizeof(bulk_path)) {
+        ESP_LOGE(TAG, "THINGSPEAK_CHANNEL_ID does not fit into bulk_path[%u]", (unsigned)sizeof(bulk_path));
+        ESP_ERROR_CHECK(ESP_ERR_INVALID_SIZE);
+    }
+    // Body head with the API key, entries are appended behind it
+    strlcpy(bulk_body, "{\"write_api_key\":\"", sizeof(bulk_body));
+    strlcat(bulk_body, THINGSPEAK_WRITE_API_KEY, sizeof(bulk_body));
+    bulk_head_len = strlcat(bulk_body, "\",\"updates\":[", sizeof(bulk_body));
+    if (bulk_head_len >= sizeof(bulk_body)) {
+        ESP_LOGE(TAG, "THINGSPEAK_WRITE_API_KEY does not fit into bulk_body[%u]", (unsigned)sizeof(bulk_body));
+        ESP_ERROR_CHECK(ESP_ERR_INVALID_SIZE);
+    }
+    payload_template_init(&bulk_template, PAYLOAD_JSON, NULL,
+                          bulk_fields, sizeof(bulk_fields) / sizeof(bulk_fields[0]));
+    payload_template_init(&bulk_utc_template, PAYLOAD_JSON, bulk_created_at,
+                          thingspeak_fields, sizeof(thingspeak_fields) / sizeof(thingspeak_fields[0]));
+    bulk_idle = xSemaphoreCreateBinary();
+    xSemaphoreGive(bulk_idle);
+#endif
+
+#if TELEMETRY_USE_MQTT
+    // One persistent MQTT session for all samples
+    mqtt_transport_config_t mqtt_config = {
+        .uri = MQTT_BROKER_URI,
+        .client_id = MQTT_CLIENT_ID,
+        .username = MQTT_USERNAME,
+        .password = MQTT_PASSWORD,
+        .topic = MQTT_TOPIC,
+        .qos = MQTT_QOS,
+        .max_batch = MQTT_MAX_BATCH,
+        .compress = MQTT_COMPRESS,
+        .fields = thingspeak_fields,
+        .field_count = sizeof(thingspeak_fields) / sizeof(thingspeak_fields[0]),
+    };
+#endif
+
+#if SIMULATION && SIM_FAKE_WIFI
+    // Connection is only the "got ip" event
+    ESP_ERROR_CHECK(sim_wifi_start(event_handler));
+#else
+    // Upload host is kept resolved in background
+    dns_cache_init();
+    dns_cache_add_host(THINGSPEAK_HOST);
+    dns_cache_add_host(TIME_NTP_SERVER);
+    // UTC time stamps, synced after the station gets an IP address
+    timekeeper_config_t time_config = {
+        .server = TIME_NTP_SERVER,
+        .port = TIME_NTP_PORT,
+        .interval_s = TIME_SYNC_INTERVAL_S,
+    };
+    timekeeper_init(&time_config);
+    // HTTPS uploads, certificate from ESP-IDF bundle
+    https_upload_init(THINGSPEAK_HOST, NULL);
     // Initialize Wi-Fi connection
     wifi_init_sta();
+#if STATUS_SERVER_ENABLE
+    // LAN clients pull the latest reading and metrics
+    status_server_config_t status_config = {
+        .port = STATUS_SERVER_PORT,
+        .max_clients = STATUS_SERVER_MAX_CLIENTS,
+        .metrics = status_metrics,
+        .metric_count = sizeof(status_metrics) / sizeof(status_metrics[0]),
+    };
+    status_server_start(&status_config);
+#endif
+#endif
+#if TELEMETRY_USE_MQTT
+    mqtt_transport_init(&mqtt_config);
+#endif
 }
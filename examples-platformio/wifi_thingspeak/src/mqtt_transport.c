@@ -0,0 +1,314 @@
+/*
+  MQTT telemetry transport with offline outbox and batching.
+
+  Xtensa dual-core 32-bit LX6 (FireBeetle ESP32), 240 MHz
+  PlatformIO, ESP-IDF framework
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+
+  NOTES:
+    * Samples stay in the outbox until the broker acknowledges them
+      (QoS 1/2), so nothing is lost over a broken session, but a sample
+      can be delivered twice
+    * For a local test broker on Linux run "mosquitto -v" and subscribe
+      with "mosquitto_sub -v -t '#'"
+
+  See also:
+    ESP-MQTT
+      * https://docs.espressif.com/projects/esp-idf/en/v4.4/esp32/api-reference/protocols/mqtt.html
+    ThingSpeak MQTT API
+      * https://www.mathworks.com/help/thingspeak/mqtt-basics.html
+ */
+
+
+/*-----------------------------------------------------------*/
+#include <string.h>
+#include <stdlib.h>             // malloc() function
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <esp_log.h>            // ESP_LOG/E/W/I functions
+#include <esp_timer.h>          // esp_timer_get_time() function
+#include <mqtt_client.h>        // ESP-MQTT
+#include <deflate_stream.h>     // Streaming compressor
+#include <mqtt_transport.h>
+
+
+/*-----------------------------------------------------------*/
+#define MQTT_TRANSPORT_ACK_TIMEOUT_US (30 * 1000000LL)
+
+
+/*-----------------------------------------------------------*/
+// Tag for ESP_LOG/E/W/I functions
+static const char *TAG = "mqtt transport";
+
+// Message waiting for acknowledgement
+typedef struct {
+    int msg_id;             // -1 if nothing is in flight
+    uint8_t samples;        // Samples at the outbox head it carries
+    int64_t sent_us;
+} mqtt_inflight_t;
+
+static mqtt_transport_config_t s_config;
+static char s_topic[MQTT_TRANSPORT_MAX_TOPIC];
+static payload_template_t s_template;
+static esp_mqtt_client_handle_t s_client = NULL;
+
+// Outbox ring, the oldest sample is at "s_head"
+static int32_t s_outbox[MQTT_TRANSPORT_OUTBOX_LEN][MQTT_TRANSPORT_MAX_FIELDS];
+static uint8_t s_head = 0;
+static uint8_t s_count = 0;
+static mqtt_inflight_t s_inflight = { .msg_id = -1 };
+
+static mqtt_transport_stats_t s_stats;
+static SemaphoreHandle_t s_lock = NULL;
+static SemaphoreHandle_t s_wakeup = NULL;
+
+// Compressor, allocated only if batches are compressed
+static deflate_stream_t *s_deflate = NULL;
+
+
+/*-----------------------------------------------------------*/
+/* Encode "count" samples from the outbox head. A single sample is
+   sent as URL query (ThingSpeak format), batches as JSON array.
+   Must be called with the lock taken. */
+static size_t build_message(char *msg, size_t size, uint8_t count)
+{
+    size_t len = 0;
+    size_t n;
+
+    if (s_config.max_batch <= 1) {
+        return payload_encode(&s_template, s_outbox[s_head], (uint8_t *)msg, size);
+    }
+
+    msg[len++] = '[';
+    for (uint8_t i = 0; i < count; i++) {
+        uint8_t index = (s_head + i) % MQTT_TRANSPORT_OUTBOX_LEN;
+
+        if (len + 3 > size) {
+            return 0;
+        }
+        if (i > 0) {
+            msg[len++] = ',';
+        }
+        // Keep space for ',' or ']' and zero terminator
+        n = payload_encode(&s_template, s_outbox[index], (uint8_t *)msg + len, size - len - 2);
+        if (n == 0) {
+            return 0;
+        }
+        len += n;
+    }
+    msg[len++] = ']';
+    msg[len] = '\0';
+
+    return len;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Remove samples from the outbox head. Must be called with the lock
+   taken. */
+static void outbox_release(uint8_t count)
+{
+    s_head = (s_head + count) % MQTT_TRANSPORT_OUTBOX_LEN;
+    s_count -= count;
+}
+
+
+/*-----------------------------------------------------------*/
+static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data)
+{
+    esp_mqtt_event_handle_t event = (esp_mqtt_event_handle_t)event_data;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    switch ((esp_mqtt_event_id_t)event_id) {
+        case MQTT_EVENT_CONNECTED:
+            ESP_LOGI(TAG, "connected to broker, %u sample(s) in outbox", s_count);
+            s_stats.connected = true;
+            break;
+        case MQTT_EVENT_DISCONNECTED:
+            ESP_LOGW(TAG, "disconnected from broker");
+            s_stats.connected = false;
+            break;
+        case MQTT_EVENT_PUBLISHED:
+            if (event->msg_id == s_inflight.msg_id) {
+                s_stats.acked++;
+                s_stats.ack_latency_us += esp_timer_get_time() - s_inflight.sent_us;
+                outbox_release(s_inflight.samples);
+                s_inflight.msg_id = -1;
+            }
+            break;
+        default:
+            break;
+    }
+    xSemaphoreGive(s_lock);
+
+    // Outbox may be published now
+    xSemaphoreGive(s_wakeup);
+}
+
+
+/*-----------------------------------------------------------*/
+static void mqtt_publisher_task(void *pvParameters)
+{
+    static char msg[MQTT_TRANSPORT_MAX_MESSAGE];
+    // Literals take 9 bits at most, plus zlib header and trailer
+    static uint8_t zmsg[MQTT_TRANSPORT_MAX_MESSAGE + MQTT_TRANSPORT_MAX_MESSAGE / 8 + 16];
+    const char *data;
+    uint8_t count;
+    size_t len;
+    size_t raw_len;
+    int msg_id;
+
+    // Forever loop
+    while (1) {
+        xSemaphoreTake(s_wakeup, 1000 / portTICK_PERIOD_MS);
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+
+        // The message got lost (e.g. expired from ESP-MQTT outbox), send
+        // its samples again
+        if (s_inflight.msg_id >= 0 &&
+            esp_timer_get_time() - s_inflight.sent_us > MQTT_TRANSPORT_ACK_TIMEOUT_US) {
+            ESP_LOGW(TAG, "message %d not acknowledged, resending", s_inflight.msg_id);
+            s_inflight.msg_id = -1;
+        }
+
+        // Everything waiting since the last ack goes in one publish
+        if (s_stats.connected && s_inflight.msg_id < 0 && s_count > 0) {
+            count = (s_count < s_config.max_batch) ? s_count : s_config.max_batch;
+            if (count == 0) {
+                count = 1;
+            }
+            len = build_message(msg, sizeof(msg), count);
+
+            if (len == 0) {
+                ESP_LOGE(TAG, "message does not fit into %u bytes", (unsigned)sizeof(msg));
+                outbox_release(count);
+            }
+            else {
+                data = msg;
+                raw_len = len;
+                if (s_deflate != NULL) {
+                    size_t n = deflate_stream_compress(s_deflate, DEFLATE_STREAM_ZLIB, msg, len, zmsg, sizeof(zmsg));
+                    // Subscribers expect zlib, even if it is longer
+                    if (n > 0) {
+                        data = (const char *)zmsg;
+                        len = n;
+                    }
+                }
+                // Non-blocking, the message is sent by ESP-MQTT task
+                msg_id = esp_mqtt_client_enqueue(s_client, s_topic, data, len, s_config.qos, 0, true);
+                if (msg_id >= 0) {
+                    s_stats.published++;
+                    s_stats.published_samples += count;
+                    s_stats.bytes += len;
+                    s_stats.raw_bytes += raw_len;
+                    if (s_config.qos == 0) {
+                        outbox_release(count);
+                    }
+                    else {
+                        s_inflight.msg_id = msg_id;
+                        s_inflight.samples = count;
+                        s_inflight.sent_us = esp_timer_get_time();
+                    }
+                }
+            }
+        }
+        xSemaphoreGive(s_lock);
+    }
+
+    // Delete this task if it exits from the loop above
+    vTaskDelete(NULL);
+}
+
+
+/*-----------------------------------------------------------*/
+esp_err_t mqtt_transport_init(const mqtt_transport_config_t *config)
+{
+    if (config->field_count > MQTT_TRANSPORT_MAX_FIELDS ||
+        strlen(config->topic) >= sizeof(s_topic)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    s_config = *config;
+    strcpy(s_topic, config->topic);
+    s_config.topic = s_topic;
+    payload_template_init(&s_template, (s_config.max_batch <= 1) ? PAYLOAD_URL_QUERY : PAYLOAD_JSON,
+                          NULL, config->fields, config->field_count);
+
+    s_lock = xSemaphoreCreateMutex();
+    s_wakeup = xSemaphoreCreateBinary();
+    if (s_config.compress && s_config.max_batch > 1) {
+        s_deflate = malloc(sizeof(deflate_stream_t));
+        if (s_deflate == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    esp_mqtt_client_config_t mqtt_cfg = {
+        .uri = config->uri,
+        .client_id = config->client_id,
+        .username = config->username,
+        .password = config->password,
+        .keepalive = 60,
+    };
+    s_client = esp_mqtt_client_init(&mqtt_cfg);
+    if (s_client == NULL) {
+        return ESP_FAIL;
+    }
+    esp_mqtt_client_register_event(s_client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
+
+    // ESP-MQTT reconnects on its own, also after Wi-Fi comes back
+    ESP_ERROR_CHECK(esp_mqtt_client_start(s_client));
+    xTaskCreate(mqtt_publisher_task, "mqtt_publisher", 3072, NULL, 5, NULL);
+
+    return ESP_OK;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Put one sample (field_count values) into the outbox. If the outbox
+   is full, the oldest sample not being sent right now is dropped. */
+esp_err_t mqtt_transport_send(const int32_t *values)
+{
+    uint8_t tail;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_count == MQTT_TRANSPORT_OUTBOX_LEN) {
+        if (s_inflight.msg_id >= 0 && s_inflight.samples >= s_count) {
+            // Whole outbox is in flight, nothing can be replaced
+            s_stats.dropped++;
+            xSemaphoreGive(s_lock);
+            return ESP_ERR_NO_MEM;
+        }
+        if (s_inflight.msg_id >= 0) {
+            // Head samples are in flight, overwrite the newest one
+            s_count--;
+        }
+        else {
+            outbox_release(1);
+        }
+        s_stats.dropped++;
+    }
+    tail = (s_head + s_count) % MQTT_TRANSPORT_OUTBOX_LEN;
+    memcpy(s_outbox[tail], values, s_config.field_count * sizeof(int32_t));
+    s_count++;
+    s_stats.samples++;
+    xSemaphoreGive(s_lock);
+
+    xSemaphoreGive(s_wakeup);
+    return ESP_OK;
+}
+
+
+/*-----------------------------------------------------------*/
+void mqtt_transport_get_stats(mqtt_transport_stats_t *stats)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *stats = s_stats;
+    stats->outbox = s_count;
+    xSemaphoreGive(s_lock);
+}
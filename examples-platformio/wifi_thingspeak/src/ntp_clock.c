@@ -0,0 +1,134 @@
+/*
+  Offset, drift and error bound of the local clock against SNTP.
+
+  Xtensa dual-core 32-bit LX6 (FireBeetle ESP32), 240 MHz
+  PlatformIO, ESP-IDF framework
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+
+  NOTES:
+    * The module has no ESP-IDF dependency, "tools/clock_bench.c"
+      builds it on the host
+
+  See also:
+    Simple Network Time Protocol (SNTP) Version 4
+      * https://www.rfc-editor.org/rfc/rfc4330
+ */
+
+
+/*-----------------------------------------------------------*/
+#include <ntp_clock.h>
+
+
+/*-----------------------------------------------------------*/
+#define NTP_UNIX_OFFSET_S   2208988800ULL   // 1900-01-01 to 1970-01-01
+
+
+/*-----------------------------------------------------------*/
+/* Write the 64-bit SNTP time stamp of "unix_us" to "buf" */
+void ntp_clock_put_time(uint8_t *buf, int64_t unix_us)
+{
+    uint64_t seconds = unix_us / 1000000 + NTP_UNIX_OFFSET_S;
+    uint32_t fraction = ((uint64_t)(unix_us % 1000000) << 32) / 1000000;
+
+    for (uint8_t i = 0; i < 4; i++) {
+        buf[i] = seconds >> (24 - 8 * i);
+        buf[4 + i] = fraction >> (24 - 8 * i);
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+/* Microseconds since 1970 of the SNTP time stamp in "buf". Seconds
+   with the top bit clear are from 2036-02-07 on (RFC 4330, section 3) */
+int64_t ntp_clock_get_time(const uint8_t *buf)
+{
+    uint32_t seconds = ((uint32_t)buf[0] << 24) | (buf[1] << 16) | (buf[2] << 8) | buf[3];
+    uint32_t fraction = ((uint32_t)buf[4] << 24) | (buf[5] << 16) | (buf[6] << 8) | buf[7];
+    int64_t era = (seconds & 0x80000000) ? 0 : (1LL << 32);
+
+    return (era + seconds - (int64_t)NTP_UNIX_OFFSET_S) * 1000000 +
+           (((uint64_t)fraction * 1000000) >> 32);
+}
+
+
+/*-----------------------------------------------------------*/
+/* Offset and round trip of one exchange: "t1" request sent and "t4"
+   answer received in local time, "t2" request received and "t3"
+   answer sent in server time */
+void ntp_clock_sample(int64_t t1, int64_t t2, int64_t t3, int64_t t4, ntp_clock_sample_t *sample)
+{
+    sample->offset_us = ((t2 - t1) + (t3 - t4)) / 2;
+    sample->delay_us = (t4 - t1) - (t3 - t2);
+    sample->local_us = t1 + (t4 - t1) / 2;
+    if (sample->delay_us < 0) {
+        sample->delay_us = 0;
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+/* Take a new measurement into the mapping, return the difference to
+   the predicted offset (0 at the first sync) */
+int64_t ntp_clock_apply(ntp_clock_t *clock, const ntp_clock_sample_t *sample)
+{
+    int64_t span_us = sample->local_us - clock->prev.local_us;
+    int64_t step = clock->synced ? sample->offset_us - ntp_clock_predict(clock, sample->local_us) : 0;
+    bool paired = false;
+    int32_t drift;
+
+    // Drift from two syncs far enough apart that their errors matter little
+    if (clock->prev_valid && span_us >= NTP_CLOCK_MIN_DRIFT_SPAN_S * 1000000LL &&
+        (sample->delay_us + clock->prev.delay_us) / 2 * 1000000000LL / span_us < NTP_CLOCK_RESIDUAL_PPB) {
+        paired = true;
+        drift = (sample->offset_us - clock->prev.offset_us) * 1000000000LL / span_us;
+        if (drift >= -NTP_CLOCK_MAX_DRIFT_PPB && drift <= NTP_CLOCK_MAX_DRIFT_PPB) {
+            // Smooth out the jitter of single measurements
+            clock->drift_ppb = clock->drift_known ? clock->drift_ppb + (drift - clock->drift_ppb) / 4 : drift;
+            clock->drift_known = true;
+        }
+    }
+
+    clock->base_offset_us = sample->offset_us;
+    clock->base_us = sample->local_us;
+    clock->sync_error_us = sample->delay_us / 2;
+    clock->synced = true;
+
+    // The earlier sync is kept until the span is long enough, so short
+    // sync intervals or long round trips still give a drift
+    if (!clock->prev_valid || paired) {
+        clock->prev = *sample;
+        clock->prev_valid = true;
+    }
+    return step;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Offset predicted for local time "time_us" */
+int64_t ntp_clock_predict(const ntp_clock_t *clock, int64_t time_us)
+{
+    return clock->base_offset_us + (time_us - clock->base_us) * clock->drift_ppb / 1000000000LL;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Error bound of the offset used at local time "time_us": error of
+   the last sync, plus the drift uncertainty since then, plus the
+   drift over "update_ms" if the offset is moved on only that often */
+uint32_t ntp_clock_error_us(const ntp_clock_t *clock, int64_t time_us, uint32_t update_ms)
+{
+    int64_t age = time_us - clock->base_us;
+    int64_t error = clock->sync_error_us;
+
+    if (!clock->synced) {
+        return UINT32_MAX;
+    }
+    error += (age < 0 ? -age : age) / 1000 *
+             (clock->drift_known ? NTP_CLOCK_RESIDUAL_PPB : NTP_CLOCK_DRIFT_ERROR_PPB) / 1000000;
+    error += (int64_t)update_ms * 1000 * (clock->drift_ppb < 0 ? -clock->drift_ppb : clock->drift_ppb) / 1000000000LL;
+
+    return (error > UINT32_MAX) ? UINT32_MAX : error;
+}
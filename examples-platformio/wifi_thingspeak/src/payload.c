@@ -0,0 +1,260 @@
+/*
+  Heap-free and printf-free encoder for upload payloads.
+
+  Xtensa dual-core 32-bit LX6 (FireBeetle ESP32), 240 MHz
+  PlatformIO, ESP-IDF framework
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+
+  See also:
+    CBOR, RFC 8949 (decimal fractions in section 3.4.4)
+      * https://www.rfc-editor.org/rfc/rfc8949
+ */
+
+
+/*-----------------------------------------------------------*/
+#include <string.h>
+#include <stdbool.h>
+#include <payload.h>
+
+
+/*-----------------------------------------------------------*/
+// CBOR major types
+#define CBOR_UNSIGNED   0x00
+#define CBOR_NEGATIVE   0x20
+#define CBOR_TEXT       0x60
+#define CBOR_ARRAY      0x80
+#define CBOR_MAP        0xa0
+#define CBOR_TAG        0xc0
+#define CBOR_TAG_DECIMAL_FRACTION 4
+
+
+/*-----------------------------------------------------------*/
+// Bounds-checked output buffer
+typedef struct {
+    uint8_t *buf;
+    size_t size;
+    size_t len;
+    bool overflow;
+} payload_out_t;
+
+
+/*-----------------------------------------------------------*/
+static void out_bytes(payload_out_t *out, const void *data, size_t len)
+{
+    if (out->overflow || len > out->size - out->len) {
+        out->overflow = true;
+        return;
+    }
+    memcpy(out->buf + out->len, data, len);
+    out->len += len;
+}
+
+
+/*-----------------------------------------------------------*/
+static void out_char(payload_out_t *out, char c)
+{
+    out_bytes(out, &c, 1);
+}
+
+
+/*-----------------------------------------------------------*/
+static void out_fixed(payload_out_t *out, int32_t value, uint8_t decimals)
+{
+    size_t len;
+
+    if (out->overflow) {
+        return;
+    }
+    len = payload_write_fixed(value, decimals, (char *)out->buf + out->len, out->size - out->len);
+    if (len == 0) {
+        out->overflow = true;
+    }
+    out->len += len;
+}
+
+
+/*-----------------------------------------------------------*/
+/* CBOR initial byte(s): major type and argument */
+static void cbor_head(payload_out_t *out, uint8_t major, uint32_t arg)
+{
+    uint8_t head[5];
+    size_t len;
+
+    if (arg < 24) {
+        head[0] = major | arg;
+        len = 1;
+    }
+    else if (arg <= 0xff) {
+        head[0] = major | 24;
+        head[1] = arg;
+        len = 2;
+    }
+    else if (arg <= 0xffff) {
+        head[0] = major | 25;
+        head[1] = arg >> 8;
+        head[2] = arg;
+        len = 3;
+    }
+    else {
+        head[0] = major | 26;
+        head[1] = arg >> 24;
+        head[2] = arg >> 16;
+        head[3] = arg >> 8;
+        head[4] = arg;
+        len = 5;
+    }
+    out_bytes(out, head, len);
+}
+
+
+/*-----------------------------------------------------------*/
+static void cbor_int(payload_out_t *out, int32_t value)
+{
+    if (value >= 0) {
+        cbor_head(out, CBOR_UNSIGNED, value);
+    }
+    else {
+        cbor_head(out, CBOR_NEGATIVE, (uint32_t)(-(value + 1)));
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+/* Write fixed-point number, e.g. value 235 with 1 decimal place as
+   "23.5". Return number of characters written, 0 if it does not fit.
+   The output is not zero terminated. */
+size_t payload_write_fixed(int32_t value, uint8_t decimals, char *buf, size_t size)
+{
+    char digits[12];
+    uint8_t count = 0;
+    uint32_t magnitude = (value < 0) ? -(uint32_t)value : (uint32_t)value;
+    size_t len;
+
+    if (decimals >= sizeof(digits) - 1) {
+        return 0;
+    }
+
+    // Digits in reverse order, at least one before the decimal point
+    do {
+        digits[count++] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude != 0 && count < sizeof(digits));
+    while (count <= decimals && count < sizeof(digits)) {
+        digits[count++] = '0';
+    }
+
+    len = count + (value < 0 ? 1 : 0) + (decimals > 0 ? 1 : 0);
+    if (len > size) {
+        return 0;
+    }
+
+    len = 0;
+    if (value < 0) {
+        buf[len++] = '-';
+    }
+    while (count > 0) {
+        if (count == decimals) {
+            buf[len++] = '.';
+        }
+        buf[len++] = digits[--count];
+    }
+
+    return len;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Prepare template: remember the prefix and the field names with
+   their lengths. Prefix is raw text put in front of URL query or
+   inside the JSON object (e.g. "\"api_key\":\"...\""). CBOR output
+   does not use the prefix. */
+int payload_template_init(payload_template_t *tpl, payload_format_t format, const char *prefix,
+                          const payload_field_t *fields, uint8_t field_count)
+{
+    if (field_count > PAYLOAD_MAX_FIELDS) {
+        return -1;
+    }
+
+    memset(tpl, 0, sizeof(payload_template_t));
+    tpl->format = format;
+    tpl->prefix = (prefix != NULL) ? prefix : "";
+    tpl->prefix_len = strlen(tpl->prefix);
+    tpl->field_count = field_count;
+    for (uint8_t i = 0; i < field_count; i++) {
+        tpl->fields[i] = fields[i];
+        tpl->key_len[i] = strlen(fields[i].key);
+    }
+
+    return 0;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Encode one value per template field into "buf". Return length of
+   the payload, or 0 if it does not fit. Text formats are zero
+   terminated (the terminator is not counted in the length). */
+size_t payload_encode(const payload_template_t *tpl, const int32_t *values, uint8_t *buf, size_t size)
+{
+    payload_out_t out = {
+        .buf = buf,
+        .size = size,
+        .len = 0,
+        .overflow = false,
+    };
+
+    switch (tpl->format) {
+        case PAYLOAD_URL_QUERY:
+            out_bytes(&out, tpl->prefix, tpl->prefix_len);
+            for (uint8_t i = 0; i < tpl->field_count; i++) {
+                if (i > 0 || tpl->prefix_len > 0) {
+                    out_char(&out, '&');
+                }
+                out_bytes(&out, tpl->fields[i].key, tpl->key_len[i]);
+                out_char(&out, '=');
+                out_fixed(&out, values[i], tpl->fields[i].decimals);
+            }
+            out_char(&out, '\0');
+            out.len--;
+            break;
+
+        case PAYLOAD_JSON:
+            out_char(&out, '{');
+            out_bytes(&out, tpl->prefix, tpl->prefix_len);
+            for (uint8_t i = 0; i < tpl->field_count; i++) {
+                if (i > 0 || tpl->prefix_len > 0) {
+                    out_char(&out, ',');
+                }
+                out_char(&out, '"');
+                out_bytes(&out, tpl->fields[i].key, tpl->key_len[i]);
+                out_bytes(&out, "\":", 2);
+                out_fixed(&out, values[i], tpl->fields[i].decimals);
+            }
+            out_char(&out, '}');
+            out_char(&out, '\0');
+            out.len--;
+            break;
+
+        case PAYLOAD_CBOR:
+            cbor_head(&out, CBOR_MAP, tpl->field_count);
+            for (uint8_t i = 0; i < tpl->field_count; i++) {
+                cbor_head(&out, CBOR_TEXT, tpl->key_len[i]);
+                out_bytes(&out, tpl->fields[i].key, tpl->key_len[i]);
+                if (tpl->fields[i].decimals == 0) {
+                    cbor_int(&out, values[i]);
+                }
+                else {
+                    // Decimal fraction [exponent, mantissa]
+                    cbor_head(&out, CBOR_TAG, CBOR_TAG_DECIMAL_FRACTION);
+                    cbor_head(&out, CBOR_ARRAY, 2);
+                    cbor_int(&out, -(int32_t)tpl->fields[i].decimals);
+                    cbor_int(&out, values[i]);
+                }
+            }
+            break;
+    }
+
+    return out.overflow ? 0 : out.len;
+}
@@ -0,0 +1,524 @@
+/*
+  Roaming between access points while connected.
+
+  Xtensa dual-core 32-bit LX6 (FireBeetle ESP32), 240 MHz
+  PlatformIO, ESP-IDF framework
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+
+  NOTES:
+    * roam_init() must be called after the default event loop is
+      created and before the application registers its own Wi-Fi
+      event handler, so the configuration is updated before the
+      application reconnects
+    * A roam is a disconnect followed by a connect to the chosen BSSID,
+      uploads in progress at that moment fail and are repeated by
+      their transport
+
+  See also:
+    Wi-Fi driver, station scan
+      * https://docs.espressif.com/projects/esp-idf/en/v4.4/esp32/api-guides/wifi.html#scan-configuration
+ */
+
+
+/*-----------------------------------------------------------*/
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <esp_log.h>            // ESP_LOG/E/W/I functions
+#include <esp_timer.h>          // esp_timer_get_time() function
+#include <esp_wifi.h>           // Wi-Fi driver
+#include <esp_netif.h>          // IP_EVENT
+#include <roam.h>
+
+
+/*-----------------------------------------------------------*/
+#define ROAM_SCAN_RECORDS 20
+#define ROAM_CHANNELS     14
+
+
+/*-----------------------------------------------------------*/
+// One access point of a candidate network
+typedef struct {
+    bool used;
+    uint8_t bssid[6];
+    uint8_t network;            // Index into the candidate networks
+    uint8_t channel;
+    int16_t rssi;               // Smoothed, dBm
+    int64_t seen_us;
+    uint32_t throughput;        // Upload bytes per second, 0 if unknown
+    uint16_t failure_permille;  // Smoothed upload failure rate
+    uint8_t connect_failures;
+} roam_entry_t;
+
+
+/*-----------------------------------------------------------*/
+// Tag for ESP_LOG/E/W/I functions
+static const char *TAG = "roam";
+
+static roam_config_t s_config;
+static roam_network_t s_networks[ROAM_MAX_NETWORKS];
+static roam_entry_t s_entries[ROAM_MAX_BSSIDS];
+static roam_entry_t *s_current = NULL;  // AP the station is connected to
+static roam_entry_t *s_target = NULL;   // AP of a roam in progress
+static roam_stats_t s_stats;
+static SemaphoreHandle_t s_lock = NULL;
+static TaskHandle_t s_task = NULL;
+static wifi_ap_record_t s_records[ROAM_SCAN_RECORDS];
+
+static int64_t s_disconnected_us = 0;   // 0 while connected
+static int64_t s_roam_started_us = 0;
+static int64_t s_last_roam_us = 0;
+static int64_t s_last_scan_us = 0;
+static int64_t s_last_full_scan_us = 0;
+static uint8_t s_next_channel = 0;      // Round robin over known channels
+
+
+/*-----------------------------------------------------------*/
+static int8_t network_index(const uint8_t *ssid)
+{
+    for (uint8_t i = 0; i < s_config.network_count; i++) {
+        if (strcmp((const char *)ssid, s_networks[i].ssid) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+/*-----------------------------------------------------------*/
+static roam_entry_t *find_entry(const uint8_t *bssid)
+{
+    for (uint8_t i = 0; i < ROAM_MAX_BSSIDS; i++) {
+        if (s_entries[i].used && memcmp(s_entries[i].bssid, bssid, 6) == 0) {
+            return &s_entries[i];
+        }
+    }
+    return NULL;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Store RSSI of a seen access point, a new one replaces a free entry
+   or the one seen longest ago (never the current AP). Must be called
+   with the lock taken. */
+static roam_entry_t *update_entry(const wifi_ap_record_t *ap, int8_t network)
+{
+    roam_entry_t *entry = find_entry(ap->bssid);
+
+    if (entry == NULL) {
+        for (uint8_t i = 0; i < ROAM_MAX_BSSIDS; i++) {
+            if (&s_entries[i] == s_current || &s_entries[i] == s_target) {
+                continue;
+            }
+            if (!s_entries[i].used) {
+                entry = &s_entries[i];
+                break;
+            }
+            if (entry == NULL || s_entries[i].seen_us < entry->seen_us) {
+                entry = &s_entries[i];
+            }
+        }
+        if (entry == NULL) {
+            return NULL;
+        }
+        memset(entry, 0, sizeof(roam_entry_t));
+        entry->used = true;
+        memcpy(entry->bssid, ap->bssid, 6);
+        entry->rssi = ap->rssi;
+    }
+    else {
+        entry->rssi += (ap->rssi - entry->rssi) / 4;
+    }
+    entry->network = network;
+    entry->channel = ap->primary;
+    entry->seen_us = esp_timer_get_time();
+
+    return entry;
+}
+
+
+/*-----------------------------------------------------------*/
+static int8_t ilog2(uint32_t value)
+{
+    return 31 - __builtin_clz(value);
+}
+
+
+/*-----------------------------------------------------------*/
+/* Score in dB, see "roam.h" */
+static int16_t score(const roam_entry_t *entry, const roam_entry_t *current)
+{
+    int16_t value = entry->rssi - entry->failure_permille / 50 - 10 * entry->connect_failures;
+    int16_t bonus;
+
+    if (current != NULL && entry != current && entry->throughput > 0 && current->throughput > 0) {
+        bonus = 3 * (ilog2(entry->throughput) - ilog2(current->throughput));
+        value += (bonus > 6) ? 6 : (bonus < -6) ? -6 : bonus;
+    }
+    return value;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Best known access point other than "exclude", NULL if none. Must
+   be called with the lock taken. */
+static roam_entry_t *select_target(const roam_entry_t *exclude)
+{
+    roam_entry_t *best = NULL;
+
+    for (uint8_t i = 0; i < ROAM_MAX_BSSIDS; i++) {
+        if (!s_entries[i].used || &s_entries[i] == exclude) {
+            continue;
+        }
+        if (best == NULL || score(&s_entries[i], s_current) > score(best, s_current)) {
+            best = &s_entries[i];
+        }
+    }
+    return best;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Lock the station configuration to one BSSID, or release the lock
+   and let the driver choose an AP of the best network */
+static void configure(const roam_entry_t *entry)
+{
+    wifi_config_t config;
+    const roam_network_t *network = &s_networks[entry ? entry->network : 0];
+
+    esp_wifi_get_config(WIFI_IF_STA, &config);
+    strlcpy((char *)config.sta.ssid, network->ssid, sizeof(config.sta.ssid));
+    strlcpy((char *)config.sta.password, network->password, sizeof(config.sta.password));
+    config.sta.bssid_set = (entry != NULL);
+    config.sta.channel = entry ? entry->channel : 0;
+    if (entry != NULL) {
+        memcpy(config.sta.bssid, entry->bssid, 6);
+    }
+    esp_wifi_set_config(WIFI_IF_STA, &config);
+}
+
+
+/*-----------------------------------------------------------*/
+/* Blocking scan of one channel with short dwell time, or of all
+   channels if "channel" is 0 */
+static void scan(uint8_t channel)
+{
+    wifi_scan_config_t scan_conf = {
+        .ssid = NULL,
+        .bssid = NULL,
+        .channel = channel,
+        .show_hidden = false,
+        .scan_type = WIFI_SCAN_TYPE_ACTIVE,
+    };
+    uint16_t count = ROAM_SCAN_RECORDS;
+    int8_t network;
+
+    if (channel != 0) {
+        scan_conf.scan_time.active.min = ROAM_SCAN_DWELL_MS / 2;
+        scan_conf.scan_time.active.max = ROAM_SCAN_DWELL_MS;
+    }
+    if (esp_wifi_scan_start(&scan_conf, true) != ESP_OK) {
+        return;
+    }
+    // Results must be read to free them
+    if (esp_wifi_scan_get_ap_records(&count, s_records) != ESP_OK) {
+        return;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (uint16_t i = 0; i < count; i++) {
+        if ((network = network_index(s_records[i].ssid)) >= 0) {
+            update_entry(&s_records[i], network);
+        }
+    }
+    if (channel == 0) {
+        s_stats.full_scans++;
+    }
+    else {
+        s_stats.channel_scans++;
+    }
+    xSemaphoreGive(s_lock);
+}
+
+
+/*-----------------------------------------------------------*/
+/* Next channel with a known candidate, 0 if there is none. Must be
+   called with the lock taken. */
+static uint8_t next_channel(void)
+{
+    bool used[ROAM_CHANNELS + 1] = { false };
+    uint8_t channels[ROAM_CHANNELS];
+    uint8_t count = 0;
+
+    for (uint8_t i = 0; i < ROAM_MAX_BSSIDS; i++) {
+        uint8_t channel = s_entries[i].channel;
+        if (s_entries[i].used && channel > 0 && channel <= ROAM_CHANNELS && !used[channel]) {
+            used[channel] = true;
+            channels[count++] = channel;
+        }
+    }
+    return (count > 0) ? channels[s_next_channel++ % count] : 0;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Disconnect and join "target", the application reconnects on
+   disconnection. Must be called with the lock taken. */
+static void roam_to(roam_entry_t *target)
+{
+    ESP_LOGI(TAG, "roaming from %02x:%02x:%02x:%02x:%02x:%02x (%d dBm) to %02x:%02x:%02x:%02x:%02x:%02x (%d dBm, channel %u)",
+             s_current->bssid[0], s_current->bssid[1], s_current->bssid[2],
+             s_current->bssid[3], s_current->bssid[4], s_current->bssid[5], s_current->rssi,
+             target->bssid[0], target->bssid[1], target->bssid[2],
+             target->bssid[3], target->bssid[4], target->bssid[5], target->rssi, target->channel);
+    s_target = target;
+    s_roam_started_us = esp_timer_get_time();
+    s_last_roam_us = s_roam_started_us;
+    s_stats.roams++;
+    configure(target);
+    esp_wifi_disconnect();
+}
+
+
+/*-----------------------------------------------------------*/
+static void roam_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+    wifi_ap_record_t ap;
+    roam_entry_t *entry;
+    int8_t network;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
+        wifi_event_sta_disconnected_t *event = (wifi_event_sta_disconnected_t *)event_data;
+
+        if (s_disconnected_us == 0) {
+            s_disconnected_us = esp_timer_get_time();
+        }
+        s_current = NULL;
+        s_stats.connected = false;
+
+        // Lost link (not our own disconnect), reconnect to the best other AP
+        entry = find_entry(event->bssid);
+        if (s_roam_started_us == 0 && entry != NULL) {
+            if (entry->connect_failures < 255) {
+                entry->connect_failures++;
+            }
+            roam_entry_t *target = select_target(entry);
+            configure((target != NULL && score(target, NULL) > score(entry, NULL)) ? target : NULL);
+        }
+    }
+    else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
+        s_disconnected_us = 0;
+        s_stats.connected = true;
+        if (esp_wifi_sta_get_ap_info(&ap) == ESP_OK && (network = network_index(ap.ssid)) >= 0) {
+            s_current = update_entry(&ap, network);
+            if (s_current != NULL) {
+                s_current->connect_failures = 0;
+            }
+        }
+        if (s_roam_started_us != 0) {
+            ESP_LOGI(TAG, "roam done in %d ms", (int)((esp_timer_get_time() - s_roam_started_us) / 1000));
+            s_roam_started_us = 0;
+            s_target = NULL;
+        }
+    }
+    xSemaphoreGive(s_lock);
+}
+
+
+/*-----------------------------------------------------------*/
+/* Scan all channels and connect to the best AP of all candidate
+   networks, runs in the roam task */
+static void connect_best(void)
+{
+    roam_entry_t *best;
+
+    scan(0);
+    s_last_full_scan_us = esp_timer_get_time();
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    best = select_target(NULL);
+    if (best != NULL) {
+        ESP_LOGI(TAG, "best AP of \"%s\" at %d dBm, channel %u",
+                 s_networks[best->network].ssid, best->rssi, best->channel);
+    }
+    configure(best);
+    xSemaphoreGive(s_lock);
+
+    esp_wifi_connect();
+}
+
+
+/*-----------------------------------------------------------*/
+static void roam_task(void *pvParameter)
+{
+    wifi_ap_record_t ap;
+    roam_entry_t *target;
+    bool need_scan;
+    uint8_t channel;
+    int64_t now;
+
+    // Forever loop
+    while (1) {
+        // First connection requested by roam_connect_best()
+        if (ulTaskNotifyTake(pdTRUE, ROAM_MONITOR_MS / portTICK_PERIOD_MS) > 0) {
+            connect_best();
+            continue;
+        }
+        now = esp_timer_get_time();
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        // The chosen AP did not take the station, any AP will do
+        if (s_roam_started_us != 0 && now - s_roam_started_us > ROAM_CONNECT_TIMEOUT_S * 1000000LL) {
+            ESP_LOGW(TAG, "roam failed");
+            s_stats.roam_failures++;
+            if (s_target != NULL && s_target->connect_failures < 255) {
+                s_target->connect_failures++;
+            }
+            s_roam_started_us = 0;
+            s_target = NULL;
+            configure(NULL);
+            esp_wifi_connect();
+        }
+        // The application stopped reconnecting
+        if (s_roam_started_us == 0 && s_current == NULL && s_disconnected_us != 0 &&
+            now - s_disconnected_us > ROAM_RECONNECT_S * 1000000LL) {
+            configure(select_target(NULL));
+            esp_wifi_connect();
+            s_disconnected_us = now;
+        }
+        if (s_current == NULL || s_roam_started_us != 0) {
+            xSemaphoreGive(s_lock);
+            continue;
+        }
+
+        // Link quality of the current AP
+        if (esp_wifi_sta_get_ap_info(&ap) == ESP_OK) {
+            update_entry(&ap, s_current->network);
+        }
+        need_scan = s_current->rssi < s_config.scan_below_rssi ||
+                    s_current->failure_permille > s_config.scan_failure_permille;
+        channel = (now - s_last_full_scan_us >= ROAM_FULL_SCAN_S * 1000000LL) ? 0 : next_channel();
+
+        // Forget access points not seen for long
+        for (uint8_t i = 0; i < ROAM_MAX_BSSIDS; i++) {
+            if (s_entries[i].used && &s_entries[i] != s_current &&
+                now - s_entries[i].seen_us > ROAM_ENTRY_TIMEOUT_S * 1000000LL) {
+                s_entries[i].used = false;
+            }
+        }
+        xSemaphoreGive(s_lock);
+
+        // A good link is left alone, no scans at all
+        if (!need_scan || now - s_last_scan_us < s_config.scan_interval_s * 1000000LL) {
+            continue;
+        }
+        scan(channel);
+        s_last_scan_us = now;
+        if (channel == 0) {
+            s_last_full_scan_us = now;
+        }
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        if (s_current != NULL && now - s_last_roam_us >= ROAM_MIN_DWELL_S * 1000000LL) {
+            target = select_target(s_current);
+            if (target != NULL && score(target, s_current) >= score(s_current, s_current) + s_config.hysteresis_db) {
+                roam_to(target);
+            }
+        }
+        xSemaphoreGive(s_lock);
+    }
+
+    // Delete this task if it exits from the loop above
+    vTaskDelete(NULL);
+}
+
+
+/*-----------------------------------------------------------*/
+/* Register event handlers and start the monitor task */
+esp_err_t roam_init(const roam_config_t *config)
+{
+    if (config->network_count == 0 || config->network_count > ROAM_MAX_NETWORKS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_config = *config;
+    memcpy(s_networks, config->networks, config->network_count * sizeof(roam_network_t));
+    s_config.networks = s_networks;
+    memset(s_entries, 0, sizeof(s_entries));
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_lock = xSemaphoreCreateMutex();
+
+    // Any-ID handlers run before ID ones, this runs before the application's
+    esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &roam_event_handler, NULL, NULL);
+    esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &roam_event_handler, NULL, NULL);
+
+    if (xTaskCreate(roam_task, "roam", 3072, NULL, 3, &s_task) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Connect to the best AP of all candidate networks, call instead of
+   esp_wifi_connect() on WIFI_EVENT_STA_START. The scan of all
+   channels takes a few hundred milliseconds, so it runs in the roam
+   task and the event loop is not blocked. */
+esp_err_t roam_connect_best(void)
+{
+    if (s_task == NULL) {
+        return esp_wifi_connect();
+    }
+    xTaskNotifyGive(s_task);
+
+    return ESP_OK;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Result of one upload over the current AP */
+void roam_report_upload(bool ok, size_t bytes, int64_t latency_us)
+{
+    uint32_t throughput;
+
+    if (s_lock == NULL) {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_current != NULL) {
+        s_current->failure_permille += ((ok ? 0 : 1000) - (int16_t)s_current->failure_permille) / 8;
+        if (ok && latency_us > 0) {
+            throughput = (int64_t)bytes * 1000000 / latency_us;
+            s_current->throughput = (s_current->throughput == 0) ? throughput :
+                (int64_t)s_current->throughput + ((int64_t)throughput - s_current->throughput) / 4;
+        }
+    }
+    xSemaphoreGive(s_lock);
+}
+
+
+/*-----------------------------------------------------------*/
+void roam_get_stats(roam_stats_t *stats)
+{
+    if (s_lock == NULL) {
+        memset(stats, 0, sizeof(roam_stats_t));
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *stats = s_stats;
+    stats->candidates = 0;
+    for (uint8_t i = 0; i < ROAM_MAX_BSSIDS; i++) {
+        stats->candidates += s_entries[i].used;
+    }
+    if (s_current != NULL) {
+        stats->rssi = s_current->rssi;
+        stats->channel = s_current->channel;
+        memcpy(stats->bssid, s_current->bssid, 6);
+        stats->failure_permille = s_current->failure_permille;
+    }
+    xSemaphoreGive(s_lock);
+}
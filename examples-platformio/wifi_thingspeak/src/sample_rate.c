@@ -0,0 +1,158 @@
+/*
+  Adaptive sampling period driven by signal variability.
+
+  Xtensa dual-core 32-bit LX6 (FireBeetle ESP32), 240 MHz
+  PlatformIO, ESP-IDF framework
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+
+  NOTES:
+    * The module has no ESP-IDF dependency, "i2c_sensor/tools/rate_bench.c"
+      builds it on the host
+    * Every example builds on its own, "i2c_sensor" and
+      "wifi_thingspeak" have the same copy of this module, a fix
+      goes into both
+    * Weighted mean and variance use weight 1/8, so a single step
+      alone exceeds the deviation limit only if it is about three
+      limits or more
+
+  See also:
+    Incremental calculation of weighted mean and variance
+      * https://fanf2.user.srcf.net/hermes/doc/antiforgery/stats.pdf
+ */
+
+
+/*-----------------------------------------------------------*/
+#include <string.h>
+#include <stdlib.h>             // abs() function
+#include <sample_rate.h>
+
+
+/*-----------------------------------------------------------*/
+#define MS_PER_MINUTE 60000
+#define MS_PER_HOUR 3600000
+
+
+/*-----------------------------------------------------------*/
+void sample_rate_init(sample_rate_t *sr, const sample_rate_config_t *config)
+{
+    memset(sr, 0, sizeof(sample_rate_t));
+    sr->config = *config;
+    if (sr->config.channels > SAMPLE_RATE_MAX_CHANNELS) {
+        sr->config.channels = SAMPLE_RATE_MAX_CHANNELS;
+    }
+    if (sr->config.max_period_ms < sr->config.min_period_ms) {
+        sr->config.max_period_ms = sr->config.min_period_ms;
+    }
+    // Start fast, the first samples prime the statistics
+    sr->period_ms = sr->config.min_period_ms;
+    sr->hold = sr->config.hold;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Check new values (channel n is used if bit n of "valid" is set)
+   and return the delay before the next sample */
+uint32_t sample_rate_update(sample_rate_t *sr, const int32_t *values, uint32_t valid, int64_t time_ms)
+{
+    const sample_rate_channel_t *limit;
+    bool change = false;
+    int32_t step, diff;
+    int64_t limit_x256;
+
+    for (uint8_t i = 0; i < sr->config.channels; i++) {
+        if (!(valid & (1UL << i))) {
+            continue;
+        }
+        limit = &sr->config.channel[i];
+        if (!sr->state[i].primed) {
+            sr->state[i].last = values[i];
+            sr->state[i].last_ms = time_ms;
+            sr->state[i].mean_x16 = values[i] * 16;
+            sr->state[i].var_x256 = 0;
+            sr->state[i].primed = true;
+            continue;
+        }
+
+        // Rate of change since the last sample of the channel
+        step = abs(values[i] - sr->state[i].last);
+        if (step > limit->deadband && time_ms > sr->state[i].last_ms &&
+            (int64_t)step * MS_PER_MINUTE >= (int64_t)limit->slope * (time_ms - sr->state[i].last_ms)) {
+            change = true;
+        }
+        sr->state[i].last = values[i];
+        sr->state[i].last_ms = time_ms;
+
+        // Variance of recent samples
+        diff = values[i] * 16 - sr->state[i].mean_x16;
+        sr->state[i].mean_x16 += diff / 8;
+        sr->state[i].var_x256 = (sr->state[i].var_x256 + (int64_t)diff * diff / 8) * 7 / 8;
+        limit_x256 = (int64_t)limit->deviation * limit->deviation * 256;
+        if (sr->state[i].var_x256 > limit_x256) {
+            change = true;
+        }
+    }
+
+    if (sr->period_ms == sr->config.min_period_ms) {
+        sr->fast_samples++;
+    }
+    if (change) {
+        if (sr->period_ms > sr->config.min_period_ms) {
+            sr->speed_ups++;
+        }
+        sr->period_ms = sr->config.min_period_ms;
+        sr->hold = sr->config.hold;
+    }
+    else if (sr->hold > 0) {
+        sr->hold--;
+    }
+    else {
+        // Back off while the signal is stable
+        sr->period_ms = (sr->period_ms > sr->config.max_period_ms / 2) ?
+                        sr->config.max_period_ms : sr->period_ms * 2;
+    }
+    sr->samples++;
+    sr->elapsed_ms += sr->period_ms;
+
+    return sr->period_ms;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Add the time one sample took: sensor read and its processing */
+void sample_rate_account(sample_rate_t *sr, int64_t bus_us, int64_t cpu_us)
+{
+    sr->bus_us += bus_us;
+    sr->cpu_us += cpu_us;
+}
+
+
+/*-----------------------------------------------------------*/
+static void cost_per_hour(const sample_rate_t *sr, uint64_t samples_h_x1000, sample_rate_cost_t *cost)
+{
+    // Average sample costs times samples per hour
+    uint64_t bus_us = sr->bus_us / sr->samples;
+    uint64_t cpu_us = sr->cpu_us / sr->samples;
+
+    cost->samples = samples_h_x1000 / 1000;
+    cost->bus_ms = bus_us * samples_h_x1000 / 1000000;
+    cost->cpu_ms = cpu_us * samples_h_x1000 / 1000000;
+    // Microseconds times milliwatts are nanojoules
+    cost->energy_mj = (bus_us + cpu_us) * sr->config.active_mw * samples_h_x1000 / 1000000000;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Costs per hour of this controller and of the fixed fastest rate */
+void sample_rate_report(const sample_rate_t *sr, sample_rate_cost_t *adaptive, sample_rate_cost_t *fixed)
+{
+    memset(adaptive, 0, sizeof(sample_rate_cost_t));
+    memset(fixed, 0, sizeof(sample_rate_cost_t));
+    if (sr->samples == 0 || sr->elapsed_ms == 0 || sr->config.min_period_ms == 0) {
+        return;
+    }
+    cost_per_hour(sr, (uint64_t)sr->samples * MS_PER_HOUR * 1000 / sr->elapsed_ms, adaptive);
+    cost_per_hour(sr, (uint64_t)MS_PER_HOUR * 1000 / sr->config.min_period_ms, fixed);
+}
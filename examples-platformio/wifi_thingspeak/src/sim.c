@@ -0,0 +1,318 @@
+/*
+  Simulated DHT12, Wi-Fi and HTTP uploads with benchmark counters.
+
+  Xtensa dual-core 32-bit LX6 (FireBeetle ESP32), 240 MHz
+  PlatformIO, ESP-IDF framework
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+
+  NOTES:
+    * A stand-in server for uploads over the real network can be as
+      simple as "python3 -m http.server 8080" on a computer in the
+      same network; any HTTP status is recorded, only 200 counts as
+      a successful upload
+ */
+
+
+/*-----------------------------------------------------------*/
+#include <string.h>
+#include <stdio.h>              // snprintf() function
+#include <inttypes.h>           // PRIu32 format macro
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_log.h>            // ESP_LOG/E/W/I functions
+#include <esp_timer.h>          // esp_timer_get_time() function
+#include <esp_system.h>         // Heap statistics
+#include <esp_heap_caps.h>
+#include <esp_rom_sys.h>        // esp_rom_delay_us() function
+#include <esp_netif.h>          // IP_EVENT
+#include <esp_http_client.h>
+#include <sim.h>
+
+
+/*-----------------------------------------------------------*/
+#define SIM_BENCH_PERIOD_MS 10000
+
+// Random walk limits and steps, values in tenths
+#define SIM_TEMP_START   225
+#define SIM_TEMP_MIN     150
+#define SIM_TEMP_MAX     300
+#define SIM_HUMID_START  450
+#define SIM_HUMID_MIN    200
+#define SIM_HUMID_MAX    800
+
+
+/*-----------------------------------------------------------*/
+// Tag for ESP_LOG/E/W/I functions
+static const char *TAG = "sim";
+
+static sim_config_t s_config;
+static uint32_t s_random;
+static int16_t s_temp = SIM_TEMP_START;
+static int16_t s_humid = SIM_HUMID_START;
+static uint32_t s_entry = 0;            // In-process "channel entries"
+
+static sim_bench_t s_bench;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+
+/*-----------------------------------------------------------*/
+/* Xorshift pseudo-random generator, shared by all tasks */
+static uint32_t sim_random(void)
+{
+    uint32_t x;
+
+    taskENTER_CRITICAL(&s_lock);
+    x = s_random;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    s_random = x;
+    taskEXIT_CRITICAL(&s_lock);
+
+    return x;
+}
+
+
+/*-----------------------------------------------------------*/
+static bool sim_chance(uint16_t permille)
+{
+    return (sim_random() % 1000) < permille;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Block for "ms", busy-wait if it is shorter than one tick */
+static void sim_delay_ms(uint32_t ms)
+{
+    if (pdMS_TO_TICKS(ms) > 0) {
+        vTaskDelay(pdMS_TO_TICKS(ms));
+    }
+    else if (ms > 0) {
+        esp_rom_delay_us(ms * 1000);
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+static int16_t random_walk(int16_t value, int16_t step, int16_t min, int16_t max)
+{
+    value += (int16_t)(sim_random() % (2 * step + 1)) - step;
+    if (value < min) {
+        value = min;
+    }
+    else if (value > max) {
+        value = max;
+    }
+    return value;
+}
+
+
+/*-----------------------------------------------------------*/
+void sim_init(const sim_config_t *config)
+{
+    s_config = *config;
+    s_random = (config->seed != 0) ? config->seed : 1;
+    s_temp = SIM_TEMP_START;
+    s_humid = SIM_HUMID_START;
+    s_entry = 0;
+    memset(&s_bench, 0, sizeof(s_bench));
+
+    ESP_LOGI(TAG, "seed %" PRIu32 ", sensor %" PRIu32 " ms, uploads %s", s_config.seed,
+             s_config.dht_latency_ms, s_config.fake_wifi ? "in-process" : s_config.http_host);
+}
+
+
+/*-----------------------------------------------------------*/
+/* Same interface as one DHT12 read over I2C */
+esp_err_t sim_dht12_read(struct DHT12_values_structure *dht)
+{
+    sim_delay_ms(s_config.dht_latency_ms);
+
+    if (sim_chance(s_config.dht_timeout_permille)) {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    s_temp = random_walk(s_temp, 2, SIM_TEMP_MIN, SIM_TEMP_MAX);
+    s_humid = random_walk(s_humid, 3, SIM_HUMID_MIN, SIM_HUMID_MAX);
+    dht12_set_x10(dht, s_temp, s_humid);
+    dht->checksum = dht->humidInt + dht->humidDec + dht->tempInt + dht->tempDec;
+
+    if (sim_chance(s_config.dht_checksum_permille)) {
+        // One flipped bit on the bus
+        dht->tempInt ^= 1 << (sim_random() % 8);
+    }
+    return ESP_OK;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Pretend the station got an address, "handler" sees the same event
+   as after a real connection */
+esp_err_t sim_wifi_start(esp_event_handler_t handler)
+{
+    ip_event_got_ip_t event;
+    esp_err_t err;
+
+    err = esp_event_loop_create_default();
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+        return err;
+    }
+    err = esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, handler, NULL);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    memset(&event, 0, sizeof(event));
+    event.ip_info.ip.addr = ESP_IP4TOADDR(10, 0, 0, 2);
+    event.ip_info.netmask.addr = ESP_IP4TOADDR(255, 255, 255, 0);
+    event.ip_info.gw.addr = ESP_IP4TOADDR(10, 0, 0, 1);
+    return esp_event_post(IP_EVENT, IP_EVENT_STA_GOT_IP, &event, sizeof(event), portMAX_DELAY);
+}
+
+
+/*-----------------------------------------------------------*/
+/* Plain HTTP GET at the stand-in server, body is the response */
+static esp_err_t standin_get(const char *path, char *response, size_t response_size, int *status)
+{
+    esp_http_client_config_t config = {
+        .host = s_config.http_host,
+        .port = s_config.http_port,
+        .path = path,
+        .method = HTTP_METHOD_GET,
+        .timeout_ms = 5000,
+    };
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    esp_err_t err;
+    int len = 0;
+
+    if (client == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    err = esp_http_client_open(client, 0);
+    if (err == ESP_OK) {
+        esp_http_client_fetch_headers(client);
+        *status = esp_http_client_get_status_code(client);
+        len = esp_http_client_read(client, response, response_size - 1);
+    }
+    response[(len > 0) ? len : 0] = '\0';
+    esp_http_client_cleanup(client);
+
+    return err;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Same interface as https_upload_get() */
+esp_err_t sim_http_get(const char *path, char *response, size_t response_size, int *status)
+{
+    uint32_t latency_ms = s_config.http_latency_ms;
+    uint32_t entry;
+
+    *status = 0;
+    if (response_size == 0) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (!s_config.fake_wifi) {
+        return standin_get(path, response, response_size, status);
+    }
+
+    // Latency jitters by +-50 %
+    if (latency_ms > 0) {
+        latency_ms = latency_ms / 2 + sim_random() % (latency_ms + 1);
+    }
+    sim_delay_ms(latency_ms);
+
+    if (sim_chance(s_config.http_error_permille)) {
+        response[0] = '\0';
+        return ESP_ERR_HTTP_CONNECT;
+    }
+    *status = 200;
+    taskENTER_CRITICAL(&s_lock);
+    entry = ++s_entry;
+    taskEXIT_CRITICAL(&s_lock);
+    snprintf(response, response_size, "%" PRIu32, entry);
+
+    return ESP_OK;
+}
+
+
+/*-----------------------------------------------------------*/
+void sim_bench_sample(bool ok)
+{
+    taskENTER_CRITICAL(&s_lock);
+    s_bench.samples++;
+    if (!ok) {
+        s_bench.sensor_errors++;
+    }
+    taskEXIT_CRITICAL(&s_lock);
+}
+
+
+/*-----------------------------------------------------------*/
+void sim_bench_upload(int64_t latency_us, bool ok)
+{
+    taskENTER_CRITICAL(&s_lock);
+    s_bench.uploads++;
+    if (!ok) {
+        s_bench.upload_errors++;
+    }
+    s_bench.latency_sum_us += latency_us;
+    if (s_bench.uploads == 1 || latency_us < s_bench.latency_min_us) {
+        s_bench.latency_min_us = latency_us;
+    }
+    if (latency_us > s_bench.latency_max_us) {
+        s_bench.latency_max_us = latency_us;
+    }
+    taskEXIT_CRITICAL(&s_lock);
+}
+
+
+/*-----------------------------------------------------------*/
+/* Copy the counters, optionally start a new interval */
+void sim_bench_get(sim_bench_t *bench, bool reset)
+{
+    taskENTER_CRITICAL(&s_lock);
+    *bench = s_bench;
+    if (reset) {
+        memset(&s_bench, 0, sizeof(s_bench));
+    }
+    taskEXIT_CRITICAL(&s_lock);
+}
+
+
+/*-----------------------------------------------------------*/
+/* Log throughput, upload latency and heap usage every interval */
+void sim_bench_task(void *pvParameter)
+{
+    sim_bench_t bench;
+    int64_t start = esp_timer_get_time();
+    int64_t now;
+    uint32_t elapsed_ms;
+
+    while (1) {
+        vTaskDelay(SIM_BENCH_PERIOD_MS / portTICK_PERIOD_MS);
+
+        sim_bench_get(&bench, true);
+        now = esp_timer_get_time();
+        elapsed_ms = (now - start) / 1000;
+        start = now;
+
+        ESP_LOGI(TAG, "bench: %" PRIu32 ".%02" PRIu32 " samples/s, %" PRIu32 " sensor errors",
+                 bench.samples * 1000 / elapsed_ms, bench.samples * 100000 / elapsed_ms % 100,
+                 bench.sensor_errors);
+        ESP_LOGI(TAG, "bench: %" PRIu32 " uploads, %" PRIu32 " failed, latency min/avg/max %" PRIu32 "/%" PRIu32 "/%" PRIu32 " ms",
+                 bench.uploads, bench.upload_errors,
+                 (uint32_t)(bench.latency_min_us / 1000),
+                 (uint32_t)(bench.uploads ? bench.latency_sum_us / bench.uploads / 1000 : 0),
+                 (uint32_t)(bench.latency_max_us / 1000));
+        ESP_LOGI(TAG, "bench: heap free %" PRIu32 ", min free %" PRIu32 ", largest block %u",
+                 esp_get_free_heap_size(), esp_get_minimum_free_heap_size(),
+                 (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+    }
+
+    // Delete this task if it exits from the loop above
+    vTaskDelete(NULL);
+}
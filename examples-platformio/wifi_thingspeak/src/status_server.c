@@ -0,0 +1,280 @@
+/*
+  HTTP server with the latest reading and runtime metrics for LAN clients.
+
+  Xtensa dual-core 32-bit LX6 (FireBeetle ESP32), 240 MHz
+  PlatformIO, ESP-IDF framework
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+
+  NOTES:
+    * Handlers run in the single server task, so the rendered buffers
+      are only touched there; the values are shared with the sampling
+      task under a spinlock held for a copy
+    * Try: curl -i http://<device ip>/latest
+
+  See also:
+    HTTP Server
+      * https://docs.espressif.com/projects/esp-idf/en/v4.4/esp32/api-reference/protocols/esp_http_server.html
+
+    Prometheus text format
+      * https://prometheus.io/docs/instrumenting/exposition_formats/
+ */
+
+
+/*-----------------------------------------------------------*/
+#include <string.h>
+#include <stdio.h>              // snprintf() function
+#include <stdlib.h>             // abs() function
+#include <inttypes.h>           // PRIu32, PRId64 format macros
+#include <freertos/FreeRTOS.h>
+#include <esp_log.h>            // ESP_LOG/E/W/I functions
+#include <esp_timer.h>          // esp_timer_get_time() function
+#include <esp_system.h>         // esp_random() function
+#include <esp_http_server.h>
+#include <status_server.h>
+
+
+/*-----------------------------------------------------------*/
+// One endpoint with its rendered body
+typedef struct endpoint {
+    const char *uri;
+    const char *type;
+    char *body;
+    size_t size;
+    size_t len;
+    uint32_t rendered;          // Version of the data in the body
+    char etag[STATUS_SERVER_ETAG_SIZE];
+    const uint32_t *version;    // Version of the data, 0 = no data yet
+    void (*render)(struct endpoint *ep);
+} endpoint_t;
+
+
+/*-----------------------------------------------------------*/
+// Tag for ESP_LOG/E/W/I functions
+static const char *TAG = "status server";
+
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static httpd_handle_t s_server = NULL;
+static status_server_stats_t s_stats;
+// Versions restart at every boot, the ETag adds a random boot ID so a
+// poller does not get "304 Not Modified" for a body of the last boot
+static uint32_t s_boot_id;
+
+// Values set by the application, guarded by "s_lock"
+static int32_t s_temp_x10;
+static int32_t s_humid_x10;
+static char s_time[STATUS_SERVER_MAX_TIME];
+static uint32_t s_latest_version = 0;
+static const status_metric_t *s_metrics;
+static uint8_t s_metric_count;
+static int64_t s_metric_values[STATUS_SERVER_MAX_METRICS];
+static uint32_t s_metrics_version = 1;
+
+// Rendered bodies, used by the server task only
+static char s_latest_body[STATUS_SERVER_LATEST_SIZE];
+static char s_metrics_body[STATUS_SERVER_METRICS_SIZE];
+
+
+/*-----------------------------------------------------------*/
+/* Value in tenths as decimal text, e.g. -3 as "-0.3" */
+static int format_x10(char *buf, size_t size, int32_t value)
+{
+    return snprintf(buf, size, "%s%d.%d", (value < 0) ? "-" : "", abs(value) / 10, abs(value) % 10);
+}
+
+
+/*-----------------------------------------------------------*/
+static void render_latest(endpoint_t *ep)
+{
+    int32_t temp_x10, humid_x10;
+    char stamp[STATUS_SERVER_MAX_TIME];
+    char temp[12], humid[12];
+
+    portENTER_CRITICAL(&s_lock);
+    temp_x10 = s_temp_x10;
+    humid_x10 = s_humid_x10;
+    memcpy(stamp, s_time, sizeof(stamp));
+    ep->rendered = s_latest_version;
+    portEXIT_CRITICAL(&s_lock);
+
+    format_x10(temp, sizeof(temp), temp_x10);
+    format_x10(humid, sizeof(humid), humid_x10);
+    ep->len = snprintf(ep->body, ep->size, "{\"temperature\":%s,\"humidity\":%s,\"time\":\"%s\"}\n",
+                       temp, humid, stamp);
+}
+
+
+/*-----------------------------------------------------------*/
+static void render_metrics(endpoint_t *ep)
+{
+    int64_t values[STATUS_SERVER_MAX_METRICS];
+    size_t len = 0;
+    int n;
+
+    portENTER_CRITICAL(&s_lock);
+    memcpy(values, s_metric_values, sizeof(values));
+    ep->rendered = s_metrics_version;
+    portEXIT_CRITICAL(&s_lock);
+
+    for (uint8_t i = 0; i < s_metric_count; i++) {
+        n = snprintf(ep->body + len, ep->size - len, "# HELP %s %s\n# TYPE %s %s\n%s %" PRId64 "\n",
+                     s_metrics[i].name, s_metrics[i].help, s_metrics[i].name,
+                     s_metrics[i].counter ? "counter" : "gauge", s_metrics[i].name, values[i]);
+        if (n < 0 || (size_t)n >= ep->size - len) {
+            // Only complete metrics are served
+            ESP_LOGW(TAG, "metrics do not fit into buffer");
+            break;
+        }
+        len += n;
+    }
+    ep->body[len] = '\0';
+    ep->len = len;
+}
+
+
+/*-----------------------------------------------------------*/
+static endpoint_t s_endpoints[] = {
+    {"/latest", "application/json", s_latest_body, sizeof(s_latest_body), 0, 0, "",
+     &s_latest_version, render_latest},
+    {"/metrics", "text/plain; version=0.0.4", s_metrics_body, sizeof(s_metrics_body), 0, 0, "",
+     &s_metrics_version, render_metrics},
+};
+
+
+/*-----------------------------------------------------------*/
+/* Serve the rendered body, render it first if the data changed */
+static esp_err_t endpoint_handler(httpd_req_t *req)
+{
+    endpoint_t *ep = (endpoint_t *)req->user_ctx;
+    int64_t start = esp_timer_get_time();
+    bool rendered = false;
+    bool not_modified = false;
+    char etag[STATUS_SERVER_ETAG_SIZE];
+    uint32_t version;
+    esp_err_t err;
+
+    portENTER_CRITICAL(&s_lock);
+    version = *ep->version;
+    portEXIT_CRITICAL(&s_lock);
+
+    if (version == 0) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        err = httpd_resp_sendstr(req, "no sample yet\n");
+    }
+    else {
+        if (version != ep->rendered) {
+            ep->render(ep);
+            snprintf(ep->etag, sizeof(ep->etag), "\"%08" PRIx32 "-%08" PRIx32 "\"", s_boot_id, ep->rendered);
+            rendered = true;
+        }
+        httpd_resp_set_hdr(req, "ETag", ep->etag);
+        httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+        // The poller has this body already
+        if (httpd_req_get_hdr_value_str(req, "If-None-Match", etag, sizeof(etag)) == ESP_OK &&
+            strcmp(etag, ep->etag) == 0) {
+            httpd_resp_set_status(req, "304 Not Modified");
+            err = httpd_resp_send(req, NULL, 0);
+            not_modified = true;
+        }
+        else {
+            httpd_resp_set_type(req, ep->type);
+            err = httpd_resp_send(req, ep->body, ep->len);
+        }
+    }
+
+    int64_t elapsed = esp_timer_get_time() - start;
+    portENTER_CRITICAL(&s_lock);
+    s_stats.requests++;
+    s_stats.renders += rendered;
+    s_stats.not_modified += not_modified;
+    s_stats.handler_us += elapsed;
+    if (elapsed > s_stats.max_handler_us) {
+        s_stats.max_handler_us = elapsed;
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    return err;
+}
+
+
+/*-----------------------------------------------------------*/
+esp_err_t status_server_start(const status_server_config_t *config)
+{
+    httpd_config_t httpd_config = HTTPD_DEFAULT_CONFIG();
+    esp_err_t err;
+
+    if (config->metric_count > STATUS_SERVER_MAX_METRICS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_metrics = config->metrics;
+    s_metric_count = config->metric_count;
+    s_boot_id = esp_random();
+
+    httpd_config.server_port = config->port;
+    httpd_config.max_open_sockets = config->max_clients;
+    // A new client closes the connection idle for the longest time
+    httpd_config.lru_purge_enable = true;
+    httpd_config.task_priority = STATUS_SERVER_PRIORITY;
+    httpd_config.recv_wait_timeout = STATUS_SERVER_TIMEOUT_S;
+    httpd_config.send_wait_timeout = STATUS_SERVER_TIMEOUT_S;
+    httpd_config.max_uri_handlers = sizeof(s_endpoints) / sizeof(s_endpoints[0]);
+
+    if ((err = httpd_start(&s_server, &httpd_config)) != ESP_OK) {
+        ESP_LOGE(TAG, "start failed: %s", esp_err_to_name(err));
+        return err;
+    }
+    for (uint8_t i = 0; i < sizeof(s_endpoints) / sizeof(s_endpoints[0]); i++) {
+        httpd_uri_t uri = {
+            .uri = s_endpoints[i].uri,
+            .method = HTTP_GET,
+            .handler = endpoint_handler,
+            .user_ctx = &s_endpoints[i],
+        };
+        httpd_register_uri_handler(s_server, &uri);
+    }
+    ESP_LOGI(TAG, "listening on port %u, %u clients at most", config->port, config->max_clients);
+
+    return ESP_OK;
+}
+
+
+/*-----------------------------------------------------------*/
+/* New reading, /latest is rendered again on the next request */
+void status_server_set_latest(int32_t temp_x10, int32_t humid_x10, const char *time)
+{
+    portENTER_CRITICAL(&s_lock);
+    if (s_latest_version == 0 || temp_x10 != s_temp_x10 || humid_x10 != s_humid_x10 ||
+        strncmp(time, s_time, sizeof(s_time)) != 0) {
+        s_temp_x10 = temp_x10;
+        s_humid_x10 = humid_x10;
+        strlcpy(s_time, time, sizeof(s_time));
+        s_latest_version++;
+    }
+    portEXIT_CRITICAL(&s_lock);
+}
+
+
+/*-----------------------------------------------------------*/
+void status_server_set_metric(uint8_t index, int64_t value)
+{
+    if (index >= STATUS_SERVER_MAX_METRICS) {
+        return;
+    }
+    portENTER_CRITICAL(&s_lock);
+    if (s_metric_values[index] != value) {
+        s_metric_values[index] = value;
+        s_metrics_version++;
+    }
+    portEXIT_CRITICAL(&s_lock);
+}
+
+
+/*-----------------------------------------------------------*/
+void status_server_get_stats(status_server_stats_t *stats)
+{
+    portENTER_CRITICAL(&s_lock);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_lock);
+}
@@ -0,0 +1,354 @@
+/*
+  Wall-clock time for sample time stamps, synchronized over SNTP.
+
+  Xtensa dual-core 32-bit LX6 (FireBeetle ESP32), 240 MHz
+  PlatformIO, ESP-IDF framework
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+
+  NOTES:
+    * The system time (time(), gettimeofday()) is not touched, so the
+      module can be used next to ESP-IDF SNTP
+    * Server host name is resolved by "dns_cache", which must be
+      initialized
+
+  See also:
+    Simple Network Time Protocol (SNTP) Version 4
+      * https://www.rfc-editor.org/rfc/rfc4330
+ */
+
+
+/*-----------------------------------------------------------*/
+#include <string.h>
+#include <time.h>               // gmtime_r(), strftime() functions
+#include <inttypes.h>           // PRId64 format macro
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_log.h>            // ESP_LOG/E/W/I functions
+#include <esp_timer.h>          // esp_timer_get_time() function
+#include <nvs.h>                // Drift kept over reboots
+#include <lwip/sockets.h>       // UDP socket
+#include <dns_cache.h>          // Server address
+#include <ntp_clock.h>          // Offset and drift arithmetic
+#include <timekeeper.h>
+
+
+/*-----------------------------------------------------------*/
+#define NTP_PACKET          48
+#define NTP_MODE_CLIENT     3
+#define NTP_MODE_SERVER     4
+#define NTP_VERSION         4
+#define TIMEKEEPER_UPDATE_MS 1000           // Offset moved on by drift
+
+
+/*-----------------------------------------------------------*/
+// Tag for ESP_LOG/E/W/I functions
+static const char *TAG = "timekeeper";
+
+static timekeeper_config_t s_config;
+static TaskHandle_t s_task = NULL;
+static bool s_started = false;          // First sync was requested
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Mapping, guarded by "s_mux"
+static int64_t s_offset_us = 0;         // Used for stamping
+static ntp_clock_t s_clock;
+static timekeeper_status_t s_status;
+
+
+/*-----------------------------------------------------------*/
+/* One SNTP exchange. The local send time goes out as transmit time
+   stamp and must come back as originate time stamp, so late answers
+   of earlier queries are recognized. */
+static esp_err_t ntp_query(int sock, const struct sockaddr_in *server, ntp_clock_sample_t *sample)
+{
+    uint8_t buf[NTP_PACKET];
+    uint8_t cookie[8];
+    int64_t t1, t2, t3, t4;
+    int len;
+
+    memset(buf, 0, sizeof(buf));
+    buf[0] = (NTP_VERSION << 3) | NTP_MODE_CLIENT;
+    t1 = esp_timer_get_time();
+    ntp_clock_put_time(&buf[40], t1);
+    memcpy(cookie, &buf[40], sizeof(cookie));
+    if (sendto(sock, buf, sizeof(buf), 0, (const struct sockaddr *)server, sizeof(struct sockaddr_in)) < 0) {
+        return ESP_FAIL;
+    }
+
+    while (1) {
+        len = recv(sock, buf, sizeof(buf), 0);
+        t4 = esp_timer_get_time();
+        if (len <= 0) {
+            return ESP_ERR_TIMEOUT;
+        }
+        if (len >= NTP_PACKET && memcmp(&buf[24], cookie, sizeof(cookie)) == 0) {
+            break;
+        }
+    }
+
+    // Leap indicator 3 or stratum 0 (kiss-o'-death): server not synced
+    if ((buf[0] & 0x07) != NTP_MODE_SERVER || (buf[0] >> 6) == 3 || buf[1] == 0 || buf[1] > 15) {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    t2 = ntp_clock_get_time(&buf[32]);
+    t3 = ntp_clock_get_time(&buf[40]);
+    ntp_clock_sample(t1, t2, t3, t4, sample);
+
+    return ESP_OK;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Query the server a few times, keep the sample with the shortest
+   round trip, it has the smallest error */
+static esp_err_t ntp_measure(ntp_clock_sample_t *best)
+{
+    struct sockaddr_in server = {
+        .sin_family = AF_INET,
+        .sin_port = htons(s_config.port),
+    };
+    struct timeval timeout = {
+        .tv_sec = TIMEKEEPER_TIMEOUT_MS / 1000,
+        .tv_usec = (TIMEKEEPER_TIMEOUT_MS % 1000) * 1000,
+    };
+    ntp_clock_sample_t sample;
+    uint8_t valid = 0;
+    uint32_t addr;
+    int sock;
+
+    if (dns_cache_resolve(s_config.server, &addr) != ESP_OK) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    server.sin_addr.s_addr = addr;
+
+    sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) {
+        return ESP_FAIL;
+    }
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    for (uint8_t i = 0; i < TIMEKEEPER_SAMPLES; i++) {
+        if (ntp_query(sock, &server, &sample) != ESP_OK) {
+            continue;
+        }
+        if (valid == 0 || sample.delay_us < best->delay_us) {
+            *best = sample;
+        }
+        valid++;
+    }
+    close(sock);
+
+    return (valid > 0) ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+
+/*-----------------------------------------------------------*/
+static void load_drift(void)
+{
+    nvs_handle_t handle;
+    int32_t drift;
+
+    if (nvs_open(TIMEKEEPER_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return;
+    }
+    if (nvs_get_i32(handle, TIMEKEEPER_NVS_KEY, &drift) == ESP_OK &&
+        drift >= -NTP_CLOCK_MAX_DRIFT_PPB && drift <= NTP_CLOCK_MAX_DRIFT_PPB) {
+        s_clock.drift_ppb = drift;
+        s_clock.drift_known = true;
+        ESP_LOGI(TAG, "drift %d ppb loaded", (int)drift);
+    }
+    nvs_close(handle);
+}
+
+
+/*-----------------------------------------------------------*/
+static void store_drift(int32_t drift)
+{
+    nvs_handle_t handle;
+
+    if (nvs_open(TIMEKEEPER_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+        return;
+    }
+    if (nvs_set_i32(handle, TIMEKEEPER_NVS_KEY, drift) == ESP_OK) {
+        nvs_commit(handle);
+    }
+    nvs_close(handle);
+}
+
+
+/*-----------------------------------------------------------*/
+/* Take a new measurement into the mapping */
+static void apply_sample(const ntp_clock_sample_t *sample)
+{
+    int32_t stored;
+    int32_t drift;
+    int64_t step;
+
+    portENTER_CRITICAL(&s_mux);
+    stored = s_clock.drift_ppb;
+    step = ntp_clock_apply(&s_clock, sample);
+    drift = s_clock.drift_ppb;
+    s_offset_us = s_clock.base_offset_us;
+
+    s_status.synced = true;
+    s_status.last_sync_us = sample->local_us;
+    s_status.sync_error_us = s_clock.sync_error_us;
+    s_status.last_step_us = step;
+    s_status.syncs++;
+    portEXIT_CRITICAL(&s_mux);
+
+    // Flash is written only on a change of more than 1 ppm
+    if (s_clock.drift_known && (drift - stored > 1000 || stored - drift > 1000)) {
+        store_drift(drift);
+    }
+
+    ESP_LOGI(TAG, "synced: offset %" PRId64 " us, step %" PRId64 " us, error %d us, drift %d ppb",
+             sample->offset_us, step, (int)(sample->delay_us / 2), (int)drift);
+}
+
+
+/*-----------------------------------------------------------*/
+static void timekeeper_task(void *pvParameter)
+{
+    int64_t next_sync = 0;
+    ntp_clock_sample_t sample;
+    esp_err_t err;
+
+    // Forever loop
+    while (1) {
+        bool requested = ulTaskNotifyTake(pdTRUE, TIMEKEEPER_UPDATE_MS / portTICK_PERIOD_MS) > 0;
+        int64_t now = esp_timer_get_time();
+
+        if (requested || (s_started && now >= next_sync)) {
+            err = ntp_measure(&sample);
+            if (err == ESP_OK) {
+                apply_sample(&sample);
+                next_sync = now + s_config.interval_s * 1000000LL;
+            }
+            else {
+                ESP_LOGW(TAG, "sync with %s failed: %s", s_config.server, esp_err_to_name(err));
+                portENTER_CRITICAL(&s_mux);
+                s_status.failures++;
+                portEXIT_CRITICAL(&s_mux);
+                next_sync = now + TIMEKEEPER_RETRY_S * 1000000LL;
+            }
+        }
+
+        // Stamping uses a plain offset, move it on by the drift
+        portENTER_CRITICAL(&s_mux);
+        s_offset_us = ntp_clock_predict(&s_clock, esp_timer_get_time());
+        portEXIT_CRITICAL(&s_mux);
+    }
+
+    // Delete this task if it exits from the loop above
+    vTaskDelete(NULL);
+}
+
+
+/*-----------------------------------------------------------*/
+/* Start the background task, the first sync waits for
+   timekeeper_sync_now(). NVS must be initialized. */
+esp_err_t timekeeper_init(const timekeeper_config_t *config)
+{
+    if (s_task != NULL) {
+        return ESP_OK;
+    }
+    if (config->server == NULL || config->interval_s == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_config = *config;
+    memset(&s_status, 0, sizeof(s_status));
+    load_drift();
+
+    if (xTaskCreate(timekeeper_task, "timekeeper", 3072, NULL, 4, &s_task) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Sync right away, e.g. after the station got an IP address. The
+   mapping stays valid meanwhile. */
+void timekeeper_sync_now(void)
+{
+    if (s_task != NULL) {
+        s_started = true;
+        xTaskNotifyGive(s_task);
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+bool timekeeper_is_synced(void)
+{
+    return s_status.synced;
+}
+
+
+/*-----------------------------------------------------------*/
+/* UTC in microseconds since 1970 of the local time "time_us" (from
+   esp_timer_get_time()). Meaningless until timekeeper_is_synced(). */
+int64_t timekeeper_to_utc_us(int64_t time_us)
+{
+    int64_t offset;
+
+    portENTER_CRITICAL(&s_mux);
+    offset = s_offset_us;
+    portEXIT_CRITICAL(&s_mux);
+
+    return time_us + offset;
+}
+
+
+/*-----------------------------------------------------------*/
+int64_t timekeeper_now_utc_us(void)
+{
+    return timekeeper_to_utc_us(esp_timer_get_time());
+}
+
+
+/*-----------------------------------------------------------*/
+/* Error bound of the time stamp of local time "time_us": error of the
+   last sync, plus the drift uncertainty since then */
+uint32_t timekeeper_error_us(int64_t time_us)
+{
+    uint32_t error;
+
+    portENTER_CRITICAL(&s_mux);
+    // Offset is moved on only once per update period
+    error = ntp_clock_error_us(&s_clock, time_us, TIMEKEEPER_UPDATE_MS);
+    portEXIT_CRITICAL(&s_mux);
+
+    return error;
+}
+
+
+/*-----------------------------------------------------------*/
+void timekeeper_get_status(timekeeper_status_t *status)
+{
+    portENTER_CRITICAL(&s_mux);
+    *status = s_status;
+    status->offset_us = s_offset_us;
+    status->drift_ppb = s_clock.drift_ppb;
+    status->drift_known = s_clock.drift_known;
+    portEXIT_CRITICAL(&s_mux);
+}
+
+
+/*-----------------------------------------------------------*/
+/* Write UTC time as e.g. "2022-05-17T10:00:00Z". Return number of
+   characters written (zero terminated), 0 if it does not fit. */
+size_t timekeeper_format_iso8601(int64_t utc_us, char *buf, size_t size)
+{
+    time_t seconds = utc_us / 1000000;
+    struct tm tm;
+
+    if (gmtime_r(&seconds, &tm) == NULL) {
+        return 0;
+    }
+    return strftime(buf, size, "%Y-%m-%dT%H:%M:%SZ", &tm);
+}
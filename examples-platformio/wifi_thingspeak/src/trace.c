@@ -0,0 +1,311 @@
+/*
+  Sample-to-cloud latency tracing.
+
+  Xtensa dual-core 32-bit LX6 (FireBeetle ESP32), 240 MHz
+  PlatformIO, ESP-IDF framework
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+
+  NOTES:
+    * Dump format, one line per finished sample:
+        TRACE,<id>,<ok>,<start us>,<read>,<queued>,...,<acked>
+      stage times are microseconds after the start, empty if the
+      stage was skipped; a "TRACE_STAGES,..." line with stage names
+      precedes every dump
+ */
+
+
+/*-----------------------------------------------------------*/
+#include <stdio.h>              // printf() function
+#include <string.h>
+#include <inttypes.h>           // PRIu32, PRId64 format macros
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <esp_log.h>            // ESP_LOG/E/W/I functions
+#include <esp_timer.h>          // esp_timer_get_time() function
+#include <trace.h>
+
+
+/*-----------------------------------------------------------*/
+typedef enum {
+    TRACE_FREE = 0,
+    TRACE_ACTIVE,
+    TRACE_DONE,                 // Finished, not dumped yet
+    TRACE_DUMPED,
+} trace_state_t;
+
+typedef struct {
+    uint32_t id;
+    uint8_t state;
+    bool ok;
+    uint8_t marks;              // Bit mask of recorded stages
+    int64_t start_us;
+    uint32_t offset_us[TRACE_STAGE_COUNT];
+} trace_record_t;
+
+
+/*-----------------------------------------------------------*/
+// Tag for ESP_LOG/E/W/I functions
+static const char *TAG = "trace";
+
+static const char *s_stage_names[TRACE_STAGE_COUNT] = {
+    "start", "read", "queued", "encoded", "dns", "connect", "sent", "acked",
+};
+
+static trace_record_t s_ring[TRACE_RING_LEN];
+static trace_record_t s_dump[TRACE_RING_LEN];   // Copy printed by trace_dump()
+static trace_hist_t s_hist[TRACE_STAGE_COUNT];
+static uint32_t s_next_id = 1;
+static uint32_t s_lost = 0;                     // Overwritten before dumped
+static SemaphoreHandle_t s_lock = NULL;
+
+
+/*-----------------------------------------------------------*/
+/* Record with identifier "id", NULL if it was overwritten already.
+   Must be called with the lock taken. */
+static trace_record_t *find_record(uint32_t id)
+{
+    trace_record_t *rec = &s_ring[id % TRACE_RING_LEN];
+
+    return (id != TRACE_NONE && rec->id == id) ? rec : NULL;
+}
+
+
+/*-----------------------------------------------------------*/
+static void hist_add(trace_hist_t *hist, uint32_t span_us)
+{
+    uint32_t ms = span_us / 1000;
+    uint8_t bin = 0;
+
+    while (ms > 0 && bin < TRACE_HIST_BINS - 1) {
+        ms >>= 1;
+        bin++;
+    }
+    hist->bins[bin]++;
+    hist->count++;
+    hist->sum_us += span_us;
+    if (span_us > hist->max_us) {
+        hist->max_us = span_us;
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+void trace_init(void)
+{
+    if (s_lock == NULL) {
+        s_lock = xSemaphoreCreateMutex();
+    }
+    memset(s_ring, 0, sizeof(s_ring));
+    memset(s_hist, 0, sizeof(s_hist));
+    s_next_id = 1;
+    s_lost = 0;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Start tracing a new sample, return its identifier */
+uint32_t trace_begin(void)
+{
+    trace_record_t *rec;
+    uint32_t id;
+
+    if (s_lock == NULL) {
+        return TRACE_NONE;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    id = s_next_id++;
+    if (s_next_id == TRACE_NONE) {
+        s_next_id++;
+    }
+    rec = &s_ring[id % TRACE_RING_LEN];
+    if (rec->state == TRACE_DONE || rec->state == TRACE_ACTIVE) {
+        s_lost++;
+    }
+    memset(rec, 0, sizeof(trace_record_t));
+    rec->id = id;
+    rec->state = TRACE_ACTIVE;
+    rec->marks = 1 << TRACE_START;
+    rec->start_us = esp_timer_get_time();
+    xSemaphoreGive(s_lock);
+
+    return id;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Record "stage" of sample "id" at the given time */
+void trace_mark_at(uint32_t id, trace_stage_t stage, int64_t time_us)
+{
+    trace_record_t *rec;
+
+    if (id == TRACE_NONE || stage >= TRACE_STAGE_COUNT) {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    rec = find_record(id);
+    if (rec != NULL && rec->state == TRACE_ACTIVE && time_us >= rec->start_us) {
+        rec->offset_us[stage] = time_us - rec->start_us;
+        rec->marks |= 1 << stage;
+    }
+    xSemaphoreGive(s_lock);
+}
+
+
+/*-----------------------------------------------------------*/
+void trace_mark(uint32_t id, trace_stage_t stage)
+{
+    trace_mark_at(id, stage, esp_timer_get_time());
+}
+
+
+/*-----------------------------------------------------------*/
+/* Sample reached its last stage. Spans of successful samples go to
+   the histograms, all samples are kept for the dump. */
+void trace_finish(uint32_t id, bool ok)
+{
+    trace_record_t *rec;
+    uint32_t prev = 0;
+
+    if (id == TRACE_NONE) {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    rec = find_record(id);
+    if (rec != NULL && rec->state == TRACE_ACTIVE) {
+        rec->state = TRACE_DONE;
+        rec->ok = ok;
+        if (ok) {
+            for (uint8_t stage = TRACE_START + 1; stage < TRACE_STAGE_COUNT; stage++) {
+                if (rec->marks & (1 << stage)) {
+                    hist_add(&s_hist[stage], rec->offset_us[stage] - prev);
+                    prev = rec->offset_us[stage];
+                }
+            }
+            hist_add(&s_hist[TRACE_START], prev);
+        }
+    }
+    xSemaphoreGive(s_lock);
+}
+
+
+/*-----------------------------------------------------------*/
+/* Forget a sample that will not be uploaded */
+void trace_abort(uint32_t id)
+{
+    trace_record_t *rec;
+
+    if (id == TRACE_NONE) {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    rec = find_record(id);
+    if (rec != NULL && rec->state == TRACE_ACTIVE) {
+        rec->state = TRACE_FREE;
+    }
+    xSemaphoreGive(s_lock);
+}
+
+
+/*-----------------------------------------------------------*/
+const char *trace_stage_name(trace_stage_t stage)
+{
+    return (stage < TRACE_STAGE_COUNT) ? s_stage_names[stage] : "?";
+}
+
+
+/*-----------------------------------------------------------*/
+/* Histogram of spans ending with "stage", TRACE_START for totals */
+void trace_get_hist(trace_stage_t stage, trace_hist_t *hist)
+{
+    if (s_lock == NULL || stage >= TRACE_STAGE_COUNT) {
+        memset(hist, 0, sizeof(trace_hist_t));
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *hist = s_hist[stage];
+    xSemaphoreGive(s_lock);
+}
+
+
+/*-----------------------------------------------------------*/
+/* Upper bound of the bin with the given percentile, e.g. 990 for p99 */
+uint32_t trace_percentile_us(const trace_hist_t *hist, uint16_t permille)
+{
+    uint32_t rank = ((uint64_t)hist->count * permille + 999) / 1000;
+    uint32_t seen = 0;
+    uint32_t bound_us;
+
+    if (hist->count == 0) {
+        return 0;
+    }
+    for (uint8_t bin = 0; bin < TRACE_HIST_BINS - 1; bin++) {
+        seen += hist->bins[bin];
+        if (seen >= rank) {
+            bound_us = (1UL << bin) * 1000;
+            return (bound_us < hist->max_us) ? bound_us : hist->max_us;
+        }
+    }
+    return hist->max_us;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Print finished samples not dumped yet, oldest first. Printing is
+   done from a copy, so tracing in other tasks is not blocked. */
+void trace_dump(void)
+{
+    uint32_t first, lost;
+    uint8_t count = 0;
+
+    if (s_lock == NULL) {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    first = s_next_id - TRACE_RING_LEN;
+    for (uint32_t i = 0; i < TRACE_RING_LEN; i++) {
+        trace_record_t *rec = find_record(first + i);
+        if (rec != NULL && rec->state == TRACE_DONE) {
+            s_dump[count++] = *rec;
+            rec->state = TRACE_DUMPED;
+        }
+    }
+    lost = s_lost;
+    xSemaphoreGive(s_lock);
+
+    printf("TRACE_STAGES");
+    for (uint8_t stage = 0; stage < TRACE_STAGE_COUNT; stage++) {
+        printf(",%s", s_stage_names[stage]);
+    }
+    printf("\n");
+    for (uint8_t i = 0; i < count; i++) {
+        printf("TRACE,%" PRIu32 ",%d,%" PRId64, s_dump[i].id, s_dump[i].ok, s_dump[i].start_us);
+        for (uint8_t stage = TRACE_START + 1; stage < TRACE_STAGE_COUNT; stage++) {
+            if (s_dump[i].marks & (1 << stage)) {
+                printf(",%" PRIu32, s_dump[i].offset_us[stage]);
+            }
+            else {
+                printf(",");
+            }
+        }
+        printf("\n");
+    }
+    ESP_LOGI(TAG, "%u sample(s) dumped, %" PRIu32 " lost", count, lost);
+
+    // Span statistics of all successful samples so far
+    for (uint8_t stage = 0; stage < TRACE_STAGE_COUNT; stage++) {
+        trace_hist_t hist;
+
+        trace_get_hist(stage, &hist);
+        if (hist.count == 0) {
+            continue;
+        }
+        ESP_LOGI(TAG, "%-8s n %" PRIu32 ", avg %" PRIu32 " ms, p50 <%" PRIu32 ", p90 <%" PRIu32 ", p99 <%" PRIu32 ", max %" PRIu32 " ms",
+                 (stage == TRACE_START) ? "total" : s_stage_names[stage], hist.count,
+                 (uint32_t)(hist.sum_us / hist.count / 1000),
+                 trace_percentile_us(&hist, 500) / 1000, trace_percentile_us(&hist, 900) / 1000,
+                 trace_percentile_us(&hist, 990) / 1000, hist.max_us / 1000);
+    }
+}
@@ -0,0 +1,210 @@
+/*
+  Host test of "src/ntp_clock.c" against simulated clocks.
+
+  Build and run on Linux:
+
+    cc -O2 -Iinclude tools/clock_bench.c src/ntp_clock.c -lm -o clock_bench
+    ./clock_bench
+
+  Simulates a local crystal with a known drift against UTC and an NTP
+  server behind a network with random, asymmetric delays, and runs
+  the sync schedule of "src/timekeeper.c": four exchanges per sync,
+  the one with the shortest round trip is used, the stamping offset
+  is moved on once a second. All time stamps go through the 64-bit
+  SNTP format. Every second of two simulated days, a sample time
+  stamp is compared with the true UTC.
+
+  The table shows the true drift, the estimate after the last sync,
+  the largest stamp error, the smallest margin to the error bound of
+  ntp_clock_error_us() and the stamps outside the bound. The program
+  returns 1 if a stamp is outside its bound, if a drift estimate is
+  more than 1 ppm off, or if an SNTP time stamp (up to 2062) does not
+  convert back to within 1 us.
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+ */
+
+
+/*-----------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <ntp_clock.h>
+
+
+/*-----------------------------------------------------------*/
+#define BENCH_UTC_START_US  1652781600000000LL  // 2022-05-17T10:00:00Z
+#define BENCH_DURATION_S    (2 * 24 * 3600)
+#define BENCH_DRIFT_TOL_PPB 1000
+
+// Schedule of "src/timekeeper.c" and "include/my_data.h"
+#define TIMEKEEPER_SAMPLES   4
+#define TIMEKEEPER_UPDATE_MS 1000
+#define TIME_SYNC_INTERVAL_S 3600
+
+
+/*-----------------------------------------------------------*/
+typedef struct {
+    const char *name;
+    double drift_ppm;           // Local clock slower (+) or faster (-)
+    uint32_t base_delay_us;     // One way, both directions
+    uint32_t jitter_us;         // Extra on the way to the server, 1/4 back
+    uint32_t interval_s;
+    bool loaded;                // Drift known from NVS, 2 ppm off
+} bench_scenario_t;
+
+static int s_failed = 0;
+
+
+/*-----------------------------------------------------------*/
+static double uniform(void)
+{
+    return rand() / (RAND_MAX + 1.0);
+}
+
+
+/*-----------------------------------------------------------*/
+/* True UTC at local time "local_us" */
+static int64_t utc_at(const bench_scenario_t *sc, int64_t local_us)
+{
+    return BENCH_UTC_START_US + local_us + llround(local_us * sc->drift_ppm * 1e-6);
+}
+
+
+/*-----------------------------------------------------------*/
+/* Value as it arrives in a 64-bit SNTP time stamp */
+static int64_t on_wire(int64_t unix_us)
+{
+    uint8_t buf[8];
+
+    ntp_clock_put_time(buf, unix_us);
+    return ntp_clock_get_time(buf);
+}
+
+
+/*-----------------------------------------------------------*/
+/* ntp_measure(): shortest of four exchanges, starting at "local_us" */
+static void measure(const bench_scenario_t *sc, int64_t local_us, ntp_clock_sample_t *best)
+{
+    ntp_clock_sample_t sample;
+
+    for (uint8_t i = 0; i < TIMEKEEPER_SAMPLES; i++) {
+        int64_t t1 = local_us;
+        int64_t arrive = t1 + sc->base_delay_us + (int64_t)(uniform() * sc->jitter_us);
+        int64_t leave = arrive + 50;
+        int64_t t4 = leave + sc->base_delay_us + (int64_t)(uniform() * sc->jitter_us / 4);
+
+        ntp_clock_sample(t1, on_wire(utc_at(sc, arrive)),
+                         on_wire(utc_at(sc, leave)), t4, &sample);
+        if (i == 0 || sample.delay_us < best->delay_us) {
+            *best = sample;
+        }
+        local_us = t4 + 10000;
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+static void bench(const bench_scenario_t *sc)
+{
+    ntp_clock_t clock = {0};
+    ntp_clock_sample_t sample;
+    int64_t offset = 0;
+    int64_t next_sync = 0;
+    int64_t max_error = 0;
+    int64_t min_margin = INT64_MAX;
+    uint32_t violations = 0;
+    int64_t drift_error;
+    int checks = 0;
+
+    srand(2022);
+    if (sc->loaded) {
+        clock.drift_ppb = llround(sc->drift_ppm * 1000) + 2000;
+        clock.drift_known = true;
+    }
+
+    // Boot to first sync takes a few seconds (Wi-Fi)
+    for (int64_t s = 5; s < BENCH_DURATION_S; s++) {
+        int64_t now = s * 1000000;
+
+        // timekeeper_task(): sync when due, then move the offset on
+        if (now >= next_sync) {
+            measure(sc, now, &sample);
+            ntp_clock_apply(&clock, &sample);
+            next_sync = now + sc->interval_s * 1000000LL;
+        }
+        offset = ntp_clock_predict(&clock, now);
+
+        // A sample somewhere within the next update period
+        int64_t stamp_us = now + (int64_t)(uniform() * TIMEKEEPER_UPDATE_MS * 1000);
+        int64_t error = llabs(stamp_us + offset - utc_at(sc, stamp_us));
+        int64_t bound = ntp_clock_error_us(&clock, stamp_us, TIMEKEEPER_UPDATE_MS);
+
+        max_error = (error > max_error) ? error : max_error;
+        min_margin = (bound - error < min_margin) ? bound - error : min_margin;
+        if (error > bound) {
+            violations++;
+        }
+    }
+
+    drift_error = llabs(clock.drift_ppb - llround(sc->drift_ppm * 1000));
+    checks += violations != 0;
+    checks += !clock.drift_known || drift_error > BENCH_DRIFT_TOL_PPB;
+
+    printf("%-22s %9lld %9d %10lld %9lld %10u %6d\n", sc->name, llround(sc->drift_ppm * 1000),
+           (int)clock.drift_ppb, (long long)max_error, (long long)min_margin, (unsigned)violations, checks);
+    if (checks != 0) {
+        s_failed++;
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+/* SNTP time stamps of random times convert back within 1 us */
+static void wire_check(void)
+{
+    int64_t worst = 0;
+
+    srand(1);
+    for (int i = 0; i < 1000000; i++) {
+        int64_t t = BENCH_UTC_START_US + (int64_t)(uniform() * 40 * 365.25 * 86400e6);
+        int64_t error = llabs(on_wire(t) - t);
+
+        worst = (error > worst) ? error : worst;
+    }
+    printf("SNTP time stamps: worst round trip %lld us over 10^6 values%s\n\n", (long long)worst,
+           worst > 1 ? " FAILED" : "");
+    if (worst > 1) {
+        s_failed++;
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+int main(void)
+{
+    static const bench_scenario_t scenarios[] = {
+        {"ideal crystal", 0, 1000, 2000, TIME_SYNC_INTERVAL_S, false},
+        {"slow 40 ppm", 40, 1000, 2000, TIME_SYNC_INTERVAL_S, false},
+        {"fast 40 ppm", -40, 1000, 2000, TIME_SYNC_INTERVAL_S, false},
+        {"fast 25 ppm, 100 s", -25, 1000, 2000, 100, false},
+        {"slow 20 ppm, 30 ms", 20, 5000, 30000, TIME_SYNC_INTERVAL_S, false},
+        {"slow 30 ppm, loaded", 30, 1000, 2000, TIME_SYNC_INTERVAL_S, true},
+        {"slow 30 ppm, 30 ms, ld", 30, 5000, 30000, TIME_SYNC_INTERVAL_S, true},
+    };
+
+    wire_check();
+    printf("%-22s %9s %9s %10s %9s %10s %6s\n", "scenario", "drift_ppb", "estimate", "max_err_us",
+           "margin_us", "violations", "checks");
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        bench(&scenarios[i]);
+    }
+
+    if (s_failed != 0) {
+        printf("\n%d check(s) FAILED\n", s_failed);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,323 @@
+/*
+  Host benchmark of "src/deflate_stream.c" on realistic sensor batches.
+
+  Build and run on Linux (zlib is used as reference and to check that
+  every output inflates back to the input):
+
+    cc -O2 -Iinclude tools/deflate_bench.c src/deflate_stream.c -lz -o deflate_bench
+    ./deflate_bench
+
+  Other windows are tried by adding e.g. "-DDEFLATE_STREAM_WINDOW_BITS=10".
+  For every batch the table shows compressed size, ratio, throughput
+  and peak RAM of the compressor. Peak RAM of deflate_stream is its
+  state structure (no allocation), zlib is measured by counting its
+  allocations.
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+ */
+
+
+/*-----------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
+#include <deflate_stream.h>
+
+
+/*-----------------------------------------------------------*/
+#define BENCH_MAX_INPUT  16384
+#define BENCH_PIECE      64         // Input is written in pieces like on the device
+#define BENCH_MIN_TIME_S 0.2
+
+
+/*-----------------------------------------------------------*/
+typedef struct {
+    uint8_t *buf;
+    size_t size;
+    size_t len;
+} bench_out_t;
+
+// Allocations of zlib
+static size_t s_heap_now = 0;
+static size_t s_heap_peak = 0;
+
+static deflate_stream_t s_stream;
+
+
+/*-----------------------------------------------------------*/
+static double now_s(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Random walk of DHT12 values in tenths, like "src/sim.c" */
+static void next_sample(int32_t *temp, int32_t *humid)
+{
+    *temp += rand() % 5 - 2;
+    *humid += rand() % 7 - 3;
+    if (*humid < 0) {
+        *humid = 0;
+    }
+    else if (*humid > 1000) {
+        *humid = 1000;
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+static size_t fixed(char *buf, int32_t value)
+{
+    return sprintf(buf, "%s%d.%d", value < 0 ? "-" : "", abs(value) / 10, abs(value) % 10);
+}
+
+
+/*-----------------------------------------------------------*/
+/* ThingSpeak bulk update body, as sent by "src/main.c" */
+static size_t make_bulk_json(char *buf, int count)
+{
+    int32_t temp = 231, humid = 415;
+    size_t len = sprintf(buf, "{\"write_api_key\":\"XXXXXXXXXXXXXXXX\",\"updates\":[");
+
+    for (int i = 0; i < count; i++) {
+        next_sample(&temp, &humid);
+        len += sprintf(buf + len, "%s{\"delta_t\":%d,\"field1\":", i ? "," : "", i ? 60 : 0);
+        len += fixed(buf + len, temp);
+        len += sprintf(buf + len, ",\"field2\":");
+        len += fixed(buf + len, humid);
+        len += sprintf(buf + len, "}");
+    }
+    len += sprintf(buf + len, "]}");
+    return len;
+}
+
+
+/*-----------------------------------------------------------*/
+/* MQTT batch of "src/mqtt_transport.c" */
+static size_t make_mqtt_json(char *buf, int count)
+{
+    int32_t temp = 231, humid = 415;
+    size_t len = sprintf(buf, "[");
+
+    for (int i = 0; i < count; i++) {
+        next_sample(&temp, &humid);
+        len += sprintf(buf + len, "%s{\"field1\":", i ? "," : "");
+        len += fixed(buf + len, temp);
+        len += sprintf(buf + len, ",\"field2\":");
+        len += fixed(buf + len, humid);
+        len += sprintf(buf + len, "}");
+    }
+    len += sprintf(buf + len, "]");
+    return len;
+}
+
+
+/*-----------------------------------------------------------*/
+/* CSV with time stamps, e.g. a logger export */
+static size_t make_csv(char *buf, int count)
+{
+    int32_t temp = 231, humid = 415;
+    size_t len = sprintf(buf, "created_at,field1,field2\n");
+
+    for (int i = 0; i < count; i++) {
+        next_sample(&temp, &humid);
+        len += sprintf(buf + len, "2022-05-17T10:%02d:%02dZ,", (i / 60) % 60, i % 60);
+        len += fixed(buf + len, temp);
+        buf[len++] = ',';
+        len += fixed(buf + len, humid);
+        buf[len++] = '\n';
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+
+/*-----------------------------------------------------------*/
+static esp_err_t bench_write(void *ctx, const uint8_t *data, size_t len)
+{
+    bench_out_t *out = ctx;
+
+    if (out->len + len > out->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(out->buf + out->len, data, len);
+    out->len += len;
+    return ESP_OK;
+}
+
+
+/*-----------------------------------------------------------*/
+static size_t stream_compress(const uint8_t *in, size_t len, uint8_t *buf, size_t size)
+{
+    bench_out_t out = {buf, size, 0};
+
+    deflate_stream_init(&s_stream, DEFLATE_STREAM_GZIP, bench_write, &out);
+    for (size_t i = 0; i < len; i += BENCH_PIECE) {
+        deflate_stream_write(&s_stream, in + i, (len - i < BENCH_PIECE) ? len - i : BENCH_PIECE);
+    }
+    return (deflate_stream_finish(&s_stream) == ESP_OK) ? out.len : 0;
+}
+
+
+/*-----------------------------------------------------------*/
+static void *counting_alloc(void *opaque, unsigned items, unsigned size)
+{
+    size_t *block = malloc(sizeof(size_t) + (size_t)items * size);
+
+    if (block == NULL) {
+        return NULL;
+    }
+    *block = (size_t)items * size;
+    s_heap_now += *block;
+    if (s_heap_now > s_heap_peak) {
+        s_heap_peak = s_heap_now;
+    }
+    return block + 1;
+}
+
+
+/*-----------------------------------------------------------*/
+static void counting_free(void *opaque, void *ptr)
+{
+    size_t *block = (size_t *)ptr - 1;
+
+    s_heap_now -= *block;
+    free(block);
+}
+
+
+/*-----------------------------------------------------------*/
+static size_t zlib_compress(const uint8_t *in, size_t len, uint8_t *buf, size_t size,
+                            int level, int window_bits, int mem_level)
+{
+    z_stream z = {
+        .zalloc = counting_alloc,
+        .zfree = counting_free,
+    };
+    size_t out;
+
+    // +16 selects the gzip wrapper
+    if (deflateInit2(&z, level, Z_DEFLATED, window_bits + 16, mem_level, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return 0;
+    }
+    z.next_in = (uint8_t *)in;
+    z.avail_in = len;
+    z.next_out = buf;
+    z.avail_out = size;
+    out = (deflate(&z, Z_FINISH) == Z_STREAM_END) ? z.total_out : 0;
+    deflateEnd(&z);
+    return out;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Inflate gzip data and compare with the original */
+static int verify(const uint8_t *gz, size_t gz_len, const uint8_t *in, size_t len)
+{
+    static uint8_t check[BENCH_MAX_INPUT];
+    z_stream z = {0};
+    int ok;
+
+    inflateInit2(&z, 15 + 16);
+    z.next_in = (uint8_t *)gz;
+    z.avail_in = gz_len;
+    z.next_out = check;
+    z.avail_out = sizeof(check);
+    ok = inflate(&z, Z_FINISH) == Z_STREAM_END && z.total_out == len && memcmp(check, in, len) == 0;
+    inflateEnd(&z);
+    return ok;
+}
+
+
+/*-----------------------------------------------------------*/
+typedef enum { BENCH_STREAM, BENCH_ZLIB_SMALL, BENCH_ZLIB_1, BENCH_ZLIB_6 } bench_method_t;
+
+static const char *method_names[] = {
+    "deflate_stream", "zlib -6 w9 m1", "zlib -1", "zlib -6",
+};
+
+static void run(const char *name, const uint8_t *in, size_t len, bench_method_t method, int *failed)
+{
+    static uint8_t buf[BENCH_MAX_INPUT + 1024];
+    size_t out = 0;
+    size_t ram = sizeof(deflate_stream_t);
+    long rounds = 0;
+    double start = now_s();
+    double elapsed;
+
+    do {
+        s_heap_peak = 0;
+        switch (method) {
+            case BENCH_STREAM:
+                out = stream_compress(in, len, buf, sizeof(buf));
+                break;
+            case BENCH_ZLIB_SMALL:
+                out = zlib_compress(in, len, buf, sizeof(buf), 6, 9, 1);
+                break;
+            case BENCH_ZLIB_1:
+                out = zlib_compress(in, len, buf, sizeof(buf), 1, 15, 8);
+                break;
+            case BENCH_ZLIB_6:
+                out = zlib_compress(in, len, buf, sizeof(buf), 6, 15, 8);
+                break;
+        }
+        rounds++;
+        elapsed = now_s() - start;
+    } while (elapsed < BENCH_MIN_TIME_S);
+
+    if (method != BENCH_STREAM) {
+        ram = s_heap_peak;
+    }
+    if (out == 0 || !verify(buf, out, in, len)) {
+        printf("%-22s %-15s FAILED\n", name, method_names[method]);
+        (*failed)++;
+        return;
+    }
+    printf("%-22s %-15s %6zu %6zu %6.2f %8.1f %8zu\n", name, method_names[method], len, out,
+           (double)len / out, len * rounds / elapsed / 1e6, ram);
+}
+
+
+/*-----------------------------------------------------------*/
+int main(void)
+{
+    static char in[BENCH_MAX_INPUT];
+    static const int counts[] = {4, 16, 64};
+    struct {
+        const char *name;
+        size_t (*make)(char *buf, int count);
+    } batches[] = {
+        {"bulk json", make_bulk_json},
+        {"mqtt json", make_mqtt_json},
+        {"csv", make_csv},
+    };
+    char name[32];
+    int failed = 0;
+
+    printf("deflate_stream: %d-byte window, %d hash entries, state %zu bytes\n\n",
+           DEFLATE_STREAM_WINDOW, DEFLATE_STREAM_HASH_SIZE, sizeof(deflate_stream_t));
+    printf("%-22s %-15s %6s %6s %6s %8s %8s\n", "batch", "method", "in", "out", "ratio", "MB/s", "RAM");
+
+    for (size_t b = 0; b < sizeof(batches) / sizeof(batches[0]); b++) {
+        for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+            size_t len;
+
+            srand(1);
+            len = batches[b].make(in, counts[c]);
+            snprintf(name, sizeof(name), "%s x%d", batches[b].name, counts[c]);
+            for (int m = BENCH_STREAM; m <= BENCH_ZLIB_6; m++) {
+                run(name, (const uint8_t *)in, len, m, &failed);
+            }
+        }
+    }
+
+    return failed ? 1 : 0;
+}
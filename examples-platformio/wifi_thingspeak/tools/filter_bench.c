@@ -0,0 +1,290 @@
+/*
+  Host benchmark of "src/filters.c" against floating-point references.
+
+  Build and run on Linux:
+
+    cc -O2 -Iinclude tools/filter_bench.c src/filters.c -lm -o filter_bench
+    ./filter_bench
+
+  Runs a simulated DHT12 temperature (tenths of degree: slow drift,
+  +-0.2 °C noise and 1 % single-sample glitches of up to 8 °C) through
+  every fixed-point kernel and through the same filter written with
+  doubles. The table shows the largest and mean difference between
+  the two outputs in sample units (the fixed-point output is an
+  integer, so up to 0.5 is rounding), for the Hampel filter also the
+  samples where only one of them found an outlier, and the time per
+  sample of both. The Hampel row uses the window and threshold of
+  "src/main.c".
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+ */
+
+
+/*-----------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <filters.h>
+
+
+/*-----------------------------------------------------------*/
+#define BENCH_SAMPLES    100000
+#define BENCH_MIN_TIME_S 0.2
+#define BENCH_MAD_SCALE  1.4826
+
+
+/*-----------------------------------------------------------*/
+typedef enum {
+    KERNEL_MAVG,
+    KERNEL_EMA,
+    KERNEL_MEDIAN,
+    KERNEL_HAMPEL,
+} kernel_t;
+
+// One filter of both kinds
+typedef struct {
+    kernel_t kernel;
+    uint8_t size;
+    uint16_t param;             // EMA alpha or Hampel threshold, Q8
+    union {
+        filter_mavg_t mavg;
+        filter_ema_t ema;
+        filter_median_t median;
+        filter_hampel_t hampel;
+    } fixed;
+    double window[FILTER_MAX_WINDOW];
+    uint8_t count;
+    uint8_t head;
+    double ema;
+    bool primed;
+    uint32_t outliers;
+} bench_filter_t;
+
+static int16_t s_signal[BENCH_SAMPLES];
+static int16_t s_fixed[BENCH_SAMPLES];
+static double s_float[BENCH_SAMPLES];
+static volatile double s_sink;
+
+
+/*-----------------------------------------------------------*/
+static double now_s(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+/*-----------------------------------------------------------*/
+static void make_signal(void)
+{
+    double drift = 215.0;
+
+    srand(2022);
+    for (int i = 0; i < BENCH_SAMPLES; i++) {
+        drift += (rand() % 3 - 1) * 0.3;
+        drift = (drift < -400) ? -400 : (drift > 800 ? 800 : drift);
+        s_signal[i] = lround(drift) + rand() % 5 - 2;
+        if (rand() % 100 == 0) {
+            s_signal[i] += (rand() % 2 ? 1 : -1) * (20 + rand() % 60);
+        }
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+static void fixed_init(bench_filter_t *f)
+{
+    switch (f->kernel) {
+        case KERNEL_MAVG:
+            filter_mavg_init(&f->fixed.mavg, f->size);
+            break;
+        case KERNEL_EMA:
+            filter_ema_init(&f->fixed.ema, f->param);
+            break;
+        case KERNEL_MEDIAN:
+            filter_median_init(&f->fixed.median, f->size);
+            break;
+        case KERNEL_HAMPEL:
+            filter_hampel_init(&f->fixed.hampel, f->size, f->param);
+            break;
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+static int16_t fixed_update(bench_filter_t *f, int16_t x)
+{
+    switch (f->kernel) {
+        case KERNEL_MAVG:
+            return filter_mavg_update(&f->fixed.mavg, x);
+        case KERNEL_EMA:
+            return filter_ema_update(&f->fixed.ema, x);
+        case KERNEL_MEDIAN:
+            return filter_median_update(&f->fixed.median, x);
+        default:
+            return filter_hampel_update(&f->fixed.hampel, x);
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+
+/*-----------------------------------------------------------*/
+static double median_of(double *a, uint8_t n)
+{
+    qsort(a, n, sizeof(double), compare_double);
+    return (n % 2 == 1) ? a[n / 2] : (a[n / 2 - 1] + a[n / 2]) / 2;
+}
+
+
+/*-----------------------------------------------------------*/
+static void float_init(bench_filter_t *f)
+{
+    f->count = 0;
+    f->head = 0;
+    f->ema = 0;
+    f->primed = false;
+    f->outliers = 0;
+}
+
+
+/*-----------------------------------------------------------*/
+/* The textbook definitions, no running sums or sorted copies */
+static double float_update(bench_filter_t *f, double x)
+{
+    double sorted[FILTER_MAX_WINDOW];
+    double dev[FILTER_MAX_WINDOW];
+    double median, mad, sum = 0;
+
+    if (f->kernel == KERNEL_EMA) {
+        f->ema = f->primed ? f->ema + f->param / 256.0 * (x - f->ema) : x;
+        f->primed = true;
+        return f->ema;
+    }
+
+    f->window[f->head] = x;
+    f->head = (f->head + 1) % f->size;
+    if (f->count < f->size) {
+        f->count++;
+    }
+    if (f->kernel == KERNEL_MAVG) {
+        for (uint8_t i = 0; i < f->count; i++) {
+            sum += f->window[i];
+        }
+        return sum / f->count;
+    }
+
+    memcpy(sorted, f->window, f->count * sizeof(double));
+    median = median_of(sorted, f->count);
+    if (f->kernel == KERNEL_MEDIAN) {
+        return median;
+    }
+    if (f->count < 3) {
+        return x;
+    }
+    for (uint8_t i = 0; i < f->count; i++) {
+        dev[i] = fabs(f->window[i] - median);
+    }
+    mad = median_of(dev, f->count);
+    mad = (mad < 1) ? 1 : mad;
+    if (fabs(x - median) > f->param / 256.0 * BENCH_MAD_SCALE * mad) {
+        f->outliers++;
+        return median;
+    }
+    return x;
+}
+
+
+/*-----------------------------------------------------------*/
+static void bench(const char *name, kernel_t kernel, uint8_t size, uint16_t param)
+{
+    bench_filter_t f = {
+        .kernel = kernel,
+        .size = size,
+        .param = param,
+    };
+    double max_error = 0, error_sum = 0, error;
+    double start, fixed_s, float_s;
+    unsigned long rounds;
+    long decisions = 0;
+
+    // Accuracy, and for Hampel the samples replaced by only one of them
+    fixed_init(&f);
+    float_init(&f);
+    for (int i = 0; i < BENCH_SAMPLES; i++) {
+        uint32_t fixed_outliers = (kernel == KERNEL_HAMPEL) ? f.fixed.hampel.outliers : 0;
+        uint32_t float_outliers = f.outliers;
+
+        s_fixed[i] = fixed_update(&f, s_signal[i]);
+        s_float[i] = float_update(&f, s_signal[i]);
+        if (kernel == KERNEL_HAMPEL &&
+            (f.fixed.hampel.outliers - fixed_outliers) != (f.outliers - float_outliers)) {
+            decisions++;
+        }
+        error = fabs(s_fixed[i] - s_float[i]);
+        error_sum += error;
+        if (error > max_error) {
+            max_error = error;
+        }
+    }
+
+    // Speed
+    rounds = 0;
+    start = now_s();
+    do {
+        fixed_init(&f);
+        for (int i = 0; i < BENCH_SAMPLES; i++) {
+            s_fixed[i] = fixed_update(&f, s_signal[i]);
+        }
+        rounds++;
+        fixed_s = now_s() - start;
+    } while (fixed_s < BENCH_MIN_TIME_S);
+    fixed_s /= rounds;
+
+    rounds = 0;
+    start = now_s();
+    do {
+        float_init(&f);
+        for (int i = 0; i < BENCH_SAMPLES; i++) {
+            s_sink = float_update(&f, s_signal[i]);
+        }
+        rounds++;
+        float_s = now_s() - start;
+    } while (float_s < BENCH_MIN_TIME_S);
+    float_s /= rounds;
+
+    printf("%-13s %8.2f %8.3f %9ld %9.1f %9.1f\n", name, max_error, error_sum / BENCH_SAMPLES, decisions,
+           fixed_s * 1e9 / BENCH_SAMPLES, float_s * 1e9 / BENCH_SAMPLES);
+}
+
+
+/*-----------------------------------------------------------*/
+int main(void)
+{
+    make_signal();
+    printf("%-13s %8s %8s %9s %9s %9s\n", "kernel", "max err", "avg err", "decisions", "ns/sample", "ns/float");
+    bench("mavg 5", KERNEL_MAVG, 5, 0);
+    bench("mavg 15", KERNEL_MAVG, 15, 0);
+    bench("ema 1/4", KERNEL_EMA, 0, FILTER_Q8(0.25));
+    bench("ema 1/32", KERNEL_EMA, 0, FILTER_Q8(1.0 / 32));
+    bench("median 5", KERNEL_MEDIAN, 5, 0);
+    bench("median 15", KERNEL_MEDIAN, 15, 0);
+    bench("hampel 5 x3", KERNEL_HAMPEL, 5, FILTER_Q8(3));
+    bench("hampel 15 x3", KERNEL_HAMPEL, 15, FILTER_Q8(3));
+
+    return 0;
+}
@@ -0,0 +1,35 @@
+/*
+  Host stand-in of <esp_err.h>, see "esp_host.h".
+ */
+
+#ifndef ESP_HOST_ERR
+#define ESP_HOST_ERR
+
+
+/*-----------------------------------------------------------*/
+#include <stdint.h>
+
+
+/*-----------------------------------------------------------*/
+typedef int esp_err_t;
+
+#define ESP_OK                  0
+#define ESP_FAIL                -1
+#define ESP_ERR_NO_MEM          0x101
+#define ESP_ERR_INVALID_ARG     0x102
+#define ESP_ERR_INVALID_STATE   0x103
+#define ESP_ERR_INVALID_SIZE    0x104
+#define ESP_ERR_NOT_FOUND       0x105
+#define ESP_ERR_NOT_SUPPORTED   0x106
+#define ESP_ERR_TIMEOUT         0x107
+#define ESP_ERR_INVALID_RESPONSE 0x108
+#define ESP_ERR_INVALID_CRC     0x109
+#define ESP_ERR_HTTP_BASE       0x7000
+#define ESP_ERR_HTTP_CONNECT    (ESP_ERR_HTTP_BASE + 2)
+
+
+/*-----------------------------------------------------------*/
+// Used function(s)
+const char *esp_err_to_name(esp_err_t code);
+
+#endif
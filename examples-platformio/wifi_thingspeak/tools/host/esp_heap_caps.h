@@ -0,0 +1,22 @@
+/*
+  Host stand-in of <esp_heap_caps.h>, see "esp_host.h".
+ */
+
+#ifndef ESP_HOST_HEAP_CAPS
+#define ESP_HOST_HEAP_CAPS
+
+
+/*-----------------------------------------------------------*/
+#include <stddef.h>
+#include <stdint.h>
+
+
+/*-----------------------------------------------------------*/
+#define MALLOC_CAP_8BIT (1 << 2)
+
+
+/*-----------------------------------------------------------*/
+// Used function(s)
+size_t heap_caps_get_largest_free_block(uint32_t caps);
+
+#endif
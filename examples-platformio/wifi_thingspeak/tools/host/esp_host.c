@@ -0,0 +1,401 @@
+/*
+  Host (Linux) stand-ins of the ESP-IDF and FreeRTOS functions used by
+  the sampling and upload modules.
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+
+  NOTES:
+    * Built by the host tools only, see "esp_host.h"
+ */
+
+
+/*-----------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_err.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_rom_sys.h>
+#include <esp_system.h>
+#include <esp_heap_caps.h>
+#include <esp_event.h>
+#include <esp_netif.h>
+#include <esp_http_client.h>
+#include <esp_host.h>
+
+
+/*-----------------------------------------------------------*/
+#define HOST_MAX_HANDLERS 8
+#define HOST_HTTP_HEADERS 1024
+
+
+/*-----------------------------------------------------------*/
+struct esp_http_client {
+    esp_http_client_config_t config;
+    int sock;
+    int status;
+    char head[HOST_HTTP_HEADERS];
+    size_t head_len;            // Received, headers and start of the body
+    size_t body_start;
+    size_t body_pos;            // Body bytes of "head" already read
+};
+
+typedef struct {
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_t handler;
+    void *arg;
+} host_handler_t;
+
+esp_event_base_t const IP_EVENT = "IP_EVENT";
+
+static int64_t s_time_us = 0;
+static int s_log_level = ESP_LOG_WARN;
+static uint32_t s_random = 2022;
+static host_handler_t s_handlers[HOST_MAX_HANDLERS];
+static uint8_t s_handler_count = 0;
+
+
+/*-----------------------------------------------------------*/
+void esp_host_advance_us(int64_t us)
+{
+    s_time_us += us;
+}
+
+
+/*-----------------------------------------------------------*/
+void esp_host_set_time_us(int64_t us)
+{
+    s_time_us = us;
+}
+
+
+/*-----------------------------------------------------------*/
+void esp_host_log_level(int level)
+{
+    s_log_level = level;
+}
+
+
+/*-----------------------------------------------------------*/
+int esp_host_log_enabled(int level)
+{
+    return level <= s_log_level;
+}
+
+
+/*-----------------------------------------------------------*/
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code) {
+        case ESP_OK:
+            return "ESP_OK";
+        case ESP_FAIL:
+            return "ESP_FAIL";
+        case ESP_ERR_NO_MEM:
+            return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG:
+            return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE:
+            return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE:
+            return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND:
+            return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED:
+            return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT:
+            return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_INVALID_RESPONSE:
+            return "ESP_ERR_INVALID_RESPONSE";
+        case ESP_ERR_INVALID_CRC:
+            return "ESP_ERR_INVALID_CRC";
+        case ESP_ERR_HTTP_CONNECT:
+            return "ESP_ERR_HTTP_CONNECT";
+        default:
+            return "UNKNOWN ERROR";
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+int64_t esp_timer_get_time(void)
+{
+    return s_time_us;
+}
+
+
+/*-----------------------------------------------------------*/
+void esp_rom_delay_us(uint32_t us)
+{
+    s_time_us += us;
+}
+
+
+/*-----------------------------------------------------------*/
+void vTaskDelay(TickType_t ticks)
+{
+    s_time_us += (int64_t)ticks * portTICK_PERIOD_MS * 1000;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Only the calling task can end, and the host tools never do it */
+void vTaskDelete(TaskHandle_t task)
+{
+    (void)task;
+    exit(0);
+}
+
+
+/*-----------------------------------------------------------*/
+uint32_t esp_get_free_heap_size(void)
+{
+    return 0;
+}
+
+
+/*-----------------------------------------------------------*/
+uint32_t esp_get_minimum_free_heap_size(void)
+{
+    return 0;
+}
+
+
+/*-----------------------------------------------------------*/
+size_t heap_caps_get_largest_free_block(uint32_t caps)
+{
+    (void)caps;
+    return 0;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Xorshift, fixed seed: host runs repeat */
+uint32_t esp_random(void)
+{
+    s_random ^= s_random << 13;
+    s_random ^= s_random >> 17;
+    s_random ^= s_random << 5;
+    return s_random;
+}
+
+
+/*-----------------------------------------------------------*/
+esp_err_t esp_event_loop_create_default(void)
+{
+    return ESP_OK;
+}
+
+
+/*-----------------------------------------------------------*/
+esp_err_t esp_event_handler_register(esp_event_base_t event_base, int32_t event_id,
+                                     esp_event_handler_t event_handler, void *event_handler_arg)
+{
+    // The same handler again replaces its argument, as in ESP-IDF
+    for (uint8_t i = 0; i < s_handler_count; i++) {
+        if (s_handlers[i].base == event_base && s_handlers[i].id == event_id &&
+            s_handlers[i].handler == event_handler) {
+            s_handlers[i].arg = event_handler_arg;
+            return ESP_OK;
+        }
+    }
+    if (s_handler_count == HOST_MAX_HANDLERS) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_handlers[s_handler_count++] = (host_handler_t) {
+        .base = event_base,
+        .id = event_id,
+        .handler = event_handler,
+        .arg = event_handler_arg,
+    };
+    return ESP_OK;
+}
+
+
+/*-----------------------------------------------------------*/
+esp_err_t esp_event_post(esp_event_base_t event_base, int32_t event_id, const void *event_data,
+                         size_t event_data_size, TickType_t ticks_to_wait)
+{
+    (void)event_data_size;
+    (void)ticks_to_wait;
+
+    for (uint8_t i = 0; i < s_handler_count; i++) {
+        if (s_handlers[i].base == event_base &&
+            (s_handlers[i].id == event_id || s_handlers[i].id == ESP_EVENT_ANY_ID)) {
+            s_handlers[i].handler(s_handlers[i].arg, event_base, event_id, (void *)event_data);
+        }
+    }
+    return ESP_OK;
+}
+
+
+/*-----------------------------------------------------------*/
+static int64_t real_time_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+/*-----------------------------------------------------------*/
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *config)
+{
+    esp_http_client_handle_t client = calloc(1, sizeof(struct esp_http_client));
+
+    if (client != NULL) {
+        client->config = *config;
+        client->sock = -1;
+    }
+    return client;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Connect and send the request, GET only. Time spent on the network
+   is added to the virtual clock by the wrappers at the end. */
+static esp_err_t http_open(esp_http_client_handle_t client, int write_len)
+{
+    struct addrinfo hints = {
+        .ai_family = AF_INET,
+        .ai_socktype = SOCK_STREAM,
+    };
+    struct addrinfo *res;
+    struct timeval timeout = {
+        .tv_sec = client->config.timeout_ms / 1000,
+        .tv_usec = client->config.timeout_ms % 1000 * 1000,
+    };
+    char port[8];
+    char request[512];
+    int len;
+
+    (void)write_len;
+    snprintf(port, sizeof(port), "%d", client->config.port ? client->config.port : 80);
+    if (getaddrinfo(client->config.host, port, &hints, &res) != 0) {
+        return ESP_ERR_HTTP_CONNECT;
+    }
+    client->sock = socket(res->ai_family, res->ai_socktype, 0);
+    if (client->sock < 0 || connect(client->sock, res->ai_addr, res->ai_addrlen) != 0) {
+        freeaddrinfo(res);
+        return ESP_ERR_HTTP_CONNECT;
+    }
+    freeaddrinfo(res);
+    setsockopt(client->sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    len = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n",
+                   client->config.path ? client->config.path : "/", client->config.host);
+    if (len < 0 || (size_t)len >= sizeof(request) || send(client->sock, request, len, 0) != len) {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Read up to the end of the headers, return -1 on failure */
+static int64_t http_fetch_headers(esp_http_client_handle_t client)
+{
+    char *end = NULL;
+    ssize_t n;
+
+    while (end == NULL && client->head_len < sizeof(client->head) - 1) {
+        n = recv(client->sock, client->head + client->head_len, sizeof(client->head) - 1 - client->head_len, 0);
+        if (n <= 0) {
+            return -1;
+        }
+        client->head_len += n;
+        client->head[client->head_len] = '\0';
+        end = strstr(client->head, "\r\n\r\n");
+    }
+    if (end == NULL || sscanf(client->head, "HTTP/%*s %d", &client->status) != 1) {
+        return -1;
+    }
+    client->body_start = end + 4 - client->head;
+    client->body_pos = client->body_start;
+    return 0;
+}
+
+
+/*-----------------------------------------------------------*/
+int esp_http_client_get_status_code(esp_http_client_handle_t client)
+{
+    return client->status;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Body bytes received with the headers first, then the socket */
+static int http_read(esp_http_client_handle_t client, char *buffer, int len)
+{
+    int done = 0;
+    ssize_t n;
+
+    if (client->body_pos < client->head_len) {
+        done = client->head_len - client->body_pos;
+        done = (done < len) ? done : len;
+        memcpy(buffer, client->head + client->body_pos, done);
+        client->body_pos += done;
+    }
+    while (done < len) {
+        n = recv(client->sock, buffer + done, len - done, 0);
+        if (n <= 0) {
+            break;
+        }
+        done += n;
+    }
+    return done;
+}
+
+
+/*-----------------------------------------------------------*/
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client)
+{
+    if (client->sock >= 0) {
+        close(client->sock);
+    }
+    free(client);
+    return ESP_OK;
+}
+
+
+/*-----------------------------------------------------------*/
+esp_err_t esp_http_client_open(esp_http_client_handle_t client, int write_len)
+{
+    int64_t start = real_time_us();
+    esp_err_t result = http_open(client, write_len);
+
+    esp_host_advance_us(real_time_us() - start);
+    return result;
+}
+
+/*-----------------------------------------------------------*/
+int64_t esp_http_client_fetch_headers(esp_http_client_handle_t client)
+{
+    int64_t start = real_time_us();
+    int64_t result = http_fetch_headers(client);
+
+    esp_host_advance_us(real_time_us() - start);
+    return result;
+}
+
+/*-----------------------------------------------------------*/
+int esp_http_client_read(esp_http_client_handle_t client, char *buffer, int len)
+{
+    int64_t start = real_time_us();
+    int result = http_read(client, buffer, len);
+
+    esp_host_advance_us(real_time_us() - start);
+    return result;
+}
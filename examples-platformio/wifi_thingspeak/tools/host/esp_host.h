@@ -0,0 +1,33 @@
+/*
+  Host (Linux) stand-ins of the ESP-IDF and FreeRTOS functions used by
+  the sampling and upload modules.
+
+  Only the few calls these modules make are provided. There is one
+  thread: critical sections and mutexes do nothing, vTaskDelay() and
+  esp_rom_delay_us() advance a virtual clock instead of sleeping, and
+  esp_timer_get_time() reads it. Simulated hours run in a fraction of
+  a second, while the real CPU time of the code can still be measured
+  with clock_gettime(). The HTTP client speaks plain HTTP/1.1 over a
+  POSIX socket, one request per connection.
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+ */
+
+#ifndef ESP_HOST
+#define ESP_HOST
+
+
+/*-----------------------------------------------------------*/
+#include <stdint.h>
+
+
+/*-----------------------------------------------------------*/
+// Used function(s)
+void esp_host_advance_us(int64_t us);
+void esp_host_set_time_us(int64_t us);
+void esp_host_log_level(int level);
+int esp_host_log_enabled(int level);
+
+#endif
@@ -0,0 +1,41 @@
+/*
+  Host stand-in of <esp_http_client.h>, see "esp_host.h". Plain HTTP
+  to "host" and "port" of the configuration only.
+ */
+
+#ifndef ESP_HOST_HTTP_CLIENT
+#define ESP_HOST_HTTP_CLIENT
+
+
+/*-----------------------------------------------------------*/
+#include <stdint.h>
+#include <esp_err.h>
+
+
+/*-----------------------------------------------------------*/
+typedef enum {
+    HTTP_METHOD_GET = 0,
+    HTTP_METHOD_POST,
+} esp_http_client_method_t;
+
+typedef struct {
+    const char *host;
+    int port;
+    const char *path;
+    esp_http_client_method_t method;
+    int timeout_ms;
+} esp_http_client_config_t;
+
+typedef struct esp_http_client *esp_http_client_handle_t;
+
+
+/*-----------------------------------------------------------*/
+// Used function(s)
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *config);
+esp_err_t esp_http_client_open(esp_http_client_handle_t client, int write_len);
+int64_t esp_http_client_fetch_headers(esp_http_client_handle_t client);
+int esp_http_client_get_status_code(esp_http_client_handle_t client);
+int esp_http_client_read(esp_http_client_handle_t client, char *buffer, int len);
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client);
+
+#endif
@@ -0,0 +1,38 @@
+/*
+  Host stand-in of <esp_log.h>, see "esp_host.h". Messages go to
+  stderr, so the tables of the host tools on stdout stay readable.
+ */
+
+#ifndef ESP_HOST_LOG
+#define ESP_HOST_LOG
+
+
+/*-----------------------------------------------------------*/
+#include <stdio.h>
+#include <esp_host.h>
+
+
+/*-----------------------------------------------------------*/
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE,
+} esp_log_level_t;
+
+#define ESP_HOST_LOG_AT(level, letter, tag, format, ...) do { \
+        if (esp_host_log_enabled(level)) { \
+            fprintf(stderr, letter " %s: " format "\n", tag, ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+#define ESP_LOGE(tag, format, ...) ESP_HOST_LOG_AT(ESP_LOG_ERROR, "E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) ESP_HOST_LOG_AT(ESP_LOG_WARN, "W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) ESP_HOST_LOG_AT(ESP_LOG_INFO, "I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) ESP_HOST_LOG_AT(ESP_LOG_DEBUG, "D", tag, format, ##__VA_ARGS__)
+
+#define esp_log_level_set(tag, level) esp_host_log_level(level)
+
+#endif
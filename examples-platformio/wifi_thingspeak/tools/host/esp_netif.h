@@ -0,0 +1,43 @@
+/*
+  Host stand-in of <esp_netif.h>, see "esp_host.h".
+ */
+
+#ifndef ESP_HOST_NETIF
+#define ESP_HOST_NETIF
+
+
+/*-----------------------------------------------------------*/
+#include <stdint.h>
+#include <esp_event.h>
+
+
+/*-----------------------------------------------------------*/
+// Address in network byte order, as lwIP keeps it
+#define ESP_IP4TOADDR(a, b, c, d) \
+    ((uint32_t)(a) | (uint32_t)(b) << 8 | (uint32_t)(c) << 16 | (uint32_t)(d) << 24)
+
+typedef enum {
+    IP_EVENT_STA_GOT_IP,
+    IP_EVENT_STA_LOST_IP,
+} ip_event_t;
+
+typedef struct {
+    uint32_t addr;
+} esp_ip4_addr_t;
+
+typedef struct {
+    esp_ip4_addr_t ip;
+    esp_ip4_addr_t netmask;
+    esp_ip4_addr_t gw;
+} esp_netif_ip_info_t;
+
+typedef struct {
+    int if_index;
+    void *esp_netif;
+    esp_netif_ip_info_t ip_info;
+    bool ip_changed;
+} ip_event_got_ip_t;
+
+extern esp_event_base_t const IP_EVENT;
+
+#endif
@@ -0,0 +1,17 @@
+/*
+  Host stand-in of <esp_rom_sys.h>, see "esp_host.h".
+ */
+
+#ifndef ESP_HOST_ROM_SYS
+#define ESP_HOST_ROM_SYS
+
+
+/*-----------------------------------------------------------*/
+#include <stdint.h>
+
+
+/*-----------------------------------------------------------*/
+// Used function(s)
+void esp_rom_delay_us(uint32_t us);
+
+#endif
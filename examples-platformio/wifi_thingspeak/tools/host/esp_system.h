@@ -0,0 +1,21 @@
+/*
+  Host stand-in of <esp_system.h>, see "esp_host.h". The host has no
+  heap of the chip, the statistics are 0.
+ */
+
+#ifndef ESP_HOST_SYSTEM
+#define ESP_HOST_SYSTEM
+
+
+/*-----------------------------------------------------------*/
+#include <stdint.h>
+#include <esp_err.h>
+
+
+/*-----------------------------------------------------------*/
+// Used function(s)
+uint32_t esp_get_free_heap_size(void);
+uint32_t esp_get_minimum_free_heap_size(void);
+uint32_t esp_random(void);
+
+#endif
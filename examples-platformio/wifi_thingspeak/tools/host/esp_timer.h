@@ -0,0 +1,17 @@
+/*
+  Host stand-in of <esp_timer.h>, see "esp_host.h".
+ */
+
+#ifndef ESP_HOST_TIMER
+#define ESP_HOST_TIMER
+
+
+/*-----------------------------------------------------------*/
+#include <stdint.h>
+
+
+/*-----------------------------------------------------------*/
+// Used function(s)
+int64_t esp_timer_get_time(void);
+
+#endif
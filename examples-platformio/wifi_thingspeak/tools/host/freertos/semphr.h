@@ -0,0 +1,35 @@
+/*
+  Host stand-in of <freertos/semphr.h>, see "esp_host.h". With one
+  thread, a mutex is always free.
+ */
+
+#ifndef ESP_HOST_SEMPHR
+#define ESP_HOST_SEMPHR
+
+
+/*-----------------------------------------------------------*/
+#include <freertos/FreeRTOS.h>
+
+
+/*-----------------------------------------------------------*/
+typedef void *SemaphoreHandle_t;
+
+static inline SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return (SemaphoreHandle_t)1;
+}
+
+static inline BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    (void)sem;
+    (void)ticks;
+    return pdTRUE;
+}
+
+static inline BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    (void)sem;
+    return pdTRUE;
+}
+
+#endif
@@ -0,0 +1,23 @@
+/*
+  Host stand-in of <freertos/task.h>, see "esp_host.h". Delays advance
+  the virtual clock, tasks cannot be created.
+ */
+
+#ifndef ESP_HOST_TASK
+#define ESP_HOST_TASK
+
+
+/*-----------------------------------------------------------*/
+#include <freertos/FreeRTOS.h>
+
+
+/*-----------------------------------------------------------*/
+typedef void *TaskHandle_t;
+
+
+/*-----------------------------------------------------------*/
+// Used function(s)
+void vTaskDelay(TickType_t ticks);
+void vTaskDelete(TaskHandle_t task);
+
+#endif
@@ -0,0 +1,173 @@
+#!/usr/bin/env python3
+"""
+Local NTP server standing in for pool.ntp.org in tests.
+
+Usage:
+    python3 tools/ntp_standin.py --port 12300
+    python3 tools/ntp_standin.py --port 12300 --offset 3.5 --drift-ppm 40 --delay-ms 5 --jitter-ms 20
+    python3 tools/ntp_standin.py --selftest
+
+Answers SNTP client requests with the host time, optionally shifted
+by a fixed offset, running fast or slow by "--drift-ppm", and with
+extra (random, asymmetric) delay or dropped answers, so the
+"timekeeper" module can be checked against a known clock: set
+TIME_NTP_SERVER to the address of the host and TIME_NTP_PORT to the
+port. Every answer is logged with the time it carried.
+
+The "--selftest" mode runs the server in a thread and checks that
+its answers carry the configured offset and drift, measured against
+the host clock within the error of the local round trips. The
+offset and drift arithmetic of the firmware is tested by
+"tools/clock_bench.c".
+
+Copyright (c) 2022 Tomas Fryza
+Dept. of Radio Electronics, Brno University of Technology, Czechia
+This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+"""
+
+import argparse
+import random
+import socket
+import struct
+import sys
+import threading
+import time
+
+NTP_UNIX_OFFSET = 2208988800
+PACKET = struct.Struct("!BBbb II 4s QQQQ")  # RFC 4330 header
+
+
+def to_ntp(t):
+    seconds = int(t)
+    return ((seconds + NTP_UNIX_OFFSET) << 32) | int((t - seconds) * (1 << 32))
+
+
+def from_ntp(value):
+    return (value >> 32) - NTP_UNIX_OFFSET + (value & 0xffffffff) / (1 << 32)
+
+
+class StandIn:
+    """NTP server with a configurable clock"""
+
+    def __init__(self, port, offset=0.0, drift_ppm=0.0, delay_ms=0.0, jitter_ms=0.0, drop_permille=0,
+                 seed=1, verbose=True):
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        self.sock.bind(("0.0.0.0", port))
+        self.port = self.sock.getsockname()[1]
+        self.offset = offset
+        self.drift = drift_ppm * 1e-6
+        self.delay = delay_ms / 1000
+        self.jitter = jitter_ms / 1000
+        self.drop = drop_permille
+        self.rng = random.Random(seed)
+        self.verbose = verbose
+        self.start = time.time()
+        self.answers = 0
+
+    def now(self):
+        """Server clock: host time with offset and drift"""
+        t = time.time()
+        return t + self.offset + (t - self.start) * self.drift
+
+    def serve(self, count=None):
+        while count is None or self.answers < count:
+            data, addr = self.sock.recvfrom(512)
+            if len(data) < PACKET.size or data[0] & 0x07 != 3:
+                continue
+            if self.rng.randrange(1000) < self.drop:
+                continue
+            # Delay on the way in only, the path is asymmetric
+            time.sleep(self.delay + self.rng.random() * self.jitter)
+            receive = self.now()
+            version = (data[0] >> 3) & 0x07
+            originate = struct.unpack_from("!Q", data, 40)[0]
+            transmit = self.now()
+            answer = PACKET.pack((version << 3) | 4, 1, 6, -20, 0, 0, b"LOCL",
+                                 to_ntp(transmit), originate, to_ntp(receive), to_ntp(transmit))
+            self.sock.sendto(answer, addr)
+            self.answers += 1
+            if self.verbose:
+                print("%s:%d %s.%06d UTC" % (addr[0], addr[1],
+                      time.strftime("%Y-%m-%dT%H:%M:%S", time.gmtime(transmit)), int(transmit % 1 * 1e6)),
+                      file=sys.stderr)
+
+
+def query(addr, local):
+    """One SNTP exchange, times from "local", return offset, round trip and midpoint"""
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.settimeout(1.0)
+    t1 = local()
+    request = bytearray(PACKET.size)
+    request[0] = (4 << 3) | 3
+    struct.pack_into("!Q", request, 40, to_ntp(t1))
+    sock.sendto(request, addr)
+    try:
+        answer = sock.recv(512)
+    except socket.timeout:
+        return None
+    t4 = local()
+    sock.close()
+    fields = PACKET.unpack(answer[:PACKET.size])
+    if fields[8] != to_ntp(t1):
+        return None
+    t2, t3 = from_ntp(fields[9]), from_ntp(fields[10])
+    return ((t2 - t1) + (t3 - t4)) / 2, max(0.0, (t4 - t1) - (t3 - t2)), (t1 + t4) / 2
+
+
+def sync(addr, local, samples=4):
+    results = [r for r in (query(addr, local) for _ in range(samples)) if r is not None]
+    return min(results, key=lambda r: r[1]) if results else None
+
+
+def selftest(offset=2.5, drift_ppm=10000.0):
+    """Server clock against host time: offset now and its change over a second"""
+    server = StandIn(0, offset=offset, drift_ppm=drift_ppm, verbose=False)
+    threading.Thread(target=server.serve, daemon=True).start()
+    addr = ("127.0.0.1", server.port)
+
+    first = sync(addr, time.time)
+    time.sleep(1.0)
+    second = sync(addr, time.time)
+    if first is None or second is None:
+        print("selftest: no answer", file=sys.stderr)
+        return False
+
+    # Both bounds are the round trips plus 100 us of Python timing;
+    # the drift is large, so a wrong sign or scale cannot pass
+    expected = offset + (second[2] - server.start) * server.drift
+    offset_bound = second[1] / 2 + 0.0001
+    span = second[2] - first[2]
+    drift = (second[0] - first[0]) / span * 1e6
+    drift_bound = ((first[1] + second[1]) / 2 + 0.0001) / span * 1e6
+    ok = abs(second[0] - expected) <= offset_bound and abs(drift - drift_ppm) <= drift_bound
+    print("selftest: offset %.6f s (expected %.6f +- %.6f), drift %.0f ppm (expected %.0f +- %.0f): %s" % (
+        second[0], expected, offset_bound, drift, drift_ppm, drift_bound, "OK" if ok else "MISMATCH"),
+        file=sys.stderr)
+    return ok
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("-p", "--port", type=int, default=12300, help="UDP port, 123 needs root")
+    parser.add_argument("--offset", type=float, default=0.0, help="seconds added to host time")
+    parser.add_argument("--drift-ppm", type=float, default=0.0, help="server clock runs fast (+) or slow (-)")
+    parser.add_argument("--delay-ms", type=float, default=0.0, help="delay before every answer")
+    parser.add_argument("--jitter-ms", type=float, default=0.0, help="random extra delay")
+    parser.add_argument("--drop", type=int, default=0, help="unanswered requests per mille")
+    parser.add_argument("--selftest", action="store_true", help="check the clock of the server")
+    args = parser.parse_args()
+
+    if args.selftest:
+        sys.exit(0 if selftest() else 1)
+
+    server = StandIn(args.port, args.offset, args.drift_ppm, args.delay_ms, args.jitter_ms, args.drop)
+    print("NTP stand-in on UDP port %d" % server.port, file=sys.stderr)
+    try:
+        server.serve()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,203 @@
+/*
+  Host benchmark of "src/payload.c" against snprintf().
+
+  Build and run on Linux:
+
+    cc -O2 -Iinclude tools/payload_bench.c src/payload.c -o payload_bench
+    ./payload_bench
+
+  Encodes the same random DHT12 samples (temperature -40.0..80.0 °C,
+  humidity 0.0..100.0 %, in tenths) as the ThingSpeak request of
+  "src/main.c" with snprintf() and integer arguments (as the former
+  firmware), with snprintf() and float arguments, and with a
+  prepared payload template; JSON and CBOR are encoded by the
+  template only. The table shows payload bytes, outputs different
+  from the snprintf() reference and time per payload. Before the
+  table, an API key too long for the buffer shows how each of them
+  fails: snprintf() cuts the request, payload_encode() returns 0.
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+ */
+
+
+/*-----------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <payload.h>
+
+
+/*-----------------------------------------------------------*/
+#define BENCH_SAMPLES    4096
+#define BENCH_MIN_TIME_S 0.2
+#define BENCH_LINK_SIZE  128        // UPLOAD_LINK_SIZE of "src/main.c"
+#define BENCH_API_KEY    "XXXXXXXXXXXXXXXX"
+
+
+/*-----------------------------------------------------------*/
+typedef size_t (*bench_encode_t)(int32_t temp, int32_t humid, char *buf, size_t size);
+
+static const payload_field_t fields[] = {
+    {"field1", 1},
+    {"field2", 1},
+};
+
+static payload_template_t s_url;
+static payload_template_t s_json;
+static payload_template_t s_cbor;
+static int32_t s_values[BENCH_SAMPLES][2];
+static char s_reference[BENCH_SAMPLES][BENCH_LINK_SIZE];
+static volatile size_t s_sink;
+
+
+/*-----------------------------------------------------------*/
+static double now_s(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+/*-----------------------------------------------------------*/
+static size_t snprintf_size(int n, size_t size)
+{
+    // Cut or failed output is no payload
+    return (n < 0 || (size_t)n >= size) ? 0 : (size_t)n;
+}
+
+
+/*-----------------------------------------------------------*/
+static size_t url_snprintf(int32_t temp, int32_t humid, char *buf, size_t size)
+{
+    return snprintf_size(snprintf(buf, size, "/update?api_key=%s&field1=%s%d.%d&field2=%s%d.%d", BENCH_API_KEY,
+                                  temp < 0 ? "-" : "", abs(temp) / 10, abs(temp) % 10,
+                                  humid < 0 ? "-" : "", abs(humid) / 10, abs(humid) % 10), size);
+}
+
+
+/*-----------------------------------------------------------*/
+static size_t url_snprintf_float(int32_t temp, int32_t humid, char *buf, size_t size)
+{
+    return snprintf_size(snprintf(buf, size, "/update?api_key=%s&field1=%.1f&field2=%.1f", BENCH_API_KEY,
+                                  temp / 10.0f, humid / 10.0f), size);
+}
+
+
+/*-----------------------------------------------------------*/
+static size_t url_payload(int32_t temp, int32_t humid, char *buf, size_t size)
+{
+    int32_t values[2] = {temp, humid};
+
+    return payload_encode(&s_url, values, (uint8_t *)buf, size);
+}
+
+
+/*-----------------------------------------------------------*/
+static size_t json_snprintf(int32_t temp, int32_t humid, char *buf, size_t size)
+{
+    return snprintf_size(snprintf(buf, size, "{\"api_key\":\"%s\",\"field1\":%s%d.%d,\"field2\":%s%d.%d}",
+                                  BENCH_API_KEY, temp < 0 ? "-" : "", abs(temp) / 10, abs(temp) % 10,
+                                  humid < 0 ? "-" : "", abs(humid) / 10, abs(humid) % 10), size);
+}
+
+
+/*-----------------------------------------------------------*/
+static size_t json_payload(int32_t temp, int32_t humid, char *buf, size_t size)
+{
+    int32_t values[2] = {temp, humid};
+
+    return payload_encode(&s_json, values, (uint8_t *)buf, size);
+}
+
+
+/*-----------------------------------------------------------*/
+static size_t cbor_payload(int32_t temp, int32_t humid, char *buf, size_t size)
+{
+    int32_t values[2] = {temp, humid};
+
+    return payload_encode(&s_cbor, values, (uint8_t *)buf, size);
+}
+
+
+/*-----------------------------------------------------------*/
+/* "reference" NULL: outputs are not compared */
+static void bench(const char *name, bench_encode_t encode, bench_encode_t reference)
+{
+    char buf[BENCH_LINK_SIZE];
+    size_t bytes = 0;
+    size_t len;
+    unsigned mismatches = 0;
+    unsigned long rounds = 0;
+    double start, elapsed;
+
+    for (int i = 0; i < BENCH_SAMPLES; i++) {
+        len = encode(s_values[i][0], s_values[i][1], buf, sizeof(buf));
+        bytes += len;
+        if (reference != NULL) {
+            reference(s_values[i][0], s_values[i][1], s_reference[i], BENCH_LINK_SIZE);
+            if (len == 0 || strcmp(buf, s_reference[i]) != 0) {
+                mismatches++;
+            }
+        }
+    }
+
+    start = now_s();
+    do {
+        for (int i = 0; i < BENCH_SAMPLES; i++) {
+            s_sink += encode(s_values[i][0], s_values[i][1], buf, sizeof(buf));
+        }
+        rounds++;
+        elapsed = now_s() - start;
+    } while (elapsed < BENCH_MIN_TIME_S);
+
+    printf("%-18s %9.1f %10u %10.1f\n", name, (double)bytes / BENCH_SAMPLES, mismatches,
+           elapsed * 1e9 / (rounds * BENCH_SAMPLES));
+}
+
+
+/*-----------------------------------------------------------*/
+static void long_key(void)
+{
+    char prefix[BENCH_LINK_SIZE + 64] = "/update?api_key=";
+    char buf[BENCH_LINK_SIZE];
+    int32_t values[2] = {-123, 456};
+    payload_template_t tpl;
+    int n;
+
+    // Key of 120 characters, the request needs about 160 bytes
+    memset(prefix + strlen(prefix), 'K', 120);
+    n = snprintf(buf, sizeof(buf), "%s&field1=-12.3&field2=45.6", prefix);
+    payload_template_init(&tpl, PAYLOAD_URL_QUERY, prefix, fields, 2);
+    printf("long key: snprintf needs %d of %zu bytes and sends \"...%s\", payload_encode returns %zu\n\n",
+           n, sizeof(buf), buf + strlen(buf) - 12, payload_encode(&tpl, values, (uint8_t *)buf, sizeof(buf)));
+}
+
+
+/*-----------------------------------------------------------*/
+int main(void)
+{
+    srand(2022);
+    for (int i = 0; i < BENCH_SAMPLES; i++) {
+        s_values[i][0] = rand() % 1201 - 400;
+        s_values[i][1] = rand() % 1001;
+    }
+    payload_template_init(&s_url, PAYLOAD_URL_QUERY, "/update?api_key=" BENCH_API_KEY, fields, 2);
+    payload_template_init(&s_json, PAYLOAD_JSON, "\"api_key\":\"" BENCH_API_KEY "\"", fields, 2);
+    payload_template_init(&s_cbor, PAYLOAD_CBOR, NULL, fields, 2);
+
+    long_key();
+    printf("%-18s %9s %10s %10s\n", "encoder", "bytes", "mismatches", "ns/payload");
+    bench("url snprintf", url_snprintf, NULL);
+    bench("url snprintf %.1f", url_snprintf_float, url_snprintf);
+    bench("url payload", url_payload, url_snprintf);
+    bench("json snprintf", json_snprintf, NULL);
+    bench("json payload", json_payload, json_snprintf);
+    bench("cbor payload", cbor_payload, NULL);
+
+    return 0;
+}
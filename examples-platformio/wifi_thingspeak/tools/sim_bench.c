@@ -0,0 +1,338 @@
+/*
+  Host build of the simulated sampling, encoding and upload path.
+
+  Build and run on Linux:
+
+    cc -O2 -Iinclude -Itools/host tools/sim_bench.c tools/host/esp_host.c src/sim.c src/payload.c src/filters.c src/aggregate.c src/sample_rate.c src/arena.c src/trace.c -lm -o sim_bench
+    ./sim_bench
+    ./sim_bench 127.0.0.1 8080     # Uploads to a stand-in HTTP server
+
+  Runs the modules of "src/main.c" with SIMULATION set: "src/sim.c"
+  is the DHT12, the Wi-Fi connection and the HTTP server, the
+  FreeRTOS and ESP-IDF calls are the stand-ins of "tools/host". The
+  loop does per sample what dht_sensor_task() and thingspeak_upload()
+  do: read and check the sensor, pick the next period, reject
+  outliers, report by exception, encode the request into the upload
+  arena and send it. Delays advance a virtual clock, one simulated
+  hour takes well under a second.
+
+  Every scenario runs one simulated hour with the SIM_* settings of
+  "include/my_data.h", some with more faults. Uploads block the loop
+  (the firmware has an upload task), so their latency costs samples.
+  The table shows the samples, failed sensor reads, reported samples,
+  uploads, failed uploads, average upload latency and the host CPU
+  time per sample. The run fails (exit code 1) if a request does not
+  decode to the sample it was made from, a reported sample is not
+  uploaded, a run does not repeat with the same seed, or the share of
+  failed reads is more than 1 % off the configured fault rates. With
+  a stand-in server, one simulated minute is run against it and any
+  HTTP status other than 200 is a failed upload.
+
+  Copyright (c) 2022 Tomas Fryza
+  Dept. of Radio Electronics, Brno University of Technology, Czechia
+  This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+ */
+
+
+/*-----------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/task.h>
+#include <esp_netif.h>
+#include <my_data.h>
+#include <payload.h>
+#include <dht12.h>
+#include <aggregate.h>
+#include <filters.h>
+#include <sample_rate.h>
+#include <arena.h>
+#include <trace.h>
+#include <sim.h>
+
+
+/*-----------------------------------------------------------*/
+#define BENCH_HOUR_MS    (60 * 60 * 1000)
+#define BENCH_STANDIN_MS (60 * 1000)   // Real requests are not virtual
+
+// Settings of "src/main.c"
+#define UPLOAD_LINK_SIZE 128
+#define UPLOAD_RESPONSE_SIZE 32
+#define UPLOAD_ARENA_SIZE 512
+#define REPORT_TEMP_DEADBAND 3
+#define REPORT_HUMID_DEADBAND 10
+#define REPORT_HEARTBEAT_MS (15 * 60 * 1000)
+#define FILTER_WINDOW 5
+#define FILTER_THRESHOLD FILTER_Q8(3)
+#define SAMPLE_HOLD 4
+#define SAMPLE_ACTIVE_MW 130
+
+
+/*-----------------------------------------------------------*/
+typedef struct {
+    sim_bench_t sim;
+    uint32_t reported;
+    uint32_t decode_errors;     // Requests not matching their sample
+    uint32_t got_ip;
+    double cpu_s;
+} bench_result_t;
+
+static const payload_field_t thingspeak_fields[] = {
+    {"field1", 1},
+    {"field2", 1},
+};
+static const sample_rate_channel_t sample_limits[] = {
+    {1, 3, 2},
+    {5, 20, 10},
+};
+
+static payload_template_t s_template;
+static char s_prefix[80];
+static uint8_t s_arena_buffer[UPLOAD_ARENA_SIZE];
+static arena_t s_arena;
+static uint32_t s_got_ip;
+static int s_failed = 0;
+
+
+/*-----------------------------------------------------------*/
+static double now_s(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+/*-----------------------------------------------------------*/
+static void got_ip_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+    s_got_ip++;
+}
+
+
+/*-----------------------------------------------------------*/
+/* Value of "name" in the query string, in tenths */
+static int32_t query_value(const char *link, const char *name)
+{
+    const char *p = strstr(link, name);
+
+    if (p == NULL || p[strlen(name)] != '=') {
+        return INT32_MIN;
+    }
+    return (int32_t)lround(strtod(p + strlen(name) + 1, NULL) * 10);
+}
+
+
+/*-----------------------------------------------------------*/
+/* thingspeak_upload() of the SIMULATION build */
+static void upload(uint32_t trace_id, const int32_t *values, bench_result_t *r)
+{
+    char *link = arena_calloc(&s_arena, 1, UPLOAD_LINK_SIZE);
+    char *response;
+    int status = 0;
+    int64_t start;
+    esp_err_t err;
+
+    if (link == NULL ||
+        payload_encode(&s_template, values, (uint8_t *)link, UPLOAD_LINK_SIZE) == 0) {
+        r->decode_errors++;
+        trace_abort(trace_id);
+        return;
+    }
+    if (query_value(link, "field1") != values[0] || query_value(link, "field2") != values[1] ||
+        strncmp(link, s_prefix, strlen(s_prefix)) != 0) {
+        r->decode_errors++;
+    }
+    trace_mark(trace_id, TRACE_ENCODED);
+
+    response = arena_alloc(&s_arena, UPLOAD_RESPONSE_SIZE);
+    start = esp_timer_get_time();
+    err = sim_http_get(link, response, UPLOAD_RESPONSE_SIZE, &status);
+    sim_bench_upload(esp_timer_get_time() - start, err == ESP_OK && status == 200);
+    trace_mark(trace_id, TRACE_ACKED);
+    trace_finish(trace_id, err == ESP_OK && status == 200);
+    arena_reset(&s_arena);
+}
+
+
+/*-----------------------------------------------------------*/
+/* "duration_ms" of dht_sensor_task() in simulated time */
+static void run(const sim_config_t *config, uint32_t duration_ms, bench_result_t *r)
+{
+    struct DHT12_values_structure dht;
+    aggregate_config_t aggregate_config = {
+        .temp_deadband = REPORT_TEMP_DEADBAND,
+        .humid_deadband = REPORT_HUMID_DEADBAND,
+        .heartbeat_ms = REPORT_HEARTBEAT_MS,
+    };
+    sample_rate_config_t sample_config = {
+        .min_period_ms = SIM_SAMPLE_PERIOD_MS,
+        .max_period_ms = SIM_SAMPLE_PERIOD_MS,
+        .hold = SAMPLE_HOLD,
+        .active_mw = SAMPLE_ACTIVE_MW,
+        .channels = sizeof(sample_limits) / sizeof(sample_limits[0]),
+        .channel = sample_limits,
+    };
+    filter_hampel_t temp_filter, humid_filter;
+    sample_rate_t sample_rate;
+    double start;
+
+    memset(r, 0, sizeof(*r));
+    esp_host_set_time_us(0);
+    s_got_ip = 0;
+    sim_init(config);
+    aggregate_init(&aggregate_config);
+    trace_init();
+    filter_hampel_init(&temp_filter, FILTER_WINDOW, FILTER_THRESHOLD);
+    filter_hampel_init(&humid_filter, FILTER_WINDOW, FILTER_THRESHOLD);
+    sample_rate_init(&sample_rate, &sample_config);
+    arena_init(&s_arena, s_arena_buffer, sizeof(s_arena_buffer));
+    if (sim_wifi_start(got_ip_handler) != ESP_OK) {
+        return;
+    }
+    r->got_ip = s_got_ip;
+
+    start = now_s();
+    while (esp_timer_get_time() < (int64_t)duration_ms * 1000) {
+        uint32_t trace_id = trace_begin();
+        int64_t read_start = esp_timer_get_time();
+        esp_err_t err = sim_dht12_read(&dht);
+        int64_t read_end = esp_timer_get_time();
+        uint32_t period_ms;
+
+        if (err == ESP_OK && !dht12_checksum_ok(&dht)) {
+            err = ESP_ERR_INVALID_CRC;
+        }
+        trace_mark(trace_id, TRACE_READ);
+        sim_bench_sample(err == ESP_OK);
+        if (err != ESP_OK) {
+            trace_abort(trace_id);
+            vTaskDelay(sample_rate.period_ms / portTICK_PERIOD_MS);
+            continue;
+        }
+
+        int32_t values[2] = {
+            dht12_temp_x10(&dht),
+            dht12_humid_x10(&dht),
+        };
+        period_ms = sample_rate_update(&sample_rate, values, 0x3, read_end / 1000);
+        dht12_set_x10(&dht,
+                      filter_hampel_update(&temp_filter, dht12_temp_x10(&dht)),
+                      filter_hampel_update(&humid_filter, dht12_humid_x10(&dht)));
+
+        if (aggregate_add(&dht, esp_timer_get_time() / 1000)) {
+            int32_t reported[2] = {
+                dht12_temp_x10(&dht),
+                dht12_humid_x10(&dht),
+            };
+
+            r->reported++;
+            trace_mark(trace_id, TRACE_QUEUED);
+            upload(trace_id, reported, r);
+        }
+        else {
+            trace_abort(trace_id);
+        }
+        sample_rate_account(&sample_rate, read_end - read_start, esp_timer_get_time() - read_end);
+        vTaskDelay(period_ms / portTICK_PERIOD_MS);
+    }
+    r->cpu_s = now_s() - start;
+    sim_bench_get(&r->sim, false);
+}
+
+
+/*-----------------------------------------------------------*/
+static void bench(const char *name, const sim_config_t *config)
+{
+    uint32_t duration_ms = config->fake_wifi ? BENCH_HOUR_MS : BENCH_STANDIN_MS;
+    bench_result_t r, again;
+    double expected_errors, errors;
+    int checks = 0;
+
+    run(config, duration_ms, &r);
+    run(config, duration_ms, &again);
+    if (again.cpu_s < r.cpu_s) {
+        r.cpu_s = again.cpu_s;
+    }
+
+    // Every read fault is found: a timeout, or a flipped bit that the
+    // checksum cannot miss
+    expected_errors = config->dht_timeout_permille / 1000.0 +
+                      (1 - config->dht_timeout_permille / 1000.0) * config->dht_checksum_permille / 1000.0;
+    errors = r.sim.samples ? (double)r.sim.sensor_errors / r.sim.samples : 0;
+    checks += r.got_ip != 1;
+    checks += r.decode_errors != 0;
+    checks += r.reported != r.sim.uploads;
+    if (config->fake_wifi) {
+        checks += memcmp(&r.sim, &again.sim, sizeof(r.sim)) != 0 || r.reported != again.reported;
+    }
+    checks += r.sim.samples == 0 || errors < expected_errors - 0.01 || errors > expected_errors + 0.01;
+
+    printf("%-16s %7u %7u %8u %7u %6u %6u %6u %9.1f\n", name, (unsigned)r.sim.samples,
+           (unsigned)r.sim.sensor_errors, (unsigned)r.reported, (unsigned)r.sim.uploads,
+           (unsigned)r.sim.upload_errors,
+           (unsigned)(r.sim.uploads ? r.sim.latency_sum_us / r.sim.uploads / 1000 : 0),
+           (unsigned)checks, r.sim.samples ? r.cpu_s * 1e9 / r.sim.samples : 0.0);
+    if (checks != 0) {
+        s_failed++;
+    }
+}
+
+
+/*-----------------------------------------------------------*/
+int main(int argc, char *argv[])
+{
+    sim_config_t config = {
+        .seed = SIM_SEED,
+        .dht_latency_ms = SIM_DHT12_LATENCY_MS,
+        .dht_timeout_permille = SIM_DHT12_TIMEOUT_PERMILLE,
+        .dht_checksum_permille = SIM_DHT12_CHECKSUM_PERMILLE,
+        .fake_wifi = true,
+        .http_host = SIM_HTTP_HOST,
+        .http_port = SIM_HTTP_PORT,
+        .http_latency_ms = SIM_HTTP_LATENCY_MS,
+        .http_error_permille = SIM_HTTP_ERROR_PERMILLE,
+    };
+
+    strcpy(s_prefix, "/update?api_key=");
+    strncat(s_prefix, THINGSPEAK_WRITE_API_KEY, sizeof(s_prefix) - strlen(s_prefix) - 1);
+    payload_template_init(&s_template, PAYLOAD_URL_QUERY, s_prefix, thingspeak_fields, 2);
+
+    if (argc == 3) {
+        // Real uploads: every request waits for the server
+        config.fake_wifi = false;
+        config.http_host = argv[1];
+        config.http_port = atoi(argv[2]);
+    }
+
+    printf("%-16s %7s %7s %8s %7s %6s %6s %6s %9s\n", "scenario", "samples", "errors", "reported",
+           "uploads", "failed", "lat_ms", "checks", "ns/sample");
+    bench("my_data.h", &config);
+    if (config.fake_wifi) {
+        config.seed = 7;
+        bench("seed 7", &config);
+        config.seed = SIM_SEED;
+        config.dht_timeout_permille = 100;
+        config.dht_checksum_permille = 100;
+        bench("sensor 10+10 %", &config);
+        config.dht_timeout_permille = SIM_DHT12_TIMEOUT_PERMILLE;
+        config.dht_checksum_permille = SIM_DHT12_CHECKSUM_PERMILLE;
+        config.http_error_permille = 300;
+        bench("uploads 30 %", &config);
+        config.http_error_permille = SIM_HTTP_ERROR_PERMILLE;
+        config.http_latency_ms = 0;
+        config.dht_latency_ms = 0;
+        bench("no latency", &config);
+    }
+
+    if (s_failed != 0) {
+        printf("\n%d scenario(s) FAILED\n", s_failed);
+        return 1;
+    }
+    return 0;
+}
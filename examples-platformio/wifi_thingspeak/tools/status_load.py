@@ -0,0 +1,233 @@
+#!/usr/bin/env python3
+"""
+Load test of the device HTTP endpoints /latest and /metrics.
+
+Usage:
+    python3 tools/status_load.py 192.168.1.42
+    python3 tools/status_load.py 192.168.1.42 --clients 20 --rate 1 --duration 60 --etag
+    python3 tools/status_load.py --selftest
+
+Every client keeps one HTTP/1.1 connection open and polls the paths
+in turn at "--rate" requests per second, like a dashboard polling
+many devices; with "--etag" it sends "If-None-Match" with the last
+ETag. A connection closed by the device (more clients than
+STATUS_SERVER_MAX_CLIENTS) is opened again and counted. At the end
+the script prints requests per second, answers by status, reconnects
+and latency percentiles per path. Runs on any Linux host with Python 3.
+
+The "--selftest" mode starts a local stand-in with the same rules as
+"src/status_server.c" (body rendered only after a change, ETag, 304)
+and checks the harness against it.
+
+Copyright (c) 2022 Tomas Fryza
+Dept. of Radio Electronics, Brno University of Technology, Czechia
+This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+"""
+
+import argparse
+import collections
+import http.client
+import http.server
+import random
+import sys
+import threading
+import time
+
+
+class Client(threading.Thread):
+    """One poller with a kept connection"""
+
+    def __init__(self, host, port, paths, rate, duration, etag, timeout):
+        super().__init__(daemon=True)
+        self.host = host
+        self.port = port
+        self.paths = paths
+        self.period = 1.0 / rate if rate > 0 else 0.0
+        self.duration = duration
+        self.use_etag = etag
+        self.timeout = timeout
+        self.etags = {}
+        self.latency = collections.defaultdict(list)
+        self.status = collections.Counter()
+        self.reconnects = 0
+        self.errors = 0
+
+    def run(self):
+        conn = None
+        end = time.monotonic() + self.duration
+        next_time = time.monotonic()
+        i = 0
+        while time.monotonic() < end:
+            path = self.paths[i % len(self.paths)]
+            i += 1
+            headers = {}
+            if self.use_etag and path in self.etags:
+                headers["If-None-Match"] = self.etags[path]
+            for attempt in range(2):
+                if conn is None:
+                    conn = http.client.HTTPConnection(self.host, self.port, timeout=self.timeout)
+                start = time.monotonic()
+                try:
+                    conn.request("GET", path, headers=headers)
+                    response = conn.getresponse()
+                    response.read()
+                except (OSError, http.client.HTTPException):
+                    # Kept connection closed by the server, try a new one
+                    conn.close()
+                    conn = None
+                    if attempt == 0:
+                        self.reconnects += 1
+                        continue
+                    self.errors += 1
+                    break
+                self.latency[path].append(time.monotonic() - start)
+                self.status[response.status] += 1
+                if response.getheader("ETag"):
+                    self.etags[path] = response.getheader("ETag")
+                if response.getheader("Connection", "").lower() == "close":
+                    conn.close()
+                    conn = None
+                break
+            next_time += self.period
+            time.sleep(max(0.0, next_time - time.monotonic()))
+        if conn is not None:
+            conn.close()
+
+
+def percentile(values, p):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100))] if values else 0.0
+
+
+def load(host, port, paths, clients, rate, duration, etag, timeout=5.0):
+    threads = [Client(host, port, paths, rate, duration, etag, timeout) for _ in range(clients)]
+    start = time.monotonic()
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    elapsed = time.monotonic() - start
+
+    status = sum((t.status for t in threads), collections.Counter())
+    requests = sum(status.values())
+    result = {
+        "requests": requests,
+        "per_second": requests / elapsed,
+        "status": dict(status),
+        "reconnects": sum(t.reconnects for t in threads),
+        "errors": sum(t.errors for t in threads),
+        "latency": {},
+    }
+    print("%d clients, %d requests in %.1f s (%.1f/s), status %s, %d reconnects, %d errors" % (
+        clients, requests, elapsed, result["per_second"],
+        ", ".join("%d: %d" % kv for kv in sorted(status.items())), result["reconnects"], result["errors"]))
+    for path in paths:
+        values = [v for t in threads for v in t.latency[path]]
+        result["latency"][path] = [percentile(values, p) for p in (50, 95, 99, 100)]
+        print("  %-10s p50 %6.1f ms, p95 %6.1f ms, p99 %6.1f ms, max %6.1f ms" % (
+            (path,) + tuple(v * 1000 for v in result["latency"][path])))
+    return result
+
+
+class StandInHandler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def do_GET(self):
+        server = self.server
+        with server.lock:
+            if self.path not in server.data:
+                self.send_error(404)
+                return
+            version, values = server.data[self.path]
+            body, rendered = server.bodies.get(self.path, (None, None))
+            if rendered != version:
+                # Rendered again only after a change
+                body = server.render(self.path, values)
+                server.bodies[self.path] = (body, version)
+                server.renders += 1
+        etag = '"%08x-%08x"' % (server.boot_id, version)
+        if self.headers.get("If-None-Match") == etag:
+            self.send_response(304)
+            self.send_header("ETag", etag)
+            self.send_header("Content-Length", "0")
+            self.end_headers()
+            return
+        self.send_response(200)
+        self.send_header("ETag", etag)
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def log_message(self, format, *args):
+        pass
+
+
+class StandIn(http.server.ThreadingHTTPServer):
+    """Endpoints of the device with a changing reading"""
+
+    def __init__(self):
+        super().__init__(("127.0.0.1", 0), StandInHandler)
+        self.lock = threading.Lock()
+        self.data = {"/latest": (1, (215, 402)), "/metrics": (1, (0,))}
+        self.bodies = {}
+        self.renders = 0
+        # Random per start as esp_random() on the device
+        self.boot_id = random.getrandbits(32)
+
+    def render(self, path, values):
+        if path == "/latest":
+            return b'{"temperature":%.1f,"humidity":%.1f,"time":""}\n' % (values[0] / 10, values[1] / 10)
+        return b"# HELP dht12_samples_total Samples read from DHT12\n# TYPE dht12_samples_total counter\n" \
+               b"dht12_samples_total %d\n" % values[0]
+
+    def sample(self, n):
+        with self.lock:
+            self.data["/latest"] = (self.data["/latest"][0] + 1, (215 + n % 3, 402))
+            self.data["/metrics"] = (self.data["/metrics"][0] + 1, (n,))
+
+
+def selftest():
+    server = StandIn()
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+    stop = threading.Event()
+
+    def sampler():
+        n = 0
+        while not stop.wait(0.5):
+            n += 1
+            server.sample(n)
+
+    threading.Thread(target=sampler, daemon=True).start()
+    result = load("127.0.0.1", server.server_address[1], ["/latest", "/metrics"], 8, 20, 2.0, True)
+    stop.set()
+    server.shutdown()
+
+    ok = result["errors"] == 0 and result["status"].get(304, 0) > 0 and result["status"].get(200, 0) > 0 and \
+        server.renders < result["requests"] / 4
+    print("selftest: %d renders for %d requests: %s" % (server.renders, result["requests"], "OK" if ok else "FAIL"),
+          file=sys.stderr)
+    return ok
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("host", nargs="?", help="device address")
+    parser.add_argument("-p", "--port", type=int, default=80, help="STATUS_SERVER_PORT")
+    parser.add_argument("--paths", default="/latest,/metrics", help="comma separated paths polled in turn")
+    parser.add_argument("-c", "--clients", type=int, default=10, help="concurrent pollers")
+    parser.add_argument("-r", "--rate", type=float, default=1.0, help="requests per second of every poller")
+    parser.add_argument("-d", "--duration", type=float, default=30.0, help="seconds")
+    parser.add_argument("--etag", action="store_true", help="send If-None-Match with the last ETag")
+    parser.add_argument("--selftest", action="store_true", help="check the harness against a local stand-in")
+    args = parser.parse_args()
+
+    if args.selftest:
+        sys.exit(0 if selftest() else 1)
+    if args.host is None:
+        parser.error("device address is required")
+    result = load(args.host, args.port, args.paths.split(","), args.clients, args.rate, args.duration, args.etag)
+    sys.exit(1 if result["errors"] else 0)
+
+
+if __name__ == "__main__":
+    main()
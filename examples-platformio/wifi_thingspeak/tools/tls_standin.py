@@ -0,0 +1,323 @@
+#!/usr/bin/env python3
+"""
+Local HTTPS stand-in of ThingSpeak for upload and handshake tests.
+
+Usage:
+    python3 tools/tls_standin.py --host 192.168.1.10
+    python3 tools/tls_standin.py --host 192.168.1.10 --close-every 5 --drop-every 7
+    python3 tools/tls_standin.py --bench
+    python3 tools/tls_standin.py --selftest
+
+Serves "GET /update" (answers the entry number) and "POST
+/channels/<id>/bulk_update.json" over TLS 1.2 with session tickets,
+like the mbedTLS of ESP-IDF v4.4 talks to api.thingspeak.com. A CA and
+a server certificate for "--host" are made with the openssl tool at
+start; to point the firmware at the stand-in set THINGSPEAK_HOST in
+"src/main.c" to the host and pass the printed CA file (as a string)
+to https_upload_init() instead of NULL. Every upload is logged with
+the handshake kind (full or resumed); an upload seen twice is counted
+as a duplicate. "--close-every" answers every Nth request with
+"Connection: close" (reconnect and resumption); "--drop-every" closes
+the connection after reading every Nth request without an answer
+(a lost response, which must not be uploaded again).
+
+The "--bench" mode runs uploads from this host with a fresh
+connection and full handshake each, a fresh connection resuming the
+TLS session, and one kept connection, and prints the times. The
+"--selftest" mode runs the same table and also checks the rules of
+"src/https_upload.c": sessions are resumed and lost responses do not
+produce duplicates. Needs Python 3.7+ and the openssl tool.
+
+Copyright (c) 2022 Tomas Fryza
+Dept. of Radio Electronics, Brno University of Technology, Czechia
+This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+"""
+
+import argparse
+import collections
+import http.client
+import http.server
+import ipaddress
+import os
+import socket
+import ssl
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+
+def make_certificates(directory, host):
+    """CA and server certificate for "host", returns (ca, cert, key) paths"""
+    ca_key = os.path.join(directory, "ca.key")
+    ca = os.path.join(directory, "ca.pem")
+    key = os.path.join(directory, "server.key")
+    csr = os.path.join(directory, "server.csr")
+    cert = os.path.join(directory, "server.pem")
+    ext = os.path.join(directory, "server.ext")
+    try:
+        ipaddress.ip_address(host)
+        san = "IP:%s" % host
+    except ValueError:
+        san = "DNS:%s" % host
+    with open(ext, "w") as f:
+        f.write("subjectAltName=%s\nbasicConstraints=CA:FALSE\n" % san)
+
+    def openssl(*args):
+        subprocess.run(["openssl"] + list(args), check=True, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+
+    # EC keys as the handshake cost of a real server is mostly ECDHE
+    openssl("ecparam", "-name", "prime256v1", "-genkey", "-noout", "-out", ca_key)
+    openssl("req", "-x509", "-new", "-key", ca_key, "-days", "365", "-subj", "/CN=tls stand-in CA", "-out", ca)
+    openssl("ecparam", "-name", "prime256v1", "-genkey", "-noout", "-out", key)
+    openssl("req", "-new", "-key", key, "-subj", "/CN=%s" % host, "-out", csr)
+    openssl("x509", "-req", "-in", csr, "-CA", ca, "-CAkey", ca_key, "-CAcreateserial", "-days", "365",
+            "-extfile", ext, "-out", cert)
+    return ca, cert, key
+
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def handle_one_request(self):
+        try:
+            super().handle_one_request()
+        except (ssl.SSLError, ConnectionError):
+            self.close_connection = True
+
+    def count(self):
+        """Number of this request, True if the answer is dropped"""
+        server = self.server
+        with server.lock:
+            server.requests += 1
+            n = server.requests
+        return n, server.drop_every and n % server.drop_every == 0
+
+    def answer(self, body, n):
+        close = self.server.close_every and n % self.server.close_every == 0
+        self.send_response(200)
+        self.send_header("Content-Type", "text/plain" if body[:1] != b"{" else "application/json")
+        self.send_header("Content-Length", str(len(body)))
+        if close:
+            self.send_header("Connection", "close")
+            self.close_connection = True
+        self.end_headers()
+        self.wfile.write(body)
+
+    def upload(self, key):
+        server = self.server
+        with server.lock:
+            server.uploads[key] += 1
+            if server.uploads[key] > 1:
+                server.duplicates += 1
+            entry = len(server.uploads)
+        if server.verbose:
+            print("%s %s handshake: %s%s" % (self.client_address[0], self.handshake, key[:60],
+                  " DUPLICATE" if server.uploads[key] > 1 else ""), file=sys.stderr)
+        return entry
+
+    def do_GET(self):
+        n, drop = self.count()
+        if not self.path.startswith("/update?"):
+            self.send_error(404)
+            return
+        if drop:
+            self.close_connection = True
+            return
+        self.answer(b"%d" % self.upload(self.path), n)
+
+    def do_POST(self):
+        n, drop = self.count()
+        body = self.rfile.read(int(self.headers.get("Content-Length", "0")))
+        if not self.path.endswith("/bulk_update.json"):
+            self.send_error(404)
+            return
+        if drop:
+            self.close_connection = True
+            return
+        self.upload(self.path + body.decode(errors="replace"))
+        self.answer(b'{"success":true}', n)
+
+    def log_message(self, format, *args):
+        pass
+
+
+class StandIn(http.server.ThreadingHTTPServer):
+    """ThingSpeak upload endpoints over TLS 1.2 with session tickets"""
+
+    daemon_threads = True
+
+    def __init__(self, address, cert, key, close_every=0, drop_every=0, verbose=True):
+        super().__init__(address, Handler)
+        self.ctx = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+        self.ctx.maximum_version = ssl.TLSVersion.TLSv1_2
+        self.ctx.load_cert_chain(cert, key)
+        self.close_every = close_every
+        self.drop_every = drop_every
+        self.verbose = verbose
+        self.lock = threading.Lock()
+        self.requests = 0
+        self.uploads = collections.Counter()
+        self.duplicates = 0
+        self.handshakes = collections.Counter()
+        self.port = self.server_address[1]
+
+    def finish_request(self, request, client_address):
+        # Handshake in the connection thread, not in accept()
+        request.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        try:
+            tls = self.ctx.wrap_socket(request, server_side=True)
+        except (ssl.SSLError, ConnectionError, OSError):
+            return
+        kind = "resumed" if tls.session_reused else "full"
+        with self.lock:
+            self.handshakes[kind] += 1
+        handler = Handler.__new__(Handler)
+        handler.handshake = kind
+        Handler.__init__(handler, tls, client_address, self)
+
+
+class Uploader:
+    """Client side with the rules of "src/https_upload.c" """
+
+    def __init__(self, port, ca, host="127.0.0.1", keep=True, resume=True):
+        self.port = port
+        self.host = host
+        self.ctx = ssl.create_default_context(cafile=ca)
+        self.ctx.maximum_version = ssl.TLSVersion.TLSv1_2
+        self.keep = keep
+        self.resume = resume
+        self.session = None
+        self.conn = None
+        self.handshake_s = []
+        self.resumed = 0
+        self.failed = 0
+
+    def connect(self):
+        start = time.monotonic()
+        sock = socket.create_connection((self.host, self.port), timeout=5)
+        sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        tls = self.ctx.wrap_socket(sock, server_hostname=self.host,
+                                   session=self.session if self.resume else None)
+        self.handshake_s.append(time.monotonic() - start)
+        self.resumed += tls.session_reused
+        self.session = tls.session
+        self.conn = http.client.HTTPConnection(self.host, self.port, timeout=5)
+        self.conn.sock = tls
+
+    def close(self):
+        if self.conn is not None:
+            self.conn.close()
+            self.conn = None
+
+    def get(self, path):
+        """Send once; only a failed write on a kept connection is sent again"""
+        for attempt in range(2):
+            if self.conn is None:
+                self.connect()
+            try:
+                self.conn.putrequest("GET", path, skip_host=True)
+                self.conn.putheader("Host", self.host)
+                self.conn.putheader("Connection", "keep-alive")
+                self.conn.endheaders()
+            except OSError:
+                self.close()
+                continue
+            try:
+                response = self.conn.getresponse()
+                body = response.read()
+                if response.getheader("Connection", "").lower() == "close" or not self.keep:
+                    self.close()
+                return response.status, body
+            except (OSError, http.client.HTTPException):
+                # Written already, a repeat could store the sample twice
+                self.close()
+                break
+        self.failed += 1
+        return None, None
+
+
+def run(port, ca, variant, count, tag=0):
+    keep, resume = {"new each": (False, False), "resumed": (False, True), "keep-alive": (True, True)}[variant]
+    uploader = Uploader(port, ca, keep=keep, resume=resume)
+    start = time.monotonic()
+    for i in range(count):
+        uploader.get("/update?api_key=STANDIN&field1=%s&field2=%d&field3=%d" % (variant.replace(" ", "-"), tag, i))
+    elapsed = time.monotonic() - start
+    uploader.close()
+    return uploader, elapsed
+
+
+def bench(server, ca, count=40):
+    rows = {}
+    print("%-10s %8s %10s %7s %9s %10s %6s" % ("variant", "requests", "handshakes", "resumed", "hs ms",
+                                             "ms/request", "failed"))
+    for variant in ("new each", "resumed", "keep-alive"):
+        uploader, elapsed = run(server.port, ca, variant, count)
+        hs = uploader.handshake_s
+        print("%-10s %8d %10d %7d %9.2f %10.2f %6d" % (variant, count, len(hs), uploader.resumed,
+                                                        sum(hs) * 1000 / len(hs), elapsed * 1000 / count,
+                                                        uploader.failed))
+        rows[variant] = uploader
+    return rows
+
+
+def selftest(server, ca):
+    rows = bench(server, ca, 20)
+    ok = rows["new each"].resumed == 0 and rows["resumed"].resumed == 19 and len(rows["keep-alive"].handshake_s) == 1
+
+    # Closed connections are resumed, lost responses are not uploaded again
+    server.close_every = 5
+    server.drop_every = 7
+    before = server.duplicates
+    uploader, _ = run(server.port, ca, "keep-alive", 28, tag=1)
+    duplicates = server.duplicates - before
+    ok = ok and uploader.failed == 4 and duplicates == 0 and uploader.resumed == len(uploader.handshake_s) - 1
+    print("faults: 28 uploads, %d failed (4 dropped), %d handshakes (%d resumed), %d duplicates" % (
+        uploader.failed, len(uploader.handshake_s), uploader.resumed, duplicates), file=sys.stderr)
+    print("selftest: %s" % ("OK" if ok else "FAIL"), file=sys.stderr)
+    return ok
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("--host", default="127.0.0.1", help="address or name of this host seen by the device")
+    parser.add_argument("-p", "--port", type=int, default=443, help="TCP port (HTTPS_UPLOAD_PORT)")
+    parser.add_argument("--close-every", type=int, default=0, help="close the connection after every Nth answer")
+    parser.add_argument("--drop-every", type=int, default=0, help="drop the answer of every Nth request")
+    parser.add_argument("--bench", action="store_true", help="compare handshakes from this host and exit")
+    parser.add_argument("--selftest", action="store_true", help="check resumption and no duplicate uploads")
+    args = parser.parse_args()
+
+    with tempfile.TemporaryDirectory() as directory:
+        local = args.bench or args.selftest
+        ca, cert, key = make_certificates(directory, "127.0.0.1" if local else args.host)
+        server = StandIn(("127.0.0.1", 0) if local else ("0.0.0.0", args.port), cert, key,
+                         args.close_every, args.drop_every, verbose=not local)
+        threading.Thread(target=server.serve_forever, daemon=True).start()
+        if args.selftest:
+            ok = selftest(server, ca)
+            server.shutdown()
+            sys.exit(0 if ok else 1)
+        if args.bench:
+            bench(server, ca)
+            server.shutdown()
+            return
+
+        with open(ca) as f:
+            print(f.read(), file=sys.stderr)
+        print("CA certificate above, serving https://%s:%d/update" % (args.host, server.port), file=sys.stderr)
+        try:
+            while True:
+                time.sleep(10)
+                with server.lock:
+                    print("%d requests, %d uploads, %d duplicates, handshakes %s" % (
+                        server.requests, len(server.uploads), server.duplicates, dict(server.handshakes)),
+                        file=sys.stderr)
+        except KeyboardInterrupt:
+            server.shutdown()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,130 @@
+#!/usr/bin/env python3
+"""
+Convert "TRACE,..." lines from the serial log of wifi_thingspeak into
+a Chrome trace file, viewable in chrome://tracing or ui.perfetto.dev.
+
+Usage:
+    pio device monitor | tee serial.log
+    python3 tools/trace2chrome.py serial.log -o trace.json
+
+Every sample is one bar split into its stages; samples overlapping
+in time are drawn in separate lanes. A summary of stage durations is
+printed to stderr.
+
+Copyright (c) 2022 Tomas Fryza
+Dept. of Radio Electronics, Brno University of Technology, Czechia
+This work is licensed under the terms of the GNU GENERAL PUBLIC LICENSE.
+"""
+
+import argparse
+import json
+import re
+import sys
+
+DEFAULT_STAGES = ["start", "read", "queued", "encoded", "dns", "connect", "sent", "acked"]
+
+# Serial monitor may prefix lines with escape sequences or timestamps
+LINE_RE = re.compile(r"(TRACE_STAGES|TRACE),(.*)$")
+
+
+def parse(lines):
+    """Return stage names and samples {id: (ok, start_us, [offsets])}"""
+    stages = DEFAULT_STAGES
+    samples = {}
+    for line in lines:
+        match = LINE_RE.search(line.strip())
+        if not match:
+            continue
+        fields = match.group(2).split(",")
+        if match.group(1) == "TRACE_STAGES":
+            stages = fields
+            continue
+        try:
+            sample_id = int(fields[0])
+            ok = fields[1] == "1"
+            start = int(fields[2])
+            offsets = [int(f) if f else None for f in fields[3:]]
+        except (ValueError, IndexError):
+            continue
+        samples[sample_id] = (ok, start, offsets)
+    return stages, samples
+
+
+def percentile(values, p):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+
+def convert(stages, samples):
+    events = []
+    lanes = []      # End time of the last sample in every lane
+    durations = {}
+
+    for sample_id in sorted(samples, key=lambda i: samples[i][1]):
+        ok, start, offsets = samples[sample_id]
+        recorded = [(stages[i + 1], o) for i, o in enumerate(offsets) if o is not None]
+        end = start + (recorded[-1][1] if recorded else 0)
+
+        # First lane free at the start of this sample
+        for lane, lane_end in enumerate(lanes):
+            if lane_end <= start:
+                lanes[lane] = end
+                break
+        else:
+            lanes.append(end)
+            lane = len(lanes) - 1
+
+        events.append({
+            "name": "sample %d" % sample_id, "cat": "sample", "ph": "X",
+            "ts": start, "dur": end - start, "pid": 1, "tid": lane + 1,
+            "args": {"id": sample_id, "ok": ok},
+        })
+        prev = 0
+        for name, offset in recorded:
+            events.append({
+                "name": name, "cat": "stage", "ph": "X",
+                "ts": start + prev, "dur": offset - prev, "pid": 1, "tid": lane + 1,
+                "args": {"id": sample_id},
+            })
+            if ok:
+                durations.setdefault(name, []).append(offset - prev)
+            prev = offset
+        if ok:
+            durations.setdefault("total", []).append(prev)
+
+    events.append({"name": "process_name", "ph": "M", "pid": 1, "args": {"name": "wifi_thingspeak"}})
+    for lane in range(len(lanes)):
+        events.append({"name": "thread_name", "ph": "M", "pid": 1, "tid": lane + 1,
+                       "args": {"name": "lane %d" % (lane + 1)}})
+    return events, durations
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("log", nargs="?", help="serial log, standard input if omitted")
+    parser.add_argument("-o", "--output", default="trace.json", help="Chrome trace file")
+    args = parser.parse_args()
+
+    if args.log:
+        with open(args.log, errors="replace") as f:
+            stages, samples = parse(f)
+    else:
+        stages, samples = parse(sys.stdin)
+    if not samples:
+        sys.exit("no TRACE lines found")
+
+    events, durations = convert(stages, samples)
+    with open(args.output, "w") as f:
+        json.dump({"traceEvents": events, "displayTimeUnit": "ms"}, f)
+
+    print("%d sample(s) -> %s" % (len(samples), args.output), file=sys.stderr)
+    for name in [s for s in stages[1:] if s in durations] + ["total"]:
+        values = durations.get(name)
+        if values:
+            print("%-8s n %4d  p50 %8.1f  p90 %8.1f  p99 %8.1f  max %8.1f ms" % (
+                name, len(values), percentile(values, 50) / 1000, percentile(values, 90) / 1000,
+                percentile(values, 99) / 1000, max(values) / 1000), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()